@@ -0,0 +1,175 @@
+//////////////////////////////////////////////////////////////////////////////////////
+// Receiver side statistics of the R-IoT streams, per module : packets, samples and bytes per period,
+// lost and reordered samples, inter-arrival jitter. Same estimators as max-msp/riot_stream_stats.js.
+// Plain C++ like ../src/src/RiotFrame.h, used by riot_stream_stats.cpp and its unit test
+//
+// Both formats carry an output sample counter and the µs acquisition time of each sample :
+// - OSC bundles : /riot/v3/<id>/sequence message ("ii" counter, µs), one per sample of the batch.
+//   Needs the sequence stream (streams bit 0x4000)
+// - binary frames (streamformat=1) : counter of the first sample in the header, µs in each sample
+// Loss and reorders come from the counter. The jitter is the RFC 3550 estimator of the transit time
+// (arrival - acquisition of the newest sample of the packet) variation : WiFi / network jitter, not the
+// sampling one nor the batching delay. The module and host clocks aren't synced, only the variation counts
+
+#ifndef _STREAM_STATS_H
+#define _STREAM_STATS_H
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <map>
+#include "RiotFrame.h"
+
+#define OSC_BUNDLE_HEADER       16      // #bundle + timetag
+#define OSC_SEQUENCE_SUFFIX     "/sequence"
+#define JITTER_GAIN             16.0    // RFC 3550
+
+struct streamModuleStats {
+  // Counters of the current period, cleared by report()
+  uint32_t packets = 0;
+  uint32_t samples = 0;
+  uint64_t bytes = 0;
+  uint32_t lost = 0;
+  uint32_t reordered = 0;
+  // Since the first packet
+  uint32_t next = 0;          // expected counter
+  bool started = false;
+  int32_t transit = 0;        // µs, arrival - acquisition of the newest sample of the last packet
+  bool hasTransit = false;
+  double jitter = 0.0;        // µs
+};
+
+class streamStats {
+public:
+  // Returns false when the datagram isn't a R-IoT packet (or a bundle without /sequence message)
+  bool addDatagram(const uint8_t *data, uint32_t len, uint32_t arrivalUs) {
+    streamModuleStats *module = NULL;
+    uint32_t newest = 0;
+
+    if (len >= OSC_BUNDLE_HEADER && !memcmp(data, "#bundle", 8))
+      module = parseBundle(data, len, newest);
+    else if (len >= 2 && data[0] == RIOT_FRAME_MAGIC_0 && data[1] == RIOT_FRAME_MAGIC_1)
+      module = parseFrame(data, len, newest);
+    if (!module)
+      return false;
+    module->packets++;
+    module->bytes += len;
+    addTransit(*module, newest, arrivalUs);
+    return true;
+  }
+
+  // One line per module : id, packets/s, samples/s, kB/s, lost %, reordered, jitter µs. Clears the counters
+  void report(FILE *out, float seconds) {
+    for (auto &entry : modules) {
+      streamModuleStats &m = entry.second;
+      uint32_t expected = m.samples + m.lost;
+      fprintf(out, "%u\t%.1f\t%.1f\t%.2f\t%.2f\t%u\t%.0f\n", entry.first, m.packets / seconds, m.samples / seconds,
+              m.bytes / 1024.0 / seconds, expected ? 100.0 * m.lost / expected : 0.0, m.reordered, m.jitter);
+      m.packets = m.samples = m.lost = m.reordered = 0;
+      m.bytes = 0;
+    }
+  }
+
+  int getModuleCount() { return (int)modules.size(); }
+  // NULL when nothing was received from that module
+  const streamModuleStats* getModule(uint32_t id) {
+    auto entry = modules.find(id);
+    return entry == modules.end() ? NULL : &entry->second;
+  }
+
+private:
+  // Counter of one received sample
+  void addSample(streamModuleStats &m, uint32_t sequence) {
+    m.samples++;
+    if (m.started) {
+      int32_t gap = (int32_t)(sequence - m.next);   // signed, counters wrap on 32 bits
+      if (gap < 0) {
+        m.reordered++;
+        if (m.lost)
+          m.lost--;   // was counted lost when the gap was seen
+        return;
+      }
+      m.lost += gap;
+    }
+    m.started = true;
+    m.next = sequence + 1;
+  }
+
+  // Once per packet, from the µs acquisition time of its newest sample and the µs arrival time
+  void addTransit(streamModuleStats &m, uint32_t timestamp, uint32_t arrival) {
+    int32_t transit = (int32_t)(arrival - timestamp);
+    if (m.hasTransit) {
+      int32_t d = transit - m.transit;
+      m.jitter += (abs(d) - m.jitter) / JITTER_GAIN;
+    }
+    m.transit = transit;
+    m.hasTransit = true;
+  }
+
+  static uint32_t readBigEndian(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+  }
+
+  // Offset of the 4 byte aligned word following the string at offset, 0 if not terminated within end
+  static uint32_t skipString(const uint8_t *data, uint32_t offset, uint32_t end) {
+    while (offset < end && data[offset])
+      offset++;
+    if (offset >= end)
+      return 0;
+    return (offset + 4) & ~3;
+  }
+
+  // Walks the bundle elements for the /sequence messages (several with batchsize > 1)
+  streamModuleStats* parseBundle(const uint8_t *data, uint32_t len, uint32_t &newest) {
+    streamModuleStats *module = NULL;
+    uint32_t offset = OSC_BUNDLE_HEADER;
+    const size_t suffixLength = strlen(OSC_SEQUENCE_SUFFIX);
+
+    while (offset + 4 <= len) {
+      uint32_t size = readBigEndian(data + offset);
+      uint32_t start = offset + 4;
+      if (!size || size > len - start)
+        break;
+      offset = start + size;
+
+      uint32_t tags = skipString(data, start, offset);
+      if (!tags)
+        continue;
+      const char *address = (const char*)data + start;
+      size_t addressLength = strlen(address);
+      if (addressLength < suffixLength || strcmp(address + addressLength - suffixLength, OSC_SEQUENCE_SUFFIX))
+        continue;
+      // "/riot/v3/<id>/sequence"
+      const char *id = address;
+      for (int slashes = 0; slashes < 2 && id; slashes++)
+        id = strchr(id + 1, '/');
+      uint32_t values = skipString(data, tags, offset);
+      if (!id || !values || values + 8 > offset)
+        continue;
+      module = &modules[(uint32_t)atoi(id + 1)];
+      addSample(*module, readBigEndian(data + values));
+      newest = readBigEndian(data + values + 4);
+    }
+    return module;
+  }
+
+  streamModuleStats* parseFrame(const uint8_t *data, uint32_t len, uint32_t &newest) {
+    riotFrameHeader header;
+    riotFrameSample sample;
+    uint16_t count = riotFrameCheck(data, len, header);
+
+    if (!count)
+      return NULL;
+    streamModuleStats *module = &modules[header.moduleId];
+    for (uint16_t i = 0; i < count; i++)
+      addSample(*module, header.sequence + i);
+    memcpy(&sample, data + sizeof(riotFrameHeader) + (count - 1) * sizeof(riotFrameSample), sizeof(sample));
+    newest = sample.timestamp;
+    return module;
+  }
+
+  std::map<uint32_t, streamModuleStats> modules;
+};
+
+#endif
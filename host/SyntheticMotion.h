@@ -0,0 +1,106 @@
+//////////////////////////////////////////////////////////////////////////////////////
+// Synthetic motion for the host replay and tests : an exact orientation trajectory q(t) (yaw / pitch / roll
+// swings) and the raw int16 frames a still sensor with that orientation would give, in LSB for the default
+// ranges (8g, 2000°/s, 4 gauss) :
+// - gyro : body rate of the trajectory, w = 2 q* x dq/dt, dq/dt from the product of the 3 axis rotations
+// - acc / mag : gravity and earth field rotated in the body frame by the same q, v = q* x v x q
+// so the filters are fed consistent data and their errors are theirs, not the generator's.
+// Same conventions as the madgwick filter (q : sensor relative to earth, dq/dt = q x w / 2) in the filter
+// frame (NWU after the W3C permutation of motionCore::compute()), mapped back to the sensor axes for the
+// default board orientation (TOP_NWU_LENGTH)
+
+#ifndef _SYNTHETIC_MOTION_H
+#define _SYNTHETIC_MOTION_H
+
+#include "riot.h"
+
+#define SYNTHETIC_PERIOD    0.005f      // s, default sample rate
+#define SYNTHETIC_NOISE     8           // LSB peak
+
+// a x b
+static inline void quaternionProduct(const float a[4], const float b[4], float r[4]) {
+  r[0] = a[0] * b[0] - a[1] * b[1] - a[2] * b[2] - a[3] * b[3];
+  r[1] = a[0] * b[1] + a[1] * b[0] + a[2] * b[3] - a[3] * b[2];
+  r[2] = a[0] * b[2] - a[1] * b[3] + a[2] * b[0] + a[3] * b[1];
+  r[3] = a[0] * b[3] + a[1] * b[2] - a[2] * b[1] + a[3] * b[0];
+}
+
+// Orientation at t and its derivative : q = qz(yaw) x qy(pitch) x qx(roll)
+static inline void syntheticOrientation(float t, float q[4], float dq[4]) {
+  const float angle[3] = {(float)HALF_PI * sinf(TWO_PI * 0.2f * t), 0.5f * sinf(TWO_PI * 0.13f * t), 0.3f * sinf(TWO_PI * 0.17f * t)};
+  const float rate[3] = {(float)(HALF_PI * TWO_PI * 0.2f) * cosf(TWO_PI * 0.2f * t),
+                         (float)(0.5f * TWO_PI * 0.13f) * cosf(TWO_PI * 0.13f * t),
+                         (float)(0.3f * TWO_PI * 0.17f) * cosf(TWO_PI * 0.17f * t)};
+  const int axis[3] = {3, 2, 1};    // yaw about z, pitch about y, roll about x
+  float r[3][4], dr[3][4], a[4], b[4];
+
+  // Each rotation and its derivative : d/dt (cos(θ/2), sin(θ/2) u) = θ'/2 (-sin(θ/2), cos(θ/2) u)
+  for (int i = 0; i < 3; i++) {
+    float c = cosf(0.5f * angle[i]), s = sinf(0.5f * angle[i]);
+    memset(r[i], 0, sizeof(r[i]));
+    memset(dr[i], 0, sizeof(dr[i]));
+    r[i][0] = c;
+    r[i][axis[i]] = s;
+    dr[i][0] = -0.5f * rate[i] * s;
+    dr[i][axis[i]] = 0.5f * rate[i] * c;
+  }
+  quaternionProduct(r[0], r[1], a);
+  quaternionProduct(a, r[2], q);
+  // Product rule
+  memset(dq, 0, 4 * sizeof(float));
+  for (int i = 0; i < 3; i++) {
+    quaternionProduct(i == 0 ? dr[0] : r[0], i == 1 ? dr[1] : r[1], a);
+    quaternionProduct(a, i == 2 ? dr[2] : r[2], b);
+    for (int k = 0; k < 4; k++)
+      dq[k] += b[k];
+  }
+}
+
+// World vector in the body frame : q* x (0, v) x q
+static inline void syntheticToBody(const float q[4], const float v[3], float body[3]) {
+  const float conjugate[4] = {q[0], -q[1], -q[2], -q[3]};
+  const float vector[4] = {0.f, v[0], v[1], v[2]};
+  float a[4], b[4];
+  quaternionProduct(conjugate, vector, a);
+  quaternionProduct(a, q, b);
+  for (int k = 0; k < 3; k++)
+    body[k] = b[k + 1];
+}
+
+static inline int16_t syntheticNoise() {
+  return rand() % (2 * SYNTHETIC_NOISE + 1) - SYNTHETIC_NOISE;
+}
+
+// Sample index in the filter frame, noise free : acc (g), gyro (deg/s), mag (gauss). q = true orientation
+static inline void syntheticSample(uint32_t index, float q[4], float acc[3], float gyro[3], float mag[3]) {
+  const float gravity[3] = {0.f, 0.f, 1.f};      // g, up (NWU)
+  const float field[3] = {0.2f, 0.f, -0.4f};     // gauss, north & down
+  float dq[4], rate[4];
+
+  syntheticOrientation(index * SYNTHETIC_PERIOD, q, dq);
+  const float conjugate[4] = {q[0], -q[1], -q[2], -q[3]};
+  quaternionProduct(conjugate, dq, rate);   // w / 2
+  for (int k = 0; k < 3; k++)
+    gyro[k] = 2.f * rate[k + 1] * RAD_TO_DEG;
+  syntheticToBody(q, gravity, acc);
+  syntheticToBody(q, field, mag);
+}
+
+// Raw frame (accX..magZ) of sample index, q = true orientation at that sample. Noise from rand()
+static inline void syntheticFrame(uint32_t index, int16_t frame[RAW_FRAME_SIZE], float q[4]) {
+  const float accLsb = 32768.f / ACC_SCALE;
+  const float gyroLsb = 32768.f / GYRO_SCALE;
+  const float magLsb = 32768.f / MAG_SCALE;
+  float acc[3], gyro[3], mag[3];
+
+  syntheticSample(index, q, acc, gyro, mag);
+  // Filter frame (x, y, z) = sensor (-x, -y, z) with TOP_NWU_LENGTH and the W3C permutation
+  const float sign[3] = {-1.f, -1.f, 1.f};
+  for (int k = 0; k < 3; k++) {
+    frame[k] = (int16_t)lroundf(sign[k] * acc[k] * accLsb) + syntheticNoise();
+    frame[3 + k] = (int16_t)lroundf(sign[k] * gyro[k] * gyroLsb) + syntheticNoise();
+    frame[6 + k] = (int16_t)lroundf(sign[k] * mag[k] * magLsb) + syntheticNoise();
+  }
+}
+
+#endif
@@ -0,0 +1,17 @@
+// Host build : the global objects of riot-v3.ino (the sketch itself, setup() and loop(), is not built)
+
+#include "main.h"
+#include "riot.h"
+
+USBMSC MSC;
+U8G2_SSD1306_128X64_NONAME_F_HW_I2C u8g2(U8G2_R0, U8X8_PIN_NONE);
+WebServer httpServer(HTTP_SERVER_PORT);
+WiFiClient client;
+WiFiUDP udpPacket;
+WiFiUDP streamPacket;
+WiFiUDP switchPacket;
+WiFiUDP configPacket;
+MicroOscUdp<1024> oscUdp(&configPacket, defaultIP, DEFAULT_UDP_PORT);
+
+char serialBuffer[MAX_SERIAL_LEN];
+unsigned char serialIndex = 0;
@@ -0,0 +1,52 @@
+// Host replay benchmark : runs the firmware replay command (riotCore::replay()) on a raw int16 trace, so that
+// the fusion engines and the bundle forge are measured on the very same data on every change, in CI.
+// The PerfMeter reports (ns/sample mean, p50, p99, max and samples/s) are printed for each engine. The
+// device profiler (perf / replay commands) remains the reference for the actual timings on the ESP32-S3
+//
+// riot_replay trace.raw                  replays a trace recorded by the record command
+// riot_replay --synthetic N [trace.raw]  writes a synthetic trace of N frames then replays it
+
+#include "riot.h"
+#include "SyntheticMotion.h"
+
+#define SYNTHETIC_TRACE     "synthetic.raw"
+
+// Frames of the synthetic motion (see SyntheticMotion.h)
+static bool writeSyntheticTrace(const char *path, uint32_t frames) {
+  FIL traceFile;
+  UINT written;
+  int16_t frame[RAW_FRAME_SIZE];
+  float q[4];
+
+  if (f_open(&traceFile, path, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
+    return false;
+  srand(1);
+  for (uint32_t i = 0; i < frames; i++) {
+    syntheticFrame(i, frame, q);
+    if (f_write(&traceFile, frame, sizeof(frame), &written) != FR_OK) {
+      f_close(&traceFile);
+      return false;
+    }
+  }
+  f_close(&traceFile);
+  return true;
+}
+
+int main(int argc, char **argv) {
+  const char *path = RECORD_FILE;
+
+  if (argc > 2 && !strcmp(argv[1], "--synthetic")) {
+    path = argc > 3 ? argv[3] : SYNTHETIC_TRACE;
+    if (!writeSyntheticTrace(path, atoi(argv[2]))) {
+      fprintf(stderr, "Can't write %s\n", path);
+      return 1;
+    }
+  }
+  else if (argc > 1)
+    path = argv[1];
+
+  riot.init();
+  motion.init();
+  riot.begin();     // OSC messages & bundle layout, no network on the host
+  return riot.replay(path) ? 0 : 1;
+}
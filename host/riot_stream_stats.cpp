@@ -0,0 +1,82 @@
+// R-IoT v3 stream statistics, C++ receiver : listens to the UDP port where any number of modules stream
+// (OSC bundles with the /sequence message or binary frames) and prints for each module every period :
+//   id, packets/s, samples/s, kbytes/s, lost %, reordered, inter-arrival jitter (µs)
+// See StreamStats.h for the estimators, same as max-msp/riot_stream_stats.js (Max / node)
+//
+// riot_stream_stats [port] [period ms] [duration s]     defaults : 8888, 1000, 0 = until killed
+
+#include "StreamStats.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_PORT          8888
+#define DEFAULT_PERIOD        1000      // ms
+#define RECEIVE_BUFFER        (4 * 1024 * 1024)
+#define MAX_DATAGRAM          65536
+
+static uint64_t nowUs() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
+
+int main(int argc, char **argv) {
+  int port = argc > 1 ? atoi(argv[1]) : DEFAULT_PORT;
+  int period = argc > 2 ? atoi(argv[2]) : DEFAULT_PERIOD;
+  int duration = argc > 3 ? atoi(argv[3]) : 0;
+  static uint8_t datagram[MAX_DATAGRAM];
+  streamStats stats;
+
+  if (port <= 0 || period <= 0) {
+    fprintf(stderr, "Usage : %s [port] [period ms] [duration s]\n", argv[0]);
+    return 1;
+  }
+
+  int sock = socket(AF_INET, SOCK_DGRAM, 0);
+  if (sock < 0) {
+    perror("socket");
+    return 1;
+  }
+  // Several modules at 1kHz : don't drop on the host side while printing
+  int bufferSize = RECEIVE_BUFFER;
+  setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+  int reuse = 1;
+  setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(port);
+  if (bind(sock, (struct sockaddr*)&address, sizeof(address)) < 0) {
+    perror("bind");
+    close(sock);
+    return 1;
+  }
+  printf("riot_stream_stats listening on port %d\nid\tpkt/s\tsmp/s\tkB/s\tlost %%\treorder\tjitter µs\n", port);
+  fflush(stdout);
+
+  uint64_t start = nowUs();
+  uint64_t lastReport = start;
+  struct pollfd pending = {sock, POLLIN, 0};
+  while (!duration || nowUs() - start < (uint64_t)duration * 1000000ULL) {
+    uint64_t now = nowUs();
+    uint64_t elapsed = now - lastReport;
+    if (elapsed >= (uint64_t)period * 1000) {
+      stats.report(stdout, elapsed / 1e6f);
+      fflush(stdout);
+      lastReport = now;
+      continue;
+    }
+    if (poll(&pending, 1, (int)(((uint64_t)period * 1000 - elapsed) / 1000) + 1) <= 0)
+      continue;
+    ssize_t len = recv(sock, datagram, sizeof(datagram), 0);
+    if (len > 0)
+      stats.addDatagram(datagram, (uint32_t)len, (uint32_t)nowUs());
+  }
+  close(sock);
+  return 0;
+}
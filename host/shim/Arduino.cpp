@@ -0,0 +1,343 @@
+// Host build : definitions of the shim (see Arduino.h)
+
+#include "Arduino.h"
+#include "SPI.h"
+#include "Wire.h"
+#include "EEPROM.h"
+#include "WiFi.h"
+#include "ESPmDNS.h"
+#include "Update.h"
+#include "U8g2lib.h"
+#include "USB.h"
+#include "FFat.h"
+#include "ff.h"
+#include "Preferences.h"
+#include "esp_netif_net_stack.h"
+#include "lwip/dhcp.h"
+#include "lwip/etharp.h"
+#include <chrono>
+#include <thread>
+#include <map>
+#include <vector>
+#include <stdio.h>
+
+HardwareSerial Serial;
+HardwareSerial Serial0;
+HardwareSerial Serial1;
+EspClass ESP;
+WiFiClass WiFi;
+SPIClass SPI;
+TwoWire Wire(0);
+TwoWire Wire1(1);
+EEPROMClass EEPROM;
+MDNSResponder MDNS;
+UpdateClass Update;
+ESPUSB USB;
+F_Fat FFat;
+
+const uint8_t u8g2_font_crox3cb_tr[1] = {0};
+const uint8_t u8g2_font_7x14_mf[1] = {0};
+const uint8_t u8g2_font_6x10_tf[1] = {0};
+const uint8_t u8g2_font_u8glib_4_hr[1] = {0};
+const uint8_t u8g2_font_t0_11_me[1] = {0};
+const uint8_t u8g2_font_2x2[1] = {0};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+// Time
+static const std::chrono::steady_clock::time_point hostStart = std::chrono::steady_clock::now();
+
+uint64_t hostNanos(void) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - hostStart).count();
+}
+
+uint32_t millis(void) { return hostNanos() / 1000000; }
+uint32_t micros(void) { return hostNanos() / 1000; }
+void delay(uint32_t ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+void delayMicroseconds(uint32_t us) { std::this_thread::sleep_for(std::chrono::microseconds(us)); }
+void yield(void) { std::this_thread::yield(); }
+int64_t esp_timer_get_time(void) { return hostNanos() / 1000; }
+uint32_t EspClass::getCycleCount(void) { return (uint32_t)hostNanos(); }
+uint32_t getCpuFrequencyMhz(void) { return 1000; }
+bool setCpuFrequencyMhz(uint32_t mhz) { return true; }
+uint32_t getXtalFrequencyMhz(void) { return 40; }
+uint32_t getApbFrequency(void) { return 80000000; }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+// GPIO / ADC
+static int hostPins[64];
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+void digitalWrite(uint8_t pin, uint8_t val) { if (pin < 64) hostPins[pin] = val; }
+int digitalRead(uint8_t pin) { return pin < 64 ? hostPins[pin] : 0; }
+void hostSetPin(uint8_t pin, int level) { if (pin < 64) hostPins[pin] = level; }
+int gpio_get_level(gpio_num_t pin) { return (pin >= 0 && pin < 64) ? hostPins[pin] : 0; }
+uint16_t analogRead(uint8_t pin) { return 0; }
+uint32_t analogReadMilliVolts(uint8_t pin) { return 0; }
+void analogReadResolution(uint8_t bits) {}
+void analogSetAttenuation(int attenuation) {}
+void analogSetPinAttenuation(uint8_t pin, int attenuation) {}
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode) {}
+void attachInterruptArg(uint8_t pin, void (*isr)(void*), void *arg, int mode) {}
+void detachInterrupt(uint8_t pin) {}
+void rgbLedWrite(uint8_t pin, uint8_t red, uint8_t green, uint8_t blue) {}
+long random(long max) { return max > 0 ? rand() % max : 0; }
+long random(long min, long max) { return max > min ? min + rand() % (max - min) : min; }
+void randomSeed(unsigned long seed) { srand(seed); }
+float temperatureRead(void) { return 40.f; }
+
+bool analogContinuous(const uint8_t pins[], size_t pinsCount, uint32_t conversionsPerPin, uint32_t samplingFrequency, void (*userFunc)(void)) { return true; }
+bool analogContinuousRead(adc_continuous_data_t **buffer, uint32_t timeout) { return false; }
+bool analogContinuousStart(void) { return true; }
+bool analogContinuousStop(void) { return true; }
+bool analogContinuousDeinit(void) { return true; }
+void analogContinuousSetAtten(int attenuation) {}
+void analogContinuousSetWidth(uint8_t bits) {}
+
+char* strlwr(char *s) {
+  for (char *c = s ; *c ; c++)
+    *c = tolower(*c);
+  return s;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+// Print / Serial
+size_t Print::printf(const char *format, ...) {
+  char buffer[512];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  if (len <= 0)
+    return 0;
+  return write((const uint8_t*)buffer, min((size_t)len, sizeof(buffer) - 1));
+}
+
+static size_t printNumber(Print *out, const char *format, long long v) {
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), format, v);
+  return out->write(buffer);
+}
+
+size_t Print::print(int v, int base) { return print((long)v, base); }
+size_t Print::print(unsigned int v, int base) { return print((unsigned long)v, base); }
+size_t Print::print(long v, int base) { return printNumber(this, base == 16 ? "%llX" : "%lld", v); }
+size_t Print::print(unsigned long v, int base) { return printNumber(this, base == 16 ? "%llX" : "%llu", v); }
+size_t Print::print(double v, int decimals) {
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "%.*f", decimals, v);
+  return write(buffer);
+}
+size_t Print::print(const IPAddress &ip) { return print(ip.toString()); }
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+  return fwrite(buffer, 1, size, stdout);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+// Chip
+void esp_restart(void) { exit(0); }
+const char* esp_err_to_name(esp_err_t code) { return code == ESP_OK ? "ESP_OK" : "ESP_FAIL"; }
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len) {
+  crc = ~crc;
+  while (len--) {
+    crc ^= *buf++;
+    for (int bit = 0 ; bit < 8 ; bit++)
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+  }
+  return ~crc;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle) {
+  static int dummy;
+  *handle = (esp_timer_handle_t)&dummy;
+  return ESP_OK;
+}
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) { return ESP_OK; }
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout) { return ESP_OK; }
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) { return ESP_OK; }
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) { return ESP_OK; }
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type) { return ESP_OK; }
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *info) { return ESP_FAIL; }
+
+esp_netif_t* esp_netif_get_handle_from_ifkey(const char *key) { return NULL; }
+void* esp_netif_get_netif_impl(esp_netif_t *esp_netif) { return NULL; }
+struct dhcp* netif_dhcp_data(struct netif *netif) { return NULL; }
+err_t etharp_request(struct netif *netif, const ip4_addr_t *ipaddr) { return -1; }
+ssize_t etharp_find_addr(struct netif *netif, const ip4_addr_t *ipaddr, struct eth_addr **eth_ret, const ip4_addr_t **ip_ret) { return -1; }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+// FreeRTOS
+static int hostHandle;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char *name, uint32_t stack, void *param, UBaseType_t priority, TaskHandle_t *handle, BaseType_t core) {
+  if (handle)
+    *handle = &hostHandle;
+  return pdPASS;
+}
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name, uint32_t stack, void *param, UBaseType_t priority, TaskHandle_t *handle) {
+  return xTaskCreatePinnedToCore(task, name, stack, param, priority, handle, tskNO_AFFINITY);
+}
+void vTaskDelete(TaskHandle_t task) {}
+void vTaskDelay(TickType_t ticks) { delay(ticks); }
+void vTaskSuspend(TaskHandle_t task) {}
+void vTaskResume(TaskHandle_t task) {}
+TaskHandle_t xTaskGetCurrentTaskHandle(void) { return &hostHandle; }
+TickType_t xTaskGetTickCount(void) { return millis(); }
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) { return 0; }
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t timeout) { return 0; }
+BaseType_t xTaskNotifyGive(TaskHandle_t task) { return pdPASS; }
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken) {}
+SemaphoreHandle_t xSemaphoreCreateMutex(void) { return &hostHandle; }
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void) { return &hostHandle; }
+SemaphoreHandle_t xSemaphoreCreateBinary(void) { return &hostHandle; }
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t timeout) { return pdTRUE; }
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) { return pdTRUE; }
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t semaphore, TickType_t timeout) { return pdTRUE; }
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t semaphore) { return pdTRUE; }
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t *woken) { return pdTRUE; }
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) {}
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t reload, void *id, TimerCallbackFunction_t callback) { return &hostHandle; }
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t wait) { return pdPASS; }
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t wait) { return pdPASS; }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+// UDP capture
+static hostUdpCallback udpCapture;
+
+void hostUdpCapture(hostUdpCallback callback) { udpCapture = callback; }
+
+int WiFiUDP::endPacket(void) {
+  if (udpCapture)
+    udpCapture((const uint8_t*)packet.data(), packet.size());
+  packet.clear();
+  return 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+// FatFs on stdio
+FRESULT f_open(FIL *fp, const TCHAR *path, BYTE mode) {
+  const char *fmode = "rb";
+  if (mode & FA_CREATE_ALWAYS)
+    fmode = (mode & FA_READ) ? "w+b" : "wb";
+  else if ((mode & FA_OPEN_APPEND) == FA_OPEN_APPEND)
+    fmode = "ab";
+  else if (mode & FA_WRITE)
+    fmode = "r+b";
+  if (*path == '/')
+    path++;
+  fp->file = fopen(path, fmode);
+  if (!fp->file && (mode & FA_WRITE) && !(mode & FA_CREATE_ALWAYS) && (mode & (FA_OPEN_ALWAYS | FA_CREATE_NEW)))
+    fp->file = fopen(path, "w+b");
+  if (!fp->file)
+    return FR_NO_FILE;
+  return FR_OK;
+}
+
+FRESULT f_close(FIL *fp) {
+  if (!fp->file)
+    return FR_INVALID_OBJECT;
+  fclose(fp->file);
+  fp->file = NULL;
+  return FR_OK;
+}
+
+FRESULT f_read(FIL *fp, void *buff, UINT btr, UINT *br) {
+  *br = fread(buff, 1, btr, fp->file);
+  return ferror(fp->file) ? FR_DISK_ERR : FR_OK;
+}
+
+FRESULT f_write(FIL *fp, const void *buff, UINT btw, UINT *bw) {
+  *bw = fwrite(buff, 1, btw, fp->file);
+  return *bw == btw ? FR_OK : FR_DISK_ERR;
+}
+
+FRESULT f_lseek(FIL *fp, FSIZE_t ofs) { return fseek(fp->file, ofs, SEEK_SET) ? FR_DISK_ERR : FR_OK; }
+FRESULT f_sync(FIL *fp) { return fflush(fp->file) ? FR_DISK_ERR : FR_OK; }
+FSIZE_t f_tell(FIL *fp) { return ftell(fp->file); }
+bool f_eof(FIL *fp) { return f_tell(fp) >= f_size(fp); }
+
+FSIZE_t f_size(FIL *fp) {
+  long position = ftell(fp->file);
+  fseek(fp->file, 0, SEEK_END);
+  long size = ftell(fp->file);
+  fseek(fp->file, position, SEEK_SET);
+  return size;
+}
+
+FRESULT f_stat(const TCHAR *path, FILINFO *fno) {
+  if (*path == '/')
+    path++;
+  FILE *file = fopen(path, "rb");
+  if (!file)
+    return FR_NO_FILE;
+  fseek(file, 0, SEEK_END);
+  if (fno) {
+    memset(fno, 0, sizeof(FILINFO));
+    fno->fsize = ftell(file);
+    snprintf(fno->fname, sizeof(fno->fname), "%s", path);
+  }
+  fclose(file);
+  return FR_OK;
+}
+
+FRESULT f_unlink(const TCHAR *path) {
+  if (*path == '/')
+    path++;
+  return remove(path) ? FR_NO_FILE : FR_OK;
+}
+
+FRESULT f_rename(const TCHAR *oldName, const TCHAR *newName) {
+  if (*oldName == '/')
+    oldName++;
+  if (*newName == '/')
+    newName++;
+  FILE *file = fopen(newName, "rb");
+  if (file) {             // FatFs refuses to overwrite
+    fclose(file);
+    return FR_EXIST;
+  }
+  return rename(oldName, newName) ? FR_NO_FILE : FR_OK;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+// Preferences in memory, shared by all the instances like the NVS partition
+static std::map<std::string, std::vector<uint8_t>> hostNvs;
+
+bool Preferences::begin(const char *name, bool readOnly) {
+  space = std::string(name) + "/";
+  this->readOnly = readOnly;
+  return true;
+}
+
+bool Preferences::clear(void) {
+  if (readOnly)
+    return false;
+  for (auto entry = hostNvs.begin() ; entry != hostNvs.end() ; )
+    entry = entry->first.compare(0, space.size(), space) ? std::next(entry) : hostNvs.erase(entry);
+  return true;
+}
+
+bool Preferences::remove(const char *key) { return !readOnly && hostNvs.erase(space + key); }
+bool Preferences::isKey(const char *key) { return hostNvs.count(space + key); }
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t len) {
+  if (readOnly)
+    return 0;
+  hostNvs[space + key].assign((const uint8_t*)value, (const uint8_t*)value + len);
+  return len;
+}
+
+size_t Preferences::getBytesLength(const char *key) {
+  auto entry = hostNvs.find(space + key);
+  return entry == hostNvs.end() ? 0 : entry->second.size();
+}
+
+size_t Preferences::getBytes(const char *key, void *buf, size_t maxLen) {
+  auto entry = hostNvs.find(space + key);
+  if (entry == hostNvs.end() || entry->second.size() > maxLen)
+    return 0;
+  memcpy(buf, entry->second.data(), entry->second.size());
+  return entry->second.size();
+}
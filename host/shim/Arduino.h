@@ -0,0 +1,335 @@
+// Host (Linux / x86) shim of the Arduino-ESP32 core, FreeRTOS, WiFi and FatFs APIs used by the firmware.
+// Just enough to compile the firmware sources unchanged for the benchmarks and tests of ../ : time is the
+// host clock, the tasks / timers / interrupts never run, the network calls do nothing and FatFs works on
+// the host files (relative to the current directory). The other library headers include this one.
+
+#ifndef _HOST_ARDUINO_H
+#define _HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <ctype.h>
+#include <algorithm>
+#include <string>
+
+using std::min;
+using std::max;
+
+#define HOST_BUILD            1
+
+#define ARDUINO_ISR_ATTR
+#define IRAM_ATTR
+#define PROGMEM
+#define F(s)                  (s)
+
+#define HIGH                  1
+#define LOW                   0
+#define INPUT                 0x01
+#define OUTPUT                0x03
+#define INPUT_PULLUP          0x05
+#define INPUT_PULLDOWN        0x09
+#define CHANGE                0x03
+#define RISING                0x01
+#define FALLING               0x02
+#define A0                    1
+#define A1                    2
+#define A2                    3
+#define A3                    4
+#define A4                    5
+#define A5                    6
+
+#define PI                    3.1415926535897932384626433832795
+#define HALF_PI               1.5707963267948966192313216916398
+#define TWO_PI                6.283185307179586476925286766559
+#define DEG_TO_RAD            0.017453292519943295769236907684886
+#define RAD_TO_DEG            57.295779513082320876798154814105
+
+#define BIN                   2
+#define OCT                   8
+#define DEC                   10
+#define HEX                   16
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define bitRead(value, bit)   (((value) >> (bit)) & 0x01)
+#define lowByte(w)            ((uint8_t)((w) & 0xff))
+#define highByte(w)           ((uint8_t)((w) >> 8))
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+// Binary constants (binary.h), the ones used
+#define B0001                 1
+#define B0010                 2
+#define B0100                 4
+#define B1000                 8
+#define B1111                 15
+#define B000011               3
+#define B001100               12
+#define B110000               48
+#define B00000011             3
+#define B00001100             12
+#define B00110000             48
+#define B11000000             192
+
+inline bool isDigit(int c) { return isdigit(c); }
+char* strlwr(char *s);
+void yield(void);
+
+// Time : host monotonic clock since the start of the program
+uint32_t millis(void);
+uint32_t micros(void);
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+uint64_t hostNanos(void);
+
+// GPIO / ADC : inputs read 0 unless set by a test
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+void hostSetPin(uint8_t pin, int level);
+typedef int gpio_num_t;     // driver/gpio.h
+int gpio_get_level(gpio_num_t pin);
+uint16_t analogRead(uint8_t pin);
+uint32_t analogReadMilliVolts(uint8_t pin);
+void analogReadResolution(uint8_t bits);
+void analogSetAttenuation(int attenuation);
+void analogSetPinAttenuation(uint8_t pin, int attenuation);
+#define ADC_11db              3
+#define ADC_ATTENDB_MAX       3
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode);
+void attachInterruptArg(uint8_t pin, void (*isr)(void*), void *arg, int mode);
+void detachInterrupt(uint8_t pin);
+void rgbLedWrite(uint8_t pin, uint8_t red, uint8_t green, uint8_t blue);
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+float temperatureRead(void);
+bool setCpuFrequencyMhz(uint32_t mhz);
+uint32_t getCpuFrequencyMhz(void);
+uint32_t getXtalFrequencyMhz(void);
+uint32_t getApbFrequency(void);
+
+// ADC continuous driver (esp32-hal-adc.h)
+typedef struct {
+  uint8_t pin;
+  uint8_t channel;
+  int avg_read_raw;
+  int avg_read_mvolts;
+} adc_continuous_data_t;
+bool analogContinuous(const uint8_t pins[], size_t pinsCount, uint32_t conversionsPerPin, uint32_t samplingFrequency, void (*userFunc)(void));
+bool analogContinuousRead(adc_continuous_data_t **buffer, uint32_t timeout);
+bool analogContinuousStart(void);
+bool analogContinuousStop(void);
+bool analogContinuousDeinit(void);
+void analogContinuousSetAtten(int attenuation);
+void analogContinuousSetWidth(uint8_t bits);
+
+// Strings
+class String : public std::string {
+public:
+  String() {}
+  String(const char *s) : std::string(s ? s : "") {}
+  String(const std::string &s) : std::string(s) {}
+  String(char c) : std::string(1, c) {}
+  String(int v) : std::string(std::to_string(v)) {}
+  String(unsigned int v) : std::string(std::to_string(v)) {}
+  String(long v) : std::string(std::to_string(v)) {}
+  String(unsigned long v) : std::string(std::to_string(v)) {}
+  String(float v, int decimals = 2) { char b[32]; snprintf(b, sizeof(b), "%.*f", decimals, v); assign(b); }
+  String(double v, int decimals = 2) { char b[32]; snprintf(b, sizeof(b), "%.*f", decimals, v); assign(b); }
+  unsigned int length(void) const { return size(); }
+  bool concat(const String &s) { append(s); return true; }
+  long toInt(void) const { return atol(c_str()); }
+  float toFloat(void) const { return atof(c_str()); }
+  bool startsWith(const String &s) const { return compare(0, s.size(), s) == 0; }
+  bool endsWith(const String &s) const { return size() >= s.size() && compare(size() - s.size(), s.size(), s) == 0; }
+  void toCharArray(char *buf, unsigned int size) const { snprintf(buf, size, "%s", c_str()); }
+  int indexOf(char c) const { size_t p = find(c); return p == npos ? -1 : (int)p; }
+  String substring(unsigned int from) const { return String(std::string::substr(from)); }
+  String substring(unsigned int from, unsigned int to) const { return String(std::string::substr(from, to - from)); }
+  void trim(void) { erase(0, find_first_not_of(" \t\r\n")); erase(find_last_not_of(" \t\r\n") + 1); }
+  void toLowerCase(void) { for (auto &c : *this) c = tolower(c); }
+  String operator+(const String &s) const { return String((const std::string&)*this + (const std::string&)s); }
+  String operator+(const char *s) const { return String((const std::string&)*this + s); }
+  friend String operator+(const char *a, const String &b) { return String(a + (const std::string&)b); }
+  bool operator==(const char *s) const { return compare(s) == 0; }
+  bool operator==(const String &s) const { return compare(s) == 0; }
+};
+
+// Serial : printed on stdout
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) { return write(&c, 1); }
+  virtual size_t write(const uint8_t *buffer, size_t size) = 0;
+  size_t write(const char *s) { return write((const uint8_t*)s, strlen(s)); }
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+  size_t print(const char *s) { return write(s); }
+  size_t print(const String &s) { return write(s.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int v, int base = 10);
+  size_t print(unsigned int v, int base = 10);
+  size_t print(long v, int base = 10);
+  size_t print(unsigned long v, int base = 10);
+  size_t print(double v, int decimals = 2);
+  size_t print(const class IPAddress &ip);
+  size_t println(void) { return write("\r\n"); }
+  template<class T> size_t println(const T &v) { size_t n = print(v); return n + println(); }
+  template<class T> size_t println(const T &v, int format) { size_t n = print(v, format); return n + println(); }
+  void flush(void) {}
+};
+
+class Stream : public Print {
+public:
+  virtual int available(void) { return 0; }
+  virtual int read(void) { return -1; }
+  virtual int peek(void) { return -1; }
+  void setTimeout(unsigned long timeout) {}
+};
+
+class HardwareSerial : public Stream {
+public:
+  void begin(unsigned long baud, ...) {}
+  void end(void) {}
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+  operator bool() const { return true; }
+  void setTxTimeoutMs(uint32_t timeout) {}
+  void setRxBufferSize(size_t size) {}
+};
+extern HardwareSerial Serial;
+extern HardwareSerial Serial0;
+extern HardwareSerial Serial1;
+#define USBSerial Serial
+
+class IPAddress {
+public:
+  IPAddress() { bytes[0] = bytes[1] = bytes[2] = bytes[3] = 0; }
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) { bytes[0] = a; bytes[1] = b; bytes[2] = c; bytes[3] = d; }
+  IPAddress(uint32_t address) { memcpy(bytes, &address, 4); }
+  operator uint32_t() const { uint32_t a; memcpy(&a, bytes, 4); return a; }
+  uint8_t operator[](int index) const { return bytes[index]; }
+  uint8_t& operator[](int index) { return bytes[index]; }
+  bool operator==(const IPAddress &ip) const { return !memcmp(bytes, ip.bytes, 4); }
+  bool operator!=(const IPAddress &ip) const { return memcmp(bytes, ip.bytes, 4); }
+  bool fromString(const char *address) {
+    unsigned int a, b, c, d;
+    if (sscanf(address, "%u.%u.%u.%u", &a, &b, &c, &d) != 4 || a > 255 || b > 255 || c > 255 || d > 255)
+      return false;
+    bytes[0] = a; bytes[1] = b; bytes[2] = c; bytes[3] = d;
+    return true;
+  }
+  String toString(void) const { char s[16]; snprintf(s, sizeof(s), "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2], bytes[3]); return String(s); }
+private:
+  uint8_t bytes[4];
+};
+#define INADDR_NONE           IPAddress(0, 0, 0, 0)
+
+// Byte order (lwip)
+#define htonl(x)              __builtin_bswap32((uint32_t)(x))
+#define ntohl(x)              __builtin_bswap32((uint32_t)(x))
+#define htons(x)              __builtin_bswap16((uint16_t)(x))
+#define ntohs(x)              __builtin_bswap16((uint16_t)(x))
+
+// Chip
+class EspClass {
+public:
+  uint32_t getCycleCount(void);     // ns on the host : getCpuFrequencyMhz() returns 1000
+  uint64_t getEfuseMac(void) { return 0x0000aabbccddeeffULL; }
+  uint32_t getFreeHeap(void) { return 256 * 1024; }
+  uint32_t getHeapSize(void) { return 320 * 1024; }
+  uint32_t getMinFreeHeap(void) { return 200 * 1024; }
+  uint32_t getMaxAllocHeap(void) { return 128 * 1024; }
+  uint32_t getFreePsram(void) { return 0; }
+  const char* getChipModel(void) { return "host"; }
+  uint8_t getChipRevision(void) { return 0; }
+  uint8_t getChipCores(void) { return 2; }
+  const char* getSdkVersion(void) { return "host"; }
+  uint32_t getFlashChipSize(void) { return 8 * 1024 * 1024; }
+  uint32_t getSketchSize(void) { return 0; }
+  uint32_t getFreeSketchSpace(void) { return 0; }
+  void restart(void) { exit(0); }
+};
+extern EspClass ESP;
+void esp_restart(void);
+typedef int esp_err_t;
+#define ESP_OK                0
+#define ESP_FAIL              -1
+const char* esp_err_to_name(esp_err_t code);
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len);
+
+// esp_timer : the timers are created but never fire
+typedef struct esp_timer* esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void *arg);
+typedef enum { ESP_TIMER_TASK = 0, ESP_TIMER_ISR } esp_timer_dispatch_t;
+typedef struct {
+  esp_timer_cb_t callback;
+  void *arg;
+  esp_timer_dispatch_t dispatch_method;
+  const char *name;
+  bool skip_unhandled_events;
+} esp_timer_create_args_t;
+int64_t esp_timer_get_time(void);
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle);
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period);
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+esp_err_t esp_timer_delete(esp_timer_handle_t timer);
+
+// FreeRTOS : tasks are not started (xTaskCreate returns pdPASS and a dummy handle), notifications and
+// semaphores never block, critical sections do nothing
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void* TaskHandle_t;
+typedef void* SemaphoreHandle_t;
+typedef void* TimerHandle_t;
+typedef void* QueueHandle_t;
+typedef void (*TaskFunction_t)(void*);
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t);
+#define pdTRUE                1
+#define pdFALSE               0
+#define pdPASS                1
+#define pdFAIL                0
+#define portMAX_DELAY         0xffffffffUL
+#define portTICK_PERIOD_MS    1
+#define pdMS_TO_TICKS(ms)     ((TickType_t)(ms))
+#define tskNO_AFFINITY        0x7fffffff
+typedef struct { int owner; int count; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED  {0, 0}
+#define portENTER_CRITICAL(mux)       ((void)(mux))
+#define portEXIT_CRITICAL(mux)        ((void)(mux))
+#define portENTER_CRITICAL_ISR(mux)   ((void)(mux))
+#define portEXIT_CRITICAL_ISR(mux)    ((void)(mux))
+#define portYIELD_FROM_ISR(woken)     ((void)(woken))
+#define taskYIELD()
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char *name, uint32_t stack, void *param, UBaseType_t priority, TaskHandle_t *handle, BaseType_t core);
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name, uint32_t stack, void *param, UBaseType_t priority, TaskHandle_t *handle);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+void vTaskSuspend(TaskHandle_t task);
+void vTaskResume(TaskHandle_t task);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+TickType_t xTaskGetTickCount(void);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t timeout);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken);
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void);
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t timeout);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t semaphore, TickType_t timeout);
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t semaphore);
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t *woken);
+void vSemaphoreDelete(SemaphoreHandle_t semaphore);
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t reload, void *id, TimerCallbackFunction_t callback);
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t wait);
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t wait);
+
+#endif
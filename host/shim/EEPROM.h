@@ -0,0 +1,18 @@
+// Host build : emulated EEPROM, in memory
+#ifndef _HOST_EEPROM_H
+#define _HOST_EEPROM_H
+
+#include "Arduino.h"
+
+class EEPROMClass {
+public:
+  bool begin(size_t size) { return true; }
+  uint32_t readUInt(int address) { uint32_t v; memcpy(&v, &data[address], 4); return v; }
+  size_t writeUInt(int address, uint32_t value) { memcpy(&data[address], &value, 4); return 4; }
+  bool commit(void) { return true; }
+private:
+  uint8_t data[64] = {0};
+};
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,15 @@
+// Host build : mDNS responder, does nothing
+#ifndef _HOST_ESPMDNS_H
+#define _HOST_ESPMDNS_H
+
+#include "Arduino.h"
+
+class MDNSResponder {
+public:
+  bool begin(const String &hostName) { return true; }
+  void end(void) {}
+  bool addService(const char *service, const char *proto, uint16_t port) { return true; }
+};
+extern MDNSResponder MDNS;
+
+#endif
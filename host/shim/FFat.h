@@ -0,0 +1,18 @@
+// Host build : FAT partition of the flash (FatFs on the host files, see ff.h)
+#ifndef _HOST_FFAT_H
+#define _HOST_FFAT_H
+
+#include "FS.h"
+
+class F_Fat : public fs::FS {
+public:
+  bool begin(bool formatOnFail = false, const char *basePath = "/ffat", uint8_t maxOpenFiles = 10, const char *partitionLabel = NULL) { return true; }
+  void end(void) {}
+  bool format(bool fullWipe = false, char *partitionLabel = NULL) { return true; }
+  size_t totalBytes(void) { return 8 * 1024 * 1024; }
+  size_t freeBytes(void) { return 4 * 1024 * 1024; }
+  uint8_t getDrive(void) { return 0; }
+};
+extern F_Fat FFat;
+
+#endif
@@ -0,0 +1,40 @@
+// Host build : Arduino file system classes (FFat). Files never open : the firmware streams through
+// FatFs (ff.h), these are only used by the maintenance routines
+#ifndef _HOST_FS_H
+#define _HOST_FS_H
+
+#include "Arduino.h"
+
+#define FILE_READ             "r"
+#define FILE_WRITE            "w"
+#define FILE_APPEND           "a"
+
+namespace fs {
+class File : public Stream {
+public:
+  size_t write(const uint8_t *buffer, size_t size) override { return 0; }
+  using Print::write;
+  operator bool() const { return false; }
+  bool isDirectory(void) { return false; }
+  File openNextFile(void) { return File(); }
+  const char* name(void) { return ""; }
+  const char* path(void) { return ""; }
+  size_t size(void) { return 0; }
+  void close(void) {}
+};
+
+class FS {
+public:
+  File open(const char *path, const char *mode = FILE_READ) { return File(); }
+  File open(const String &path, const char *mode = FILE_READ) { return File(); }
+  bool exists(const char *path) { return false; }
+  bool remove(const char *path) { return false; }
+  bool rename(const char *from, const char *to) { return false; }
+  bool mkdir(const char *path) { return false; }
+  bool rmdir(const char *path) { return false; }
+};
+}
+using fs::FS;
+using fs::File;
+
+#endif
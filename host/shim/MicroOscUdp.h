@@ -0,0 +1,28 @@
+// Host build : MicroOsc over UDP, receives nothing
+#ifndef _HOST_MICROOSCUDP_H
+#define _HOST_MICROOSCUDP_H
+
+#include "WiFi.h"
+
+class MicroOscMessage {
+public:
+  bool checkOscAddress(const char *address) { return false; }
+  bool checkOscAddressAndTypeTags(const char *address, const char *typetags) { return false; }
+  int32_t nextAsInt(void) { return 0; }
+  float nextAsFloat(void) { return 0.; }
+  const char* nextAsString(void) { return ""; }
+  const char* getTypeTags(void) { return ""; }
+};
+
+typedef void (*tOscCallbackFunction)(MicroOscMessage &message);
+
+template <uint16_t MICRO_OSC_IN_SIZE>
+class MicroOscUdp {
+public:
+  MicroOscUdp(WiFiUDP *udp, IPAddress destination = IPAddress(), uint16_t port = 0) {}
+  void setDestination(IPAddress destination, uint16_t port) {}
+  void onOscMessageReceived(tOscCallbackFunction callback) {}
+  void receiveMessages(tOscCallbackFunction callback) {}
+};
+
+#endif
@@ -0,0 +1,22 @@
+// Host build : NVS key / value store, in memory
+#ifndef _HOST_PREFERENCES_H
+#define _HOST_PREFERENCES_H
+
+#include "Arduino.h"
+
+class Preferences {
+public:
+  bool begin(const char *name, bool readOnly = false);
+  void end(void) {}
+  bool clear(void);
+  bool remove(const char *key);
+  bool isKey(const char *key);
+  size_t putBytes(const char *key, const void *value, size_t len);
+  size_t getBytes(const char *key, void *buf, size_t maxLen);
+  size_t getBytesLength(const char *key);
+private:
+  std::string space;
+  bool readOnly = false;
+};
+
+#endif
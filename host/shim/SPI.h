@@ -0,0 +1,40 @@
+// Host build : SPI bus, no device answers (reads 0)
+#ifndef _HOST_SPI_H
+#define _HOST_SPI_H
+
+#include "Arduino.h"
+
+#define SPI_MODE0             0
+#define SPI_MODE1             1
+#define SPI_MODE2             2
+#define SPI_MODE3             3
+#define MSBFIRST              1
+#define LSBFIRST              0
+#define SPI_MSBFIRST          MSBFIRST
+#define SPI_LSBFIRST          LSBFIRST
+#define FSPI                  0
+#define HSPI                  1
+
+class SPISettings {
+public:
+  SPISettings(uint32_t clock = 1000000, uint8_t bitOrder = MSBFIRST, uint8_t dataMode = SPI_MODE0) {}
+};
+
+class SPIClass {
+public:
+  SPIClass(uint8_t bus = FSPI) {}
+  void begin(int8_t sck = -1, int8_t miso = -1, int8_t mosi = -1, int8_t ss = -1) {}
+  void end(void) {}
+  void setFrequency(uint32_t frequency) {}
+  void setDataMode(uint8_t mode) {}
+  void setBitOrder(uint8_t order) {}
+  void beginTransaction(SPISettings settings) {}
+  void endTransaction(void) {}
+  uint8_t transfer(uint8_t data) { return 0; }
+  void transfer(void *data, uint32_t size) { memset(data, 0, size); }
+  uint16_t transfer16(uint16_t data) { return 0; }
+  void transferBytes(const uint8_t *data, uint8_t *out, uint32_t size) { if (out) memset(out, 0, size); }
+};
+extern SPIClass SPI;
+
+#endif
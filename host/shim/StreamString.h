@@ -0,0 +1,7 @@
+// Host build : see Arduino.h
+#include "Arduino.h"
+class StreamString : public Stream, public String {
+public:
+  size_t write(const uint8_t *buffer, size_t size) override { append((const char*)buffer, size); return size; }
+  using Print::write;
+};
@@ -0,0 +1,42 @@
+// Host build : OLED display, draws nowhere
+#ifndef _HOST_U8G2LIB_H
+#define _HOST_U8G2LIB_H
+
+#include "Arduino.h"
+
+typedef const uint8_t* u8g2_font_t;
+typedef int u8g2_cb_t;
+#define U8G2_R0                 0
+#define U8X8_PIN_NONE           255
+
+extern const uint8_t u8g2_font_crox3cb_tr[];
+extern const uint8_t u8g2_font_7x14_mf[];
+extern const uint8_t u8g2_font_6x10_tf[];
+extern const uint8_t u8g2_font_u8glib_4_hr[];
+extern const uint8_t u8g2_font_t0_11_me[];
+extern const uint8_t u8g2_font_2x2[];
+
+class U8G2_SSD1306_128X64_NONAME_F_HW_I2C : public Print {
+public:
+  U8G2_SSD1306_128X64_NONAME_F_HW_I2C(int rotation, uint8_t reset = U8X8_PIN_NONE, uint8_t clock = U8X8_PIN_NONE, uint8_t data = U8X8_PIN_NONE) {}
+  bool begin(void) { return true; }
+  void clearDisplay(void) {}
+  void clearBuffer(void) {}
+  void sendBuffer(void) {}
+  void setFont(const uint8_t *font) {}
+  void setCursor(int x, int y) {}
+  int drawStr(int x, int y, const char *s) { return 0; }
+  void drawPixel(int x, int y) {}
+  void drawBox(int x, int y, int w, int h) {}
+  void drawFrame(int x, int y, int w, int h) {}
+  void setDrawColor(uint8_t color) {}
+  void setPowerSave(uint8_t save) {}
+  void setContrast(uint8_t value) {}
+  int getWidth(void) { return 128; }
+  int getHeight(void) { return 64; }
+  int getStrWidth(const char *s) { return 6 * strlen(s); }
+  size_t write(const uint8_t *buffer, size_t size) override { return size; }
+  using Print::write;
+};
+
+#endif
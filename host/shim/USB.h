@@ -0,0 +1,23 @@
+// Host build : TinyUSB device, never enumerated
+#ifndef _HOST_USB_H
+#define _HOST_USB_H
+
+#include "Arduino.h"
+
+typedef enum { ARDUINO_USB_STARTED_EVENT = 0, ARDUINO_USB_STOPPED_EVENT, ARDUINO_USB_SUSPEND_EVENT, ARDUINO_USB_RESUME_EVENT } arduino_usb_event_t;
+typedef int esp_event_base_t;
+#define ARDUINO_USB_EVENTS    0
+typedef void (*esp_event_handler_t)(void *arg, esp_event_base_t base, int32_t id, void *data);
+
+class ESPUSB {
+public:
+  bool begin(void) { return true; }
+  void onEvent(esp_event_handler_t callback) {}
+  void onEvent(arduino_usb_event_t event, esp_event_handler_t callback) {}
+  void productName(const char *name) {}
+  void manufacturerName(const char *name) {}
+  operator bool() const { return false; }
+};
+extern ESPUSB USB;
+
+#endif
@@ -0,0 +1,25 @@
+// Host build : USB mass storage class, never mounted
+#ifndef _HOST_USBMSC_H
+#define _HOST_USBMSC_H
+
+#include "USB.h"
+
+typedef int32_t (*msc_read_cb)(uint32_t lba, uint32_t offset, void *buffer, uint32_t bufsize);
+typedef int32_t (*msc_write_cb)(uint32_t lba, uint32_t offset, uint8_t *buffer, uint32_t bufsize);
+typedef bool (*msc_start_stop_cb)(uint8_t power_condition, bool start, bool load_eject);
+
+class USBMSC {
+public:
+  bool begin(uint32_t block_count, uint16_t block_size) { return true; }
+  void end(void) {}
+  void vendorID(const char *vid) {}
+  void productID(const char *pid) {}
+  void productRevision(const char *rev) {}
+  void onStartStop(msc_start_stop_cb cb) {}
+  void onRead(msc_read_cb cb) {}
+  void onWrite(msc_write_cb cb) {}
+  void mediaPresent(bool media_present) {}
+  void isWritable(bool is_writable) {}
+};
+
+#endif
@@ -0,0 +1,27 @@
+// Host build : firmware update, always fails
+#ifndef _HOST_UPDATE_H
+#define _HOST_UPDATE_H
+
+#include "Arduino.h"
+
+#define UPDATE_SIZE_UNKNOWN   0xFFFFFFFF
+#define U_FLASH               0
+#define U_SPIFFS              100
+#define U_FS                  U_SPIFFS
+
+class UpdateClass {
+public:
+  bool begin(size_t size = UPDATE_SIZE_UNKNOWN, int command = U_FLASH) { return false; }
+  size_t write(uint8_t *data, size_t len) { return 0; }
+  bool end(bool evenIfRemaining = false) { return false; }
+  bool hasError(void) { return true; }
+  bool setMD5(const char *md5) { return false; }
+  void runAsync(bool async) {}
+  void printError(Print &out) { out.println("host build"); }
+  bool isFinished(void) { return false; }
+  size_t writeStream(Stream &data) { return 0; }
+  uint8_t getError(void) { return 1; }
+};
+extern UpdateClass Update;
+
+#endif
@@ -0,0 +1,51 @@
+// Host build : HTTP server, never started
+#ifndef _HOST_WEBSERVER_H
+#define _HOST_WEBSERVER_H
+
+#include "Arduino.h"
+#include "FS.h"
+#include <functional>
+
+enum HTTPMethod { HTTP_ANY, HTTP_GET, HTTP_POST, HTTP_PUT, HTTP_PATCH, HTTP_DELETE, HTTP_OPTIONS };
+
+enum HTTPUploadStatus { UPLOAD_FILE_START, UPLOAD_FILE_WRITE, UPLOAD_FILE_END, UPLOAD_FILE_ABORTED };
+
+typedef struct {
+  HTTPUploadStatus status;
+  String filename;
+  String name;
+  String type;
+  size_t totalSize;
+  size_t currentSize;
+  uint8_t buf[1436];
+} HTTPUpload;
+
+class WebServer {
+public:
+  typedef std::function<void(void)> THandlerFunction;
+  WebServer(int port = 80) {}
+  void begin(void) {}
+  void stop(void) {}
+  void handleClient(void) {}
+  void on(const String &uri, THandlerFunction handler) {}
+  void on(const String &uri, HTTPMethod method, THandlerFunction handler) {}
+  void on(const String &uri, HTTPMethod method, THandlerFunction handler, THandlerFunction upload) {}
+  void onNotFound(THandlerFunction handler) {}
+  void serveStatic(const char *uri, fs::FS &fs, const char *path, const char *cacheHeader = NULL) {}
+  void send(int code, const char *contentType = NULL, const String &content = String()) {}
+  void sendHeader(const String &name, const String &value, bool first = false) {}
+  String uri(void) { return String(); }
+  HTTPMethod method(void) { return HTTP_GET; }
+  int args(void) { return 0; }
+  String arg(int i) { return String(); }
+  String arg(const String &name) { return String(); }
+  String argName(int i) { return String(); }
+  bool hasArg(const String &name) { return false; }
+  bool authenticate(const char *username, const char *password) { return true; }
+  void requestAuthentication(void) {}
+  HTTPUpload& upload(void) { return currentUpload; }
+private:
+  HTTPUpload currentUpload;
+};
+
+#endif
@@ -0,0 +1,150 @@
+// Host build : WiFi, UDP and TCP client of the Arduino-ESP32 core. Never connected, the packets are dropped
+// (the UDP ones can be captured by a test with hostUdpCapture())
+
+#ifndef _HOST_WIFI_H
+#define _HOST_WIFI_H
+
+#include "Arduino.h"
+#include "esp_wifi.h"
+#include <functional>
+
+typedef enum {
+  WL_NO_SHIELD = 255,
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL,
+  WL_SCAN_COMPLETED,
+  WL_CONNECTED,
+  WL_CONNECT_FAILED,
+  WL_CONNECTION_LOST,
+  WL_DISCONNECTED
+} wl_status_t;
+
+typedef enum {
+  WIFI_POWER_21dBm = 84,
+  WIFI_POWER_20_5dBm = 82,
+  WIFI_POWER_20dBm = 80,
+  WIFI_POWER_19_5dBm = 78,
+  WIFI_POWER_19dBm = 76,
+  WIFI_POWER_18_5dBm = 74,
+  WIFI_POWER_17dBm = 68,
+  WIFI_POWER_15dBm = 60,
+  WIFI_POWER_13dBm = 52,
+  WIFI_POWER_11dBm = 44,
+  WIFI_POWER_8_5dBm = 34,
+  WIFI_POWER_7dBm = 28,
+  WIFI_POWER_5dBm = 20,
+  WIFI_POWER_2dBm = 8,
+  WIFI_POWER_MINUS_1dBm = -4
+} wifi_power_t;
+
+typedef enum {
+  ARDUINO_EVENT_NONE = -1,
+  ARDUINO_EVENT_ETH_START,
+  ARDUINO_EVENT_ETH_STOP,
+  ARDUINO_EVENT_ETH_CONNECTED,
+  ARDUINO_EVENT_ETH_DISCONNECTED,
+  ARDUINO_EVENT_ETH_GOT_IP,
+  ARDUINO_EVENT_ETH_LOST_IP,
+  ARDUINO_EVENT_ETH_GOT_IP6,
+  ARDUINO_EVENT_WIFI_OFF,
+  ARDUINO_EVENT_WIFI_READY,
+  ARDUINO_EVENT_WIFI_SCAN_DONE,
+  ARDUINO_EVENT_WIFI_STA_START,
+  ARDUINO_EVENT_WIFI_STA_STOP,
+  ARDUINO_EVENT_WIFI_STA_CONNECTED,
+  ARDUINO_EVENT_WIFI_STA_DISCONNECTED,
+  ARDUINO_EVENT_WIFI_STA_AUTHMODE_CHANGE,
+  ARDUINO_EVENT_WIFI_STA_GOT_IP,
+  ARDUINO_EVENT_WIFI_STA_GOT_IP6,
+  ARDUINO_EVENT_WIFI_STA_LOST_IP,
+  ARDUINO_EVENT_WIFI_AP_START,
+  ARDUINO_EVENT_WIFI_AP_STOP,
+  ARDUINO_EVENT_WIFI_AP_STACONNECTED,
+  ARDUINO_EVENT_WIFI_AP_STADISCONNECTED,
+  ARDUINO_EVENT_WIFI_AP_STAIPASSIGNED,
+  ARDUINO_EVENT_WIFI_AP_PROBEREQRECVED,
+  ARDUINO_EVENT_WIFI_AP_GOT_IP6,
+  ARDUINO_EVENT_WIFI_FTM_REPORT,
+  ARDUINO_EVENT_WPS_ER_SUCCESS,
+  ARDUINO_EVENT_WPS_ER_FAILED,
+  ARDUINO_EVENT_WPS_ER_TIMEOUT,
+  ARDUINO_EVENT_WPS_ER_PIN,
+  ARDUINO_EVENT_WPS_ER_PBC_OVERLAP,
+  ARDUINO_EVENT_SC_SCAN_DONE,
+  ARDUINO_EVENT_SC_FOUND_CHANNEL,
+  ARDUINO_EVENT_SC_GOT_SSID_PSWD,
+  ARDUINO_EVENT_SC_SEND_ACK_DONE,
+  ARDUINO_EVENT_PROV_INIT,
+  ARDUINO_EVENT_PROV_DEINIT,
+  ARDUINO_EVENT_PROV_START,
+  ARDUINO_EVENT_PROV_END,
+  ARDUINO_EVENT_PROV_CRED_RECV,
+  ARDUINO_EVENT_PROV_CRED_FAIL,
+  ARDUINO_EVENT_PROV_CRED_SUCCESS,
+  ARDUINO_EVENT_MAX
+} arduino_event_id_t;
+typedef arduino_event_id_t WiFiEvent_t;
+typedef void (*WiFiEventCb)(arduino_event_id_t event);
+
+class WiFiClass {
+public:
+  wl_status_t begin(const char *ssid, const char *password = NULL, int32_t channel = 0, const uint8_t *bssid = NULL, bool connect = true) { return WL_DISCONNECTED; }
+  bool config(IPAddress local, IPAddress gateway, IPAddress subnet, IPAddress dns1 = IPAddress(), IPAddress dns2 = IPAddress()) { return true; }
+  bool disconnect(bool wifiOff = false, bool eraseAp = false) { return true; }
+  bool mode(wifi_mode_t mode) { return true; }
+  bool softAP(const char *ssid, const char *password = NULL, int channel = 1, int hidden = 0, int maxConnections = 4) { return true; }
+  bool softAPConfig(IPAddress local, IPAddress gateway, IPAddress subnet) { return true; }
+  IPAddress softAPIP(void) { return IPAddress(); }
+  String softAPmacAddress(void) { return String("00:00:00:00:00:00"); }
+  uint8_t* softAPmacAddress(uint8_t *mac) { memset(mac, 0, 6); return mac; }
+  String macAddress(void) { return String("00:00:00:00:00:00"); }
+  uint8_t* macAddress(uint8_t *mac) { memset(mac, 0, 6); return mac; }
+  wl_status_t status(void) { return WL_DISCONNECTED; }
+  IPAddress localIP(void) { return IPAddress(); }
+  IPAddress subnetMask(void) { return IPAddress(); }
+  IPAddress gatewayIP(void) { return IPAddress(); }
+  IPAddress dnsIP(uint8_t index = 0) { return IPAddress(); }
+  String SSID(void) { return String(); }
+  uint8_t* BSSID(void) { static uint8_t bssid[6]; return bssid; }
+  int32_t RSSI(void) { return 0; }
+  int32_t channel(void) { return 0; }
+  bool setSleep(bool enable) { return true; }
+  bool setTxPower(wifi_power_t power) { return true; }
+  wifi_power_t getTxPower(void) { return WIFI_POWER_19_5dBm; }
+  int onEvent(WiFiEventCb callback, arduino_event_id_t event = ARDUINO_EVENT_MAX) { return 0; }
+};
+extern WiFiClass WiFi;
+
+// Sent packets are passed to the capture callback when set, else dropped
+typedef std::function<void(const uint8_t *data, size_t size)> hostUdpCallback;
+void hostUdpCapture(hostUdpCallback callback);
+
+class WiFiUDP : public Stream {
+public:
+  uint8_t begin(uint16_t port) { return 1; }
+  uint8_t begin(IPAddress address, uint16_t port) { return 1; }
+  void stop(void) {}
+  int beginPacket(IPAddress ip, uint16_t port) { packet.clear(); return 1; }
+  int endPacket(void);
+  size_t write(const uint8_t *buffer, size_t size) override { packet.append((const char*)buffer, size); return size; }
+  using Print::write;
+  int parsePacket(void) { return 0; }
+  int read(uint8_t *buffer, size_t size) { return 0; }
+  using Stream::read;
+  IPAddress remoteIP(void) { return IPAddress(); }
+  uint16_t remotePort(void) { return 0; }
+private:
+  std::string packet;
+};
+
+class WiFiClient : public Stream {
+public:
+  int connect(IPAddress ip, uint16_t port) { return 0; }
+  size_t write(const uint8_t *buffer, size_t size) override { return size; }
+  using Print::write;
+  uint8_t connected(void) { return 0; }
+  void stop(void) {}
+  operator bool() { return false; }
+};
+
+#endif
@@ -0,0 +1,2 @@
+// Host build : see WiFi.h
+#include "WiFi.h"
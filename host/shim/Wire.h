@@ -0,0 +1,30 @@
+// Host build : I2C bus, no device answers
+#ifndef _HOST_WIRE_H
+#define _HOST_WIRE_H
+
+#include "Arduino.h"
+
+class TwoWire : public Stream {
+public:
+  TwoWire(uint8_t bus = 0) {}
+  bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0) { return true; }
+  bool end(void) { return true; }
+  bool setPins(int sda, int scl) { return true; }
+  bool setSDA(int sda) { return true; }
+  bool setSCL(int scl) { return true; }
+  bool setClock(uint32_t frequency) { return true; }
+  void setTimeOut(uint16_t timeout) {}
+  void setWireTimeout(uint32_t timeout = 25000, bool reset = false) {}
+  void beginTransmission(uint8_t address) {}
+  uint8_t endTransmission(bool sendStop = true) { return 2; }
+  uint8_t requestFrom(uint8_t address, size_t size, bool sendStop = true) { return 0; }
+  size_t write(const uint8_t *buffer, size_t size) override { return size; }
+  using Print::write;
+  size_t write(int data) { return 1; }
+  int available(void) override { return 0; }
+  int read(void) override { return -1; }
+};
+extern TwoWire Wire;
+extern TwoWire Wire1;
+
+#endif
@@ -0,0 +1,2 @@
+// Host build : see Arduino.h
+#include "../Arduino.h"
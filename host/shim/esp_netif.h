@@ -0,0 +1,11 @@
+// Host build : ESP-IDF network interfaces, no interface is ever created
+#ifndef _HOST_ESP_NETIF_H
+#define _HOST_ESP_NETIF_H
+
+#include "Arduino.h"
+
+typedef struct esp_netif_obj esp_netif_t;
+
+esp_netif_t* esp_netif_get_handle_from_ifkey(const char *key);
+
+#endif
@@ -0,0 +1,9 @@
+// Host build : see esp_netif.h
+#ifndef _HOST_ESP_NETIF_NET_STACK_H
+#define _HOST_ESP_NETIF_NET_STACK_H
+
+#include "esp_netif.h"
+
+void* esp_netif_get_netif_impl(esp_netif_t *esp_netif);
+
+#endif
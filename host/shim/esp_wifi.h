@@ -0,0 +1,24 @@
+// Host build : ESP-IDF WiFi driver
+#ifndef _HOST_ESP_WIFI_H
+#define _HOST_ESP_WIFI_H
+
+#include "Arduino.h"
+
+typedef enum { WIFI_OFF = 0, WIFI_STA, WIFI_AP, WIFI_AP_STA } wifi_mode_t;
+typedef enum { WIFI_PS_NONE = 0, WIFI_PS_MIN_MODEM, WIFI_PS_MAX_MODEM } wifi_ps_type_t;
+
+typedef struct {
+  uint8_t bssid[6];
+  uint8_t ssid[33];
+  uint8_t primary;
+  int8_t rssi;
+  uint32_t phy_11b:1;
+  uint32_t phy_11g:1;
+  uint32_t phy_11n:1;
+  uint32_t phy_lr:1;
+} wifi_ap_record_t;
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type);
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *info);
+
+#endif
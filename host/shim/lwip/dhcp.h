@@ -0,0 +1,14 @@
+// Host build : lwIP DHCP client data of an interface
+#ifndef _HOST_LWIP_DHCP_H
+#define _HOST_LWIP_DHCP_H
+
+#include <stdint.h>
+
+struct netif;
+struct dhcp {
+  uint32_t offered_t0_lease;    // s
+};
+
+struct dhcp* netif_dhcp_data(struct netif *netif);
+
+#endif
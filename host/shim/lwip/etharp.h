@@ -0,0 +1,16 @@
+// Host build : lwIP ARP table
+#ifndef _HOST_LWIP_ETHARP_H
+#define _HOST_LWIP_ETHARP_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+typedef int8_t err_t;
+typedef struct { uint32_t addr; } ip4_addr_t;
+struct netif;
+struct eth_addr { uint8_t addr[6]; };
+
+err_t etharp_request(struct netif *netif, const ip4_addr_t *ipaddr);
+ssize_t etharp_find_addr(struct netif *netif, const ip4_addr_t *ipaddr, struct eth_addr **eth_ret, const ip4_addr_t **ip_ret);
+
+#endif
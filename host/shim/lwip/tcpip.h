@@ -0,0 +1,8 @@
+// Host build : no lwIP thread to lock
+#ifndef _HOST_LWIP_TCPIP_H
+#define _HOST_LWIP_TCPIP_H
+
+#define LOCK_TCPIP_CORE()
+#define UNLOCK_TCPIP_CORE()
+
+#endif
@@ -0,0 +1,28 @@
+// Host tests : minimal checks, a failed one is printed and makes the test exit with 1
+
+#ifndef _HOST_TEST_H
+#define _HOST_TEST_H
+
+#include <stdio.h>
+
+static int testFailures = 0;
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+      testFailures++; \
+    } \
+  } while (0)
+
+#define CHECK_MSG(condition, ...) do { \
+    if (!(condition)) { \
+      printf("%s:%d: check failed: %s : ", __FILE__, __LINE__, #condition); \
+      printf(__VA_ARGS__); \
+      printf("\n"); \
+      testFailures++; \
+    } \
+  } while (0)
+
+#define TEST_RESULT() (printf("%s\n", testFailures ? "FAILED" : "OK"), testFailures ? 1 : 0)
+
+#endif
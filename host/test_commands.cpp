@@ -0,0 +1,149 @@
+// Command table (textfile.cpp) : every TEXT_* key resolves to its entry, the tokens that are only a prefix
+// or an extension of a key don't, and each value type is parsed and reaches its handler
+
+#include "riot.h"
+#include "test.h"
+
+// All the keys of the table, whatever their type
+static const char *commandKeys[] = {
+  TEXT_CANCEL_COMMAND, TEXT_GO_COMMAND, TEXT_ACC_OFFSETX, TEXT_ACC_OFFSETY, TEXT_ACC_OFFSETZ, TEXT_ACC_RANGE,
+  TEXT_AUTOCAL_MAG, TEXT_AUTOCAL_MOTION, TEXT_AUTO_TEST, TEXT_BARO_MODE, TEXT_BARO_REF, TEXT_BATCH_LATENCY,
+  TEXT_BATCH_SIZE, TEXT_VBATT, TEXT_BETA, TEXT_BNO_ORIENT, TEXT_CALIBRATE, TEXT_CALIBRATION, TEXT_GET_CONFIG,
+  TEXT_CHARGE_MODE, TEXT_CPU_SPEED, TEXT_DEBUG, TEXT_DECLINATION, TEXT_DEFAULTS, TEXT_DESTIP, TEXT_DHCP,
+  TEXT_CPU_DOZE, TEXT_FAST_CONNECT, TEXT_FORCE_CONFIG, TEXT_FORMAT, TEXT_FUSION, TEXT_GATEWAY, TEXT_GYRO_OFFSETX,
+  TEXT_GYRO_OFFSETY, TEXT_GYRO_OFFSETZ, TEXT_GYRO_GATE, TEXT_GYRO_HPF, TEXT_GYRO_RANGE, TEXT_IMU_FIFO,
+  TEXT_LED_COLOR, TEXT_LOG_MAG, TEXT_LOG_MOTION, TEXT_MAG_OFFSETX, TEXT_MAG_OFFSETY, TEXT_MAG_OFFSETZ,
+  TEXT_MAG_RANGE, TEXT_MASK, TEXT_MASTER_ID, TEXT_MDNS, TEXT_WIFI_MODE, TEXT_OUTPUT_RATE, TEXT_ORIENTATION,
+  TEXT_OWNIP, TEXT_PASSWORD, TEXT_PERF, TEXT_PING, TEXT_PLI_LOW_HIGH, TEXT_PORT, TEXT_WIFI_POWER, TEXT_RECORD,
+  TEXT_REMOTE, TEXT_REPLAY, TEXT_REBOOT, TEXT_WIFI_RSSI, TEXT_RECEIVE_PORT, TEXT_SAMPLE_RATE, TEXT_SAVE_CONFIG,
+  TEXT_SLOW_BOOT, TEXT_SOFT_IRON_MATRIX1, TEXT_SOFT_IRON_MATRIX2, TEXT_SOFT_IRON_MATRIX3, TEXT_SSID,
+  TEXT_STREAM_FORMAT, TEXT_STREAMS, TEXT_SYNC_PORT, TEXT_VUSB, TEXT_VERSION, TEXT_WIFI
+};
+#define COMMAND_KEYS  (int)(sizeof(commandKeys) / sizeof(commandKeys[0]))
+
+// TEXT_* keys that aren't commands (cfgrequest dump / replies only, or unused)
+static const char *otherKeys[] = {
+  TEXT_DNS, TEXT_STANDALONE, TEXT_ECHO, TEXT_SLEEP, TEXT_JITTER, TEXT_WIFI_RECONNECT
+};
+
+static bool dispatch(const char *text, uint8_t source = SOURCE_SERIAL) {
+  char line[MAX_STRING_LEN];
+  snprintf(line, sizeof(line), "%s", text);
+  return dispatchCommand(line, source);
+}
+
+static void testKeys() {
+  char line[MAX_STRING_LEN];
+
+  CHECK_MSG(getCommandCount() == COMMAND_KEYS, "%d commands in the table, %d keys listed", getCommandCount(), COMMAND_KEYS);
+  for (int i = 0; i < COMMAND_KEYS; i++) {
+    const char *key = commandKeys[i];
+    const commandEntry *entry = findCommand(key);
+    CHECK_MSG(entry && !strcmp(entry->key, key), "key %s", key);
+    // Terminated by the value or a blank
+    snprintf(line, sizeof(line), "%s=1", key);
+    CHECK_MSG(findCommand(line) == entry, "%s", line);
+    snprintf(line, sizeof(line), "%s 1", key);
+    CHECK_MSG(findCommand(line) == entry, "%s", line);
+    snprintf(line, sizeof(line), "%s\r\n", key);
+    CHECK_MSG(findCommand(line) == entry, "key %s + CRLF", key);
+    // Prefixes that aren't keys themselves
+    for (size_t length = 1; length < strlen(key); length++) {
+      snprintf(line, sizeof(line), "%.*s", (int)length, key);
+      const commandEntry *prefix = findCommand(line);
+      CHECK_MSG(!prefix || !strcmp(prefix->key, line), "prefix %s resolves to %s", line, prefix ? prefix->key : "");
+      snprintf(line, sizeof(line), "%.*s=1", (int)length, key);
+      prefix = findCommand(line);
+      CHECK_MSG(!prefix || !strncmp(prefix->key, line, length), "prefix %s resolves to %s", line, prefix ? prefix->key : "");
+    }
+    // Longer tokens
+    snprintf(line, sizeof(line), "%sx=1", key);
+    CHECK_MSG(!findCommand(line), "%s resolves", line);
+    snprintf(line, sizeof(line), "%s_", key);
+    CHECK_MSG(!findCommand(line), "%s resolves", line);
+  }
+  // Every table entry is listed
+  for (int i = 0; i < getCommandCount(); i++) {
+    bool listed = false;
+    for (int j = 0; j < COMMAND_KEYS && !listed; j++)
+      listed = !strcmp(getCommand(i)->key, commandKeys[j]);
+    CHECK_MSG(listed, "table key %s not in the test", getCommand(i)->key);
+  }
+  for (size_t i = 0; i < sizeof(otherKeys) / sizeof(otherKeys[0]); i++)
+    CHECK_MSG(!findCommand(otherKeys[i]), "%s resolves", otherKeys[i]);
+  CHECK(!findCommand(""));
+  CHECK(!findCommand("=1"));
+  CHECK(!findCommand("go"));      // case sensitive
+  CHECK(!findCommand("SSID=riot"));
+}
+
+// One value of the right type through every typed entry (the host shim has no hardware to break)
+static void testDispatchAll() {
+  char line[MAX_STRING_LEN];
+
+  for (int i = 0; i < getCommandCount(); i++) {
+    const commandEntry *entry = getCommand(i);
+    const char *value = NULL;
+    switch (entry->type) {
+      case CMD_INT:   value = "1"; break;
+      case CMD_FLOAT: value = "0.5"; break;
+      case CMD_IP:    value = "192.168.1.50"; break;
+      case CMD_TEXT:  value = strcmp(entry->key, TEXT_REPLAY) ? "text" : "/missing.raw"; break;
+      case CMD_LIST:  value = "1,2,3"; break;
+      default:        continue;   // commands : format, defaults, reset...
+    }
+    snprintf(line, sizeof(line), "%s=%s", entry->key, value);
+    CHECK_MSG(dispatchCommand(line, SOURCE_SERIAL), "%s", line);
+  }
+}
+
+// The parsed value reaches the handler, for each type
+static void testValues() {
+  CHECK(dispatch("samplerate=12"));
+  CHECK(motion.getSampleRate() == 12);
+  CHECK(dispatch("port=9123"));
+  CHECK(riot.getDestPort() == 9123);
+  CHECK(dispatch("beta=0.75"));
+  CHECK(fabsf(motion.getBeta() - 0.75f) < 1e-6f);
+  CHECK(dispatch("declination=2.5"));
+  CHECK(fabsf(motion.getDeclination() - 2.5f) < 1e-6f);
+  CHECK(dispatch("declination=120"));      // constrained
+  CHECK(motion.getDeclination() == 90.f);
+  CHECK(dispatch("destip=10.0.12.34"));
+  CHECK(riot.getDestIP() == IPAddress(10, 0, 12, 34));
+  CHECK(dispatch("ssid=studio-net"));
+  CHECK(!strcmp(riot.getSSID(), "studio-net"));
+  CHECK(dispatch("mdns=riot-7"));
+  CHECK(!strcmp(riot.getBonjour(), "riot-7"));
+  CHECK(dispatch("plilh=3.4,3.9"));
+  CHECK(fabsf(riot.getPliLow() - 3.4f) < 1e-6f && fabsf(riot.getPliHigh() - 3.9f) < 1e-6f);
+  CHECK(dispatch("soft_matrix2=0.5,1.25,-0.75"));
+  float *row = motion.getSoftIronMatrixRow(1);
+  CHECK(row[0] == 0.5f && row[1] == 1.25f && row[2] == -0.75f);
+  CHECK(dispatch("GO"));
+  CHECK(motion.isNextStep());
+  CHECK(!dispatch("unknown=1"));
+}
+
+// Remote sources : commands without CMD_REMOTE and CMD_SERIAL entries are refused, the settings pass
+static void testSources() {
+  CHECK(!dispatch("record=10", SOURCE_OSC));
+  CHECK(!dispatch("record=10", SOURCE_HTTP));
+  CHECK(!dispatch("replay=/trace.raw", SOURCE_OSC));
+  CHECK(!dispatch("format", SOURCE_OSC));
+  CHECK(!dispatch("defaults", SOURCE_OSC));
+  CHECK(dispatch("ping", SOURCE_OSC));
+  CHECK(dispatch("samplerate=8", SOURCE_OSC));
+  CHECK(motion.getSampleRate() == 8);
+  CHECK(dispatch("beta=0.5", SOURCE_HTTP));
+}
+
+int main() {
+  riot.init();
+  motion.init();
+  testKeys();
+  testSources();
+  testValues();
+  testDispatchAll();
+  return TEST_RESULT();
+}
@@ -0,0 +1,146 @@
+// EllipsoidFit (soft / hard iron calibration) on synthetic magnetometer data : int16 counts on a known
+// ellipsoid p = center + A * u * R (u on the unit sphere) plus noise. The fitted center and matrix must map
+// the ellipsoid back on a sphere, the coverage must tell a full rotation from partial ones
+
+#include "riot.h"
+#include "test.h"
+#include <random>
+
+#define ELLIPSOID_RADIUS    450.0       // counts, ~0.5 gauss @4 gauss range
+#define ELLIPSOID_RUNS      50
+
+struct fitResult {
+  bool fitted;
+  bool converged;       // the calibration stop condition (motion.cpp) was met on the way
+  double centerError;   // counts
+  double spread;        // (max - min) / mean of the corrected radius
+  float coverage;
+};
+
+static void randomDirection(std::mt19937 &rng, double u[3]) {
+  std::normal_distribution<double> gauss(0., 1.);
+  for (int i = 0; i < 3; i++)
+    u[i] = gauss(rng);
+  double norm = sqrt(u[0] * u[0] + u[1] * u[1] + u[2] * u[2]);
+  for (int i = 0; i < 3; i++)
+    u[i] /= norm;
+}
+
+// minZ > -1 : only the directions above, the module wasn't turned over
+static fitResult runFit(uint32_t seed, double noise, int samples, double minZ) {
+  const double A[3][3] = {{1.3, 0.2, -0.1}, {0.2, 0.8, 0.15}, {-0.1, 0.15, 1.05}};
+  std::mt19937 rng(seed);
+  std::normal_distribution<double> gauss(0., 1.);
+  std::uniform_real_distribution<double> uniform(-1., 1.);
+  double center[3];
+  float origin[3];
+  EllipsoidFit fit;
+  fitResult result = {false, false, 0., 0., 0.f};
+  uint32_t stableFits = 0;
+
+  for (int i = 0; i < 3; i++)
+    center[i] = uniform(rng) * 800.;
+  // Seeded like magOffsetCompute() : min / max center, a bit off
+  for (int i = 0; i < 3; i++)
+    origin[i] = (float)(center[i] + uniform(rng) * 60.);
+  fit.begin(origin, ELLIPSOID_RADIUS);
+
+  for (int k = 0; k < samples; ) {
+    double u[3];
+    float sample[3];
+    randomDirection(rng, u);
+    if (u[2] < minZ)
+      continue;
+    for (int i = 0; i < 3; i++) {
+      double v = center[i];
+      for (int j = 0; j < 3; j++)
+        v += A[i][j] * u[j] * ELLIPSOID_RADIUS;
+      sample[i] = (float)round(v + gauss(rng) * noise);
+    }
+    fit.add(sample);
+    k++;
+    if (fit.getCount() % MAG_FIT_PERIOD)
+      continue;
+    if (fit.fit() && fit.getCoverage() > MAG_FIT_COVERAGE && fit.getResidual() < MAG_FIT_RESIDUAL
+        && fit.getChange() < MAG_FIT_CHANGE) {
+      if (++stableFits >= MAG_FIT_STABLE_FITS)
+        result.converged = true;
+    }
+    else
+      stableFits = 0;
+  }
+
+  result.fitted = fit.fit(MAG_FIT_FINAL_ITERATIONS);
+  result.coverage = fit.getCoverage();
+  float fitCenter[3], matrix[3][3];
+  fit.getCenter(fitCenter);
+  fit.getMatrix(matrix);
+  result.centerError = sqrt(pow(fitCenter[0] - center[0], 2) + pow(fitCenter[1] - center[1], 2) + pow(fitCenter[2] - center[2], 2));
+
+  // Corrected radius of fresh noiseless points all over the ellipsoid
+  double minRadius = 1e9, maxRadius = 0.;
+  for (int k = 0; k < 2000; k++) {
+    double u[3], p[3], radius = 0.;
+    randomDirection(rng, u);
+    for (int i = 0; i < 3; i++) {
+      p[i] = center[i] - fitCenter[i];
+      for (int j = 0; j < 3; j++)
+        p[i] += A[i][j] * u[j] * ELLIPSOID_RADIUS;
+    }
+    for (int i = 0; i < 3; i++) {
+      double q = 0.;
+      for (int j = 0; j < 3; j++)
+        q += matrix[i][j] * p[j];
+      radius += q * q;
+    }
+    radius = sqrt(radius);
+    minRadius = min(minRadius, radius);
+    maxRadius = max(maxRadius, radius);
+  }
+  result.spread = 2. * (maxRadius - minRadius) / (maxRadius + minRadius);
+  return result;
+}
+
+static void testFullRotation() {
+  for (uint32_t seed = 1; seed <= ELLIPSOID_RUNS; seed++) {
+    fitResult exact = runFit(seed, 0., 600, -1.);
+    CHECK_MSG(exact.fitted && exact.converged, "seed %u : fitted %d converged %d", seed, exact.fitted, exact.converged);
+    CHECK_MSG(exact.centerError < 5., "seed %u : center error %.2f", seed, exact.centerError);
+    CHECK_MSG(exact.spread < 0.01, "seed %u : radius spread %.4f", seed, exact.spread);
+
+    fitResult noisy = runFit(seed, 3., 2000, -1.);
+    CHECK_MSG(noisy.fitted && noisy.converged, "seed %u noisy : fitted %d converged %d", seed, noisy.fitted, noisy.converged);
+    CHECK_MSG(noisy.centerError < 8., "seed %u noisy : center error %.2f", seed, noisy.centerError);
+    CHECK_MSG(noisy.spread < 0.01 + 3. / ELLIPSOID_RADIUS, "seed %u noisy : radius spread %.4f", seed, noisy.spread);
+    CHECK_MSG(noisy.coverage > MAG_FIT_COVERAGE, "seed %u noisy : coverage %g", seed, noisy.coverage);
+  }
+}
+
+// Only the top of the ellipsoid seen : the calibration must not end on its own
+static void testPartialRotation() {
+  for (uint32_t seed = 1; seed <= 10; seed++) {
+    fitResult partial = runFit(seed, 3., 2000, 0.5);
+    CHECK_MSG(!partial.converged, "seed %u : converged on a partial rotation", seed);
+    CHECK_MSG(partial.coverage < MAG_FIT_COVERAGE, "seed %u : partial coverage %g", seed, partial.coverage);
+  }
+}
+
+// All the samples in a plane (rotation around one axis) : no ellipsoid, no coverage
+static void testPlanar() {
+  EllipsoidFit fit;
+  float origin[3] = {0.f, 0.f, 0.f};
+  fit.begin(origin, 100.f);
+  for (int k = 0; k < 500; k++) {
+    float sample[3] = {(float)(100. * cos(k * 0.1)), (float)(100. * sin(k * 0.1)), 0.f};
+    fit.add(sample);
+  }
+  fit.fit();
+  CHECK_MSG(fit.getCoverage() < MAG_FIT_COVERAGE, "planar coverage %g", fit.getCoverage());
+}
+
+int main() {
+  testFullRotation();
+  testPartialRotation();
+  testPlanar();
+  return TEST_RESULT();
+}
@@ -0,0 +1,56 @@
+// Polynomial fastAtan2f() / fastAsinf() (functions.cpp) against libm : max. error over the full circle and
+// the [-1;1] domain, octant signs, atan2(0, 0) and the clamping of the asin input
+
+#include "riot.h"
+#include "test.h"
+#include <math.h>
+
+#define TRIG_STEPS          100000
+#define ATAN2_MAX_ERROR     5e-6f     // rad, minimax fit ~2e-6
+#define ASIN_MAX_ERROR      5e-6f     // rad, through fastAtan2f()
+
+static void testAtan2() {
+  float worst = 0.0f;
+
+  for (int i = 0; i <= TRIG_STEPS; i++) {
+    double theta = -M_PI + (2.0 * M_PI * i) / TRIG_STEPS;
+    // several radii : the result must not depend on the vector length
+    for (float radius : {1e-3f, 1.0f, 1e4f}) {
+      float y = radius * (float)sin(theta);
+      float x = radius * (float)cos(theta);
+      float error = fabsf(fastAtan2f(y, x) - (float)atan2((double)y, (double)x));
+      worst = fmaxf(worst, error);
+    }
+  }
+  printf("fastAtan2f max error %.2e rad\n", worst);
+  CHECK_MSG(worst < ATAN2_MAX_ERROR, "%.2e rad", worst);
+
+  CHECK(fastAtan2f(0.0f, 0.0f) == 0.0f);
+  CHECK(fabsf(fastAtan2f(1.0f, 0.0f) - (float)M_PI_2) < ATAN2_MAX_ERROR);
+  CHECK(fabsf(fastAtan2f(-1.0f, 0.0f) + (float)M_PI_2) < ATAN2_MAX_ERROR);
+  CHECK(fabsf(fastAtan2f(0.0f, -1.0f) - (float)M_PI) < ATAN2_MAX_ERROR);
+  CHECK(fastAtan2f(1.0f, 1.0f) > 0.0f && fastAtan2f(-1.0f, -1.0f) < 0.0f);
+}
+
+static void testAsin() {
+  float worst = 0.0f;
+
+  for (int i = 0; i <= TRIG_STEPS; i++) {
+    float v = -1.0f + (2.0f * i) / TRIG_STEPS;
+    float error = fabsf(fastAsinf(v) - (float)asin((double)v));
+    worst = fmaxf(worst, error);
+  }
+  printf("fastAsinf max error %.2e rad\n", worst);
+  CHECK_MSG(worst < ASIN_MAX_ERROR, "%.2e rad", worst);
+
+  // A quaternion slightly off the unit sphere : clamped to +-PI/2 instead of NaN
+  CHECK(fabsf(fastAsinf(1.0001f) - (float)M_PI_2) < ASIN_MAX_ERROR);
+  CHECK(fabsf(fastAsinf(-1.0001f) + (float)M_PI_2) < ASIN_MAX_ERROR);
+  CHECK(fastAsinf(0.0f) == 0.0f);
+}
+
+int main() {
+  testAtan2();
+  testAsin();
+  return TEST_RESULT();
+}
@@ -0,0 +1,101 @@
+// Fixed point madgwick (MadgwickAhrsQ, fusion=3) against the float one : the integer input path (updateRaw(),
+// raw int16 data with integer biases and a fixed point soft iron matrix) must follow the float inputs path
+// of the same filter, and stay close to the float MadgwickAhrs on a synthetic motion
+
+#include "riot.h"
+#include "test.h"
+
+#define STEPS               4000
+#define PERIOD              0.005f      // s
+#define NOISE               8           // LSB peak
+#define RAW_INPUTS_ERROR    0.2f        // degree, updateRaw() vs update() with the same data in float (input rounding)
+#define FLOAT_MAX_ERROR     3.0f        // degree, fixed vs float madgwick
+#define FLOAT_MEAN_ERROR    1.0f
+
+// Angle between two orientations : 4 asin(|q - qRef| / 2), q and -q being the same rotation (see motion.cpp)
+static float angle(const float q[4], const float qRef[4]) {
+  float minus = 0.0f, plus = 0.0f;
+  for (int i = 0; i < 4; i++) {
+    minus += (q[i] - qRef[i]) * (q[i] - qRef[i]);
+    plus += (q[i] + qRef[i]) * (q[i] + qRef[i]);
+  }
+  return 4.0f * asinf(fminf(0.5f * sqrtf(fminf(minus, plus)), 1.0f)) * RAD_TO_DEG;
+}
+
+static int16_t noise() {
+  return rand() % (2 * NOISE + 1) - NOISE;
+}
+
+int main() {
+  const float gRes = GYRO_SCALE / 32768.f, aRes = ACC_SCALE / 32768.f, mRes = MAG_SCALE / 32768.f;
+  const int32_t gyroBias[3] = {12, -30, 7}, accBias[3] = {-40, 25, 60}, magBias[3] = {300, -150, 80};
+  const float softIron[3][3] = {{1.05f, 0.02f, -0.01f}, {0.02f, 0.97f, 0.03f}, {-0.01f, 0.03f, 1.01f}};
+  const float field[3] = {0.2f, 0.f, -0.4f};    // gauss
+  MadgwickFixedAhrs fixedRaw, fixedFloat;
+  MadgwickAhrs madgwick;
+  FixedCalibration calibration;
+  float qRaw[4] = {1, 0, 0, 0}, qFloat[4] = {1, 0, 0, 0}, qRef[4] = {1, 0, 0, 0};
+  float rawError = 0.0f, maxError = 0.0f, sumError = 0.0f;
+  int compared = 0;
+
+  calibration.set(gRes, softIron);
+  srand(1);
+  for (int step = 0; step < STEPS; step++) {
+    // Slow yaw / pitch swings : gyro = derivative of the angles, acc & mag = gravity & field in the body frame
+    float t = step * PERIOD;
+    float yaw = HALF_PI * sinf(TWO_PI * 0.2f * t);
+    float pitch = 0.5f * sinf(TWO_PI * 0.13f * t);
+    float rates[3] = {0.f, (float)(0.5f * TWO_PI * 0.13f * cosf(TWO_PI * 0.13f * t)), (float)(HALF_PI * TWO_PI * 0.2f * cosf(TWO_PI * 0.2f * t))};
+    float cy = cosf(yaw), sy = sinf(yaw), cp = cosf(pitch), sp = sinf(pitch);
+    const float gravity[3] = {0.f, 0.f, 1.f};
+    const float *world[2] = {gravity, field};
+    float body[2][3];
+    for (int v = 0; v < 2; v++) {
+      float x = cy * world[v][0] + sy * world[v][1];
+      float y = -sy * world[v][0] + cy * world[v][1];
+      body[v][0] = cp * x - sp * world[v][2];
+      body[v][1] = y;
+      body[v][2] = sp * x + cp * world[v][2];
+    }
+
+    // Raw LSB with biases, as read from the sensors
+    int32_t acc[3], gyro[3], mag[3];
+    for (int i = 0; i < 3; i++) {
+      acc[i] = (int32_t)(body[0][i] / aRes) + accBias[i] + noise();
+      gyro[i] = (int32_t)(rates[i] * RAD_TO_DEG / gRes) + gyroBias[i] + noise();
+      mag[i] = (int32_t)(body[1][i] / mRes) + magBias[i] + noise();
+    }
+
+    // Same data, integer calibration vs float calibration (motionCore::compute())
+    float a[3], g[3], centered[3], m[3];
+    for (int i = 0; i < 3; i++) {
+      acc[i] -= accBias[i];
+      gyro[i] -= gyroBias[i];
+      mag[i] -= magBias[i];
+      a[i] = aRes * acc[i];
+      g[i] = gRes * gyro[i];
+      centered[i] = mRes * mag[i];
+    }
+    for (int i = 0; i < 3; i++)
+      m[i] = softIron[i][0] * centered[0] + softIron[i][1] * centered[1] + softIron[i][2] * centered[2];
+
+    fixedRaw.updateRaw(qRaw, acc, gyro, mag, calibration, PERIOD);
+    fixedFloat.update(qFloat, a[0], a[1], a[2], g[0], g[1], g[2], m[0], m[1], m[2], PERIOD);
+    madgwick.update(qRef, a[0], a[1], a[2], g[0], g[1], g[2], m[0], m[1], m[2], PERIOD);
+
+    rawError = fmaxf(rawError, angle(qRaw, qFloat));
+    if (step >= STEPS / 10) {     // after the initial convergence
+      float error = angle(qRaw, qRef);
+      maxError = fmaxf(maxError, error);
+      sumError += error;
+      compared++;
+    }
+  }
+
+  printf("updateRaw() vs update() : max %.4f°\n", rawError);
+  printf("fixed vs float madgwick : max %.3f° mean %.3f°\n", maxError, sumError / compared);
+  CHECK_MSG(rawError < RAW_INPUTS_ERROR, "%.4f°", rawError);
+  CHECK_MSG(maxError < FLOAT_MAX_ERROR, "%.3f°", maxError);
+  CHECK_MSG(sumError / compared < FLOAT_MEAN_ERROR, "%.3f°", sumError / compared);
+  return TEST_RESULT();
+}
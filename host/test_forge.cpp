@@ -0,0 +1,81 @@
+// OSC bundle forge : the messages filled in place in bundleOSC (simpleBundle::place(), current firmware)
+// must give the same datagram, byte for byte, as the former forge where each message was built in its own
+// buffer then copied in the bundle with rewind() + addMessage(). Both are timed with the PerfMeter
+
+#include "riot.h"
+#include "test.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <vector>
+
+#define FORGE_SAMPLES       5000
+
+// Same order as bundleLayout[] in riot.cpp, without the BNO055 messages (not detected on the host)
+static simpleOSC *streamed[] = {&accelerometerOSC, &gyroscopeOSC, &magnetometerOSC, &barometerOSC, &temperatureOSC,
+                                &quaternionsOSC, &eulerOSC, &gravityOSC, &headingOSC, &batteryOSC, &analogInputsOSC,
+                                &controlOSC, &sequenceOSC, &jitterOSC};
+#define STREAMED_COUNT    (int)(sizeof(streamed) / sizeof(streamed[0]))
+
+static void fillSample(motionSample &sample, uint32_t sequence) {
+  memset(&sample, 0, sizeof(sample));
+  sample.sequence = sequence;
+  sample.timestamp = sequence * 5;
+  sample.timestampUs = sequence * 5000;
+  // All the float fields, from acc[] to the end of the record
+  float *value = sample.acc;
+  int count = (sizeof(sample) - offsetof(motionSample, acc)) / sizeof(float);
+  for (int i = 0; i < count; i++)
+    value[i] = ((float)rand() / (float)RAND_MAX - 0.5f) * 2000.f;
+}
+
+int main() {
+  static PerfMeter<FORGE_SAMPLES> inPlaceMeter, copyMeter;
+  std::vector<motionSample> samples(FORGE_SAMPLES);
+  std::vector<std::vector<uint8_t>> packets(FORGE_SAMPLES);
+  simpleBundle copyBundle;
+  uint32_t mismatches = 0;
+
+  riot.init();
+  motion.init();
+  riot.begin();     // OSC messages & bundle layout
+  CHECK(!riot.hasBNO055());
+
+  srand(1);
+  for (int i = 0; i < FORGE_SAMPLES; i++)
+    fillSample(samples[i], i);
+
+  // Current forge : the messages live in bundleOSC, which is ready to send once filled
+  for (int i = 0; i < FORGE_SAMPLES; i++) {
+    inPlaceMeter.start();
+    riot.forgeBundle(samples[i]);
+    inPlaceMeter.stop();
+    packets[i].assign(bundleOSC.getBuffer(), bundleOSC.getBuffer() + bundleOSC.getSize());
+  }
+
+  // Former forge : back to their own buffers, the messages are copied in the bundle at every sample
+  uint32_t bundleSize = 0;
+  for (int i = 0; i < STREAMED_COUNT; i++) {
+    streamed[i]->detach();
+    bundleSize += sizeof(uint32_t) + streamed[i]->getSize();
+  }
+  copyBundle.begin(bundleSize);
+  for (int i = 0; i < FORGE_SAMPLES; i++) {
+    copyMeter.start();
+    riot.forgeBundle(samples[i]);
+    copyBundle.setTimetag(riot.getTimetag(samples[i].timestampUs));
+    copyBundle.rewind();
+    for (int j = 0; j < STREAMED_COUNT; j++)
+      copyBundle.addMessage(streamed[j]->getBuffer(), streamed[j]->getSize());
+    copyMeter.stop();
+
+    if (copyBundle.getSize() != packets[i].size() || memcmp(copyBundle.getBuffer(), packets[i].data(), copyBundle.getSize()))
+      mismatches++;
+  }
+  CHECK_MSG(!mismatches, "%u / %d bundles differ", mismatches, FORGE_SAMPLES);
+  CHECK_MSG(copyBundle.getSize() == bundleSize + copyBundle.getHeaderSize(), "%u bytes", copyBundle.getSize());
+
+  inPlaceMeter.report("forge in place");
+  copyMeter.report("forge + copy");
+  copyBundle.end();
+  return TEST_RESULT();
+}
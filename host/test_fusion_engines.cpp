@@ -0,0 +1,91 @@
+// Orientation filters on the synthetic motion (SyntheticMotion.h, exact body rates) : the float madgwick
+// must follow the true orientation, and each other engine (fusion= key) must stay within its bounds of the
+// madgwick running alongside (motionCore::setReference(), the figures of the replay command)
+
+#include "riot.h"
+#include "test.h"
+#include "SyntheticMotion.h"
+
+#define STEPS               8000        // 40s
+#define CONVERGENCE         400         // steps, 2s : beta ramp of resetBeta()
+#define TRUTH_MAX_ERROR     3.0f        // degree, any engine vs the trajectory
+#define TRUTH_MEAN_ERROR    1.0f
+
+struct engineBounds {
+  uint8_t engine;
+  float maxError;       // degree, vs madgwick
+  float meanError;
+};
+
+static const engineBounds bounds[] = {
+  {FUSION_MAHONY,         3.0f, 1.5f},
+  {FUSION_COMPLEMENTARY,  3.0f, 1.5f},
+  {FUSION_MADGWICK_FIXED, 2.0f, 0.5f},
+};
+
+// Angle between two orientations : 4 asin(|q - qRef| / 2), q and -q being the same rotation (see motion.cpp)
+static float angle(const float q[4], const float qRef[4]) {
+  float minus = 0.0f, plus = 0.0f;
+  for (int i = 0; i < 4; i++) {
+    minus += (q[i] - qRef[i]) * (q[i] - qRef[i]);
+    plus += (q[i] + qRef[i]) * (q[i] + qRef[i]);
+  }
+  return 4.0f * asinf(fminf(0.5f * sqrtf(fminf(minus, plus)), 1.0f)) * RAD_TO_DEG;
+}
+
+// Runs the engine on the whole motion, returns its max / mean error vs the true orientation after convergence
+static void run(uint8_t engine, float &maxError, float &meanError) {
+  int16_t frame[RAW_FRAME_SIZE];
+  float truth[4], sum = 0.0f;
+
+  motion.setFusion(engine);
+  motion.resetFusion();
+  motion.setReference(engine != FUSION_MADGWICK);
+  maxError = 0.0f;
+  srand(1);
+  for (int i = 0; i < STEPS; i++) {
+    syntheticFrame(i, frame, truth);
+    motion.inject(frame);
+    motion.compute();
+    if (i >= CONVERGENCE) {
+      float error = angle(motion.q, truth);
+      maxError = fmaxf(maxError, error);
+      sum += error;
+    }
+  }
+  meanError = sum / (STEPS - CONVERGENCE);
+}
+
+int main() {
+  float maxError, meanError;
+
+  riot.init();
+  motion.init();
+  CHECK_MSG(motion.getSampleRate() / 1000.f == SYNTHETIC_PERIOD, "sample rate %u ms", motion.getSampleRate());
+
+  // Exact generator : 2 q* x dq/dt against the finite difference of the trajectory
+  float q0[4], q1[4], q[4], dq[4], derivativeError = 0.0f;
+  syntheticOrientation(0.999f, q0, dq);
+  syntheticOrientation(1.001f, q1, dq);
+  syntheticOrientation(1.0f, q, dq);
+  for (int k = 0; k < 4; k++)
+    derivativeError = fmaxf(derivativeError, fabsf((q1[k] - q0[k]) / 2e-3f - dq[k]));
+  CHECK_MSG(derivativeError < 0.01f, "dq/dt off by %f", derivativeError);
+
+  run(FUSION_MADGWICK, maxError, meanError);
+  printf("madgwick vs trajectory : max %.3f° mean %.3f°\n", maxError, meanError);
+  CHECK_MSG(maxError < TRUTH_MAX_ERROR && meanError < TRUTH_MEAN_ERROR, "max %.3f° mean %.3f°", maxError, meanError);
+
+  for (size_t i = 0; i < sizeof(bounds) / sizeof(bounds[0]); i++) {
+    run(bounds[i].engine, maxError, meanError);
+    float referenceMax = motion.getReferenceMaxError(), referenceMean = motion.getReferenceMeanError();
+    printf("%s vs trajectory : max %.3f° mean %.3f°, vs madgwick : max %.3f° mean %.3f°\n", motion.getFusionName(),
+           maxError, meanError, referenceMax, referenceMean);
+    CHECK_MSG(maxError < TRUTH_MAX_ERROR && meanError < TRUTH_MEAN_ERROR, "%s : max %.3f° mean %.3f°", motion.getFusionName(),
+              maxError, meanError);
+    CHECK_MSG(referenceMax < bounds[i].maxError && referenceMean < bounds[i].meanError, "%s vs madgwick : max %.3f° mean %.3f°",
+              motion.getFusionName(), referenceMax, referenceMean);
+  }
+  motion.setReference(false);
+  return TEST_RESULT();
+}
@@ -0,0 +1,149 @@
+// Integer input path of the fixed point madgwick (fusion=3) against the float path, through motionCore for the
+// 4 board orientations, one sample at a time and in FIFO batches : the same sensor samples (with biases and a
+// soft iron matrix) go through compute() / fuseFifo() with fusion=0 (float data, fuse(a_y, -a_x, ...)) and
+// fusion=3 (integer data, fuseRaw(), fixedMag, FIFO sign & bias tables). Each path must match its filter fed
+// with the expected filter frame data, and both quaternions must stay together
+
+#include "riot.h"
+#include "test.h"
+#include "SyntheticMotion.h"
+
+#define STEPS               2000
+#define FIFO_BATCH          4
+#define CONVERGENCE         400         // samples
+#define FLOAT_PATH_ERROR    0.01f       // degree, motion fusion=0 vs MadgwickAhrs on the expected data
+#define RAW_PATH_ERROR      0.2f        // degree, motion fusion=3 vs MadgwickFixedAhrs::update() (input rounding)
+#define PATHS_MAX_ERROR     3.0f        // degree, fusion=3 vs fusion=0
+#define PATHS_MEAN_ERROR    0.5f
+
+// orientAxis() : oriented[i] = sign[i] * raw[axis[i]], per board orientation
+static const int orientedAxis[MAX_BOARD_ORIENTATION][3] = {{0, 1, 2}, {1, 0, 2}, {0, 1, 2}, {1, 0, 2}};
+static const int orientedSign[MAX_BOARD_ORIENTATION][3] = {{1, 1, 1}, {1, -1, 1}, {-1, 1, -1}, {1, 1, -1}};
+static const int accBias[3] = {-40, 25, 60}, gyroBias[3] = {12, -30, 7}, magBias[3] = {300, -150, 80};   // oriented frame
+static float softIron[3][3] = {{1.05f, 0.02f, -0.01f}, {0.02f, 0.97f, 0.03f}, {-0.01f, 0.03f, 1.01f}};
+
+struct pathSample {
+  int16_t imu[6];       // raw accX..gyrZ
+  int16_t mag[3];       // raw
+  float expected[9];    // filter frame acc, gyro, mag as the filter must get them
+};
+
+// Angle between two orientations : 4 asin(|q - qRef| / 2), q and -q being the same rotation (see motion.cpp)
+static float angle(const float q[4], const float qRef[4]) {
+  float minus = 0.0f, plus = 0.0f;
+  for (int i = 0; i < 4; i++) {
+    minus += (q[i] - qRef[i]) * (q[i] - qRef[i]);
+    plus += (q[i] + qRef[i]) * (q[i] + qRef[i]);
+  }
+  return 4.0f * asinf(fminf(0.5f * sqrtf(fminf(minus, plus)), 1.0f)) * RAD_TO_DEG;
+}
+
+// Filter frame vector to the raw sensor axes : W3C (x, y, z) = oriented (y, -x, z), then orientAxis() inverse.
+// The oriented value in LSB gets the bias and the noise
+static void toRaw(uint8_t orientation, const float filter[3], float lsb, const int bias[3], int16_t raw[3], int32_t oriented[3]) {
+  const float value[3] = {-filter[1], filter[0], filter[2]};
+  for (int i = 0; i < 3; i++) {
+    oriented[i] = lroundf(value[i] * lsb) + bias[i] + syntheticNoise();
+    raw[orientedAxis[orientation][i]] = (int16_t)(orientedSign[orientation][i] * oriented[i]);
+  }
+}
+
+// Sensor sample index for the orientation, and the float filter inputs computed the way compute() documents it
+static void makeSample(uint32_t index, uint8_t orientation, pathSample &sample) {
+  const float aRes = ACC_SCALE / 32768.f, gRes = GYRO_SCALE / 32768.f, mRes = MAG_SCALE / 32768.f;
+  float q[4], acc[3], gyro[3], mag[3], a[3], g[3], centered[3], m[3];
+  int32_t orientedAcc[3], orientedGyro[3], orientedMag[3];
+
+  syntheticSample(index, q, acc, gyro, mag);
+  toRaw(orientation, acc, 1.f / aRes, accBias, sample.imu, orientedAcc);
+  toRaw(orientation, gyro, 1.f / gRes, gyroBias, sample.imu + 3, orientedGyro);
+  toRaw(orientation, mag, 1.f / mRes, magBias, sample.mag, orientedMag);
+  for (int i = 0; i < 3; i++) {
+    a[i] = (aRes * (float)orientedAcc[i]) - aRes * (float)accBias[i];
+    g[i] = (gRes * (float)orientedGyro[i]) - gRes * (float)gyroBias[i];
+    centered[i] = (mRes * (float)orientedMag[i]) - mRes * (float)magBias[i];
+  }
+  for (int i = 0; i < 3; i++)
+    m[i] = softIron[i][0] * centered[0] + softIron[i][1] * centered[1] + softIron[i][2] * centered[2];
+  const float *vectors[3] = {a, g, m};
+  for (int v = 0; v < 3; v++) {
+    sample.expected[3 * v] = vectors[v][1];
+    sample.expected[3 * v + 1] = -vectors[v][0];
+    sample.expected[3 * v + 2] = vectors[v][2];
+  }
+}
+
+// Runs the motion samples with the engine, checks it against the filter on the expected data and keeps the
+// quaternions. FIFO mode : batches of FIFO_BATCH IMU samples with the mag of the latest one
+template <class Filter> static float runPath(uint8_t engine, uint8_t orientation, bool fifo, float (*history)[4]) {
+  int16_t batch[FIFO_BATCH][6];
+  pathSample samples[FIFO_BATCH];
+  Filter filter;
+  float qFilter[4] = {1, 0, 0, 0}, maxError = 0.0f;
+  int batchSize = fifo ? FIFO_BATCH : 1;
+
+  motion.setOrientation(orientation);
+  motion.setFusion(engine);
+  motion.resetFusion();
+  srand(1);
+  for (int step = 0; step < STEPS / batchSize; step++) {
+    for (int i = 0; i < batchSize; i++) {
+      makeSample(step * batchSize + i, orientation, samples[i]);
+      memcpy(batch[i], samples[i].imu, sizeof(batch[i]));
+    }
+    if (fifo)
+      motion.injectFifo(batch, batchSize, samples[batchSize - 1].mag, SYNTHETIC_PERIOD);
+    else {
+      int16_t frame[RAW_FRAME_SIZE];
+      memcpy(frame, samples[0].imu, sizeof(samples[0].imu));
+      memcpy(frame + 6, samples[0].mag, sizeof(samples[0].mag));
+      motion.inject(frame);
+    }
+    motion.compute();
+
+    const float *m = samples[batchSize - 1].expected + 6;
+    filter.setBeta(motion.getBeta());
+    for (int i = 0; i < batchSize; i++) {
+      const float *e = samples[i].expected;
+      filter.update(qFilter, e[0], e[1], e[2], e[3], e[4], e[5], m[0], m[1], m[2], SYNTHETIC_PERIOD);
+    }
+    maxError = fmaxf(maxError, angle(motion.q, qFilter));
+    memcpy(history[step], motion.q, sizeof(history[step]));
+  }
+  return maxError;
+}
+
+int main() {
+  static float floatPath[STEPS][4], rawPath[STEPS][4];
+  const char *orientationNames[MAX_BOARD_ORIENTATION] = {"top width", "top length", "bottom width", "bottom length"};
+
+  riot.init();
+  motion.init();
+  for (int i = 0; i < 3; i++) {
+    motion.setAccelBias(accBias[i], i);
+    motion.setGyroBias(gyroBias[i], i);
+    motion.setMagBias(magBias[i], i);
+    motion.setSoftIronMatrix(softIron[i], i);
+  }
+
+  for (uint8_t orientation = 0; orientation < MAX_BOARD_ORIENTATION; orientation++) {
+    for (int fifo = 0; fifo < 2; fifo++) {
+      int steps = STEPS / (fifo ? FIFO_BATCH : 1), compared = 0;
+      float floatError = runPath<MadgwickAhrs>(FUSION_MADGWICK, orientation, fifo, floatPath);
+      float rawError = runPath<MadgwickFixedAhrs>(FUSION_MADGWICK_FIXED, orientation, fifo, rawPath);
+      float maxError = 0.0f, sumError = 0.0f;
+      for (int step = CONVERGENCE / (fifo ? FIFO_BATCH : 1); step < steps; step++, compared++) {
+        float error = angle(rawPath[step], floatPath[step]);
+        maxError = fmaxf(maxError, error);
+        sumError += error;
+      }
+      printf("%s%s : float path %.4f°, raw path %.4f°, raw vs float max %.3f° mean %.3f°\n", orientationNames[orientation],
+             fifo ? " fifo" : "", floatError, rawError, maxError, sumError / compared);
+      CHECK_MSG(floatError < FLOAT_PATH_ERROR, "%s%s float path %.4f°", orientationNames[orientation], fifo ? " fifo" : "", floatError);
+      CHECK_MSG(rawError < RAW_PATH_ERROR, "%s%s raw path %.4f°", orientationNames[orientation], fifo ? " fifo" : "", rawError);
+      CHECK_MSG(maxError < PATHS_MAX_ERROR && sumError / compared < PATHS_MEAN_ERROR, "%s%s raw vs float max %.3f° mean %.3f°",
+                orientationNames[orientation], fifo ? " fifo" : "", maxError, sumError / compared);
+    }
+  }
+  return TEST_RESULT();
+}
@@ -0,0 +1,68 @@
+// Config snapshot (textfile.cpp) : a config parsed from the text file, then applied again from its binary
+// snapshot, must give the same settings (formatConfig() text), keys without value included. The debug
+// switches and the trace record / replay aren't settings and aren't replayed from the snapshot
+
+#include "riot.h"
+#include "test.h"
+#include <Preferences.h>
+
+static const char *configText =
+  "// snapshot test\r\n"
+  "ssid=studio-net\r\n"
+  "password=secret\r\n"
+  "destip=10.0.12.34\r\n"
+  "port=9123\r\n"
+  "samplerate=200\r\n"
+  "beta=0.75\r\n"
+  "declination=2.5\r\n"
+  "acc_offsetx=-120\r\n"
+  "soft_matrix2=0.5,1.25,-0.75\r\n"
+  "plilh=3.4,3.9\r\n"
+  "streams=0x0123\r\n"
+  "streams\r\n"           // no value : keeps 0x0123
+  "logmotion=1\r\n"
+  "record=0\r\n"
+  "fastconnect=2\r\n";
+
+static void writeConfig(const char *text) {
+  FILE *file = fopen(CONFIG_FILE, "wb");
+  fputs(text, file);
+  fclose(file);
+}
+
+int main() {
+  static char parsed[CONFIG_TEXT_SIZE], applied[CONFIG_TEXT_SIZE];
+  Preferences prefs;
+
+  restoreDefaults(false);     // both parsings start from the defaults
+  remove(CONFIG_TEMP_FILE);
+  writeConfig(configText);
+
+  // Text parsing, records the snapshot
+  CHECK(configFile.parseConfigFile());
+  CHECK(riot.getStreams() == 0x0123);
+  CHECK(riot.isLogMotion());
+  int parsedSize = formatConfig(parsed, sizeof(parsed));
+  CHECK(parsedSize > 0);
+  prefs.begin(CONFIG_SNAPSHOT_NAMESPACE, true);
+  CHECK(prefs.isKey(CONFIG_SNAPSHOT_KEY));
+  prefs.end();
+
+  // Same size, and no file date on the host : only the snapshot can bring back port=9123
+  restoreDefaults(false);
+  riot.setLogMotion(false);
+  char *edited = strdup(configText);
+  memcpy(strstr(edited, "port=9123"), "port=9124", 9);
+  writeConfig(edited);
+  free(edited);
+  CHECK(configFile.parseConfigFile());
+  CHECK_MSG(riot.getDestPort() == 9123, "port %u, snapshot not applied", riot.getDestPort());
+
+  int appliedSize = formatConfig(applied, sizeof(applied));
+  CHECK_MSG(appliedSize == parsedSize && !memcmp(parsed, applied, parsedSize), "parsed :\n%s\nsnapshot :\n%s", parsed, applied);
+  CHECK_MSG(riot.getStreams() == 0x0123, "streams 0x%04X", riot.getStreams());
+  CHECK(!riot.isLogMotion());
+
+  remove(CONFIG_FILE);
+  return TEST_RESULT();
+}
@@ -0,0 +1,135 @@
+// Fusion task -> network task handoff : SpscRing<motionSample> between two host threads. The records are
+// filled from their sequence number so that a torn or reordered read is caught by the consumer
+
+#include "riot.h"
+#include "test.h"
+#include <thread>
+#include <atomic>
+
+#define HANDOFF_RECORDS     2000000
+
+static void fillSample(motionSample &sample, uint32_t sequence) {
+  memset(&sample, 0, sizeof(sample));
+  sample.sequence = sequence;
+  sample.timestamp = sequence * 5;
+  sample.timestampUs = sequence * 5000;
+  for (int i = 0; i < RAW_FRAME_SIZE; i++)
+    sample.raw[i] = (int16_t)(sequence + i);
+  for (int i = 0; i < 4; i++)
+    sample.quat[i] = (float)(sequence & 0xFFFF) + i;
+  sample.bno055Quat[3] = (float)(sequence & 0xFFFF);   // last field
+}
+
+static bool checkSample(const motionSample &sample) {
+  motionSample expected;
+  fillSample(expected, sample.sequence);
+  return !memcmp(&sample, &expected, sizeof(sample));
+}
+
+// Blocking producer : every record must arrive, in order, intact
+static void testLossless() {
+  static SpscRing<motionSample, SAMPLE_RING_SIZE> ring;
+  uint32_t received = 0;
+  uint32_t torn = 0;
+  uint32_t outOfOrder = 0;
+
+  std::thread producer([]() {
+    motionSample sample;
+    for (uint32_t sequence = 0; sequence < HANDOFF_RECORDS; sequence++) {
+      fillSample(sample, sequence);
+      while (!ring.push(sample))
+        std::this_thread::yield();
+    }
+  });
+  motionSample sample;
+  while (received < HANDOFF_RECORDS) {
+    if (!ring.pop(sample)) {
+      std::this_thread::yield();
+      continue;
+    }
+    if (!checkSample(sample))
+      torn++;
+    if (sample.sequence != received)
+      outOfOrder++;
+    received++;
+  }
+  producer.join();
+  CHECK_MSG(torn == 0, "%u torn records", torn);
+  CHECK_MSG(outOfOrder == 0, "%u records out of order", outOfOrder);
+  CHECK(ring.isEmpty());
+  printf("lossless : %u records, %u overruns (retried)\n", received, ring.getOverruns());
+}
+
+// Like the fusion task : never waits, a full ring drops the record. Received + overruns = pushed and the
+// sequence only goes forward (the gaps are the drops)
+static void testDropping() {
+  static SpscRing<motionSample, SAMPLE_RING_SIZE> ring;
+  std::atomic<bool> done{false};
+  uint32_t received = 0;
+  uint32_t torn = 0;
+  uint32_t backwards = 0;
+  int64_t last = -1;
+
+  std::thread producer([&done]() {
+    motionSample sample;
+    for (uint32_t sequence = 0; sequence < HANDOFF_RECORDS; sequence++) {
+      fillSample(sample, sequence);
+      ring.push(sample);
+    }
+    done.store(true);
+  });
+  motionSample sample;
+  for (;;) {
+    if (!ring.pop(sample)) {
+      if (done.load() && ring.isEmpty())
+        break;
+      continue;
+    }
+    if (!checkSample(sample))
+      torn++;
+    if ((int64_t)sample.sequence <= last)
+      backwards++;
+    last = sample.sequence;
+    received++;
+  }
+  producer.join();
+  CHECK_MSG(torn == 0, "%u torn records", torn);
+  CHECK_MSG(backwards == 0, "%u records out of order", backwards);
+  CHECK_MSG(received + ring.getOverruns() == HANDOFF_RECORDS, "%u received + %u dropped", received, ring.getOverruns());
+  printf("dropping : %u records received, %u dropped\n", received, ring.getOverruns());
+}
+
+// flush() from the consumer while the producer runs (network down) : the ring keeps working afterwards
+static void testFlush() {
+  static SpscRing<motionSample, SAMPLE_RING_SIZE> ring;
+  std::atomic<bool> done{false};
+  uint32_t torn = 0;
+
+  std::thread producer([&done]() {
+    motionSample sample;
+    for (uint32_t sequence = 0; sequence < HANDOFF_RECORDS / 4; sequence++) {
+      fillSample(sample, sequence);
+      ring.push(sample);
+    }
+    done.store(true);
+  });
+  motionSample sample;
+  for (uint32_t i = 0; !done.load(); i++) {
+    if (i & 1)
+      ring.flush();
+    else if (ring.pop(sample) && !checkSample(sample))
+      torn++;
+  }
+  producer.join();
+  ring.flush();
+  CHECK(ring.isEmpty());
+  CHECK(ring.size() == 0);
+  CHECK_MSG(torn == 0, "%u torn records", torn);
+}
+
+int main() {
+  testLossless();
+  testDropping();
+  testFlush();
+  return TEST_RESULT();
+}
@@ -0,0 +1,106 @@
+// Receiver statistics (StreamStats.h, riot_stream_stats) on datagrams forged by the firmware : OSC bundles
+// from riotCore::forgeBundle() and binary frames from binaryFrame, several modules interleaved, with
+// known losses, reorders and arrival jitter
+
+#include "riot.h"
+#include "test.h"
+#include "StreamStats.h"
+#include <vector>
+
+#define FRAMES              100
+#define FRAME_SAMPLES       4
+#define SAMPLE_PERIOD       5000      // µs
+#define LATENCY             2000      // µs, constant part of the transit
+#define JITTERED_MODULE     3
+#define JITTER_SWING        100       // µs, +- on every other frame of the jittered module
+
+// Binary frames of FRAME_SAMPLES samples for module id
+static std::vector<std::vector<uint8_t>> forgeFrames(uint8_t id) {
+  std::vector<std::vector<uint8_t>> frames;
+  binaryFrame frame;
+
+  frame.begin(id, FRAME_SAMPLES);
+  for (uint32_t f = 0; f < FRAMES; f++) {
+    frame.rewind(f * FRAME_SAMPLES, STREAM_ALL);
+    for (int s = 0; s < FRAME_SAMPLES; s++)
+      frame.addSample()->timestamp = (f * FRAME_SAMPLES + s) * SAMPLE_PERIOD;
+    frames.emplace_back(frame.getBuffer(), frame.getBuffer() + frame.getSize());
+  }
+  frame.end();
+  return frames;
+}
+
+int main() {
+  streamStats stats;
+  motionSample sample;
+
+  riot.init();
+  motion.init();
+  riot.begin();     // OSC messages & bundle layout
+
+  // Module 1 : lossless, module 2 : frame 10 lost and frames 20 / 21 swapped, module 3 : arrival jitter
+  std::vector<std::vector<uint8_t>> frames[3] = {forgeFrames(1), forgeFrames(2), forgeFrames(JITTERED_MODULE)};
+  std::swap(frames[1][20], frames[1][21]);
+
+  for (uint32_t f = 0; f < FRAMES; f++) {
+    uint32_t arrival = (f * FRAME_SAMPLES + FRAME_SAMPLES - 1) * SAMPLE_PERIOD + LATENCY;
+    CHECK(stats.addDatagram(frames[0][f].data(), frames[0][f].size(), arrival));
+    if (f != 10)
+      CHECK(stats.addDatagram(frames[1][f].data(), frames[1][f].size(), arrival));
+    int swing = (f & 1) ? JITTER_SWING : -JITTER_SWING;
+    CHECK(stats.addDatagram(frames[2][f].data(), frames[2][f].size(), arrival + swing));
+
+    // OSC module : one bundle per sample, samples 50 to 52 lost
+    for (uint32_t s = f * FRAME_SAMPLES; s < (f + 1) * FRAME_SAMPLES; s++) {
+      if (s >= 50 && s <= 52)
+        continue;
+      memset(&sample, 0, sizeof(sample));
+      sample.sequence = s;
+      sample.timestampUs = s * SAMPLE_PERIOD;
+      riot.forgeBundle(sample);
+      CHECK(stats.addDatagram(bundleOSC.getBuffer(), bundleOSC.getSize(), sample.timestampUs + LATENCY));
+    }
+  }
+
+  CHECK_MSG(stats.getModuleCount() == 4, "%d modules", stats.getModuleCount());
+
+  const streamModuleStats *m = stats.getModule(1);
+  CHECK(m && m->packets == FRAMES && m->samples == FRAMES * FRAME_SAMPLES);
+  CHECK(m && !m->lost && !m->reordered && m->jitter < 1.0);
+  CHECK(m && m->bytes == FRAMES * (sizeof(riotFrameHeader) + FRAME_SAMPLES * sizeof(riotFrameSample)));
+
+  // The swapped frame is first seen as a loss, then taken back when it arrives late
+  m = stats.getModule(2);
+  CHECK(m && m->packets == FRAMES - 1 && m->samples == (FRAMES - 1) * FRAME_SAMPLES);
+  CHECK_MSG(m && m->lost == FRAME_SAMPLES, "%u lost", m ? m->lost : 0);
+  CHECK_MSG(m && m->reordered == FRAME_SAMPLES, "%u reordered", m ? m->reordered : 0);
+
+  // Transit time alternating by 2 x JITTER_SWING : the RFC 3550 estimator converges to it
+  m = stats.getModule(JITTERED_MODULE);
+  CHECK(m && !m->lost && !m->reordered);
+  CHECK_MSG(m && m->jitter > 0.9 * 2 * JITTER_SWING && m->jitter <= 2 * JITTER_SWING, "%.1f µs", m ? m->jitter : 0.0);
+
+  m = stats.getModule(riot.getID());
+  CHECK(m && m->packets == FRAMES * FRAME_SAMPLES - 3 && m->samples == m->packets);
+  CHECK_MSG(m && m->lost == 3 && !m->reordered && m->jitter < 1.0, "%u lost %u reordered", m ? m->lost : 0, m ? m->reordered : 0);
+
+  // Counter wrap is neither a loss nor a reorder
+  binaryFrame frame;
+  frame.begin(9, 1);
+  for (uint32_t sequence = 0xFFFFFFFE; sequence != 2; sequence++) {
+    frame.rewind(sequence, STREAM_ALL);
+    frame.addSample()->timestamp = sequence;
+    stats.addDatagram(frame.getBuffer(), frame.getSize(), sequence);
+  }
+  frame.end();
+  m = stats.getModule(9);
+  CHECK(m && m->samples == 4 && !m->lost && !m->reordered);
+
+  const uint8_t other[] = "/other/message\0\0,i\0\0\0\0\0\1";
+  CHECK(!stats.addDatagram(other, sizeof(other), 0));
+
+  stats.report(stdout, 1.0f);
+  m = stats.getModule(2);
+  CHECK(m && !m->packets && !m->samples && !m->bytes && !m->lost && !m->reordered);
+  return TEST_RESULT();
+}
@@ -0,0 +1,118 @@
+// R-IoT v3 binary frames (streamformat=1) to OSC-like messages - Node for Max script
+// Usage : [node.script riot_frame_expand.js <port>] then [script start]
+// Listens to the UDP port, decodes the frames (layout in src/src/RiotFrame.h) and outputs one list per
+// stream with the same address, values and units as the OSC bundle : the existing [route] / [OSC-route]
+// chains of riot-v3.maxpat keep working. Timestamps are output in ms like the OSC messages, the µs
+// timestamp and the sample counter are output as the /riot/v3/<id>/sequence message
+
+const maxApi = require("max-api");
+const dgram = require("dgram");
+
+const port = process.argv.length > 2 ? parseInt(process.argv[2]) : 8888;
+
+const HEADER_SIZE = 12;
+const SAMPLE_SIZE = 64;
+const VERSION = 1;
+
+// Quantization scales, see RiotFrame.h
+const ACC_SCALE = 200.0;
+const GYRO_SCALE = 900.0;
+const MAG_SCALE = 20.0;
+const QUAT_SCALE = 32767.0;
+const ANGLE_SCALE = 50.0;
+const PRESSURE_SCALE = 50.0;
+const ALTITUDE_SCALE = 5.0;
+const TEMP_SCALE = 100.0;
+const VOLTAGE_SCALE = 1000.0;
+const SOC_SCALE = 10000.0;
+
+// streams= bits (riot.h)
+const STREAM_ACCELEROMETER = 1 << 0;
+const STREAM_GYROSCOPE = 1 << 1;
+const STREAM_MAGNETOMETER = 1 << 2;
+const STREAM_BAROMETER = 1 << 3;
+const STREAM_TEMPERATURE = 1 << 4;
+const STREAM_QUATERNION = 1 << 5;
+const STREAM_EULER = 1 << 6;
+const STREAM_GRAVITY = 1 << 7;
+const STREAM_HEADING = 1 << 8;
+const STREAM_BATTERY = 1 << 10;
+const STREAM_ANALOG = 1 << 11;
+const STREAM_CONTROL = 1 << 12;
+
+const nextSequence = {};
+
+function vector(buf, offset, count, scale) {
+	const v = [];
+	for (let i = 0; i < count; i++)
+		v.push(buf.readInt16LE(offset + 2 * i) / scale);
+	return v;
+}
+
+// Same values as the int of the OSC battery message : 0 = unplugged, 1 = charging, 2 = finished, 3 = no battery
+function chargeState(flags) {
+	if (flags & 4)
+		return 1;
+	if (flags & 8)
+		return 2;
+	return (flags & 16) ? 3 : 0;
+}
+
+function expandSample(buf, offset, prefix, streams, sequence) {
+	const us = buf.readUInt32LE(offset);
+	const ms = Math.floor(us / 1000);
+	const flags = buf.readUInt8(offset + 62);
+
+	maxApi.outlet(prefix + "/sequence", sequence, us);
+	if (streams & STREAM_ACCELEROMETER)
+		maxApi.outlet(prefix + "/accelerometer", ...vector(buf, offset + 4, 3, ACC_SCALE), ms);
+	if (streams & STREAM_GYROSCOPE)
+		maxApi.outlet(prefix + "/gyroscope", ...vector(buf, offset + 10, 3, GYRO_SCALE), ms);
+	if (streams & STREAM_MAGNETOMETER)
+		maxApi.outlet(prefix + "/magnetometer", ...vector(buf, offset + 16, 3, MAG_SCALE), ms);
+	if (streams & STREAM_BAROMETER)
+		maxApi.outlet(prefix + "/barometer", buf.readUInt16LE(offset + 44) / PRESSURE_SCALE, buf.readInt16LE(offset + 46) / ALTITUDE_SCALE, ms);
+	if (streams & STREAM_TEMPERATURE)
+		maxApi.outlet(prefix + "/temperature", ...vector(buf, offset + 48, 3, TEMP_SCALE), ms);
+	if (streams & STREAM_QUATERNION)
+		maxApi.outlet(prefix + "/absoluteorientation/quaternion", ...vector(buf, offset + 22, 4, QUAT_SCALE), ms);
+	if (streams & STREAM_EULER)
+		maxApi.outlet(prefix + "/absoluteorientation/euler", ...vector(buf, offset + 30, 3, ANGLE_SCALE), ms);
+	if (streams & STREAM_GRAVITY)
+		maxApi.outlet(prefix + "/gravity", ...vector(buf, offset + 36, 3, ACC_SCALE), ms);
+	if (streams & STREAM_HEADING)
+		maxApi.outlet(prefix + "/heading", buf.readInt16LE(offset + 42) / ANGLE_SCALE, -1, -1, ms);
+	if (streams & STREAM_BATTERY)
+		maxApi.outlet(prefix + "/battery", buf.readInt16LE(offset + 60) / SOC_SCALE, chargeState(flags), ms);
+	if (streams & STREAM_ANALOG)
+		maxApi.outlet(prefix + "/analog", ...vector(buf, offset + 54, 3, VOLTAGE_SCALE), ms);
+	if (streams & STREAM_CONTROL)
+		maxApi.outlet(prefix + "/control/key", (flags & 1) ? 1 : 0, (flags & 2) ? 1 : 0, ms);
+}
+
+const socket = dgram.createSocket("udp4");
+
+socket.on("message", (buf) => {
+	if (buf.length < HEADER_SIZE || buf[0] != 0x52 || buf[1] != 0x46 || buf[2] != VERSION)
+		return;   // 'R' 'F' - OSC bundles or an other version
+	const id = buf.readUInt8(3);
+	const streams = buf.readUInt16LE(4);
+	const count = buf.readUInt16LE(6);
+	const sequence = buf.readUInt32LE(8);
+	if (buf.length < HEADER_SIZE + count * SAMPLE_SIZE)
+		return;
+
+	const prefix = "/riot/v3/" + id;
+	if (id in nextSequence && sequence != nextSequence[id])
+		maxApi.outlet(prefix + "/lost", (sequence - nextSequence[id]) >>> 0);
+	nextSequence[id] = (sequence + count) >>> 0;
+
+	for (let i = 0; i < count; i++)
+		expandSample(buf, HEADER_SIZE + i * SAMPLE_SIZE, prefix, streams, (sequence + i) >>> 0);
+});
+
+socket.on("listening", () => {
+	maxApi.post("riot_frame_expand listening on port " + port);
+});
+
+socket.bind(port);
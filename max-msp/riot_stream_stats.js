@@ -0,0 +1,146 @@
+// R-IoT v3 stream statistics - Node for Max script, or plain node for a loopback / bench test
+// Usage : [node.script riot_stream_stats.js <port> <period ms>] then [script start]
+//         node riot_stream_stats.js <port> <period ms>
+// Listens to the UDP port where any number of modules stream, OSC bundles (/sequence message,
+// streams bit 0x4000) or binary frames (streamformat=1), and reports for each module every period :
+//   id, packets/s, samples/s, kbytes/s, lost %, reordered, inter-arrival jitter (µs)
+// Loss and reorders come from the sample counter, the jitter from the µs acquisition time of the newest
+// sample of each packet against its arrival time (RFC 3550 estimator) : WiFi / network jitter, not the
+// sampling one nor the batching delay. host/riot_stream_stats.cpp is the same receiver in C++
+
+let maxApi = null;
+try {
+	maxApi = require("max-api");
+} catch (e) {
+}
+const dgram = require("dgram");
+
+const port = process.argv.length > 2 ? parseInt(process.argv[2]) : 8888;
+const period = process.argv.length > 3 ? parseInt(process.argv[3]) : 1000;
+
+const modules = {};
+
+function output(...values) {
+	if (maxApi)
+		maxApi.outlet("stats", ...values);
+	else
+		console.log(values.join("\t"));
+}
+
+function getModule(id) {
+	if (!(id in modules)) {
+		modules[id] = {
+			packets: 0, samples: 0, bytes: 0, lost: 0, reordered: 0,
+			next: null, jitter: 0, transit: null, newest: 0
+		};
+	}
+	return modules[id];
+}
+
+// Counter of one received sample
+function addSample(m, sequence) {
+	m.samples++;
+	if (m.next !== null) {
+		const gap = (sequence - m.next) | 0;   // signed, counters wrap on 32 bits
+		if (gap < 0) {
+			m.reordered++;
+			m.lost = Math.max(0, m.lost - 1);   // was counted lost when the gap was seen
+			return;
+		}
+		m.lost += gap;
+	}
+	m.next = (sequence + 1) >>> 0;
+}
+
+// Once per packet : µs acquisition time of its newest sample, arrival in µs
+function addTransit(m, timestamp, arrival) {
+	// The module and host clocks aren't synced : only the variation of the transit time counts
+	const transit = arrival - timestamp;
+	if (m.transit !== null) {
+		let d = ((transit - m.transit) | 0);
+		m.jitter += (Math.abs(d) - m.jitter) / 16;
+	}
+	m.transit = transit;
+}
+
+function readString(buf, offset) {
+	let end = offset;
+	while (end < buf.length && buf[end])
+		end++;
+	return { value: buf.toString("ascii", offset, end), next: (end + 4) & ~3 };
+}
+
+// Walks the bundle elements for the /sequence messages (several with batchsize > 1)
+function parseBundle(buf) {
+	let offset = 16;   // #bundle + timetag
+	let m = null;
+	while (offset + 4 <= buf.length) {
+		const size = buf.readInt32BE(offset);
+		const start = offset + 4;
+		offset = start + size;
+		if (size <= 0 || offset > buf.length)
+			break;
+		const address = readString(buf, start);
+		if (!address.value.endsWith("/sequence"))
+			continue;
+		const fields = address.value.split("/");   // "", riot, v3, id, sequence
+		m = getModule(fields[3]);
+		const tags = readString(buf, address.next);
+		addSample(m, buf.readUInt32BE(tags.next));
+		m.newest = buf.readUInt32BE(tags.next + 4);
+	}
+	return m;
+}
+
+function parseFrame(buf) {
+	if (buf.length < 12 || buf[2] != 1)
+		return null;
+	const m = getModule(buf.readUInt8(3));
+	const count = buf.readUInt16LE(6);
+	const sequence = buf.readUInt32LE(8);
+	let i = 0;
+	for (; i < count && 12 + (i + 1) * 64 <= buf.length; i++)
+		addSample(m, (sequence + i) >>> 0);
+	if (!i)
+		return null;
+	m.newest = buf.readUInt32LE(12 + (i - 1) * 64);
+	return m;
+}
+
+const socket = dgram.createSocket("udp4");
+
+socket.on("message", (buf) => {
+	const arrival = Number(process.hrtime.bigint() / 1000n) >>> 0;
+	let m = null;
+	if (buf.length >= 16 && buf.toString("ascii", 0, 7) == "#bundle")
+		m = parseBundle(buf);
+	else if (buf.length >= 2 && buf[0] == 0x52 && buf[1] == 0x46)   // 'R' 'F'
+		m = parseFrame(buf);
+	if (!m)
+		return;   // no /sequence in the bundle (streams=) or not a R-IoT packet
+	m.packets++;
+	m.bytes += buf.length;
+	addTransit(m, m.newest, arrival);
+});
+
+socket.on("listening", () => {
+	const text = "riot_stream_stats listening on port " + port;
+	if (maxApi)
+		maxApi.post(text);
+	else
+		console.log(text + "\nid\tpkt/s\tsmp/s\tkB/s\tlost %\treorder\tjitter µs");
+});
+
+setInterval(() => {
+	const seconds = period / 1000;
+	for (const id in modules) {
+		const m = modules[id];
+		const expected = m.samples + m.lost;
+		output(id, (m.packets / seconds).toFixed(1), (m.samples / seconds).toFixed(1),
+			(m.bytes / 1024 / seconds).toFixed(2), expected ? (100 * m.lost / expected).toFixed(2) : 0,
+			m.reordered, Math.round(m.jitter));
+		m.packets = m.samples = m.bytes = m.lost = m.reordered = 0;
+	}
+}, period);
+
+socket.bind(port);
@@ -0,0 +1,82 @@
+// R-IoT v3 clock sync server (simplified NTP over OSC) - Node for Max script, or plain node
+// Usage : [node.script riot_sync_server.js <port>] then [script start]
+//         node riot_sync_server.js <port>
+// Set syncport=<port> on the modules (same host as their destination IP). Each module sends
+// /riot/v3/<id>/sync <n> from its receive port, the server answers to that address with
+// /sync <n> <t2 seconds> <t2 fraction> <t3 seconds> <t3 fraction> : its NTP receive and transmit
+// times. The modules then stamp their OSC bundles with time tags of this host clock
+// (see src/src/ClockSync.h), so that 20+ modules can be aligned on the receiving side
+
+let maxApi = null;
+try {
+	maxApi = require("max-api");
+} catch (e) {
+}
+const dgram = require("dgram");
+
+const port = process.argv.length > 2 ? parseInt(process.argv[2]) : 8889;
+
+const NTP_UNIX_OFFSET = 2208988800n;   // seconds from 1900 to 1970
+
+// Wall clock at start then the monotonic clock : µs resolution, no steps
+const startWall = BigInt(Date.now()) * 1000n;
+const startMono = process.hrtime.bigint() / 1000n;
+
+function ntpNow() {
+	const us = startWall + process.hrtime.bigint() / 1000n - startMono;
+	const seconds = us / 1000000n + NTP_UNIX_OFFSET;
+	const fraction = ((us % 1000000n) << 32n) / 1000000n;
+	return [Number(seconds & 0xFFFFFFFFn), Number(fraction)];
+}
+
+function log(text) {
+	if (maxApi)
+		maxApi.post(text);
+	else
+		console.log(text);
+}
+
+function pad(text) {
+	const buf = Buffer.alloc((text.length + 4) & ~3);
+	buf.write(text, "ascii");
+	return buf;
+}
+
+const socket = dgram.createSocket("udp4");
+const modules = {};
+
+socket.on("message", (buf, remote) => {
+	const t2 = ntpNow();
+	// /riot/v3/<id>/sync ,i <n>
+	const end = buf.indexOf(0);
+	if (end < 0 || buf.length < 8)
+		return;
+	const address = buf.toString("ascii", 0, end);
+	if (!address.endsWith("/sync"))
+		return;
+	const tags = (end + 4) & ~3;
+	if (buf.toString("ascii", tags, tags + 2) != ",i" || buf.length < tags + 8)
+		return;
+	const sequence = buf.readUInt32BE(tags + 4);
+
+	const answer = Buffer.concat([pad("/sync"), pad(",iiiii"), Buffer.alloc(20)]);
+	const args = answer.length - 20;
+	answer.writeUInt32BE(sequence, args);
+	answer.writeUInt32BE(t2[0], args + 4);
+	answer.writeUInt32BE(t2[1], args + 8);
+	const t3 = ntpNow();
+	answer.writeUInt32BE(t3[0], args + 12);
+	answer.writeUInt32BE(t3[1], args + 16);
+	socket.send(answer, remote.port, remote.address);
+
+	if (!(address in modules)) {
+		modules[address] = true;
+		log("riot_sync_server : " + address + " from " + remote.address + ":" + remote.port);
+	}
+});
+
+socket.on("listening", () => {
+	log("riot_sync_server listening on port " + port);
+});
+
+socket.bind(port);
@@ -0,0 +1,680 @@
+// Orientation filters (AHRS) - see ahrs.h
+
+#include "ahrs.h"
+
+// Integrates the rate of change of the quaternion and normalises it
+void AhrsEngine::integrate(float q[4], float qDot1, float qDot2, float qDot3, float qDot4, float dt) {
+  q[0] += qDot1 * dt;
+  q[1] += qDot2 * dt;
+  q[2] += qDot3 * dt;
+  q[3] += qDot4 * dt;
+  normalise(q);
+}
+
+void AhrsEngine::normalise(float q[4]) {
+  float recipNorm = accurateinvSqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+  q[0] *= recipNorm;
+  q[1] *= recipNorm;
+  q[2] *= recipNorm;
+  q[3] *= recipNorm;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Implementation of Sebastian Madgwick's "...efficient orientation filter for... inertial/magnetic sensor arrays"
+// (see http://www.x-io.co.uk/category/open-source/ for examples and more details)
+// which fuses acceleration, rotation rate, and magnetic moments to produce a quaternion-based estimate of absolute
+// device orientation -- which can be converted to yaw, pitch, and roll. 
+void MadgwickAhrs::update(float q[4], float ax, float ay, float az, float gx, float gy, float gz, float mx, float my, float mz, float dt) {
+  float q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+  float recipNorm;
+  float s0, s1, s2, s3;
+  float qDot1, qDot2, qDot3, qDot4;
+  float hx, hy;
+  float _2q0mx, _2q0my, _2q0mz, _2q1mx, _2bx, _2bz, _4bx, _4bz, _8bx, _8bz, _2q0, _2q1, _2q2, _2q3, _2q0q2, _2q2q3;
+  float q0q0, q0q1, q0q2, q0q3, q1q1, q1q2, q1q3, q2q2, q2q3, q3q3;
+
+  // Use IMU algorithm if magnetometer measurement invalid (avoids NaN in magnetometer normalisation)
+  if((mx == 0.0f) && (my == 0.0f) && (mz == 0.0f)) {
+    //Serial.println("Mag data invalid - no update");
+    updateIMU(q, ax, ay, az, gx, gy, gz, dt);
+    return;
+  }
+
+  // Convert gyroscope degrees/sec to radians/sec
+  gx *= DEG_TO_RAD;
+  gy *= DEG_TO_RAD;
+  gz *= DEG_TO_RAD;
+
+  // Rate of change of quaternion from gyroscope
+  qDot1 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
+  qDot2 = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
+  qDot3 = 0.5f * (q0 * gy - q1 * gz + q3 * gx);
+  qDot4 = 0.5f * (q0 * gz + q1 * gy - q2 * gx);
+
+  // Compute feedback only if accelerometer measurement valid (avoids NaN in accelerometer normalisation)
+  if(!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f))) {
+
+    // Normalise accelerometer measurement
+    recipNorm = accurateinvSqrt(ax * ax + ay * ay + az * az);
+    ax *= recipNorm;
+    ay *= recipNorm;
+    az *= recipNorm;   
+
+    // Normalise magnetometer measurement
+    recipNorm = accurateinvSqrt(mx * mx + my * my + mz * mz); 
+    mx *= recipNorm;
+    my *= recipNorm;
+    mz *= recipNorm;
+
+    // Auxiliary variables to avoid repeated arithmetic
+    _2q0mx = 2.0f * q0 * mx;
+    _2q0my = 2.0f * q0 * my;
+    _2q0mz = 2.0f * q0 * mz;
+    _2q1mx = 2.0f * q1 * mx;
+    _2q0 = 2.0f * q0;
+    _2q1 = 2.0f * q1;
+    _2q2 = 2.0f * q2;
+    _2q3 = 2.0f * q3;
+    _2q0q2 = 2.0f * q0 * q2;
+    _2q2q3 = 2.0f * q2 * q3;
+    q0q0 = q0 * q0;
+    q0q1 = q0 * q1;
+    q0q2 = q0 * q2;
+    q0q3 = q0 * q3;
+    q1q1 = q1 * q1;
+    q1q2 = q1 * q2;
+    q1q3 = q1 * q3;
+    q2q2 = q2 * q2;
+    q2q3 = q2 * q3;
+    q3q3 = q3 * q3;
+
+
+    // Reference direction of Earth's magnetic field
+    hx = mx * q0q0 - _2q0my * q3 + _2q0mz * q2 + mx * q1q1 + _2q1 * my * q2 + _2q1 * mz * q3 - mx * q2q2 - mx * q3q3;
+    hy = _2q0mx * q3 + my * q0q0 - _2q0mz * q1 + _2q1mx * q2 - my * q1q1 + my * q2q2 + _2q2 * mz * q3 - my * q3q3;
+    _2bx = sqrtf(hx * hx + hy * hy);
+    _2bz = -_2q0mx * q2 + _2q0my * q1 + mz * q0q0 + _2q1mx * q3 - mz * q1q1 + _2q2 * my * q3 - mz * q2q2 + mz * q3q3;
+    _4bx = 2.0f * _2bx;
+    _4bz = 2.0f * _2bz;
+     // Correction / addon
+    _8bx = 2.0f * _4bx;
+    _8bz = 2.0f * _4bz;
+
+    // Gradient decent algorithm corrective step
+    // Commented = old algo with errors
+    //s0 = -_2q2 * (2.0f * q1q3 - _2q0q2 - ax) + _2q1 * (2.0f * q0q1 + _2q2q3 - ay) - _2bz * q2 * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (-_2bx * q3 + _2bz * q1) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + _2bx * q2 * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
+    s0 = -_2q2 * (2.0f * q1q3 - _2q0q2 - ax) + _2q1 * (2.0f * q0q1 + _2q2q3 - ay) - _4bz * q2 * (_4bx * (0.5f - q2q2 - q3q3) + _4bz * (q1q3 - q0q2) - mx) + (-_4bx * q3 + _4bz * q1) * (_4bx * (q1q2 - q0q3) + _4bz * (q0q1 + q2q3) - my) + _4bx * q2 * (_4bx * (q0q2 + q1q3) + _4bz * (0.5f - q1q1 - q2q2) - mz);
+    //s1 = _2q3 * (2.0f * q1q3 - _2q0q2 - ax) + _2q0 * (2.0f * q0q1 + _2q2q3 - ay) - 4.0f * q1 * (1.0f - 2.0f * q1q1 - 2.0f * q2q2 - az) + _2bz * q3 * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (_2bx * q2 + _2bz * q0) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + (_2bx * q3 - _4bz * q1) * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
+    s1 = _2q3 * (2.0f * q1q3 - _2q0q2 - ax) + _2q0 * (2.0f * q0q1 + _2q2q3 - ay) - 4.0f * q1 * (1.0f - 2.0f * q1q1 - 2.0f * q2q2 - az) + _4bz * q3 * (_4bx * (0.5f - q2q2 - q3q3) + _4bz * (q1q3 - q0q2) - mx) + (_4bx * q2 + _4bz * q0) * (_4bx * (q1q2 - q0q3) + _4bz * (q0q1 + q2q3) - my) + (_4bx * q3 - _8bz * q1) * (_4bx * (q0q2 + q1q3) + _4bz * (0.5f - q1q1 - q2q2) - mz);
+    //s2 = -_2q0 * (2.0f * q1q3 - _2q0q2 - ax) + _2q3 * (2.0f * q0q1 + _2q2q3 - ay) - 4.0f * q2 * (1.0f - 2.0f * q1q1 - 2.0f * q2q2 - az) + (-_4bx * q2 - _2bz * q0) * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (_2bx * q1 + _2bz * q3) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + (_2bx * q0 - _4bz * q2) * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
+    s2 = -_2q0 * (2.0f * q1q3 - _2q0q2 - ax) + _2q3 * (2.0f * q0q1 + _2q2q3 - ay) - 4.0f * q2 * (1.0f - 2.0f * q1q1 - 2.0f * q2q2 - az) + (-_8bx * q2 - _4bz * q0) * (_4bx * (0.5f - q2q2 - q3q3) + _4bz * (q1q3 - q0q2) - mx) + (_4bx * q1 + _4bz * q3) * (_4bx * (q1q2 - q0q3) + _4bz * (q0q1 + q2q3) - my) + (_4bx * q0 - _8bz * q2) * (_4bx * (q0q2 + q1q3) + _4bz * (0.5f - q1q1 - q2q2) - mz);
+    //s3 = _2q1 * (2.0f * q1q3 - _2q0q2 - ax) + _2q2 * (2.0f * q0q1 + _2q2q3 - ay) + (-_4bx * q3 + _2bz * q1) * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (-_2bx * q0 + _2bz * q2) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + _2bx * q1 * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
+    s3 = _2q1 * (2.0f * q1q3 - _2q0q2 - ax) + _2q2 * (2.0f * q0q1 + _2q2q3 - ay) + (-_8bx * q3 + _4bz * q1) * (_4bx * (0.5f - q2q2 - q3q3) + _4bz * (q1q3 - q0q2) - mx) + (-_4bx * q0 + _4bz * q2) * (_4bx * (q1q2 - q0q3) + _4bz * (q0q1 + q2q3) - my) + _4bx * q1 * (_4bx * (q0q2 + q1q3) + _4bz * (0.5f - q1q1 - q2q2) - mz); 
+    
+    recipNorm = accurateinvSqrt(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3); // normalise step magnitude
+    s0 *= recipNorm;
+    s1 *= recipNorm;
+    s2 *= recipNorm;
+    s3 *= recipNorm;
+
+    // Apply feedback step
+    qDot1 -= beta * s0;
+    qDot2 -= beta * s1;
+    qDot3 -= beta * s2;
+    qDot4 -= beta * s3;
+  }
+
+  // Integrate rate of change of quaternion to yield quaternion
+  integrate(q, qDot1, qDot2, qDot3, qDot4, dt);
+}
+
+// AHRS with no Mag when not available or NaN detected
+void MadgwickAhrs::updateIMU(float q[4], float ax, float ay, float az, float gx, float gy, float gz, float dt) {
+  float q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+  float recipNorm;
+  float s0, s1, s2, s3;
+  float qDot1, qDot2, qDot3, qDot4;
+  float _2q0, _2q1, _2q2, _2q3, _4q0, _4q1, _4q2, _8q1, _8q2, q0q0, q1q1, q2q2, q3q3;
+
+  // Convert gyroscope degrees/sec to radians/sec
+  gx *= DEG_TO_RAD;
+  gy *= DEG_TO_RAD;
+  gz *= DEG_TO_RAD;
+
+  // Rate of change of quaternion from gyroscope
+  qDot1 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
+  qDot2 = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
+  qDot3 = 0.5f * (q0 * gy - q1 * gz + q3 * gx);
+  qDot4 = 0.5f * (q0 * gz + q1 * gy - q2 * gx);
+
+  // Compute feedback only if accelerometer measurement valid (avoids NaN in accelerometer normalisation)
+  if(!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f))) {
+
+    // Normalise accelerometer measurement
+    recipNorm = accurateinvSqrt(ax * ax + ay * ay + az * az);
+    ax *= recipNorm;
+    ay *= recipNorm;
+    az *= recipNorm;
+
+    // Auxiliary variables to avoid repeated arithmetic
+    _2q0 = 2.0f * q0;
+    _2q1 = 2.0f * q1;
+    _2q2 = 2.0f * q2;
+    _2q3 = 2.0f * q3;
+    _4q0 = 4.0f * q0;
+    _4q1 = 4.0f * q1;
+    _4q2 = 4.0f * q2;
+    _8q1 = 8.0f * q1;
+    _8q2 = 8.0f * q2;
+    q0q0 = q0 * q0;
+    q1q1 = q1 * q1;
+    q2q2 = q2 * q2;
+    q3q3 = q3 * q3;
+
+    // Gradient decent algorithm corrective step
+    s0 = _4q0 * q2q2 + _2q2 * ax + _4q0 * q1q1 - _2q1 * ay;
+    s1 = _4q1 * q3q3 - _2q3 * ax + 4.0f * q0q0 * q1 - _2q0 * ay - _4q1 + _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * az;
+    s2 = 4.0f * q0q0 * q2 + _2q0 * ax + _4q2 * q3q3 - _2q3 * ay - _4q2 + _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * az;
+    s3 = 4.0f * q1q1 * q3 - _2q1 * ax + 4.0f * q2q2 * q3 - _2q2 * ay;
+    
+    recipNorm = accurateinvSqrt(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3); // normalise step magnitude
+    s0 *= recipNorm;
+    s1 *= recipNorm;
+    s2 *= recipNorm;
+    s3 *= recipNorm;
+
+    // Apply feedback step
+    qDot1 -= beta * s0;
+    qDot2 -= beta * s1;
+    qDot3 -= beta * s2;
+    qDot4 -= beta * s3;
+  }
+
+  // Integrate rate of change of quaternion to yield quaternion
+  integrate(q, qDot1, qDot2, qDot3, qDot4, dt);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Mahony's filter, after Madgwick's open source implementation (x-io.co.uk). The orientation error is the cross
+// product between the measured and estimated directions of gravity and magnetic field, fed back to the gyros
+// through a PI controller. No gradient to normalise => about half the float operations of the above
+void MahonyAhrs::update(float q[4], float ax, float ay, float az, float gx, float gy, float gz, float mx, float my, float mz, float dt) {
+  float q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+  float recipNorm;
+  float q0q0, q0q1, q0q2, q0q3, q1q1, q1q2, q1q3, q2q2, q2q3, q3q3;
+  float hx, hy, bx, bz;
+  float halfvx, halfvy, halfvz, halfwx, halfwy, halfwz;
+  float halfex, halfey, halfez;
+
+  // Use IMU algorithm if magnetometer measurement invalid (avoids NaN in magnetometer normalisation)
+  if((mx == 0.0f) && (my == 0.0f) && (mz == 0.0f)) {
+    updateIMU(q, ax, ay, az, gx, gy, gz, dt);
+    return;
+  }
+
+  // Convert gyroscope degrees/sec to radians/sec
+  gx *= DEG_TO_RAD;
+  gy *= DEG_TO_RAD;
+  gz *= DEG_TO_RAD;
+
+  // Compute feedback only if accelerometer measurement valid (avoids NaN in accelerometer normalisation)
+  if(!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f))) {
+
+    // Normalise accelerometer measurement
+    recipNorm = accurateinvSqrt(ax * ax + ay * ay + az * az);
+    ax *= recipNorm;
+    ay *= recipNorm;
+    az *= recipNorm;
+
+    // Normalise magnetometer measurement
+    recipNorm = accurateinvSqrt(mx * mx + my * my + mz * mz);
+    mx *= recipNorm;
+    my *= recipNorm;
+    mz *= recipNorm;
+
+    // Auxiliary variables to avoid repeated arithmetic
+    q0q0 = q0 * q0;
+    q0q1 = q0 * q1;
+    q0q2 = q0 * q2;
+    q0q3 = q0 * q3;
+    q1q1 = q1 * q1;
+    q1q2 = q1 * q2;
+    q1q3 = q1 * q3;
+    q2q2 = q2 * q2;
+    q2q3 = q2 * q3;
+    q3q3 = q3 * q3;
+
+    // Reference direction of Earth's magnetic field
+    hx = 2.0f * (mx * (0.5f - q2q2 - q3q3) + my * (q1q2 - q0q3) + mz * (q1q3 + q0q2));
+    hy = 2.0f * (mx * (q1q2 + q0q3) + my * (0.5f - q1q1 - q3q3) + mz * (q2q3 - q0q1));
+    bx = sqrtf(hx * hx + hy * hy);
+    bz = 2.0f * (mx * (q1q3 - q0q2) + my * (q2q3 + q0q1) + mz * (0.5f - q1q1 - q2q2));
+
+    // Estimated direction of gravity and magnetic field
+    halfvx = q1q3 - q0q2;
+    halfvy = q0q1 + q2q3;
+    halfvz = q0q0 - 0.5f + q3q3;
+    halfwx = bx * (0.5f - q2q2 - q3q3) + bz * (q1q3 - q0q2);
+    halfwy = bx * (q1q2 - q0q3) + bz * (q0q1 + q2q3);
+    halfwz = bx * (q0q2 + q1q3) + bz * (0.5f - q1q1 - q2q2);
+
+    // Error is sum of cross product between estimated direction and measured direction of field vectors
+    halfex = (ay * halfvz - az * halfvy) + (my * halfwz - mz * halfwy);
+    halfey = (az * halfvx - ax * halfvz) + (mz * halfwx - mx * halfwz);
+    halfez = (ax * halfvy - ay * halfvx) + (mx * halfwy - my * halfwx);
+
+    feedback(gx, gy, gz, halfex, halfey, halfez, dt);
+  }
+
+  // Rate of change of quaternion from the corrected gyroscope
+  integrate(q, 0.5f * (-q1 * gx - q2 * gy - q3 * gz),
+               0.5f * (q0 * gx + q2 * gz - q3 * gy),
+               0.5f * (q0 * gy - q1 * gz + q3 * gx),
+               0.5f * (q0 * gz + q1 * gy - q2 * gx), dt);
+}
+
+void MahonyAhrs::updateIMU(float q[4], float ax, float ay, float az, float gx, float gy, float gz, float dt) {
+  float q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+  float recipNorm;
+  float halfvx, halfvy, halfvz;
+
+  // Convert gyroscope degrees/sec to radians/sec
+  gx *= DEG_TO_RAD;
+  gy *= DEG_TO_RAD;
+  gz *= DEG_TO_RAD;
+
+  // Compute feedback only if accelerometer measurement valid (avoids NaN in accelerometer normalisation)
+  if(!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f))) {
+
+    // Normalise accelerometer measurement
+    recipNorm = accurateinvSqrt(ax * ax + ay * ay + az * az);
+    ax *= recipNorm;
+    ay *= recipNorm;
+    az *= recipNorm;
+
+    // Estimated direction of gravity
+    halfvx = q1 * q3 - q0 * q2;
+    halfvy = q0 * q1 + q2 * q3;
+    halfvz = q0 * q0 - 0.5f + q3 * q3;
+
+    // Error is cross product between estimated and measured direction of gravity
+    feedback(gx, gy, gz, ay * halfvz - az * halfvy, az * halfvx - ax * halfvz, ax * halfvy - ay * halfvx, dt);
+  }
+
+  integrate(q, 0.5f * (-q1 * gx - q2 * gy - q3 * gz),
+               0.5f * (q0 * gx + q2 * gz - q3 * gy),
+               0.5f * (q0 * gy - q1 * gz + q3 * gx),
+               0.5f * (q0 * gz + q1 * gy - q2 * gx), dt);
+}
+
+// PI controller : integral (gyro bias) then proportional feedback applied to the gyros
+void MahonyAhrs::feedback(float &gx, float &gy, float &gz, float halfex, float halfey, float halfez, float dt) {
+  if(twoKi > 0.0f) {
+    integralFBx += twoKi * halfex * dt;
+    integralFBy += twoKi * halfey * dt;
+    integralFBz += twoKi * halfez * dt;
+    gx += integralFBx;
+    gy += integralFBy;
+    gz += integralFBz;
+  }
+  else {
+    integralFBx = integralFBy = integralFBz = 0.0f;
+  }
+  gx += twoKp * halfex;
+  gy += twoKp * halfey;
+  gz += twoKp * halfez;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Complementary filter : gyro integration, then a small rotation removing alpha x the tilt error (body frame,
+// acc vs. estimated gravity) and alpha x the heading error (earth frame, horizontal mag vs. North). The mag
+// only acts on the yaw, so a disturbed mag can't tilt the orientation
+void ComplementaryAhrs::update(float q[4], float ax, float ay, float az, float gx, float gy, float gz, float mx, float my, float mz, float dt) {
+  float q0, q1, q2, q3;
+  float hx, hy, recipNorm, halfAngle;
+
+  updateIMU(q, ax, ay, az, gx, gy, gz, dt);
+  if((mx == 0.0f) && (my == 0.0f) && (mz == 0.0f))
+    return;
+
+  q0 = q[0];
+  q1 = q[1];
+  q2 = q[2];
+  q3 = q[3];
+
+  // Horizontal components of the mag in the earth frame (NWU : North is X)
+  hx = mx * (q0 * q0 + q1 * q1 - q2 * q2 - q3 * q3) + 2.0f * (my * (q1 * q2 - q0 * q3) + mz * (q1 * q3 + q0 * q2));
+  hy = my * (q0 * q0 - q1 * q1 + q2 * q2 - q3 * q3) + 2.0f * (mx * (q1 * q2 + q0 * q3) + mz * (q2 * q3 - q0 * q1));
+  if((hx == 0.0f) && (hy == 0.0f))
+    return;
+
+  // sin(heading error) = hy / |h|, the estimate is rotated back about the earth vertical axis (left product)
+  recipNorm = accurateinvSqrt(hx * hx + hy * hy);
+  halfAngle = -0.5f * alpha * hy * recipNorm;
+  q[0] = q0 - halfAngle * q3;
+  q[1] = q1 - halfAngle * q2;
+  q[2] = q2 + halfAngle * q1;
+  q[3] = q3 + halfAngle * q0;
+  normalise(q);
+}
+
+void ComplementaryAhrs::updateIMU(float q[4], float ax, float ay, float az, float gx, float gy, float gz, float dt) {
+  float q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+  float recipNorm;
+  float vx, vy, vz;
+
+  // Convert gyroscope degrees/sec to radians/sec
+  gx *= DEG_TO_RAD;
+  gy *= DEG_TO_RAD;
+  gz *= DEG_TO_RAD;
+
+  integrate(q, 0.5f * (-q1 * gx - q2 * gy - q3 * gz),
+               0.5f * (q0 * gx + q2 * gz - q3 * gy),
+               0.5f * (q0 * gy - q1 * gz + q3 * gx),
+               0.5f * (q0 * gz + q1 * gy - q2 * gx), dt);
+
+  if((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f))
+    return;
+
+  recipNorm = accurateinvSqrt(ax * ax + ay * ay + az * az);
+  ax *= recipNorm;
+  ay *= recipNorm;
+  az *= recipNorm;
+
+  // Estimated direction of gravity in the body frame
+  q0 = q[0];
+  q1 = q[1];
+  q2 = q[2];
+  q3 = q[3];
+  vx = 2.0f * (q1 * q3 - q0 * q2);
+  vy = 2.0f * (q0 * q1 + q2 * q3);
+  vz = 2.0f * (q0 * q0 + q3 * q3) - 1.0f;
+
+  // Tilt error = measured x estimated gravity
+  rotate(q, ay * vz - az * vy, az * vx - ax * vz, ax * vy - ay * vx);
+}
+
+// q = q x (1, alpha * e / 2) : small rotation of alpha x e radians in the body frame
+void ComplementaryAhrs::rotate(float q[4], float ex, float ey, float ez) {
+  float q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+  float hx = 0.5f * alpha * ex;
+  float hy = 0.5f * alpha * ey;
+  float hz = 0.5f * alpha * ez;
+
+  q[0] = q0 - q1 * hx - q2 * hy - q3 * hz;
+  q[1] = q1 + q0 * hx + q2 * hz - q3 * hy;
+  q[2] = q2 + q0 * hy - q1 * hz + q3 * hx;
+  q[3] = q3 + q0 * hz + q1 * hy - q2 * hx;
+  normalise(q);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Fixed point Madgwick. Same equations as MadgwickAhrs::update() / updateIMU() above, constants multiplications
+// by 2, 4 or 8 being shifts. The normalisations can't square values of any magnitude in fixed point, so vectors are
+// first scaled by a power of 2 (prescale()) to get their largest component within [0.5;1[, which doesn't change
+// their direction and keeps the sum of squares within [0.25;4[ for the inverse square root
+template<int FRAC>
+void MadgwickAhrsQ<FRAC>::update(float q[4], float ax, float ay, float az, float gx, float gy, float gz, float mx, float my, float mz, float dt) {
+  Q a[3], w[3], m[3];
+  bool accValid = toDirection(ax, ay, az, a);
+
+  toRadians(gx, gy, gz, w);
+  // Use IMU algorithm if magnetometer measurement invalid
+  if(!toDirection(mx, my, mz, m))
+    updateIMUQ(q, accValid ? a : NULL, w, dt);
+  else
+    updateQ(q, accValid ? a : NULL, w, m, dt);
+}
+
+template<int FRAC>
+void MadgwickAhrsQ<FRAC>::updateIMU(float q[4], float ax, float ay, float az, float gx, float gy, float gz, float dt) {
+  Q a[3], w[3];
+  bool accValid = toDirection(ax, ay, az, a);
+
+  toRadians(gx, gy, gz, w);
+  updateIMUQ(q, accValid ? a : NULL, w, dt);
+}
+
+// Raw sensors data, biases removed : the gyro gets to rad/s with the integer gain, the mag goes through the
+// soft iron matrix (keeping 8 bits below the LSB), then acc & mag are normalised as they are
+template<int FRAC>
+void MadgwickAhrsQ<FRAC>::updateRaw(float q[4], const int32_t acc[3], const int32_t gyro[3], const int32_t mag[3], const qCalibration<FRAC> &cal, float dt) {
+  const int gainShift = QCAL_GAIN_FRAC - FRAC;
+  Q a[3], w[3], m[3];
+  int64_t sum;
+
+  for(int i = 0 ; i < 3 ; i++) {
+    w[i] = Q::raw((int32_t)(((int64_t)gyro[i] * cal.gyroGain + (1LL << (gainShift - 1))) >> gainShift));
+    a[i] = Q::raw(acc[i]);
+    sum = 0;
+    for(int j = 0 ; j < 3 ; j++)
+      sum += (int64_t)cal.softIron[i][j].v * mag[j];
+    m[i] = Q::raw((int32_t)(sum >> (FRAC - 8)));
+  }
+  bool accValid = normaliseQ(a, 3);
+  if(!normaliseQ(m, 3))
+    updateIMUQ(q, accValid ? a : NULL, w, dt);
+  else
+    updateQ(q, accValid ? a : NULL, w, m, dt);
+}
+
+// a : unit acc, NULL when invalid (no feedback), w : gyros in rad/s, m : unit mag
+template<int FRAC>
+void MadgwickAhrsQ<FRAC>::updateQ(float q[4], const Q *a, const Q w[3], const Q m[3], float dt) {
+  Q qs[4] = {Q(q[0]), Q(q[1]), Q(q[2]), Q(q[3])};
+  Q q0 = qs[0], q1 = qs[1], q2 = qs[2], q3 = qs[3];
+  Q s[4], qDot[4];
+  Q wx = w[0], wy = w[1], wz = w[2];
+  Q hx, hy;
+  Q _2q0mx, _2q0my, _2q0mz, _2q1mx, _2bz, _4bx, _4bz, _8bx, _8bz, _2q0, _2q1, _2q2, _2q3, _2q0q2, _2q2q3;
+  Q q0q0, q0q1, q0q2, q0q3, q1q1, q1q2, q1q3, q2q2, q2q3, q3q3;
+  const Q half(0.5f), one(1.0f);
+
+  // Rate of change of quaternion from gyroscope
+  qDot[0] = (-q1 * wx - q2 * wy - q3 * wz) >> 1;
+  qDot[1] = (q0 * wx + q2 * wz - q3 * wy) >> 1;
+  qDot[2] = (q0 * wy - q1 * wz + q3 * wx) >> 1;
+  qDot[3] = (q0 * wz + q1 * wy - q2 * wx) >> 1;
+
+  // Compute feedback only if accelerometer measurement valid
+  if(a) {
+
+    // Auxiliary variables to avoid repeated arithmetic
+    _2q0mx = (q0 * m[0]) << 1;
+    _2q0my = (q0 * m[1]) << 1;
+    _2q0mz = (q0 * m[2]) << 1;
+    _2q1mx = (q1 * m[0]) << 1;
+    _2q0 = q0 << 1;
+    _2q1 = q1 << 1;
+    _2q2 = q2 << 1;
+    _2q3 = q3 << 1;
+    q0q0 = q0 * q0;
+    q0q1 = q0 * q1;
+    q0q2 = q0 * q2;
+    q0q3 = q0 * q3;
+    q1q1 = q1 * q1;
+    q1q2 = q1 * q2;
+    q1q3 = q1 * q3;
+    q2q2 = q2 * q2;
+    q2q3 = q2 * q3;
+    q3q3 = q3 * q3;
+    _2q0q2 = q0q2 << 1;
+    _2q2q3 = q2q3 << 1;
+
+    // Reference direction of Earth's magnetic field
+    hx = m[0] * q0q0 - _2q0my * q3 + _2q0mz * q2 + m[0] * q1q1 + _2q1 * m[1] * q2 + _2q1 * m[2] * q3 - m[0] * q2q2 - m[0] * q3q3;
+    hy = _2q0mx * q3 + m[1] * q0q0 - _2q0mz * q1 + _2q1mx * q2 - m[1] * q1q1 + m[1] * q2q2 + _2q2 * m[2] * q3 - m[1] * q3q3;
+    _2bz = -_2q0mx * q2 + _2q0my * q1 + m[2] * q0q0 + _2q1mx * q3 - m[2] * q1q1 + _2q2 * m[1] * q3 - m[2] * q2q2 + m[2] * q3q3;
+    _4bx = length(hx, hy) << 1;
+    _4bz = _2bz << 1;
+    _8bx = _4bx << 1;
+    _8bz = _4bz << 1;
+
+    // Gradient decent algorithm corrective step
+    s[0] = -_2q2 * ((q1q3 << 1) - _2q0q2 - a[0]) + _2q1 * ((q0q1 << 1) + _2q2q3 - a[1]) - _4bz * q2 * (_4bx * (half - q2q2 - q3q3) + _4bz * (q1q3 - q0q2) - m[0]) + (-_4bx * q3 + _4bz * q1) * (_4bx * (q1q2 - q0q3) + _4bz * (q0q1 + q2q3) - m[1]) + _4bx * q2 * (_4bx * (q0q2 + q1q3) + _4bz * (half - q1q1 - q2q2) - m[2]);
+    s[1] = _2q3 * ((q1q3 << 1) - _2q0q2 - a[0]) + _2q0 * ((q0q1 << 1) + _2q2q3 - a[1]) - (q1 << 2) * (one - (q1q1 << 1) - (q2q2 << 1) - a[2]) + _4bz * q3 * (_4bx * (half - q2q2 - q3q3) + _4bz * (q1q3 - q0q2) - m[0]) + (_4bx * q2 + _4bz * q0) * (_4bx * (q1q2 - q0q3) + _4bz * (q0q1 + q2q3) - m[1]) + (_4bx * q3 - _8bz * q1) * (_4bx * (q0q2 + q1q3) + _4bz * (half - q1q1 - q2q2) - m[2]);
+    s[2] = -_2q0 * ((q1q3 << 1) - _2q0q2 - a[0]) + _2q3 * ((q0q1 << 1) + _2q2q3 - a[1]) - (q2 << 2) * (one - (q1q1 << 1) - (q2q2 << 1) - a[2]) + (-_8bx * q2 - _4bz * q0) * (_4bx * (half - q2q2 - q3q3) + _4bz * (q1q3 - q0q2) - m[0]) + (_4bx * q1 + _4bz * q3) * (_4bx * (q1q2 - q0q3) + _4bz * (q0q1 + q2q3) - m[1]) + (_4bx * q0 - _8bz * q2) * (_4bx * (q0q2 + q1q3) + _4bz * (half - q1q1 - q2q2) - m[2]);
+    s[3] = _2q1 * ((q1q3 << 1) - _2q0q2 - a[0]) + _2q2 * ((q0q1 << 1) + _2q2q3 - a[1]) + (-_8bx * q3 + _4bz * q1) * (_4bx * (half - q2q2 - q3q3) + _4bz * (q1q3 - q0q2) - m[0]) + (-_4bx * q0 + _4bz * q2) * (_4bx * (q1q2 - q0q3) + _4bz * (q0q1 + q2q3) - m[1]) + _4bx * q1 * (_4bx * (q0q2 + q1q3) + _4bz * (half - q1q1 - q2q2) - m[2]);
+
+    // Normalise step magnitude and apply feedback step
+    if(normaliseQ(s, 4)) {
+      for(int i = 0 ; i < 4 ; i++)
+        qDot[i] -= beta * s[i];
+    }
+  }
+
+  integrateQ(q, qs, qDot, dt);
+}
+
+template<int FRAC>
+void MadgwickAhrsQ<FRAC>::updateIMUQ(float q[4], const Q *a, const Q w[3], float dt) {
+  Q qs[4] = {Q(q[0]), Q(q[1]), Q(q[2]), Q(q[3])};
+  Q q0 = qs[0], q1 = qs[1], q2 = qs[2], q3 = qs[3];
+  Q s[4], qDot[4];
+  Q wx = w[0], wy = w[1], wz = w[2];
+  Q _2q0, _2q1, _2q2, _2q3, _4q0, _4q1, _4q2, _8q1, _8q2, q0q0, q1q1, q2q2, q3q3;
+
+  // Rate of change of quaternion from gyroscope
+  qDot[0] = (-q1 * wx - q2 * wy - q3 * wz) >> 1;
+  qDot[1] = (q0 * wx + q2 * wz - q3 * wy) >> 1;
+  qDot[2] = (q0 * wy - q1 * wz + q3 * wx) >> 1;
+  qDot[3] = (q0 * wz + q1 * wy - q2 * wx) >> 1;
+
+  // Compute feedback only if accelerometer measurement valid
+  if(a) {
+
+    // Auxiliary variables to avoid repeated arithmetic
+    _2q0 = q0 << 1;
+    _2q1 = q1 << 1;
+    _2q2 = q2 << 1;
+    _2q3 = q3 << 1;
+    _4q0 = q0 << 2;
+    _4q1 = q1 << 2;
+    _4q2 = q2 << 2;
+    _8q1 = q1 << 3;
+    _8q2 = q2 << 3;
+    q0q0 = q0 * q0;
+    q1q1 = q1 * q1;
+    q2q2 = q2 * q2;
+    q3q3 = q3 * q3;
+
+    // Gradient decent algorithm corrective step
+    s[0] = _4q0 * q2q2 + _2q2 * a[0] + _4q0 * q1q1 - _2q1 * a[1];
+    s[1] = _4q1 * q3q3 - _2q3 * a[0] + (q0q0 << 2) * q1 - _2q0 * a[1] - _4q1 + _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * a[2];
+    s[2] = (q0q0 << 2) * q2 + _2q0 * a[0] + _4q2 * q3q3 - _2q3 * a[1] - _4q2 + _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * a[2];
+    s[3] = (q1q1 << 2) * q3 - _2q1 * a[0] + (q2q2 << 2) * q3 - _2q2 * a[1];
+
+    // Normalise step magnitude and apply feedback step
+    if(normaliseQ(s, 4)) {
+      for(int i = 0 ; i < 4 ; i++)
+        qDot[i] -= beta * s[i];
+    }
+  }
+
+  integrateQ(q, qs, qDot, dt);
+}
+
+// Integrates the rate of change of the quaternion, normalises it and hands it back in float
+template<int FRAC>
+void MadgwickAhrsQ<FRAC>::integrateQ(float q[4], Q qs[4], Q qDot[4], float dt) {
+  Q step(dt);
+
+  for(int i = 0 ; i < 4 ; i++)
+    qs[i] = qs[i] + qDot[i] * step;
+  if(!normaliseQ(qs, 4))
+    return;
+  for(int i = 0 ; i < 4 ; i++)
+    q[i] = qs[i].toFloat();
+}
+
+// Gyroscope in radians/sec, float interface
+template<int FRAC>
+void MadgwickAhrsQ<FRAC>::toRadians(float gx, float gy, float gz, Q w[3]) {
+  w[0] = Q(gx * DEG_TO_RAD);
+  w[1] = Q(gy * DEG_TO_RAD);
+  w[2] = Q(gz * DEG_TO_RAD);
+}
+
+// Float vector to a unit fixed point one. Scaling by 2^-e (e exponent of the largest component) is exact
+// and brings any unit (g, mGauss) within the Q range. False for a null vector
+template<int FRAC>
+bool MadgwickAhrsQ<FRAC>::toDirection(float x, float y, float z, Q v[3]) {
+  int e;
+  float largest = max(fabsf(x), max(fabsf(y), fabsf(z)));
+
+  if(largest == 0.0f)
+    return false;
+  frexpf(largest, &e);    // largest = f * 2^e with f within [0.5;1[
+  v[0] = Q(ldexpf(x, -e));
+  v[1] = Q(ldexpf(y, -e));
+  v[2] = Q(ldexpf(z, -e));
+  return normaliseQ(v, 3);
+}
+
+// Power of 2 scaling of v[] so that its largest absolute value gets within [0.5;1[. shift is the applied
+// left shift (negative : right shift). The OR of the magnitudes has the same highest bit as their maximum
+template<int FRAC>
+bool MadgwickAhrsQ<FRAC>::prescale(Q *v, int n, int &shift) {
+  uint32_t bits = 0;
+
+  for(int i = 0 ; i < n ; i++)
+    bits |= (uint32_t)abs(v[i].v);
+  if(!bits)
+    return false;
+  shift = (FRAC - 1) - (31 - __builtin_clz(bits));
+  for(int i = 0 ; i < n ; i++)
+    v[i] = (shift >= 0) ? (v[i] << shift) : (v[i] >> -shift);
+  return true;
+}
+
+// 1/sqrt(x) for x within [0.25;4[ : x is brought to [1;4[, then a linear first guess (< 19% error) is refined
+// by 3 Newton iterations (< 4e-5 relative error, better than accurateinvSqrt() used by the float filters)
+template<int FRAC>
+qfixed<FRAC> MadgwickAhrsQ<FRAC>::invSqrtQ(Q x) {
+  bool small = (x.v < Q(1.0f).v);
+  Q y;
+
+  if(small)
+    x = x << 2;
+  y = Q(7.0f / 6.0f) - x * Q(1.0f / 6.0f);
+  for(int i = 0 ; i < 3 ; i++)
+    y = y * (Q(1.5f) - ((x * y * y) >> 1));
+  return small ? (y << 1) : y;
+}
+
+// Scales v[] (up to 4 values) to unit length. False for a null vector, left untouched
+template<int FRAC>
+bool MadgwickAhrsQ<FRAC>::normaliseQ(Q *v, int n) {
+  int shift;
+  Q squaredNorm, recipNorm;
+
+  if(!prescale(v, n, shift))
+    return false;
+  for(int i = 0 ; i < n ; i++)
+    squaredNorm = squaredNorm + v[i] * v[i];
+  recipNorm = invSqrtQ(squaredNorm);
+  for(int i = 0 ; i < n ; i++)
+    v[i] = v[i] * recipNorm;
+  return true;
+}
+
+// sqrt(a² + b²), computed on the prescaled values then scaled back
+template<int FRAC>
+qfixed<FRAC> MadgwickAhrsQ<FRAC>::length(Q a, Q b) {
+  Q v[2] = {a, b};
+  Q squaredNorm, norm;
+  int shift;
+
+  if(!prescale(v, 2, shift))
+    return Q();
+  squaredNorm = v[0] * v[0] + v[1] * v[1];
+  norm = squaredNorm * invSqrtQ(squaredNorm);
+  return (shift >= 0) ? (norm >> shift) : (norm << -shift);
+}
+
+// The filter code lives here, only the selected Q format is compiled
+template class MadgwickAhrsQ<MADGWICK_Q_FRAC>;
@@ -0,0 +1,178 @@
+
+#ifndef _AHRS_H
+#define _AHRS_H
+
+#include "main.h"
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Orientation filters (AHRS) used by the motion class. All of them work in the same frame (NWU after the
+// W3C axis permutation done in motionCore::compute()), take gyros in deg/s and integrate over dt seconds.
+// The quaternion (w, x, y, z) is owned by the motion object and passed to the engine at each update, so that
+// switching engine at runtime (fusion= key) keeps the current orientation.
+//
+// Cost vs. accuracy, measured with the replay command on the same trace :
+// - Madgwick : gradient descent, best accuracy, most expensive
+// - Mahony : PI feedback on the cross product error, close to Madgwick, cheaper, tolerates a bad mag better
+// - Complementary : gyro integration nudged towards acc/mag by a fixed ratio, cheapest, drifts more in motion
+// - Madgwick fixed point : same as Madgwick in integer Q format arithmetic, for the low CPU clock (doze) settings.
+//   Fed by motionCore straight from the raw int16 sensors data with the integer biases (updateRaw())
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define MAHONY_TWO_KP             1.0f    // 2 * proportional gain
+#define MAHONY_TWO_KI             0.0f    // 2 * integral gain (gyro bias estimation), off by default
+#define COMPLEMENTARY_ALPHA       0.02f   // share of the acc/mag correction at each step (x 200Hz => ~2.5s time constant)
+#define MADGWICK_Q_FRAC           23      // fractional bits of the fixed point madgwick (Q8.23 : ±256, 1.2e-7 resolution)
+#define QCAL_GAIN_FRAC            30      // fractional bits of the fixed point gyro gain (rad/s per LSB, ~1e-3)
+
+enum s_fusionEngine {
+  FUSION_MADGWICK = 0,
+  FUSION_MAHONY,
+  FUSION_COMPLEMENTARY,
+  FUSION_MADGWICK_FIXED,
+  MAX_FUSION_ENGINE
+};
+
+// Filter at startup, until the fusion= key is read from the config. Build with -DFUSION_DEFAULT=FUSION_MADGWICK_FIXED
+// to run the fixed point path on a fresh module (the config file saves the selected one)
+#ifndef FUSION_DEFAULT
+#define FUSION_DEFAULT            FUSION_MADGWICK
+#endif
+
+class AhrsEngine {
+public:
+  virtual ~AhrsEngine() {}
+
+  // 9 DoF update - falls back on updateIMU() when the magnetometer measurement is invalid
+  virtual void update(float q[4], float ax, float ay, float az, float gx, float gy, float gz, float mx, float my, float mz, float dt) = 0;
+  // 6 DoF update (acc + gyro)
+  virtual void updateIMU(float q[4], float ax, float ay, float az, float gx, float gy, float gz, float dt) = 0;
+  virtual void reset() {}
+  virtual const char *getName() = 0;
+
+protected:
+  void integrate(float q[4], float qDot1, float qDot2, float qDot3, float qDot4, float dt);
+  void normalise(float q[4]);
+};
+
+
+// Implementation of Sebastian Madgwick's "...efficient orientation filter for... inertial/magnetic sensor arrays"
+class MadgwickAhrs : public AhrsEngine {
+public:
+  void update(float q[4], float ax, float ay, float az, float gx, float gy, float gz, float mx, float my, float mz, float dt);
+  void updateIMU(float q[4], float ax, float ay, float az, float gx, float gy, float gz, float dt);
+  const char *getName() { return "madgwick"; }
+  void setBeta(float gain) { beta = gain; }
+
+private:
+  float beta = 0.4f;
+};
+
+
+// Mahony's non linear complementary filter on SO(3) (PI controller on the orientation error)
+class MahonyAhrs : public AhrsEngine {
+public:
+  void update(float q[4], float ax, float ay, float az, float gx, float gy, float gz, float mx, float my, float mz, float dt);
+  void updateIMU(float q[4], float ax, float ay, float az, float gx, float gy, float gz, float dt);
+  void reset() { integralFBx = integralFBy = integralFBz = 0.0f; }
+  const char *getName() { return "mahony"; }
+
+private:
+  void feedback(float &gx, float &gy, float &gz, float ex, float ey, float ez, float dt);
+
+  float twoKp = MAHONY_TWO_KP;
+  float twoKi = MAHONY_TWO_KI;
+  float integralFBx = 0.0f, integralFBy = 0.0f, integralFBz = 0.0f;
+};
+
+
+// Gyro integration, then a fixed fraction of the tilt (acc) and heading (mag) error is removed
+// with a small rotation. No normalisation of the gradient, no integral term
+class ComplementaryAhrs : public AhrsEngine {
+public:
+  void update(float q[4], float ax, float ay, float az, float gx, float gy, float gz, float mx, float my, float mz, float dt);
+  void updateIMU(float q[4], float ax, float ay, float az, float gx, float gy, float gz, float dt);
+  const char *getName() { return "complementary"; }
+
+private:
+  void rotate(float q[4], float ex, float ey, float ez);
+
+  float alpha = COMPLEMENTARY_ALPHA;
+};
+
+
+
+/////////////////////////////////////////////////////
+// Signed fixed point number with FRAC fractional bits in an int32_t. Products go through 64 bits and are
+// rounded, shifts are powers of 2 scaling. No saturation : the filter below keeps its values within range
+template<int FRAC>
+struct qfixed {
+  int32_t v;
+
+  qfixed() : v(0) {}
+  explicit constexpr qfixed(float f) : v((int32_t)(f * (float)(1 << FRAC) + (f < 0.0f ? -0.5f : 0.5f))) {}
+  static qfixed raw(int32_t r) { qfixed x; x.v = r; return x; }
+  float toFloat() const { return (float)v * (1.0f / (float)(1 << FRAC)); }
+
+  friend qfixed operator+(qfixed a, qfixed b) { return raw(a.v + b.v); }
+  friend qfixed operator-(qfixed a, qfixed b) { return raw(a.v - b.v); }
+  friend qfixed operator-(qfixed a) { return raw(-a.v); }
+  friend qfixed operator*(qfixed a, qfixed b) { return raw((int32_t)(((int64_t)a.v * b.v + (1LL << (FRAC - 1))) >> FRAC)); }
+  friend qfixed operator<<(qfixed a, int n) { return raw(a.v * (1 << n)); }
+  friend qfixed operator>>(qfixed a, int n) { return raw(a.v >> n); }
+  qfixed &operator-=(qfixed b) { v -= b.v; return *this; }
+};
+
+
+// Calibration of the raw sensors data for MadgwickAhrsQ::updateRaw(), in the filter frame. The biases are
+// removed beforehand as integers (sensor LSB). Acc & mag are only directions, so only the soft iron matrix
+// applies to them, their scale doesn't matter. set() converts the float settings when they change, not per sample
+template<int FRAC>
+struct qCalibration {
+  int32_t gyroGain = 0;           // rad/s per LSB, QCAL_GAIN_FRAC fractional bits
+  qfixed<FRAC> softIron[3][3];
+
+  void set(float gyroRes, const float matrix[3][3]) {
+    gyroGain = (int32_t)(gyroRes * DEG_TO_RAD * (float)(1 << QCAL_GAIN_FRAC) + 0.5f);
+    for(int i = 0 ; i < 3 ; i++)
+      for(int j = 0 ; j < 3 ; j++)
+        softIron[i][j] = qfixed<FRAC>(matrix[i][j]);
+  }
+};
+
+
+// Madgwick's filter in fixed point, FRAC being the number of fractional bits (see MADGWICK_Q_FRAC).
+// Same algorithm and corrections as MadgwickAhrs. The quaternion and dt are converted on entry / exit, which is
+// exact for the quaternion as long as FRAC <= 24 (float mantissa), so switching engines is seamless.
+// updateRaw() takes the int16 sensors data with the biases removed : no float on the inputs. update() /
+// updateIMU() keep the float interface of the other engines, acc & mag being scaled by a power of 2 before the
+// conversion as they are only used as directions
+template<int FRAC>
+class MadgwickAhrsQ : public AhrsEngine {
+public:
+  void update(float q[4], float ax, float ay, float az, float gx, float gy, float gz, float mx, float my, float mz, float dt);
+  void updateIMU(float q[4], float ax, float ay, float az, float gx, float gy, float gz, float dt);
+  // acc, gyro, mag : sensor LSB minus the biases, in the filter frame (NWU + W3C permutation)
+  void updateRaw(float q[4], const int32_t acc[3], const int32_t gyro[3], const int32_t mag[3], const qCalibration<FRAC> &cal, float dt);
+  const char *getName() { return "madgwick-fixed"; }
+  void setBeta(float gain) { beta = qfixed<FRAC>(gain); }
+
+private:
+  typedef qfixed<FRAC> Q;
+
+  void updateQ(float q[4], const Q *a, const Q w[3], const Q m[3], float dt);
+  void updateIMUQ(float q[4], const Q *a, const Q w[3], float dt);
+  static void toRadians(float gx, float gy, float gz, Q w[3]);
+  static bool toDirection(float x, float y, float z, Q v[3]);
+  static bool prescale(Q *v, int n, int &shift);
+  static Q invSqrtQ(Q x);
+  static bool normaliseQ(Q *v, int n);
+  static Q length(Q a, Q b);
+  void integrateQ(float q[4], Q qs[4], Q qDot[4], float dt);
+
+  Q beta = Q(0.4f);
+};
+
+typedef MadgwickAhrsQ<MADGWICK_Q_FRAC> MadgwickFixedAhrs;
+typedef qCalibration<MADGWICK_Q_FRAC> FixedCalibration;
+
+#endif
@@ -18,10 +18,13 @@
 // light OSC parser / Micro OSC
 #include <MicroOscUdp.h>
 #include <U8g2lib.h>
-#include "./src/ota.h "
+#include "./src/ota.h"
 #include "./src/functions.h"
 #include "./src/colors.h"
 #include "./src/Switches.h"
+#include "./src/SpscRing.h"
+#include "./src/RiotFrame.h"
+#include "./src/ClockSync.h"
 
 // FFAT + MSD libs
 #include "FS.h"
@@ -39,13 +42,14 @@
 
 
 extern WiFiUDP udpPacket;
+extern WiFiUDP streamPacket;
+extern WiFiUDP switchPacket;
 extern WiFiUDP configPacket;
 extern WebServer httpServer;
 
 extern MicroOscUdp<1024> oscUdp;
 
 extern WiFiClient client;
-extern CRGBW8 blinkColor;
 // Mass storage driver using TinyUSB
 extern USBMSC MSC;
 
@@ -117,6 +121,7 @@ extern U8G2_SSD1306_128X64_NONAME_F_HW_I2C u8g2;
 #define DEFAULT_SAMPLE_RATE       5
 #define DEFAULT_ID                0
 #define CONFIG_FILE               "config.txt"
+#define CONFIG_TEMP_FILE          "config.tmp"    // written then renamed over CONFIG_FILE
 #define VERSION_FILE              "version.txt"
 #define CONFIG_MODE_TIMEOUT       2000          // Time to press on the switch to start the webserver      
 
@@ -1,7 +1,12 @@
 
 #include <float.h>
+#include "riot.h"      // first : riot.h needs the complete motion.h (motionSample) through textfile.h
 #include "motion.h"
 
+// W3C permutation of the filter inputs (x, y, z) => (y, -x, z), see compute()
+static const uint8_t w3cAxis[3] = {1, 0, 2};
+static const float w3cSign[3] = {1.f, -1.f, 1.f};
+
 motionCore::motionCore() {
   
 }
@@ -13,6 +18,7 @@ motionCore::~motionCore() {
 void motionCore::setSampleRate(uint32_t rate) {
   sampleRate = constrain(rate, MIN_SAMPLERATE, MAX_SAMPLERATE);
   deltat = (float)sampleRate / 1000.0f;
+  measuredDeltat = deltat;
 }
 
 void motionCore::init() {
@@ -29,8 +35,9 @@ void motionCore::init() {
   
   beta = BETA_DEFAULT;
   setSampleRate(DEFAULT_SAMPLE_RATE);
-  q0 = 1.0f;
-  q1 = q2 = q3 = 0.0f;
+  setFusion(FUSION_DEFAULT);
+  q[0] = 1.0f;
+  q[1] = q[2] = q[3] = 0.0f;
 
   resetSoftIron();
 }
@@ -54,6 +61,7 @@ void motionCore::begin() {
     meanMag[i] = (float)mag_bias[i];  // EMA live estimator of hard iron bias
     mbias[i] = mRes * (float)mag_bias[i];
   }
+  setFixedCalibration();
 
   resetBeta();
 }
@@ -68,6 +76,7 @@ void motionCore::setSoftIronMatrix(float v[3], uint8_t axis) {
   for(int i = 0; i < 3; i++) {
     softIronMatrix[axis][i] = v[i];
   }
+  setFixedCalibration();
 }
 
 // Define Tait-Bryan angles.
@@ -86,11 +95,22 @@ void motionCore::setSoftIronMatrix(float v[3], uint8_t axis) {
 // http://en.wikipedia.org/wiki/Conversion_between_quaternions_and_Euler_angles
 // which has additional links.
 void motionCore::grab() {
-  lsm6d.read();
+  if(lsm6d.isFifo()) {
+    imuFrames = lsm6d.readFifo();
+    deltat = lsm6d.getFifoPeriod();
+  }
+  else {
+    lsm6d.read();
+    imuFrames = 1;
+    deltat = measuredDeltat;
+  }
   lis3mdl.read();
-  bmp390.readPressure();
-  bmp390.readAltitude();
-  if(riot.hasBNO055()) {
+  // Sensors only feeding OSC streams disabled with the streams= key aren't read (pressure : 72µs)
+  if(riot.isStreamed(STREAM_BAROMETER | STREAM_TEMPERATURE)) {
+    bmp390.readPressure();
+    bmp390.readAltitude();
+  }
+  if(riot.hasBNO055() && riot.isStreamed(STREAM_BNO055)) {
     bno055.Get_Values(bno055Data, Get_EULER);
     // Flip signs / modulo here - BNO performs ZXY rotation
     bno055Data[0] = FROM_360_DEGREE(bno055Data[0]); // Yaw
@@ -115,7 +135,8 @@ void motionCore::grab() {
   magZ = lis3mdl.getMagZ();
   boardTemperatureRaw = lsm6d.getTemp();
   boardTemperature = ((float)boardTemperatureRaw / LSM6DSL_TEMP_SCALE) + LSM_BIAS_TEMPERATURE;
-  mcuTemperature = temperatureRead();
+  if(riot.isStreamed(STREAM_TEMPERATURE))
+    mcuTemperature = temperatureRead();
   temperature = bmp390.getTemp();
   pressure = bmp390.getPressure() / 100.f;   // hPa
   altitude = bmp390.getAltitude();
@@ -146,9 +167,199 @@ void motionCore::grabMag() {
   magZ = lis3mdl.getMagZ();
 }
 
+// Replay path: loads one recorded frame of raw sensors (same order and units as grab() ie accX..magZ
+// in LSB, before orientation swapping) without touching the SPI bus. Baro & temperatures keep their
+// last value. Used to benchmark compute() on a known trace
+void motionCore::inject(const int16_t *raw) {
+  accX = raw[0];
+  accY = raw[1];
+  accZ = raw[2];
+  gyrX = raw[3];
+  gyrY = raw[4];
+  gyrZ = raw[5];
+  magX = raw[6];
+  magY = raw[7];
+  magZ = raw[8];
+  imuFrames = 1;
+  deltat = (float)sampleRate / 1000.0f;
+}
+
+// FIFO mode counterpart : a batch of IMU samples (accX..gyrZ, oldest first, fused by fuseFifo() then
+// compute()) and one mag sample, period = IMU ODR period
+void motionCore::injectFifo(const int16_t (*imuSamples)[6], uint8_t count, const int16_t *mag, float period) {
+  lsm6d.loadFifo(imuSamples, count);
+  accX = lsm6d.getAccX();
+  accY = lsm6d.getAccY();
+  accZ = lsm6d.getAccZ();
+  gyrX = lsm6d.getGyrX();
+  gyrY = lsm6d.getGyrY();
+  gyrZ = lsm6d.getGyrZ();
+  magX = mag[0];
+  magY = mag[1];
+  magZ = mag[2];
+  imuFrames = lsm6d.getFifoCount();
+  deltat = period;
+}
+
+// When the fusion runs faster than the OSC output, sensors values are averaged between 2 outputs
+// (box filter = anti-aliasing before decimation). Orientation isn't averaged : quaternion, euler etc are
+// the state of the filter which already integrated all the samples, we just export the latest one
+void motionCore::accumulate() {
+  if(!decimationCount)
+    memset(decimationSum, 0, sizeof(decimationSum));
+  decimationSum[0] += a_x;
+  decimationSum[1] += a_y;
+  decimationSum[2] += a_z;
+  decimationSum[3] += g_x;
+  decimationSum[4] += g_y;
+  decimationSum[5] += g_z;
+  decimationSum[6] += m_x;
+  decimationSum[7] += m_y;
+  decimationSum[8] += m_z;
+  decimationSum[9] += pressure;
+  decimationSum[10] += altitude;
+  decimationCount++;
+}
+
+void motionCore::decimate() {
+  if(!decimationCount)
+    return;
+  float scale = 1.0f / (float)decimationCount;
+  a_x = decimationSum[0] * scale;
+  a_y = decimationSum[1] * scale;
+  a_z = decimationSum[2] * scale;
+  g_x = decimationSum[3] * scale;
+  g_y = decimationSum[4] * scale;
+  g_z = decimationSum[5] * scale;
+  m_x = decimationSum[6] * scale;
+  m_y = decimationSum[7] * scale;
+  m_z = decimationSum[8] * scale;
+  pressure = decimationSum[9] * scale;
+  altitude = decimationSum[10] * scale;
+  decimationCount = 0;
+}
+
+void motionCore::snapshot(motionSample &sample, uint32_t timestamp) {
+  sample.timestamp = timestamp;
+  sample.timestampUs = timestamp * 1000;    // refined by the fusion task with the µs timer
+  sample.sequence = 0;
+  sample.raw[0] = accX;
+  sample.raw[1] = accY;
+  sample.raw[2] = accZ;
+  sample.raw[3] = gyrX;
+  sample.raw[4] = gyrY;
+  sample.raw[5] = gyrZ;
+  sample.raw[6] = magX;
+  sample.raw[7] = magY;
+  sample.raw[8] = magZ;
+  sample.acc[0] = a_x;
+  sample.acc[1] = a_y;
+  sample.acc[2] = a_z;
+  sample.gyro[0] = g_x;
+  sample.gyro[1] = g_y;
+  sample.gyro[2] = g_z;
+  sample.mag[0] = m_x;
+  sample.mag[1] = m_y;
+  sample.mag[2] = m_z;
+  sample.pressure = pressure;
+  sample.altitude = altitude;
+  sample.boardTemperature = boardTemperature;
+  sample.temperature = temperature;
+  sample.mcuTemperature = mcuTemperature;
+  sample.quat[0] = q[0];
+  sample.quat[1] = q[1];
+  sample.quat[2] = q[2];
+  sample.quat[3] = q[3];
+  sample.yaw = yaw;
+  sample.pitch = pitch;
+  sample.roll = roll;
+  sample.heading = heading;
+  sample.grav[0] = grav_x;
+  sample.grav[1] = grav_y;
+  sample.grav[2] = grav_z;
+  for(int i = 0 ; i < 3 ; i++)
+    sample.bno055Euler[i] = (float)bno055Data[i];
+  for(int i = 0 ; i < 4 ; i++)
+    sample.bno055Quat[i] = (float)bno055Quat[i];
+}
+
+// Resets the fusion state (quaternion & beta convergence) after a replay or a benchmark
+void motionCore::resetFusion() {
+  q[0] = 1.0f;
+  q[1] = q[2] = q[3] = 0.0f;
+  ahrs->reset();
+  resetBeta();
+}
+
+// Switches the orientation filter, the quaternion is kept so the output doesn't jump
+void motionCore::setFusion(uint8_t engine) {
+  switch(engine) {
+    case FUSION_MAHONY:
+      mahony.reset();
+      ahrs = &mahony;
+      break;
+    case FUSION_COMPLEMENTARY:
+      complementary.reset();
+      ahrs = &complementary;
+      break;
+    case FUSION_MADGWICK_FIXED:
+      ahrs = &madgwickFixed;
+      break;
+    default:
+      engine = FUSION_MADGWICK;
+      ahrs = &madgwick;
+      break;
+  }
+  fusion = engine;
+}
+
+// The reference starts from the current orientation
+void motionCore::setReference(bool on) {
+  for(int i = 0 ; i < 4 ; i++)
+    qRef[i] = q[i];
+  referenceMaxError = referenceSumError = 0.0f;
+  referenceCount = 0;
+  referenceOn = on;
+}
+
+// Runs the selected filter, and the reference one on its own quaternion when enabled
+void motionCore::fuse(float ax, float ay, float az, float gx, float gy, float gz, float mx, float my, float mz, float dt) {
+  ahrs->update(q, ax, ay, az, gx, gy, gz, mx, my, mz, dt);
+  if(referenceOn)
+    reference.update(qRef, ax, ay, az, gx, gy, gz, mx, my, mz, dt);
+}
+
+// Fixed point filter straight from the integer sensors data (fixedMag for the mag). The float reference,
+// when enabled, gets the same samples scaled
+void motionCore::fuseRaw(const int32_t acc[3], const int32_t gyro[3]) {
+  madgwickFixed.updateRaw(q, acc, gyro, fixedMag, fixedCalibration, deltat);
+  if(referenceOn)
+    reference.update(qRef, aRes * acc[0], aRes * acc[1], aRes * acc[2], gRes * gyro[0], gRes * gyro[1], gRes * gyro[2], m_y, -m_x, m_z, deltat);
+}
+
+// Settings of the fixed point filter that don't change per sample : gyro gain, and the soft iron matrix
+// brought to the filter frame like the data, M'[i][j] = s[i] s[j] M[axis[i]][axis[j]]
+void motionCore::setFixedCalibration() {
+  float matrix[3][3];
+
+  for(int i = 0 ; i < 3 ; i++)
+    for(int j = 0 ; j < 3 ; j++)
+      matrix[i][j] = w3cSign[i] * w3cSign[j] * softIronMatrix[w3cAxis[i]][w3cAxis[j]];
+  fixedCalibration.set(gRes, matrix);
+}
+
 // Axis and sign swapping is done on the raw / integer values of the sensors *before* bias computation
 // or application
 void motionCore::applyOrientation() {
+  if(orientation >= MAX_BOARD_ORIENTATION)
+    orientation = TOP_NWU_LENGTH;
+  orientAxis(accX, accY, accZ);
+  orientAxis(gyrX, gyrY, gyrZ);
+  orientAxis(magX, magY, magZ);
+}
+
+// Same swap for all 3 sensors, also used alone on the acc / gyro samples queued in the IMU FIFO
+void motionCore::orientAxis(int16_t &x, int16_t &y, int16_t &z) {
   int16_t swap;
   switch(orientation) {
     // Sensor UP with natural orientation of the sensor X-NORTH-Y-WEST-Z-UP (NWU convention)
@@ -160,47 +371,28 @@ void motionCore::applyOrientation() {
     // Sensor UP with swapped X-Y axis of the sensor so that Y-NORTH-X-WEST-Z-UP (NWU convention)
     // Sensor / USB is on top - X+ is on the legnth of the board towards antenna, Y on the width, Z up
     case TOP_NWU_LENGTH:
-      swap = -accX;
-      accX = accY;
-      accY = swap;
-      swap = -gyrX;
-      gyrX = gyrY;
-      gyrY = swap;
-      swap = -magX;
-      magX = magY;
-      magY = swap;
+      swap = -x;
+      x = y;
+      y = swap;
       break;
 
     // Sensor DOWN with natural orientation of the sensor X-NORTH-Y-EAST-Z-DOWN (NED convention)
     // Sensor / USB is  bottom side - X+ is on the width of the board, Y is on the legnth of the board towards antenna, Z up
     case BOTTOM_NWU_WIDTH:
-      accX = -accX;
-      accZ = -accZ;
-      gyrX = -gyrX;
-      gyrZ = -gyrZ;
-      magX = -magX;
-      magZ = -magZ;
+      x = -x;
+      z = -z;
       break;
 
     // Sensor DOWN with swapped X-Y axis of the sensor Y-NORTH-X-EAST-Z-DOWN (NED convention)
     // Sensor / USB is bottom side - X+ is on the legnth of the board towards antenna, Y on the width, Z up
     case BOTTOM_NWU_LENGTH:
-      swap = accX;
-      accX = accY;
-      accY = swap;
-      accZ = -accZ;
-      swap = gyrX;
-      gyrX = gyrY;
-      gyrY = swap;
-      gyrZ = -gyrZ;
-      swap = magX;
-      magX = magY;
-      magY = swap;
-      magZ = -magZ;
+      swap = x;
+      x = y;
+      y = swap;
+      z = -z;
       break;
 
     default :
-      orientation = TOP_NWU_LENGTH;
       break;
   }
 }
@@ -216,9 +408,9 @@ void motionCore::compute() {
   ////////////////////////////////////////////////////////////////////////////////////////////////////
   // Magnetometers autocalibration (hard + soft iron)
   if(autoCalMagOn) {
-    bool stable = magOffsetCompute();
+    magOffsetCompute();
     
-    if(((autocalMagMaxTime && ((millis() - autoCalMagElapsed) > autocalMagMaxTime))) || isCancel() || isNextStep()) {
+    if(((autocalMagMaxTime && ((millis() - autoCalMagElapsed) > autocalMagMaxTime))) || isCancel() || isNextStep() || isMagFitConverged()) {
       Serial.printf("Mag Autocalibration ended\n");
       autoCalMagOn = false;
       // check if acc+gyro cal completed
@@ -281,6 +473,9 @@ void motionCore::compute() {
     beta = lerpBeta.getValue();
     //Serial.printf("Beta = %f\n", beta);
   }
+  madgwick.setBeta(beta);
+  madgwickFixed.setBeta(beta);
+  reference.setBeta(beta);
 
   ////////////////////////////////////////////////////////////////////////////////////
   // Note regarding the sensor orientation & angles :
@@ -294,10 +489,40 @@ void motionCore::compute() {
   // calculated depending on the desired application, examples in comments below.
 
   // Based on selected orientation, this uses X+ to point north
-  //madgwickAHRSupdate(a_x, a_y, a_z, g_x, g_y, g_z, m_x, m_y, m_z);
+  //ahrs->update(q, a_x, a_y, a_z, g_x, g_y, g_z, m_x, m_y, m_z, deltat);
 
   // Based on selected orientation, this uses Y+ to point north as in the W3C standard
-  madgwickAHRSupdate(a_y, -a_x, a_z, g_y, -g_x, g_z, m_y, -m_x, m_z);
+  // FIFO mode : older IMU samples are fused first, each with the sensor ODR period, the latest one last
+  // The fixed point filter takes the integer data, biases removed in LSB : no float on its inputs
+  if(fusion == FUSION_MADGWICK_FIXED) {
+    fixedMag[0] = magY - mag_bias[1];
+    fixedMag[1] = -(magX - mag_bias[0]);
+    fixedMag[2] = magZ - mag_bias[2];
+  }
+  if(imuFrames > 1)
+    fuseFifo();
+  if(imuFrames) {
+    if(fusion == FUSION_MADGWICK_FIXED) {
+      int32_t acc[3] = {accY - accel_bias[1], -(accX - accel_bias[0]), accZ - accel_bias[2]};
+      int32_t gyro[3] = {gyrY - gyro_bias[1], -(gyrX - gyro_bias[0]), gyrZ - gyro_bias[2]};
+      fuseRaw(acc, gyro);
+    }
+    else
+      fuse(a_y, -a_x, a_z, g_y, -g_x, g_z, m_y, -m_x, m_z, deltat);
+  }
+
+  // Angle between both orientations : 4 asin(|q - qRef| / 2), q and -q being the same rotation
+  if(referenceOn) {
+    float minus = 0.0f, plus = 0.0f, error;
+    for(int i = 0 ; i < 4 ; i++) {
+      minus += (q[i] - qRef[i]) * (q[i] - qRef[i]);
+      plus += (q[i] + qRef[i]) * (q[i] + qRef[i]);
+    }
+    error = 4.0f * asinf(min(0.5f * sqrtf(min(minus, plus)), 1.0f)) * RAD_TO_DEG;
+    referenceMaxError = max(referenceMaxError, error);
+    referenceSumError += error;
+    referenceCount++;
+  }
 
   // compute the norm of the gyro data => rough estimation of the movement
   // If below threshold, don't update euler and whatnot
@@ -306,36 +531,9 @@ void motionCore::compute() {
       return;
   }
 
-  // Euler Angle - Adjust sign here eventually if not happy of the chosen frame convention - Beware of heading computations
-  // Standard computation order for quats to euler follow the Yaw-Pitch-Roll convention & order ZYX (standard)
-  // This computation brings the pitch in the range of {-90°;+90°} and roll within {-180°;+180°}
-  
-  // Optimized, using the sum of squared quaternions = 1 and common terms
-  halfMinusQySquared = 0.5f - q2*q2; // calculate common terms to avoid repeated operations
-    // if BNO is detected, use automatically ZXZ order euler conversion 
-  if(!riot.hasBNO055()) {
-    yaw   = -atan2f(q1 * q2 + q0 * q3, halfMinusQySquared - q3*q3);   
-    pitch = -asinf(2.0f * (q0 * q2) - q1 * q3);
-    roll  = atan2f(q0 * q1 + q2 * q3, halfMinusQySquared - q1*q1);
-  }
-  
-  // Yaw-Roll-Pitch order aka YXZ like the BNO055 does, with roll on {-90°;+90} and pitch on {-180°;+180°}
-  // TODO : handle gimbal lock with straight transitions on asinf custom (see xio) ?
-  else {
-    // Original quaternion conversion without optimization (commented)
-    //yaw   = -atan2f(2.0f * (q1 * q2 + q0 * q3), q0*q0 + q1*q1 - q2*q2 - q3*q3); // Unchanged since yaw is applied first
-    //yaw   = -atan2f(2.0f * (q1 * q2 + q0 * q3), 1.0f - 2.0f * (q2*q2 + q3*q3) // Unchanged since yaw is applied first
-    yaw   = -atan2f(q1 * q2 + q0 * q3, halfMinusQySquared - q3*q3); // Unchanged since yaw is applied first
-    roll = asinf(2.0f * (q0 * q1 + q2 * q3));
-    //pitch = -atan2f(2.0f * (q0*q2 - q1*q3), q0*q0 - q1*q1 - q2*q2 + q3*q3);
-    //pitch = -atan2f(2.0f * (q0*q2 - q1*q3), 1.0f - 2.0f * (q1*q1 + q2*q2));
-    pitch = -atan2f(q0*q2 - q1*q3, halfMinusQySquared - q1*q1);
-  }
-  
-  // Compute heading *BEFORE* the final export of yaw pitch roll to save float computation of deg2rad / rad2deg
-  computeHeading();
-  computeGravity();     // Gravity vector
-  computeMagnetic();    // Magnetic vector
+  // Euler angles, heading, gravity & magnetic vectors in one pass over the quaternion
+  // Angles are converted to degrees there, by the gate that computed each of them
+  computeOrientation();
 
   // Compute error between magnetic and gravity
   // Cross product between magnetic values in madgwick frame and gravity (indicates how they are colinear or not)
@@ -344,218 +542,76 @@ void motionCore::compute() {
   // but angles below are updated only when error rises above a threshold
   //convError = computeConvergenceError();
   //Serial.printf("%d\n", convError);
-  
-  /////////////////////////////////////////////////////////////////////////////////
-  // Degree per second conversion and declination correction 
-  pitch *= RAD_TO_DEG;
-  yaw   *= RAD_TO_DEG; 
-  yaw   -= declination; 
-  roll  *= RAD_TO_DEG;
-  heading *= RAD_TO_DEG;
-  heading = TO_360_DEGREE(heading);
 }
 
-//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Implementation of Sebastian Madgwick's "...efficient orientation filter for... inertial/magnetic sensor arrays"
-// (see http://www.x-io.co.uk/category/open-source/ for examples and more details)
-// which fuses acceleration, rotation rate, and magnetic moments to produce a quaternion-based estimate of absolute
-// device orientation -- which can be converted to yaw, pitch, and roll. 
-void motionCore::madgwickAHRSupdate(float ax, float ay, float az, float gx, float gy, float gz, float mx, float my, float mz) {
-  
-  // Use IMU algorithm if magnetometer measurement invalid (avoids NaN in magnetometer normalisation)
-  if((mx == 0.0f) && (my == 0.0f) && (mz == 0.0f)) {
-    //Serial.println("Mag data invalid - no update");
-    updateIMU(ax, ay, az, gx, gy, gz);
+// Axis permutation and sign applied by orientAxis(), as tables : oriented[i] = sign[i] * raw[perm[i]]
+static const uint8_t orientationPerm[MAX_BOARD_ORIENTATION][3] = {
+  {0, 1, 2},    // TOP_NWU_WIDTH
+  {1, 0, 2},    // TOP_NWU_LENGTH
+  {0, 1, 2},    // BOTTOM_NWU_WIDTH
+  {1, 0, 2}     // BOTTOM_NWU_LENGTH
+};
+static const float orientationSign[MAX_BOARD_ORIENTATION][3] = {
+  { 1.f,  1.f,  1.f},
+  { 1.f, -1.f,  1.f},
+  {-1.f,  1.f, -1.f},
+  { 1.f,  1.f, -1.f}
+};
+
+// Runs the filter on the IMU samples queued in the FIFO before the latest one (which is processed
+// by compute() like in single sample mode). Mag is read at its own rate so we use the latest,
+// already calibrated values for all of them. deltat is the IMU ODR period (set by grab())
+// The whole batch is first converted to the filter frame, then fused : the orientation, W3C permutation
+// (x, y, z) => (y, -x, z), scaling and bias are folded into a single gain / offset / source axis per
+// channel, computed once per batch, so the conversion loop has no branch and one multiply-add per value.
+// The fixed point filter gets the integer values, sign and bias in LSB only
+void motionCore::fuseFifo() {
+  const uint8_t *perm = orientationPerm[orientation];
+  const float *sign = orientationSign[orientation];
+  uint8_t src[3];
+  float aGain[3], aOffset[3], gGain[3], gOffset[3];
+  int count = imuFrames - 1;
+  const int16_t *sample;
+
+  if(fusion == FUSION_MADGWICK_FIXED) {
+    int32_t axisSign[3], aBias[3], gBias[3], acc[3], gyro[3];
+    for(int k = 0 ; k < 3 ; k++) {
+      uint8_t axis = w3cAxis[k];
+      src[k] = perm[axis];
+      axisSign[k] = (w3cSign[k] * sign[axis] > 0.f) ? 1 : -1;
+      aBias[k] = (w3cSign[k] > 0.f) ? accel_bias[axis] : -accel_bias[axis];
+      gBias[k] = (w3cSign[k] > 0.f) ? gyro_bias[axis] : -gyro_bias[axis];
+    }
+    for(int i = 0 ; i < count ; i++) {
+      sample = lsm6d.getFifoSample(i);
+      for(int k = 0 ; k < 3 ; k++) {
+        acc[k] = axisSign[k] * sample[src[k]] - aBias[k];
+        gyro[k] = axisSign[k] * sample[3 + src[k]] - gBias[k];
+      }
+      fuseRaw(acc, gyro);
+    }
     return;
   }
 
-  // Convert gyroscope degrees/sec to radians/sec
-  gx *= DEG_TO_RAD;
-  gy *= DEG_TO_RAD;
-  gz *= DEG_TO_RAD;
-
-  // Rate of change of quaternion from gyroscope
-  qDot1 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
-  qDot2 = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
-  qDot3 = 0.5f * (q0 * gy - q1 * gz + q3 * gx);
-  qDot4 = 0.5f * (q0 * gz + q1 * gy - q2 * gx);
-
-  // Compute feedback only if accelerometer measurement valid (avoids NaN in accelerometer normalisation)
-  if(!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f))) {
-
-    // Normalise accelerometer measurement
-    recipNorm = accurateinvSqrt(ax * ax + ay * ay + az * az);
-    ax *= recipNorm;
-    ay *= recipNorm;
-    az *= recipNorm;   
-
-    // Normalise magnetometer measurement
-    recipNorm = accurateinvSqrt(mx * mx + my * my + mz * mz); 
-    mx *= recipNorm;
-    my *= recipNorm;
-    mz *= recipNorm;
-
-    // Auxiliary variables to avoid repeated arithmetic
-    _2q0mx = 2.0f * q0 * mx;
-    _2q0my = 2.0f * q0 * my;
-    _2q0mz = 2.0f * q0 * mz;
-    _2q1mx = 2.0f * q1 * mx;
-    _2q0 = 2.0f * q0;
-    _2q1 = 2.0f * q1;
-    _2q2 = 2.0f * q2;
-    _2q3 = 2.0f * q3;
-    _2q0q2 = 2.0f * q0 * q2;
-    _2q2q3 = 2.0f * q2 * q3;
-    q0q0 = q0 * q0;
-    q0q1 = q0 * q1;
-    q0q2 = q0 * q2;
-    q0q3 = q0 * q3;
-    q1q1 = q1 * q1;
-    q1q2 = q1 * q2;
-    q1q3 = q1 * q3;
-    q2q2 = q2 * q2;
-    q2q3 = q2 * q3;
-    q3q3 = q3 * q3;
-
-
-    // Reference direction of Earth's magnetic field
-    hx = mx * q0q0 - _2q0my * q3 + _2q0mz * q2 + mx * q1q1 + _2q1 * my * q2 + _2q1 * mz * q3 - mx * q2q2 - mx * q3q3;
-    hy = _2q0mx * q3 + my * q0q0 - _2q0mz * q1 + _2q1mx * q2 - my * q1q1 + my * q2q2 + _2q2 * mz * q3 - my * q3q3;
-    _2bx = sqrtf(hx * hx + hy * hy);
-    _2bz = -_2q0mx * q2 + _2q0my * q1 + mz * q0q0 + _2q1mx * q3 - mz * q1q1 + _2q2 * my * q3 - mz * q2q2 + mz * q3q3;
-    _4bx = 2.0f * _2bx;
-    _4bz = 2.0f * _2bz;
-     // Correction / addon
-    _8bx = 2.0f * _4bx;
-    _8bz = 2.0f * _4bz;
-
-    // Gradient decent algorithm corrective step
-    // Commented = old algo with errors
-    //s0 = -_2q2 * (2.0f * q1q3 - _2q0q2 - ax) + _2q1 * (2.0f * q0q1 + _2q2q3 - ay) - _2bz * q2 * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (-_2bx * q3 + _2bz * q1) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + _2bx * q2 * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
-    s0 = -_2q2 * (2.0f * q1q3 - _2q0q2 - ax) + _2q1 * (2.0f * q0q1 + _2q2q3 - ay) - _4bz * q2 * (_4bx * (0.5f - q2q2 - q3q3) + _4bz * (q1q3 - q0q2) - mx) + (-_4bx * q3 + _4bz * q1) * (_4bx * (q1q2 - q0q3) + _4bz * (q0q1 + q2q3) - my) + _4bx * q2 * (_4bx * (q0q2 + q1q3) + _4bz * (0.5f - q1q1 - q2q2) - mz);
-    //s1 = _2q3 * (2.0f * q1q3 - _2q0q2 - ax) + _2q0 * (2.0f * q0q1 + _2q2q3 - ay) - 4.0f * q1 * (1.0f - 2.0f * q1q1 - 2.0f * q2q2 - az) + _2bz * q3 * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (_2bx * q2 + _2bz * q0) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + (_2bx * q3 - _4bz * q1) * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
-    s1 = _2q3 * (2.0f * q1q3 - _2q0q2 - ax) + _2q0 * (2.0f * q0q1 + _2q2q3 - ay) - 4.0f * q1 * (1.0f - 2.0f * q1q1 - 2.0f * q2q2 - az) + _4bz * q3 * (_4bx * (0.5f - q2q2 - q3q3) + _4bz * (q1q3 - q0q2) - mx) + (_4bx * q2 + _4bz * q0) * (_4bx * (q1q2 - q0q3) + _4bz * (q0q1 + q2q3) - my) + (_4bx * q3 - _8bz * q1) * (_4bx * (q0q2 + q1q3) + _4bz * (0.5f - q1q1 - q2q2) - mz);
-    //s2 = -_2q0 * (2.0f * q1q3 - _2q0q2 - ax) + _2q3 * (2.0f * q0q1 + _2q2q3 - ay) - 4.0f * q2 * (1.0f - 2.0f * q1q1 - 2.0f * q2q2 - az) + (-_4bx * q2 - _2bz * q0) * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (_2bx * q1 + _2bz * q3) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + (_2bx * q0 - _4bz * q2) * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
-    s2 = -_2q0 * (2.0f * q1q3 - _2q0q2 - ax) + _2q3 * (2.0f * q0q1 + _2q2q3 - ay) - 4.0f * q2 * (1.0f - 2.0f * q1q1 - 2.0f * q2q2 - az) + (-_8bx * q2 - _4bz * q0) * (_4bx * (0.5f - q2q2 - q3q3) + _4bz * (q1q3 - q0q2) - mx) + (_4bx * q1 + _4bz * q3) * (_4bx * (q1q2 - q0q3) + _4bz * (q0q1 + q2q3) - my) + (_4bx * q0 - _8bz * q2) * (_4bx * (q0q2 + q1q3) + _4bz * (0.5f - q1q1 - q2q2) - mz);
-    //s3 = _2q1 * (2.0f * q1q3 - _2q0q2 - ax) + _2q2 * (2.0f * q0q1 + _2q2q3 - ay) + (-_4bx * q3 + _2bz * q1) * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (-_2bx * q0 + _2bz * q2) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + _2bx * q1 * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
-    s3 = _2q1 * (2.0f * q1q3 - _2q0q2 - ax) + _2q2 * (2.0f * q0q1 + _2q2q3 - ay) + (-_8bx * q3 + _4bz * q1) * (_4bx * (0.5f - q2q2 - q3q3) + _4bz * (q1q3 - q0q2) - mx) + (-_4bx * q0 + _4bz * q2) * (_4bx * (q1q2 - q0q3) + _4bz * (q0q1 + q2q3) - my) + _4bx * q1 * (_4bx * (q0q2 + q1q3) + _4bz * (0.5f - q1q1 - q2q2) - mz); 
-    
-    recipNorm = accurateinvSqrt(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3); // normalise step magnitude
-    s0 *= recipNorm;
-    s1 *= recipNorm;
-    s2 *= recipNorm;
-    s3 *= recipNorm;
-
-    // Apply feedback step
-    qDot1 -= beta * s0;
-    qDot2 -= beta * s1;
-    qDot3 -= beta * s2;
-    qDot4 -= beta * s3;
+  for(int k = 0 ; k < 3 ; k++) {
+    uint8_t axis = w3cAxis[k];
+    src[k] = perm[axis];
+    aGain[k] = w3cSign[k] * sign[axis] * aRes;
+    aOffset[k] = -w3cSign[k] * abias[axis];
+    gGain[k] = w3cSign[k] * sign[axis] * gRes;
+    gOffset[k] = -w3cSign[k] * gbias[axis];
   }
 
-  // Integrate rate of change of quaternion to yield quaternion
-  q0 += qDot1 * deltat;
-  q1 += qDot2 * deltat;
-  q2 += qDot3 * deltat;
-  q3 += qDot4 * deltat;
-
-  // Normalise quaternion
-  recipNorm = accurateinvSqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
-  q0 *= recipNorm;
-  q1 *= recipNorm;
-  q2 *= recipNorm;
-  q3 *= recipNorm;
-}
-
-// AHRS with no Mag when not available or NaN detected
-void motionCore::updateIMU(float ax, float ay, float az, float gx, float gy, float gz) {
-  
-  // Convert gyroscope degrees/sec to radians/sec
-  gx *= DEG_TO_RAD;
-  gy *= DEG_TO_RAD;
-  gz *= DEG_TO_RAD;
-
-  // Rate of change of quaternion from gyroscope
-  qDot1 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
-  qDot2 = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
-  qDot3 = 0.5f * (q0 * gy - q1 * gz + q3 * gx);
-  qDot4 = 0.5f * (q0 * gz + q1 * gy - q2 * gx);
-
-  // Compute feedback only if accelerometer measurement valid (avoids NaN in accelerometer normalisation)
-  if(!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f))) {
-
-    // Normalise accelerometer measurement
-    recipNorm = accurateinvSqrt(ax * ax + ay * ay + az * az);
-    ax *= recipNorm;
-    ay *= recipNorm;
-    az *= recipNorm;
-
-    // Auxiliary variables to avoid repeated arithmetic
-    _2q0 = 2.0f * q0;
-    _2q1 = 2.0f * q1;
-    _2q2 = 2.0f * q2;
-    _2q3 = 2.0f * q3;
-    _4q0 = 4.0f * q0;
-    _4q1 = 4.0f * q1;
-    _4q2 = 4.0f * q2;
-    _8q1 = 8.0f * q1;
-    _8q2 = 8.0f * q2;
-    q0q0 = q0 * q0;
-    q1q1 = q1 * q1;
-    q2q2 = q2 * q2;
-    q3q3 = q3 * q3;
-
-    // Gradient decent algorithm corrective step
-    s0 = _4q0 * q2q2 + _2q2 * ax + _4q0 * q1q1 - _2q1 * ay;
-    s1 = _4q1 * q3q3 - _2q3 * ax + 4.0f * q0q0 * q1 - _2q0 * ay - _4q1 + _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * az;
-    s2 = 4.0f * q0q0 * q2 + _2q0 * ax + _4q2 * q3q3 - _2q3 * ay - _4q2 + _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * az;
-    s3 = 4.0f * q1q1 * q3 - _2q1 * ax + 4.0f * q2q2 * q3 - _2q2 * ay;
-    
-    recipNorm = accurateinvSqrt(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3); // normalise step magnitude
-    s0 *= recipNorm;
-    s1 *= recipNorm;
-    s2 *= recipNorm;
-    s3 *= recipNorm;
-
-    // Apply feedback step
-    qDot1 -= beta * s0;
-    qDot2 -= beta * s1;
-    qDot3 -= beta * s2;
-    qDot4 -= beta * s3;
+  for(int i = 0 ; i < count ; i++) {
+    sample = lsm6d.getFifoSample(i);
+    for(int k = 0 ; k < 3 ; k++) {
+      fifoAcc[i][k] = aGain[k] * (float)sample[src[k]] + aOffset[k];
+      fifoGyro[i][k] = gGain[k] * (float)sample[3 + src[k]] + gOffset[k];
+    }
   }
 
-  // Integrate rate of change of quaternion to yield quaternion
-  q0 += qDot1 * deltat;
-  q1 += qDot2 * deltat;
-  q2 += qDot3 * deltat;
-  q3 += qDot4 * deltat;
-
-  // Normalise quaternion
-  recipNorm = accurateinvSqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
-  q0 *= recipNorm;
-  q1 *= recipNorm;
-  q2 *= recipNorm;
-  q3 *= recipNorm;
-}
-
-// https://oduerr.github.io/gesture/ypr_calculations.html
-void motionCore::computeGravity() {
-   // For NWU frame (madgwick)
-   /*grav_x = 2.0f * (q1 * q3 - q0 * q2);
-   grav_y = 2.0f * (q0 * q1 + q2 * q3);
-   grav_z = 2.0f * (q0q0 + q3q3) - 1.0f;*/
-
-   // For ENU frame like accelerometers are, and X-Y axis swap
-   grav_y = 2.0f * (q1 * q3 - q0 * q2); // y = x
-   grav_x = -2.0f * (q0 * q1 + q2 * q3); // x = -y
-   grav_z = 2.0f * (q0q0 + q3q3) - 1.0f;
-}
-
-// For NWU frame
-void motionCore::computeMagnetic() {
-   mag_x = 2.0f * (q1 * q2 + q0 * q3);
-   mag_y = 2.0f * (q0*q0 + q2*q2) - 1.0f;
-   mag_z = 2.0f * (q2 * q3 - q0 * q1);
+  for(int i = 0 ; i < count ; i++)
+    fuse(fifoAcc[i][0], fifoAcc[i][1], fifoAcc[i][2], fifoGyro[i][0], fifoGyro[i][1], fifoGyro[i][2], m_y, -m_x, m_z, deltat);
 }
 
 // Requires gravity and heading to be computed before. Replace with vector arithmetics when time comes
@@ -583,17 +639,105 @@ float motionCore::computeConvergenceError() {
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Computation below got adapted from Freescale application note for a tilt compensated compass, 
+// Euler angles, tilt compensated heading, gravity and magnetic vectors straight from the quaternion.
+// Products of the quaternion components are computed once and shared by all the outputs, and the sine /
+// cosine of pitch and roll used to de-rotate the mags come from the atan2 / asin arguments themselves
+// rather than from sinf() / cosf() of the angles. Angles go through fastAtan2f() / fastAsinf()
+//
+// Heading computation got adapted from Freescale application note for a tilt compensated compass,
 // formerly using accelerometers as inclinometers.
 // We however directly grab the stable Pitch / Roll angles from Madgwick to de-rotate the mag data.
 // This way we are un-sensitive to shaking (classic algorithm uses static accel data to get absolute angles)
-// Beware, the computation below expects angles provided in radian so the routine must be called 
-// when pitch and roll are still expressed in that unit. Cheezy dirty cheap optimization but embedded rulz
+// Each angle is converted to degrees (+ declination, 0-360° heading) by the gate that computed it : the
+// skipped ones keep their last value instead of being scaled again at every sample
 // Sourced from Freescale / NXP App Note AN4248 - https://www.nxp.com/docs/en/application-note/AN4248.pdf
 // See also: https://circuitcellar.com/cc-blog/implement-a-tilt-and-interference-compensated-electronic-compass/
+// Gravity : https://oduerr.github.io/gesture/ypr_calculations.html
+
+void motionCore::computeOrientation(void) {
+  float q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+  float q0q0 = q0 * q0, q0q1 = q0 * q1, q0q2 = q0 * q2, q0q3 = q0 * q3;
+  float q1q1 = q1 * q1, q1q2 = q1 * q2, q1q3 = q1 * q3;
+  float q2q2 = q2 * q2, q2q3 = q2 * q3, q3q3 = q3 * q3;
+  float sine, y, x, squaredNorm, invNorm;
+
+  // Gravity for ENU frame like accelerometers are, and X-Y axis swap
+  // (NWU frame / madgwick would be x = 2(q1q3 - q0q2), y = 2(q0q1 + q2q3), z = 2(q0q0 + q3q3) - 1)
+  // + Magnetic vector, NWU frame (convergence error)
+  if(riot.isStreamed(STREAM_GRAVITY)) {
+    grav_y = 2.0f * (q1q3 - q0q2);      // y = x
+    grav_x = -2.0f * (q0q1 + q2q3);     // x = -y
+    grav_z = 2.0f * (q0q0 + q3q3) - 1.0f;
+
+    mag_x = 2.0f * (q1q2 + q0q3);
+    mag_y = 2.0f * (q0q0 + q2q2) - 1.0f;
+    mag_z = 2.0f * (q2q3 - q0q1);
+  }
+
+  // Heading needs the pitch & roll below
+  if(!riot.isStreamed(STREAM_EULER | STREAM_HEADING))
+    return;
+
+  // Optimized, using the sum of squared quaternions = 1 and common terms
+  halfMinusQySquared = 0.5f - q2q2;
+  yaw = -fastAtan2f(q1q2 + q0q3, halfMinusQySquared - q3q3);    // Same for both orders since yaw is applied first
+
+  // Standard computation order for quats to euler follow the Yaw-Pitch-Roll convention & order ZYX (standard)
+  // This computation brings the pitch in the range of {-90°;+90°} and roll within {-180°;+180°}
+  if(!riot.hasBNO055()) {
+    sine = clamp(2.0f * (q0q2 - q1q3), -1.0f, 1.0f);
+    pitch = -fastAsinf(sine);
+    iSinPitch = -sine;
+    iCosPitch = sqrtf(1.0f - sine * sine);   // pitch within {-90°;+90°} => cos >= 0
+
+    y = q0q1 + q2q3;
+    x = halfMinusQySquared - q1q1;
+    roll = fastAtan2f(y, x);
+    squaredNorm = x * x + y * y;
+    if(squaredNorm > EPSILON) {
+      invNorm = invSqrt(squaredNorm);
+      iSinRoll = y * invNorm;
+      iCosRoll = x * invNorm;
+    }
+    else {                                   // gimbal lock, roll is undefined and set to 0
+      iSinRoll = 0.0f;
+      iCosRoll = 1.0f;
+    }
+  }
+
+  // Yaw-Roll-Pitch order aka YXZ like the BNO055 does, with roll on {-90°;+90} and pitch on {-180°;+180°}
+  // TODO : handle gimbal lock with straight transitions on asinf custom (see xio) ?
+  else {
+    sine = clamp(2.0f * (q0q1 + q2q3), -1.0f, 1.0f);
+    roll = fastAsinf(sine);
+    iSinRoll = sine;
+    iCosRoll = sqrtf(1.0f - sine * sine);
+
+    y = q0q2 - q1q3;
+    x = halfMinusQySquared - q1q1;
+    pitch = -fastAtan2f(y, x);
+    squaredNorm = x * x + y * y;
+    if(squaredNorm > EPSILON) {
+      invNorm = invSqrt(squaredNorm);
+      iSinPitch = -y * invNorm;
+      iCosPitch = x * invNorm;
+    }
+    else {
+      iSinPitch = 0.0f;
+      iCosPitch = 1.0f;
+    }
+  }
+
+  // Degree conversion and declination correction. The de-rotation of the mags below only needs the
+  // sine / cosine computed above
+  pitch *= RAD_TO_DEG;
+  yaw   *= RAD_TO_DEG;
+  yaw   -= declination;
+  roll  *= RAD_TO_DEG;
+
+  if(!riot.isStreamed(STREAM_HEADING))
+    return;
 
-void motionCore::computeHeading(void) {
-      
   // We work with the calibrated values of the MAG sensors (hard iron offset removed)
   // We need to apply the same permutation as in madgwick's call to have the natural Y (W3C frame) becoming X and pointing North
   // which corresponds to swapping X and Y plus sign. We remain in NWU frame (we just rotate the frame +90°)
@@ -606,21 +750,16 @@ void motionCore::computeHeading(void) {
   // Sensor frame is made NWU by axis swapping. This converts NWU to NED
   iBpy = -iBpy;
   iBpz = -iBpz;
-  
-  /* calculate sin and cosine of roll angle Phi */
-  iSinRoll = sinf(roll);
-  iCosRoll = cosf(roll);
-  /* calculate sin and cosine of pitch angle Theta */
-  iSinPitch = sinf(pitch);
-  iCosPitch = cosf(pitch); 
 
   /* de-rotate by pitch angle Theta */
   iBfx = (iBpx * iCosPitch) + (iBpz * iSinPitch); /* Eq 19: x component */
-  /* de-rotate by roll angle Phi and Theta */  
+  /* de-rotate by roll angle Phi and Theta */
   iBfy = iBpx * iSinRoll * iSinPitch + iBpy * iCosRoll - iBpz * iSinRoll * iCosPitch;
-  
+
   /* calculate current yaw/heading */
-  heading = atan2f(-iBfy, iBfx); /* Eq 22 */
+  heading = fastAtan2f(-iBfy, iBfx); /* Eq 22 */
+  heading *= RAD_TO_DEG;
+  heading = TO_360_DEGREE(heading);
 }
 
 
@@ -643,40 +782,22 @@ void motionCore::runAutoCalMotion(void) {
 
 
 bool motionCore::calibrateAccGyro(void) {
-  static bool ledState = 0;
-  static int winkCounter = 0;
-  
   delay(sampleRate);
   grabImu();
   applyOrientation();
   
-  winkCounter++;
-  // Guaranties a proper blinking independent of the samplerate for standard rates {2;50}
-  if(winkCounter > (50 / sampleRate)) {
-    winkCounter = 0;
-    ledState = 1 - ledState;
-    blinkColor = ledState ? Yellow : Black;
-    setLedColor(blinkColor);
-  }
+  // Timed by the led task, independent of the samplerate
+  blinkLed(Yellow, CALIBRATION_BLINK, CALIBRATION_BLINK);
   return(accGyroOffsetCompute());   // finished or not ?
 }
 
 bool motionCore::calibrateMag(bool end) {
-  static bool ledState = 0;
-  static int winkCounter = 0;
-
   delay(sampleRate);
   grabMag();
   applyOrientation();
 
-  winkCounter++;
-  // Guaranties a proper blinking independent of the samplerate for standard rates {2;50}
-  if(winkCounter > (50 / sampleRate)) {
-    winkCounter = 0;
-    ledState = 1 - ledState;
-    blinkColor = ledState ? White : Black;
-    setLedColor(blinkColor);
-  }
+  // Timed by the led task, independent of the samplerate
+  blinkLed(White, CALIBRATION_BLINK, CALIBRATION_BLINK);
 
   magOffsetCompute();
 
@@ -684,7 +805,7 @@ bool motionCore::calibrateMag(bool end) {
     magBiasCompute();
     return(true);
   }
-  return(false);
+  return(isMagFitConverged());   // the module can stop being rotated
 }
 
 void motionCore::accGyroBiasCompute(void){
@@ -697,35 +818,37 @@ void motionCore::accGyroBiasCompute(void){
   char str[MAX_STRING_LEN];
   sprintf(str, "*** FOUND Bias acc= %d %d %d", accel_bias[0], accel_bias[1], accel_bias[2]);
   Serial.printf("%s\n", str);
-  printToOSC(str);
+  postToOSC(str);
   sprintf(str,"*** FOUND Bias gyro= %d %d %d", gyro_bias[0], gyro_bias[1], gyro_bias[2]);
   Serial.printf("%s\n", str);
-  printToOSC(str);
+  postToOSC(str);
 }
 
 
 void motionCore::magBiasCompute(void) {
-  // TODO : compare accumulated mean with max+min / 2  
-  // Compute eigen values and softIron matrix
-  computeSoftIronMatrix();
+  // Ellipsoid center when the soft iron fit succeeded, else max+min / 2
+  float center[3];
+  bool fitted = hardIronOK && computeSoftIronMatrix(center);
   for(int i = 0 ; i < 3 ; i++) {
-    mag_bias[i] = (magOffsetAutocalMax[i] + magOffsetAutocalMin[i]) / 2;
-    //mag_bias[i] = (int)meanMag[i];
+    if(fitted)
+      mag_bias[i] = (int)roundf(center[i]);
+    else
+      mag_bias[i] = (magOffsetAutocalMax[i] + magOffsetAutocalMin[i]) / 2;
     mbias[i] = mRes * (float)mag_bias[i];
     //Serial.printf("Mag Max[%d]=%d ; Min[%d]=%d\n",i, magOffsetAutocalMax[i], i, magOffsetAutocalMin[i]);
   }
   char str[MAX_STRING_LEN];
-  sprintf(str, "*** FOUND Bias mag (MinMax) = %d %d %d", mag_bias[0], mag_bias[1], mag_bias[2]);
+  sprintf(str, "*** FOUND Bias mag (%s) = %d %d %d", fitted ? "Ellipsoid" : "MinMax", mag_bias[0], mag_bias[1], mag_bias[2]);
   Serial.printf("%s\n", str);
   Serial.printf("*** FOUND Hard Iron (EMA) = %f %f %f\n", meanMag[0], meanMag[1], meanMag[2]);
-  printToOSC(str);
+  postToOSC(str);
   Serial.printf("Soft Iron Correction Matrix:\n");
   printMatrix3x3(softIronMatrix);
 }
 
 // Should be called only when relevant rotations are detected, otherwise bias is shifting during stillness
 void motionCore::magOffsetComputeLive(void) {
-  float magSample[3] = {magX, magY, magZ};
+  float magSample[3] = {(float)magX, (float)magY, (float)magZ};
   static int cnt = 0;
   if(cnt++ > 10) {
       cnt = 0;
@@ -772,9 +895,18 @@ bool motionCore::magOffsetCompute(void) {
     char str[MAX_STRING_LEN];
     sprintf(str, "Mag means stable for long enough - Hard Iron completed");
     Serial.printf("%s\n", str);
-    printToOSC(str);
+    postToOSC(str);
     hardIronOK = true;
-    magSampleCount = 0;
+    // Fit centered on the min / max bias, scaled by the half range
+    float origin[3];
+    float radius = 0.0f;
+    for(int i = 0 ; i < 3 ; i++) {
+      origin[i] = (float)(magOffsetAutocalMax[i] + magOffsetAutocalMin[i]) / 2.0f;
+      radius += (float)(magOffsetAutocalMax[i] - magOffsetAutocalMin[i]) / 6.0f;
+    }
+    magFit.begin(origin, radius);
+    magFitStable = 0;
+    magFitReportTimer = millis();
   }
   if(hardIronOK) {
     updateScatterMatrix();
@@ -782,135 +914,58 @@ bool motionCore::magOffsetCompute(void) {
   return(stable);
 }
 
+// Feeds the ellipsoid fit with the raw sample (55 MACs) and refits every MAG_FIT_PERIOD samples
 void motionCore::updateScatterMatrix(void) {
-  float magSample[3] = {magX, magY, magZ};
+  float magSample[3] = {(float)magX, (float)magY, (float)magZ};
   
   // Update hard iron offset with EMA on the side to further compare
   for(int i = 0 ; i < 3 ; i++) {
     meanMag[i] = (1.0f - alphaSmoother) * meanMag[i] + alphaSmoother * magSample[i];
   }
   
-  // Remove hard iron before soft iron estimation
-  for(int i = 0 ; i < 3 ; i++) {
-    magSample[i] = magSample[i] - mag_bias[i];
-  }
-  
-  double v[SCATTER_PARAM_COUNT] = {
-    magSample[0]*magSample[0],
-    magSample[1]*magSample[1],
-    magSample[2]*magSample[2],
-    magSample[0]*magSample[1],
-    magSample[0]*magSample[2],
-    magSample[1]*magSample[2],
-    magSample[0],
-    magSample[1],
-    magSample[2],
-    1.0f
-  };
-
-  for (int i = 0; i < SCATTER_PARAM_COUNT; i++) {
-    for (int j = 0; j < SCATTER_PARAM_COUNT; j++) {
-      scatterMatrix[i][j] += v[i] * v[j];
-    }
-  }
-  magSampleCount++;
-}
-
-
-// --- Compute soft iron correction matrix (whitening transformation) ---
-bool motionCore::computeSoftIronMatrix(void) {
-  
-  //Serial.printf("Raw Scatter Matrix\n");
-  //printMatrix10x10(scatterMatrix);
-  // Normalize (scale) by number of samples 
-  double norm = 1.0f / (double)magSampleCount;
-  double elipsoidCenter[3];
-  double elipsoidCoeffs[SCATTER_PARAM_COUNT];  // Eigen vector
+  magFit.add(magSample);
+  if(magFit.getCount() % MAG_FIT_PERIOD)
+    return;
 
-  
-  Serial.printf("norm = %f / sampleCount = %d\n", norm, magSampleCount);
-  for (int i = 0; i < SCATTER_PARAM_COUNT; i++) {
-    for (int j = 0; j < SCATTER_PARAM_COUNT; j++) {
-      scatterMatrix[i][j] *= norm;
-    }
-  }
-  //symmetrize10x10(scatterMatrix); // Most likely not needed
-  //Serial.printf("Scatter Matrix after normalization by sampleCount\n");
-  //printMatrix10x10(scatterMatrix);
-  
-  // elipsoidCoeffs is the resulding eigen vector
-  if(powerIteration10x10(scatterMatrix, elipsoidCoeffs, 100, 1e-6f)) {
-    // beta = [A B C D E F G H I J]
-    Serial.printf("Ellipsoid Coefficients:\n");
-    for (int i = 0; i < SCATTER_PARAM_COUNT; i++) {
-        Serial.printf("%.6f ", elipsoidCoeffs[i]);
+  // Converged once the fit stops moving with a low residual and all orientations seen
+  if(magFit.fit() && magFit.getCoverage() > MAG_FIT_COVERAGE && magFit.getResidual() < MAG_FIT_RESIDUAL
+     && magFit.getChange() < MAG_FIT_CHANGE) {
+    if(magFitStable < MAG_FIT_STABLE_FITS && ++magFitStable == MAG_FIT_STABLE_FITS) {
+      char str[MAX_STRING_LEN];
+      sprintf(str, "Mag soft iron fit converged - %u samples", magFit.getCount());
+      Serial.printf("%s\n", str);
+      postToOSC(str);
     }
-    Serial.printf("\n");
   }
+  else
+    magFitStable = 0;
 
-  // Step 1: Construct M matrix from elipsoid parameters (beta)
-  double A = elipsoidCoeffs[0], B = elipsoidCoeffs[1], C = elipsoidCoeffs[2];
-  double D = elipsoidCoeffs[3], E = elipsoidCoeffs[4], F = elipsoidCoeffs[5];
-  double G = elipsoidCoeffs[6], H = elipsoidCoeffs[7], I = elipsoidCoeffs[8];
-
-  double Q[3][3] = {
-    { A, D / 2.0, E / 2.0 },
-    { D / 2.0, B, F / 2.0 },
-    { E / 2.0, F / 2.0, C }
-  };
-
-  double v[3] = { G / 2.0, H / 2.0, I / 2.0 };
-  double c = elipsoidCoeffs[9];
-
-  // Step 2: invert matrix
-  double Q_inv[3][3];
-  if (!inverse3x3(Q, Q_inv)) {
-    Serial.printf("Failed to invert ellipsoid matrix.\n");
-    return false;
-  }
-
-  // Step 3 : extract center c = -inv(Q) * v
-  for (int i = 0; i < 3; i++) {
-    elipsoidCenter[i] = 0.0f;
-    for (int j = 0; j < 3; j++) {
-      elipsoidCenter[i] -= Q_inv[i][j] * v[j];
-    }
+  if((millis() - magFitReportTimer) > MAG_FIT_REPORT) {
+    magFitReportTimer = millis();
+    char str[MAX_STRING_LEN];
+    sprintf(str, "Mag fit n=%u residual %.2f%% coverage %.4f change %.4f", magFit.getCount(),
+            100.0f * magFit.getResidual(), magFit.getCoverage(), magFit.getChange());
+    Serial.printf("%s\n", str);
+    postToOSC(str);
   }
+}
 
-  // Step 4: Compute vtAinvb = v^T * Q_inv * v
-    double vtAinvb = 0.0;
-    for (int i = 0; i < 3; i++) {
-        double row = 0.0;
-        for (int j = 0 ; j < 3; j++)
-            row += Q_inv[i][j] * v[j];
-        vtAinvb += v[i] * row;
-    }
-
-    // Step 5: Compute scale
-    double scale = 1.0f;
-    if(vtAinvb != c)
-      scale = 1.0f / (vtAinvb - c);
-
-    //Serial.printf("Scale = %f\n", scale);
-
-    // Step 6: Compute Q_inv = scale * Q_inv
-    // (no need to apply scale to Q then invert again => scalar on Q_inv
-    for (int i = 0; i < 3; ++i)
-        for (int j = 0; j < 3; ++j)
-            Q_inv[i][j] = scale * Q_inv[i][j];  
-
-    // Step 7: Normalize to get the whitening matrix 
-    // Should be "close" to identity depending on soft Iron effect
-    normalize3x3(Q_inv);
-    
-    // Step 8: stores soft iron matrix as float for reduce CPU
-    // when applying correction
-    for(int i = 0; i < 3; i++) {
-      for(int j = 0; j < 3; j++) {
-        softIronMatrix[i][j] = (float)Q_inv[i][j];
-      }
-    }  
 
+// --- Compute soft iron correction matrix (whitening transformation) ---
+// Final fit on all the accumulated samples. Soft iron stays the identity when the samples don't
+// describe an ellipsoid (not enough orientations covered). Returns the ellipsoid center
+bool motionCore::computeSoftIronMatrix(float center[3]) {
+  bool fitted = magFit.fit(MAG_FIT_FINAL_ITERATIONS);
+
+  Serial.printf("Mag fit on %u samples : residual %.2f%% coverage %.4f\n", magFit.getCount(),
+                100.0f * magFit.getResidual(), magFit.getCoverage());
+  if(!fitted || magFit.getCoverage() < MAG_FIT_COVERAGE) {
+    Serial.printf("No ellipsoid fit - soft iron not corrected\n");
+    return false;   // still the identity from resetMagOffsetCalibration()
+  }
+  magFit.getMatrix(softIronMatrix);
+  magFit.getCenter(center);
+  softIronOK = true;
   return true;
 }
 
@@ -994,7 +1049,7 @@ void motionCore::resetMagOffsetCalibration(void) {
   hardIronOK = false;
   softIronOK = false;
   stableMeanMagCounter = millis();
-  magSampleCount = 1;
+  magFitStable = 0;
   resetSoftIron();
 }
 
@@ -1012,12 +1067,7 @@ void motionCore::resetSoftIron(void) {
         softIronMatrix[i][j] = 0.0f;
     }
   }
-    
-  for(int i = 0 ; i < SCATTER_PARAM_COUNT ; i++) {
-    for(int j = 0 ; j < SCATTER_PARAM_COUNT ; j++) {
-      scatterMatrix[i][j] = 0.0f;
-    }
-  }
+  setFixedCalibration();
 }
 
 
@@ -5,6 +5,7 @@
 #include "main.h"
 #include "routines.h"
 #include "sensors.h"
+#include "ahrs.h"
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Absolute angle (madgwick)
@@ -38,13 +39,24 @@ Very Fast Adaptation (unstable but responsive)        0.3 - 0.5       Reacts ver
 #define EPSILON_SYMMETRY_MATRIX       0.2f  
 #define MAG_OFFSETS_STABLE_MAX_TIME   5000    // ms
 #define MAG_AUTOCAL_MAX_TIME          60000   // ms
-#define SCATTER_PARAM_COUNT           10      // Scatter parameter size
-
-#define MIN_SAMPLERATE    3
+#define MAG_FIT_PERIOD                20      // samples between 2 soft iron fits while calibrating
+#define MAG_FIT_FINAL_ITERATIONS      20      // inverse iterations of the last fit
+#define MAG_FIT_RESIDUAL              0.03f   // RMS relative radius error of a converged fit
+#define MAG_FIT_CHANGE                0.002f  // max. change of the soft iron matrix between 2 converged fits
+#define MAG_FIT_COVERAGE              0.001f  // min. coverage (EllipsoidFit) : orientations missing below
+#define MAG_FIT_STABLE_FITS           3       // successive fits within the limits to stop the calibration
+#define MAG_FIT_REPORT                1000    // ms, live fit quality print / OSC
+#define CALIBRATION_BLINK             50      // ms, led on / off time while calibrating
+
+#define MIN_SAMPLERATE    1       // ms - fusion period (1 kHz max)
 #define MAX_SAMPLERATE    20000
+#define MIN_OUTPUT_RATE   3       // ms - OSC output period
+#define DECIMATION_CHANNELS   11  // acc, gyro, mag, pressure, altitude averaged between 2 outputs
 
 #define G_TO_MS2          9.80665f
 
+#define RAW_FRAME_SIZE    9     // accX..magZ int16 values per recorded frame (replay & record)
+
 enum s_Axis {
   X_AXIS = 0,
   Y_AXIS,
@@ -60,6 +72,24 @@ enum s_BoardOrientation {
 };
 
 
+// Fixed size record handed over from the sensor task (core 1) to the network task (core 0) through
+// the SPSC ring : everything the OSC bundle needs, so that the network side never reads the motion object
+struct motionSample {
+  uint32_t timestamp;               // ms
+  uint32_t timestampUs;             // µs, binary frames & sequence message
+  uint32_t sequence;                // output sample counter
+  int16_t raw[RAW_FRAME_SIZE];      // accX..magZ, for the serial plotter logs
+  float acc[3], gyro[3], mag[3];    // g, deg/s, gauss
+  float pressure, altitude;
+  float boardTemperature, temperature, mcuTemperature;
+  float quat[4];                    // w, x, y, z
+  float yaw, pitch, roll, heading;
+  float grav[3];
+  float bno055Euler[3];             // yaw, roll, pitch (BNO055 order)
+  float bno055Quat[4];              // w, x, y, z
+};
+
+
 // Default scales
 #define GYRO_SCALE  2000.0f     // +- 2000 deg/s
 #define ACC_SCALE   8.0f        // +- 8g
@@ -76,19 +106,32 @@ public:
   void grab();    // Retrieves sensors data from sensor classes
   void grabImu(); // Same, just the IMU (acc, gyro, temp)
   void grabMag();
+  void inject(const int16_t *raw);   // Feeds a recorded raw frame instead of grab()
+  void injectFifo(const int16_t (*imuSamples)[6], uint8_t count, const int16_t *mag, float period);   // same, FIFO mode
+  void resetFusion();
+  void accumulate();  // sums the current sample for the output decimation
+  void decimate();    // replaces the sensors values by their average since the last call
+  void snapshot(motionSample &sample, uint32_t timestamp);  // copies the latest output for the network task
   void compute();
   float gyroNorm();
   void runAutoCalMag();
   void runAutoCalMotion();
   void applyOrientation();  // Flip axis and signs
+  void orientAxis(int16_t &x, int16_t &y, int16_t &z);
+  void fuseFifo();
+  void fuse(float ax, float ay, float az, float gx, float gy, float gz, float mx, float my, float mz, float dt);
+  void fuseRaw(const int32_t acc[3], const int32_t gyro[3]);   // fixed point filter, sensor LSB minus the biases
+  void setFixedCalibration();
   uint32_t getSampleRate() { return sampleRate; }
   void setSampleRate(uint32_t rate);
+  void setSamplePeriod(uint32_t period) { measuredDeltat = (float)period / 1000000.0f; }   // µs, measured by the fusion task
   void setGyroGate(float gate) { gyroGate = gate; }
 
   void setGyroBias(int bias, uint8_t axis) { gyro_bias[axis] = bias; gbias[axis] = (float)gyro_bias[axis] * gRes; }
   void setAccelBias(int bias, uint8_t axis) { accel_bias[axis] = bias; abias[axis] = (float)accel_bias[axis] * aRes; }
   void setMagBias(int bias, uint8_t axis) { mag_bias[axis] = bias; mbias[axis] = (float)mag_bias[axis] * mRes; }
   void setBeta(float gain) { beta = gain; }
+  void setFusion(uint8_t engine);
   void setDeclination(float angle) { declination = angle; }
   void setOrientation(uint8_t orient) { orientation = orient; }
   void setSoftIronMatrix(float v[3], uint8_t axis);
@@ -97,17 +140,20 @@ public:
   int getAccelBiasRaw(uint8_t axis) { return accel_bias[axis]; }
   int getMagBiasRaw(uint8_t axis) { return mag_bias[axis]; }
   float getBeta() { return beta; }
+  uint8_t getFusion() { return fusion; }
+  const char *getFusionName() { return ahrs->getName(); }
+  // Runs the float madgwick alongside the selected filter and tracks the angle between both orientations
+  // (replay uses it to validate the other engines on a recorded trace)
+  void setReference(bool on);
+  float getReferenceMaxError() { return referenceMaxError; }
+  float getReferenceMeanError() { return referenceCount ? referenceSumError / (float)referenceCount : 0.0f; }
   float getDeclination() { return declination; }
   uint8_t getOrientation() { return orientation; }
   float getGyroGate() { return gyroGate; }
   float (*getSoftIronMatrix())[3] {return softIronMatrix;}
   float *getSoftIronMatrixRow(uint8_t axis) { return &(softIronMatrix[axis][0]); }
 
-  void madgwickAHRSupdate(float ax, float ay, float az, float gx, float gy, float gz, float mx, float my, float mz);
-  void updateIMU(float ax, float ay, float az, float gx, float gy, float gz);
-  void computeHeading(void);
-  void computeGravity(void);
-  void computeMagnetic(void);
+  void computeOrientation(void);     // Euler angles, heading, gravity & magnetic vectors from the quaternion
   float computeConvergenceError(void);
 
   bool calibrateAccGyro();
@@ -122,7 +168,8 @@ public:
   void resetMagOffsetCalibration(void);
   void resetSoftIron(void);
   void updateScatterMatrix(void);
-  bool computeSoftIronMatrix(void);
+  bool computeSoftIronMatrix(float center[3]);
+  bool isMagFitConverged(void) { return magFitStable >= MAG_FIT_STABLE_FITS; }
   void applySoftIronMatrix(void);
   bool isStillCalibration(void);
 
@@ -136,14 +183,13 @@ public:
   int16_t magX, magY, magZ;
   int16_t boardTemperatureRaw;
 
-  CRGBW8 blinkColor;
 
   float a_x, a_y, a_z, g_x, g_y, g_z, m_x, m_y, m_z; // variables to hold latest sensor data values
   float convError;
   float temperature, boardTemperature, mcuTemperature;
   float altitude, pressure;
   float pitch, yaw, roll, heading;
-  float q0 = 1.0f, q1 = 0.0f, q2 = 0.0f, q3 = 0.0f; // quaternion of sensor frame relative to auxiliary frame
+  float q[4] = {1.0f, 0.0f, 0.0f, 0.0f}; // w x y z - quaternion of sensor frame relative to auxiliary frame
   float grav_x, grav_y, grav_z; // Gravity vector
   float mag_x, mag_y, mag_z;    // Magnetic vector
   double bno055Data[4]; // stores Euler
@@ -162,7 +208,6 @@ private:
   bool stableMeanMag = false;
   bool hardIronOK = false;
   bool softIronOK = false;
-  uint32_t magSampleCount = 0;
   int gyroAutocalThreshold = GYRO_NOISEGATE;    // for Acc / Gyro
   uint32_t gyroOffsetAutocalCounter;              // time equivalent to nb valid stable samples
   uint32_t gyroOffsetAutocalTime = 1000;          // ms = 200 samples @5ms
@@ -183,7 +228,9 @@ private:
 
   // Mag Soft iron stuff
   float meanMag[3];     // To compare with mag min+max/2 above
-  double scatterMatrix[SCATTER_PARAM_COUNT][SCATTER_PARAM_COUNT];   // Scatter Matrix for elipsoid fitting
+  EllipsoidFit magFit;  // incremental, fed once the hard iron is stable
+  int magFitStable = 0;  // successive fits within MAG_FIT_xxx limits
+  uint32_t magFitReportTimer = 0;
   float softIronMatrix[3][3] = {{1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f},{0.0f, 0.0f, 1.0f}}; 
   float alphaSmoother = MEAN_SMOOTHER_ALPHA;
   
@@ -192,6 +239,8 @@ private:
   uint8_t orientation = TOP_NWU_LENGTH;
   uint32_t sampleRate = DEFAULT_SAMPLE_RATE;
   float deltat = 0.005f;        // integration interval for both filter schemes - 5ms by default
+  float measuredDeltat = 0.005f;  // actual period of the last sample (timer + task wake up latency)
+  uint8_t imuFrames = 1;        // number of IMU samples to fuse in compute() (FIFO mode)
 
   int gyro_bias[3] = { 0, 0, 0};
   int accel_bias[3] = { 0, 0, 0};
@@ -207,21 +256,39 @@ private:
   float gyroGate;
   float mag_nobias[3];
 
-  float recipNorm;
-  float s0, s1, s2, s3;
-  float qDot1, qDot2, qDot3, qDot4;
-  float hx, hy;
-  float _2q0mx, _2q0my, _2q0mz, _2q1mx, _2bx, _2bz, _4bx, _4bz, _2q0, _2q1, _2q2, _2q3, _2q0q2, _2q2q3, q0q0, q0q1, q0q2, q0q3, q1q1, q1q2, q1q3, q2q2, q2q3, q3q3;
-  float _4q0, _4q1, _4q2, _8q1, _8q2;
-  float _8bx, _8bz;
+  // Orientation filters, selected by setFusion()
+  MadgwickAhrs madgwick;
+  MahonyAhrs mahony;
+  ComplementaryAhrs complementary;
+  MadgwickFixedAhrs madgwickFixed;
+  FixedCalibration fixedCalibration;   // gyro gain & soft iron of madgwickFixed, filter frame
+  int32_t fixedMag[3];                 // latest mag in LSB minus the biases, filter frame
+  AhrsEngine *ahrs = &madgwick;
+  uint8_t fusion = FUSION_MADGWICK;
+
+  // Reference filter (validation), degrees
+  MadgwickAhrs reference;
+  bool referenceOn = false;
+  float qRef[4];
+  float referenceMaxError, referenceSumError;
+  uint32_t referenceCount;
+
   float halfMinusQySquared;
 
+  // FIFO batch converted to the filter frame by fuseFifo() (g, deg/s)
+  float fifoAcc[IMU_FIFO_MAX_SAMPLES][3];
+  float fifoGyro[IMU_FIFO_MAX_SAMPLES][3];
+
   // Heading calculation
   float iSinRoll, iCosRoll, iSinPitch, iCosPitch;
   float iBpx, iBpy, iBpz;
   float iBfx, iBfy, iBfz;  // de rotated values of the mag sensors set to NED frame
 
   linearInterpolator lerpBeta;
+
+  // Output decimation (fusion rate > output rate)
+  float decimationSum[DECIMATION_CHANNELS];
+  uint32_t decimationCount = 0;
   
   bool _initialized = false;  
 };
@@ -14,11 +14,11 @@
 // update. This saves a lot of time by NOT re computing the OSC structure
 // and padding, and limits data updates to RAM moves.
 void simpleOSC::begin(char *oscAddress, const char* typeTagString) {
-  int i;
+  uint32_t i;
 
   _slots = strlen(typeTagString);
   // Allocate the packet buffer with a rough estimate of the size + overhead
-  int rawSize = strlen(oscAddress) + 1 + (_slots * sizeof(int32_t)) + (2 * _slots) + 20;
+  uint32_t rawSize = strlen(oscAddress) + 1 + (_slots * sizeof(int32_t)) + (2 * _slots) + 20;
   if(rawSize%4)
     rawSize = rawSize + 4;
   end();
@@ -65,14 +65,17 @@ void simpleOSC::begin(char *oscAddress, const char* typeTagString) {
   // Eventually add here a warning if we have miscomputed the buffer size and have no packet size overhead
   // + trigger some exception (like end() the packet)
   if(_packetSize > rawSize) {
-    Serial.printf("[OSC] OSC buffer undersized. Need %d bytes, have %d bytes\n", _packetSize, rawSize);
+    Serial.printf("[OSC] OSC buffer undersized. Need %u bytes, have %u bytes\n", _packetSize, rawSize);
     end();
   }
 }
 
 
 void simpleOSC::end() {
-  delete _buf; 
+  if(_ownsBuffer)
+    delete[] _buf;
+  _buf = NULL;
+  _ownsBuffer = true;
   _packetSize = 0;
   _initialized = false;
   
@@ -198,6 +201,35 @@ void simpleOSC::addFloat(float val) {
 }
 
 
+// The message was copied to location (same layout) : the private buffer is released and
+// the data pointers moved there, so that rewind() / add*() now write in place
+void simpleOSC::attach(uint8_t *location) {
+  if(!_initialized)
+    return;
+
+  uint32_t dataOffset = _pData - _buf;
+  if(_ownsBuffer)
+    delete[] _buf;
+  _buf = location;
+  _ownsBuffer = false;
+  _pData = _buf + dataOffset;
+  _pBuf = _pData;
+}
+
+// Copies the message out of the bundle, which can then be rewound and laid out again
+void simpleOSC::detach() {
+  if(!_initialized || _ownsBuffer)
+    return;
+
+  uint32_t dataOffset = _pData - _buf;
+  uint8_t *copy = new uint8_t[_packetSize + OSC_BUFFER_OVERHEAD];
+  memcpy(copy, _buf, _packetSize);
+  _buf = copy;
+  _ownsBuffer = true;
+  _pData = _buf + dataOffset;
+  _pBuf = _pData;
+}
+
 void simpleOSC::rewind() {
   if(!_initialized)
     return;
@@ -229,6 +261,7 @@ void simpleBundle::begin(uint32_t buffSize) {
   // Allocate the packet buffer with a rough estimate of the size + overhead
   buffSize += _packetSize + sizeof(timetag) + OSC_BUFFER_OVERHEAD; 
   _buf = new uint8_t[buffSize];
+  _capacity = buffSize;
 #ifdef DEBUG_OSC  
   Serial.printf("Allocated (raw) size for OSC Bundle = %d\n", buffSize);
 #endif
@@ -246,7 +279,8 @@ void simpleBundle::begin(uint32_t buffSize) {
 
 
 void simpleBundle::end() {
-  delete _buf; 
+  delete[] _buf;
+  _buf = NULL;
   _packetSize = 0;
   _initialized = false;
   
@@ -292,6 +326,10 @@ bool simpleBundle::addMessage(uint8_t *buff, uint32_t buffSize) {
     Serial.printf("[OSC] error : size not padded correctly %d bytes\n", buffSize);
     return false;
   }
+  if(_packetSize + sizeof(buffSize) + buffSize > _capacity) {
+    Serial.printf("[OSC] error : bundle undersized, %d bytes message dropped\n", buffSize);
+    return false;
+  }
   uint32_t net_value = buffSize;
   net_value = htonl(net_value);
   memcpy(_pBuf, &net_value, sizeof(net_value));
@@ -304,8 +342,82 @@ bool simpleBundle::addMessage(uint8_t *buff, uint32_t buffSize) {
   return true;
 }
 
+// Lays out the message once at the end of the bundle (size + contents, like addMessage()) and moves
+// the message there. Its address, type tags and size never change, so later updates only write the
+// big endian data words straight in the bundle. Returns the bundle size including this message, so
+// that optional messages placed last can be left out by sending less bytes
+uint32_t simpleBundle::place(simpleOSC &message) {
+  if(addMessage(message.getBuffer(), message.getSize()))
+    message.attach(_pBuf - message.getSize());
+  return _packetSize;
+}
+
+void simpleBundle::setTimetag(uint64_t ntp) {
+  uint32_t net_value[2];
+
+  if(!_initialized)
+    return;
+  net_value[0] = htonl((uint32_t)(ntp >> 32));
+  net_value[1] = htonl((uint32_t)ntp);
+  memcpy(_pData - sizeof(net_value), net_value, sizeof(net_value));
+}
+
+// Appends the messages of an other bundle (without its header) : several samples sent in a single
+// packet, each message keeping its own timestamp
+bool simpleBundle::append(simpleBundle &bundle, uint32_t size) {
+  uint32_t length = size - bundle.getHeaderSize();
+
+  if(!_initialized || size < bundle.getHeaderSize())
+    return false;
+  if(_packetSize + length > _capacity) {
+    Serial.printf("[OSC] error : bundle undersized, %d bytes dropped\n", length);
+    return false;
+  }
+  memcpy(_pBuf, bundle.getDataPointer(), length);
+  _pBuf += length;
+  _packetSize += length;
+  return true;
+}
+
+
+void binaryFrame::begin(uint8_t moduleId, uint16_t maxSamples) {
+  end();
+  _maxSamples = max((uint16_t)1, maxSamples);
+  _buf = new uint8_t[sizeof(riotFrameHeader) + _maxSamples * sizeof(riotFrameSample)];
+  _header = (riotFrameHeader*)_buf;
+  _header->magic[0] = RIOT_FRAME_MAGIC_0;
+  _header->magic[1] = RIOT_FRAME_MAGIC_1;
+  _header->version = RIOT_FRAME_VERSION;
+  _header->moduleId = moduleId;
+  rewind(0, 0);
+}
+
+void binaryFrame::end() {
+  delete[] _buf;
+  _buf = NULL;
+  _maxSamples = 0;
+}
+
+void binaryFrame::rewind(uint32_t sequence, uint16_t streams) {
+  if(!_buf)
+    return;
+  _header->streams = streams;
+  _header->count = 0;
+  _header->sequence = sequence;
+}
+
+// The sample is cleared : the fields of the disabled streams are sent as 0
+riotFrameSample* binaryFrame::addSample() {
+  if(!_buf || _header->count >= _maxSamples)
+    return NULL;
+  riotFrameSample *sample = (riotFrameSample*)(_buf + sizeof(riotFrameHeader)) + _header->count++;
+  memset(sample, 0, sizeof(riotFrameSample));
+  return sample;
+}
+
 
-simpleBundle bundleOSC;
+simpleBundle bundleOSC, batchOSC;
+binaryFrame binaryStream;
 simpleOSC rawSensors;
-simpleOSC accelerometerOSC, gyroscopeOSC, magnetometerOSC, barometerOSC, temperatureOSC, gravityOSC, headingOSC, quaternionsOSC, eulerOSC, controlOSC, batteryOSC, analogInputsOSC, bno055EulerOSC, bno055QuatOSC;
+simpleOSC accelerometerOSC, gyroscopeOSC, magnetometerOSC, barometerOSC, temperatureOSC, gravityOSC, headingOSC, quaternionsOSC, eulerOSC, controlOSC, batteryOSC, analogInputsOSC, bno055EulerOSC, bno055QuatOSC, jitterOSC, sequenceOSC, syncOSC, switchOSC;
 simpleOSC printOscMessage;
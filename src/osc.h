@@ -59,12 +59,15 @@ public:
   uint8_t* getDataPointer() { return _pData; }
   uint8_t* getBuffer() { return _buf; }
   uint32_t getSize() { return _packetSize; }
+  void attach(uint8_t *location);   // the message now lives in a bundle buffer, see simpleBundle::place()
+  void detach();                     // back to its own buffer, before the bundle is laid out again
 
 
 private:
   void pad();
 
-  uint8_t *_buf;
+  uint8_t *_buf = NULL;
+  bool _ownsBuffer = true;
   uint8_t *_pData;        // to recall where data are, to insert them
   uint8_t *_pBuf;         // on going pointer when building the packet up
   uint32_t _packetSize;   // in bytes
@@ -75,7 +78,8 @@ private:
 
 // A bundle is mostly the concatenation of several OSC message + their size, built with the class above
 // This class copies the contents of the message to a single, large buffer containing them all
-// plus the #bundle header (padded)
+// plus the #bundle header (padded). Messages sent at each sample are rather placed once in the bundle
+// with place() : they are then filled in place and the bundle is ready to send, no copy
 class simpleBundle {
 
 public:
@@ -83,7 +87,11 @@ public:
   void end();
   void rewind();
   bool addMessage(uint8_t *buff, uint32_t buffSize);
+  uint32_t place(simpleOSC &message);
+  bool append(simpleBundle &bundle, uint32_t size);   // batching : copies the messages of the first size bytes of bundle
+  void setTimetag(uint64_t ntp);    // NTP time of the contents, 0 = immediate
   uint32_t getSize() { return _packetSize; }
+  uint32_t getHeaderSize() { return _pData - _buf; }   // #bundle + timetag
   uint8_t* getDataPointer() { return _pData; }
   uint8_t* getBuffer() { return _buf; }
 
@@ -91,19 +99,43 @@ public:
 private:
   void pad(bool force = false);
   
-  uint8_t *_buf;
+  uint8_t *_buf = NULL;
   uint8_t *_pData;    // to recall where data start, to insert them
   uint8_t *_pBuf;     // on going pointer when building the packet up
   uint32_t _packetSize;   // in bytes
+  uint32_t _capacity;     // allocated bytes
   uint64_t timetag = 0; // Immediate execution
   uint32_t net_timetag = htonl(timetag);
 
   bool _initialized = false;
 };
 
-extern simpleBundle bundleOSC;
+// Compact binary alternative to the bundle (format=1 key), see ./src/RiotFrame.h for the layout
+// which also serves as the decoder for the receivers. The samples are appended to a preallocated
+// buffer after rewind(), the header being completed as they are added
+class binaryFrame {
+
+public:
+  void begin(uint8_t moduleId, uint16_t maxSamples);
+  void end();
+  void rewind(uint32_t sequence, uint16_t streams);
+  riotFrameSample* addSample();   // NULL when full
+  uint16_t getCount() { return _header->count; }
+  uint16_t getCapacity() { return _maxSamples; }
+  uint32_t getSize() { return sizeof(riotFrameHeader) + _header->count * sizeof(riotFrameSample); }
+  uint8_t* getBuffer() { return _buf; }
+
+
+private:
+  uint8_t *_buf = NULL;
+  riotFrameHeader *_header;
+  uint16_t _maxSamples = 0;
+};
+
+extern simpleBundle bundleOSC, batchOSC;
+extern binaryFrame binaryStream;
 extern simpleOSC rawSensors;
-extern simpleOSC accelerometerOSC, gyroscopeOSC, magnetometerOSC, barometerOSC, temperatureOSC, gravityOSC, headingOSC, quaternionsOSC, eulerOSC, controlOSC, batteryOSC, analogInputsOSC, bno055EulerOSC, bno055QuatOSC;
+extern simpleOSC accelerometerOSC, gyroscopeOSC, magnetometerOSC, barometerOSC, temperatureOSC, gravityOSC, headingOSC, quaternionsOSC, eulerOSC, controlOSC, batteryOSC, analogInputsOSC, bno055EulerOSC, bno055QuatOSC, jitterOSC, sequenceOSC, syncOSC, switchOSC;
 extern simpleOSC printOscMessage;
 
 
@@ -57,8 +57,6 @@
   
   check current consumption with sensors in sleep mode, and various power saving modes of the ESP32
 
-  Selection map (bitfield) to define what is sent in OSC to reduce payload and trafic
-
   check if we accept domain names / URL instead of the IP (in parseConfig()) => use gethostbyname - assumes connection works to query DNS
 
   exporting charging vs. non charging via OSC : problematic while streaming as reading the charger state takes some time. Not viable for now
@@ -89,14 +87,10 @@
 
   explore a MIDI-BLE demo for a Hyvibe compatible pedal or a handheld controller for the guitar looper (tap on a zone to detect loop start stop)
  
-  Add oversampling of the orientation filter (see limits and how long it takes to compute madgwick) for better convergence and stability
-  then define an general ODR for data (OSC)
-
   add OLED support + display menus => Make a wristlet demo
 
   create an HTML page that displays the graphs of the sensors in HTML5 
 
-  local NTP server connection + OSC time tags ? => Use ISMM simplified NTP over OSC messages
   check if AP can be started without passphrase just SSID + open network ? 
 
   test Touch capacitive inputs
@@ -141,6 +135,8 @@ static int elapsedTimeServer;
 WebServer httpServer(HTTP_SERVER_PORT);   // This is the configuration webserver + OTA (same port : 80)
 WiFiClient client;
 WiFiUDP udpPacket;
+WiFiUDP streamPacket;    // OSC bundles, used by the network task only
+WiFiUDP switchPacket;    // switch events, used by the switch task only
 WiFiUDP configPacket;
 
 // The number 1024 between the < > below  is the maximum number of bytes reserved for incomming messages.
@@ -157,11 +153,12 @@ unsigned char serialIndex = 0;
 char serialBuffer1[MAX_SERIAL_LEN];   // Secondary TTL UART (Serial1)
 int serialIndex1 = 0;
 
-TimerHandle_t xTimerSwitches;
-void timerCallback(TimerHandle_t pxTimer);  // To poll switches & debounce
-
 
 void setup() {
+  // Boot phases until the first packet, reported by riot.reportBoot(). "startup" is the app startup
+  // before setup() (esp_timer runs from there)
+  uint32_t phase = bootProfile.add("startup", 0);
+
 // For autotest & debug (HW UART)
   Serial0.begin(115200);
   Serial0.setDebugOutput(false);
@@ -175,9 +172,8 @@ void setup() {
   u8g2.clearBuffer();
   u8g2.clearDisplay();
 
-  riot.init();
-  xTimerSwitches = xTimerCreate("switch_poll_timer",SWITCH_POLLING_PERIOD, pdTRUE, 0, timerCallback);
-  xTimerStart(xTimerSwitches, 0); // start now
+  riot.init();   // switches are interrupt driven from there
+  phase = bootProfile.add("serial+oled", phase);
   
   // CHECK FAT / File system. FormatOnFail doesn't work so well
   // F_Fat::begin(bool formatOnFail, const char * basePath, uint8_t maxOpenFiles, const char * partitionLabel)
@@ -190,11 +186,13 @@ void setup() {
     }
     restoreDefaults(true);
   }
+  phase = bootProfile.add("ffat", phase);
 
   // Checks for fw updates to perform
   // Review this : maybe call from main loop, disable MSD while performing update etc
   // see if Update.write() by chunks works better than Update.writeStream()
   updateFromFS(FFat);
+  phase = bootProfile.add("fw update", phase);
 
 
   // MASS STORAGE USB Driver to expose FFAT drive
@@ -209,22 +207,20 @@ void setup() {
   MSC.begin(DISK_SECTOR_COUNT, DISK_SECTOR_SIZE);
   
   USB.begin();
+  phase = bootProfile.add("usb msc", phase);
   
   delay(riot.getSlowBoot());
+  phase = bootProfile.add("slowboot", phase);
 
   ///////////////////////////////////////////////////////////////////////////
   //// Init sensors and motion engine
+  // The BNO055 (I2C, 650ms boot wait) is probed on its own task, in parallel with the rest of the boot
+  riot.startBno055();
   lsm6d.begin(PIN_CS_ACC_GYR);
   lis3mdl.begin(PIN_CS_MAG);
   bmp390.begin(PIN_CS_ATM);
-  // Check presence of BNO055 on I2C
-  if(bno055.begin().TestConnection()) {
-    Serial.println("Found BNO055 sensor\n");
-    riot.bno055Found(true);
-    bno055.Initialize();
-    bno055.Set_Mode(NDOF);  // 9DoF fusion
-  }
   motion.init();
+  phase = bootProfile.add("sensors", phase);
   
   int parsingTime = millis();
   Serial.printf("Parsing configuration file\n\n");
@@ -235,20 +231,10 @@ void setup() {
   
   Serial.printf("\nFinished Parsing config in %dms\n", millis() - parsingTime);  
   Serial.println("Params Loaded");
+  phase = bootProfile.add("config", phase);
 
   motion.begin(); // Must be executed after parsing file to compute biases from config
-
-  /////////////////////////////////////////////////////////////////////////////////////////
-  // Some self-diag @boot time
-  riot.version();  // populates the version string (+MAC) + displays it - logs to file if version.txt not present
-  Serial.printf("Battery = %f Volts\n", readBatteryVoltage());
-  Serial.printf("USB = %f Volts\n", readUsbVoltage());
-  Serial.printf("Battery Charge : %s\n", readChargeStatus() ? "Charging" : "Finished");
-  uint64_t chipid = ESP.getEfuseMac(); //The chip ID is essentially its MAC address(length: 6 bytes).
-  Serial.printf("ESP32 Chip ID = %04X", (uint16_t)(chipid >> 32)); //print High 2 bytes
-  Serial.printf("%08X\n", (uint32_t)chipid); //print Low 4bytes.
-  Serial.printf("Flash Drive Total space: %u bytes\n", FFat.totalBytes());
-  Serial.printf("Flash Drive Free space: %u bytes\n", FFat.freeBytes());
+  phase = bootProfile.add("motion", phase);
 
   /////////////////////////////////////////////////////////////////////////////////////////
   // Check if we are going in configuration mode (+webserver + OTA)
@@ -257,10 +243,8 @@ void setup() {
   int configModeCounter = millis();
   bool blinkIt = false;
   riot.setOperationState(RIOT_STREAMING);
-  riot.poll();
   while (riot.onBoardSwitch.pressed()) {
     delay(20);
-    riot.poll();
     blinkIt = !blinkIt;
     setLedColor(blinkIt ? Red : Black);
 
@@ -273,13 +257,30 @@ void setup() {
       break;
     }
   }
+  phase = bootProfile.add("config mode", phase);
 
   // Improve seeding with motion sensor, port what is done with CFX with the new seed initializer
   randomSeed((int)(readBatteryVoltage() * 1000.f));
 
   riot.begin();
-  // Initiates the wifi connection, state machine will be processed in the main loop
+  // Initiates the wifi connection right now, the state machine is then processed in the main loop.
+  // The association runs in the WiFi tasks during the self-diag below and the BNO055 init
   riot.start();
+  riot.update();
+  phase = bootProfile.add("wifi start", phase);
+
+  /////////////////////////////////////////////////////////////////////////////////////////
+  // Some self-diag @boot time
+  riot.version();  // populates the version string (+MAC) + displays it - logs to file if version.txt not present
+  Serial.printf("Battery = %f Volts\n", readBatteryVoltage());
+  Serial.printf("USB = %f Volts\n", readUsbVoltage());
+  Serial.printf("Battery Charge : %s\n", readChargeStatus() ? "Charging" : "Finished");
+  uint64_t chipid = ESP.getEfuseMac(); //The chip ID is essentially its MAC address(length: 6 bytes).
+  Serial.printf("ESP32 Chip ID = %04X", (uint16_t)(chipid >> 32)); //print High 2 bytes
+  Serial.printf("%08X\n", (uint32_t)chipid); //print Low 4bytes.
+  Serial.printf("Flash Drive Total space: %u bytes\n", FFat.totalBytes());
+  Serial.printf("Flash Drive Free space: %u bytes\n", FFat.freeBytes());
+  bootProfile.add("self-diag", phase);
   
   if(riot.isCalibrate())
     Serial.println("Calibration available for now");
@@ -291,14 +292,16 @@ void loop() {
   riot.update();      // Updates the network/Wifi connection state machine
   riot.calibrate();   // Handles the streaming / calibration state machine
   riot.charge();      // Handles the module's charge vs. streaming based on selected mode
+  riot.sync();        // Clock sync requests to the host (syncport=)
+  riot.reportBoot();  // Boot phases, once the first packet is sent
+  riot.saveRecord();  // Trace of the record command, once complete
+  sendPostedOSC();    // Texts of the fusion task (autocalibration)
 
-  // The main process of the module : sensors acquisition, computation, OSC streaming
+  // The main process of the module (sensors acquisition, computation, OSC streaming) runs on the
+  // fusion (core 1) and network (core 0) tasks, see riotCore::startFusion()
   if(riot.isStreaming()) {
-
-    riot.process();
-
     // Incoming messages consume 170µs with wifi / UDP processing but no harm to the main loop
-    if (riot.isOSCinput()) {
+    if (riot.isOSCinput() || riot.isSyncEnabled()) {
       //Serial.println("osc in check");
       // Parses incoming OSC messages
       oscUdp.receiveMessages( receivedOscMessage );  
@@ -389,6 +392,20 @@ void receivedOscMessage( MicroOscMessage& message) {
   int32_t firstArgument;
   char line[MAX_STRING_LEN];
   
+  // Clock sync server answer : request number, receive & transmit NTP times (seconds, fraction)
+  if(message.fullMatch("/sync", "iiiii") ) {
+    uint32_t sequence = message.nextAsInt();
+    uint64_t t2 = (uint64_t)(uint32_t)message.nextAsInt() << 32;
+    t2 |= (uint32_t)message.nextAsInt();
+    uint64_t t3 = (uint64_t)(uint32_t)message.nextAsInt() << 32;
+    t3 |= (uint32_t)message.nextAsInt();
+    riot.syncResponse(sequence, t2, t3);
+    return;
+  }
+  // The port is also open for the sync answers only
+  if(!riot.isOSCinput())
+    return;
+
   if(message.fullMatch("/output", "i") ) {
     firstArgument = message.nextAsInt();
     firstArgument = constrain(firstArgument, false, true);
@@ -406,42 +423,10 @@ void receivedOscMessage( MicroOscMessage& message) {
   }
   else if(message.fullMatch(riot.getOscAddress(), "s") ) {
     strcpy(line, message.nextAsString());
-    // Parsing message commands
-    if(!strncmp(TEXT_PING, line, strlen(TEXT_PING))) {
-      Serial.printf("%s\n", TEXT_ECHO);
-      printToOSC(TEXT_ECHO);
-      return;
-    }
-    else if(!strncmp(TEXT_GO_COMMAND, line, strlen(TEXT_GO_COMMAND))) {
-      printToOSC("Next Step");
-      motion.nextStep(true);  // Proceed with calibration - emulates the switch press
-      return;
-    }
-    else if(!strncmp(TEXT_CANCEL_COMMAND, line, strlen(TEXT_CANCEL_COMMAND))) {
-      printToOSC("Cancelling operation");
-      motion.cancel(true);  // Cancel calibration - emulates the switch press
-      return;
-    }
-    else if(!strncmp(TEXT_AUTOCAL_MAG, line, strlen(TEXT_AUTOCAL_MAG))) {
-      printToOSC("Starting Mag Calibration");
-      motion.runAutoCalMag();
-      return;
-    }
-    else if(!strncmp(TEXT_AUTOCAL_MOTION, line, strlen(TEXT_AUTOCAL_MOTION))) {  
-      printToOSC("Starting Acc-Gyro Calibration");  
-      motion.runAutoCalMotion();
-      return;
-    }
-    else if(!strncmp(TEXT_SAVE_CONFIG, line,strlen(TEXT_SAVE_CONFIG))) { // Saves config to FLASH
-      storeConfig();
-      printToOSC("Config saved");
-      return;
-    }
-    else if(!strncmp(TEXT_REBOOT, line,strlen(TEXT_REBOOT))) { // Saves config to FLASH
-      // Reboot is needed to use new settings - force reboot with the watchdog or another technique or wait for the reset command
-      printToOSC("Reboot module");
-      reset();
-      return;
+    // Any setting (acknowledged on /ack) or the CMD_REMOTE commands, that reply with printToOSC()
+    if(!dispatchCommand(line, SOURCE_OSC)) {
+      Serial.printf("[RX] Unknown OSC command %s\n", line);
+      ackToOSC(line, "error");
     }
     // implement getIP, wifi RSSI etc.
   }
@@ -451,12 +436,6 @@ void receivedOscMessage( MicroOscMessage& message) {
 }
 
 
-// Xtimer polling & debouncing switches @SWITCH_POLLING_PERIOD
-void timerCallback(TimerHandle_t pxTimer) {
-    riot.poll();
-}
-
-
 //////////////////////////////////////////////////////////////////////////////////////////////
 // USB MSD callbacks
 static int32_t onWrite(uint32_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize) {
@@ -3,6 +3,13 @@
 // including disconnect / reconnect etc
 
 #include "riot.h"
+#include <Preferences.h>
+#include "esp_rom_crc.h"
+#include "esp_netif.h"
+#include "esp_netif_net_stack.h"
+#include "lwip/dhcp.h"
+#include "lwip/etharp.h"
+#include "lwip/tcpip.h"
 
 void WiFiEvent(WiFiEvent_t event);
 
@@ -12,6 +19,51 @@ IPAddress defaultSubnetMask(255, 255, 255, 0);
 IPAddress defaultGatewayIP(192, 168, 1, 1);
 IPAddress defaultDestinationIP(192, 168, 1, 100);
 
+// Messages of the bundle in their sending order with their streams= bit. The jitter message must
+// remain last so that it can be left out of the packet (bundleStreamSize), see process()
+static const struct {
+  simpleOSC *message;
+  uint32_t stream;
+} bundleLayout[] = {
+  {&accelerometerOSC, STREAM_ACCELEROMETER},
+  {&gyroscopeOSC,     STREAM_GYROSCOPE},
+  {&magnetometerOSC,  STREAM_MAGNETOMETER},
+  {&barometerOSC,     STREAM_BAROMETER},
+  {&temperatureOSC,   STREAM_TEMPERATURE},
+  {&quaternionsOSC,   STREAM_QUATERNION},
+  {&eulerOSC,         STREAM_EULER},
+  {&gravityOSC,       STREAM_GRAVITY},
+  {&headingOSC,       STREAM_HEADING},
+  {&bno055EulerOSC,   STREAM_BNO055},
+  {&bno055QuatOSC,    STREAM_BNO055},
+  {&batteryOSC,       STREAM_BATTERY},
+  {&analogInputsOSC,  STREAM_ANALOG},
+  {&controlOSC,       STREAM_CONTROL},
+  {&sequenceOSC,      STREAM_SEQUENCE},
+  {&jitterOSC,        STREAM_JITTER},
+};
+#define BUNDLE_MESSAGES   (int)(sizeof(bundleLayout) / sizeof(bundleLayout[0]))
+
+
+BootProfiler<BOOT_PHASES> bootProfile;
+
+// Woken by the switches interrupts, and at the debounce deadline of each switch that ignored an edge
+static void switchTask(void *) {
+  Switch *switches[] = {&riot.onBoardSwitch, &riot.auxSwitch};
+  for (;;) {
+    TickType_t wait = portMAX_DELAY;
+    int64_t now = esp_timer_get_time();
+    for (Switch *sw : switches) {
+      if (!sw->isBouncing())
+        continue;
+      int64_t left = sw->getSettleDeadline() - now;
+      TickType_t ticks = (left > 0) ? pdMS_TO_TICKS((uint32_t)((left + 999) / 1000)) : 0;
+      wait = min(wait, max((TickType_t)1, ticks));
+    }
+    ulTaskNotifyTake(pdTRUE, wait);
+    riot.processSwitches();
+  }
+}
 
 riotCore::riotCore() {
 }
@@ -22,6 +74,10 @@ riotCore::~riotCore() {
 }
 
 void riotCore::init() {
+  if(!motionMutex)
+    motionMutex = xSemaphoreCreateRecursiveMutex();   // also used during the boot (BNO055 task)
+  if(!networkMutex)
+    networkMutex = xSemaphoreCreateMutex();
   debugMode = false;
   setSSID(DEFAULT_SSID);
   setOwnIP(defaultIP);
@@ -53,11 +109,13 @@ void riotCore::init() {
   Wire.begin();
 
   pinMode(PIN_NEOPIXEL, OUTPUT);   // RGB Pixel output (WS2812)
+  startLed();
   setLedColor(Red);  // RED
   pinMode(PIN_SWITCH_GND, OUTPUT);
   digitalWrite(PIN_SWITCH_GND, LOW);
   pinMode(PIN_OPTION_SW, INPUT_PULLUP);
   pinMode(PIN_CHARGE_STATUS, INPUT);
+  startChargeDetection();
   pinMode(REMOTE_OUTPUT, OUTPUT);
   digitalWrite(REMOTE_OUTPUT, RemoteOutputState);
   pinMode(39, OUTPUT);
@@ -72,14 +130,16 @@ void riotCore::init() {
   
   onBoardSwitch.begin(SWITCH_INPUT, MomentarySwitch);
   auxSwitch.begin(SWITCH2_INPUT, MomentarySwitch);
-  onBoardSwitch.poll();
-  auxSwitch.poll();
+  if (!switchTaskHandle)
+    xTaskCreatePinnedToCore(switchTask, "switch", SWITCH_TASK_STACK, NULL, SWITCH_TASK_PRIORITY, &switchTaskHandle, SWITCH_TASK_CORE);
+  onBoardSwitch.enableInterrupt(switchTaskHandle);
+  auxSwitch.enableInterrupt(switchTaskHandle);
 
   // Analog Inputs
   analogReadResolution(12);
   pinMode(ANALOG_INPUT, INPUT);
   pinMode(ANALOG2_INPUT, INPUT);
-  batteryVoltageFiltered.init(readBatteryVoltage());
+  startAdc();
 
   if(!EEPROM.begin(20)) {
     Serial.println("Failed to initialize EEPROM");
@@ -103,6 +163,112 @@ void riotCore::writeSlowBoot() {
   EEPROM.commit();
 }
 
+static uint32_t networkCrc(const char *ssid, const char *password) {
+  uint32_t crc = esp_rom_crc32_le(0, (const uint8_t*)ssid, strlen(ssid) + 1);
+  return esp_rom_crc32_le(crc, (const uint8_t*)password, strlen(password) + 1);
+}
+
+// Last AP + lease, only kept if it was for the current ssid / password
+void riotCore::loadWifiCache() {
+  Preferences prefs;
+  lastAPValid = false;
+  if (!prefs.begin(WIFI_CACHE_NAMESPACE, true))
+    return;
+  if (prefs.getBytes(WIFI_CACHE_KEY, &lastAP, sizeof(lastAP)) == sizeof(lastAP)
+      && lastAP.magic == WIFI_CACHE_MAGIC && lastAP.network == networkCrc(ssid, password))
+    lastAPValid = true;
+  prefs.end();
+}
+
+// lwIP interface of the station, NULL until the WiFi is started. Under the lwIP core lock
+static struct netif* stationNetif() {
+  esp_netif_t *station = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+  return station ? (struct netif*)esp_netif_get_netif_impl(station) : NULL;
+}
+
+// Lease time granted by the DHCP server (s), 0 if unknown
+static uint32_t dhcpLeaseTime() {
+  uint32_t lease = 0;
+  LOCK_TCPIP_CORE();
+  struct netif *netif = stationNetif();
+  struct dhcp *dhcp = netif ? netif_dhcp_data(netif) : NULL;
+  if (dhcp)
+    lease = dhcp->offered_t0_lease;
+  UNLOCK_TCPIP_CORE();
+  return lease;
+}
+
+// ARP request to the gateway (send = true) or whether it answered
+static bool arpGateway(uint32_t gateway, bool send) {
+  ip4_addr_t address = {gateway};
+  struct eth_addr *eth;
+  const ip4_addr_t *ip;
+  bool found = false;
+  LOCK_TCPIP_CORE();
+  struct netif *netif = stationNetif();
+  if (netif) {
+    if (send)
+      etharp_request(netif, &address);
+    else
+      found = etharp_find_addr(netif, &address, &eth, &ip) >= 0;
+  }
+  UNLOCK_TCPIP_CORE();
+  return found;
+}
+
+// The cached lease is reused as static IP for a few connections only : there is no clock across the boots
+// to age it, and a DHCP exchange is the only way to tell the server it's still in use
+bool riotCore::isLeaseUsable() {
+  return lastAPValid && lastAP.ip && lastAP.leaseTime && lastAP.leaseReuses < WIFI_LEASE_REUSES;
+}
+
+// Reused lease found stale or too old : next connection goes through DHCP (same AP, no scan)
+void riotCore::dropLease(const char *reason) {
+  Serial.printf("%s, back to DHCP\n", reason);
+  lastAP.ip = 0;
+  fastAttempt = false;
+  gatewayCheck = 0;
+  WiFi.disconnect();
+}
+
+// Called once connected : only written when the AP, channel or lease changed. A reused lease keeps its
+// time and counts one more reuse, a DHCP one starts over
+void riotCore::saveWifiCache() {
+  wifiCache current;
+  memset(&current, 0, sizeof(current));
+  current.magic = WIFI_CACHE_MAGIC;
+  current.network = networkCrc(ssid, password);
+  memcpy(current.bssid, WiFi.BSSID(), sizeof(current.bssid));
+  current.channel = WiFi.channel();
+  if (useDHCP && !leaseReused) {
+    current.ip = WiFi.localIP();
+    current.gateway = WiFi.gatewayIP();
+    current.mask = WiFi.subnetMask();
+    current.dns = WiFi.dnsIP();
+    current.leaseTime = dhcpLeaseTime();
+  }
+  else if (leaseReused) {
+    current.ip = lastAP.ip;
+    current.gateway = lastAP.gateway;
+    current.mask = lastAP.mask;
+    current.dns = lastAP.dns;
+    current.leaseTime = lastAP.leaseTime;
+    current.leaseReuses = lastAP.leaseReuses + 1;
+  }
+  if (!memcmp(&current, &lastAP, sizeof(current))) {
+    lastAPValid = true;
+    return;
+  }
+
+  Preferences prefs;
+  if (!prefs.begin(WIFI_CACHE_NAMESPACE, false))
+    return;
+  prefs.putBytes(WIFI_CACHE_KEY, &current, sizeof(current));
+  prefs.end();
+  lastAP = current;
+  lastAPValid = true;
+}
+
 // Basic inits of the core behaviors go there, OSC mostly
 void riotCore::begin() {
 
@@ -122,6 +288,7 @@ void riotCore::begin() {
       Serial.print("R-IoT connecting to: ");
       // print the network name (SSID);
       Serial.println(ssid);
+      loadWifiCache();
     }
     else { // AP mode
       setLedColor(Red);
@@ -172,8 +339,11 @@ void riotCore::begin() {
     sprintf(str, "/%s/%s/%d/%s/%s", OSC_STRING_SOURCE, OSC_STRING_API_VERSION, moduleID, OSC_STRING_CONTROL, OSC_STRING_KEY);
     controlOSC.begin(str, "ffi");
 
+    sprintf(str, "/%s/%s/%d/%s/%s", OSC_STRING_SOURCE, OSC_STRING_API_VERSION, moduleID, OSC_STRING_CONTROL, OSC_STRING_SWITCH);
+    switchOSC.begin(str, "iii"); // switch (1 = on board, 2 = aux), pressed / released, µs time of the edge
+
     sprintf(str, "/%s/%s/%d/%s", OSC_STRING_SOURCE, OSC_STRING_API_VERSION, moduleID, OSC_STRING_BATTERY);
-    batteryOSC.begin(str, "fii"); // battery State of Charge (SoC) normalized {0;1} + charging or not.
+    batteryOSC.begin(str, "fii"); // battery State of Charge (SoC) normalized {0;1} + charge state (s_chargeState)
     
     sprintf(str, "/%s/%s/%d/%s", OSC_STRING_SOURCE, OSC_STRING_API_VERSION, moduleID, OSC_STRING_ANALOG);
     analogInputsOSC.begin(str, "fffi"); // Battery voltage, AN0 & AN1
@@ -184,10 +354,24 @@ void riotCore::begin() {
     sprintf(str, "/%s/%s/%d/%s/%s", OSC_STRING_SOURCE, OSC_STRING_API_VERSION, moduleID, OSC_STRING_BNO055, OSC_STRING_QUATERNION);
     bno055QuatOSC.begin(str, "ffffi");
 
-    uint32_t bundleSize = accelerometerOSC.getSize() + gyroscopeOSC.getSize() + magnetometerOSC.getSize() + barometerOSC.getSize();
-    bundleSize += temperatureOSC.getSize() + gravityOSC.getSize() + headingOSC.getSize() + quaternionsOSC.getSize() + eulerOSC.getSize();
-    bundleSize += controlOSC.getSize() + analogInputsOSC.getSize() + bno055EulerOSC.getSize() + bno055QuatOSC.getSize();
+    sprintf(str, "/%s/%s/%d/%s", OSC_STRING_SOURCE, OSC_STRING_API_VERSION, moduleID, OSC_STRING_JITTER);
+    jitterOSC.begin(str, "iiii"); // min, max, p99 inter-sample interval in µs
+
+    sprintf(str, "/%s/%s/%d/%s", OSC_STRING_SOURCE, OSC_STRING_API_VERSION, moduleID, OSC_STRING_SEQUENCE);
+    sequenceOSC.begin(str, "ii"); // sample counter, acquisition time in µs
+
+    sprintf(str, "/%s/%s/%d/%s", OSC_STRING_SOURCE, OSC_STRING_API_VERSION, moduleID, OSC_STRING_SYNC);
+    syncOSC.begin(str, "i"); // clock sync request number, sent to the sync server
+
+    // Sized for all the streams, so that the streams= key can enable them at any time
+    uint32_t bundleSize = 0;
+    for (int i = 0; i < BUNDLE_MESSAGES; i++)
+      bundleSize += sizeof(uint32_t) + bundleLayout[i].message->getSize();   // + size prefix of each message
     bundleOSC.begin(bundleSize);
+    batchOSC.begin(max(bundleSize, (uint32_t)BATCH_MAX_PAYLOAD));
+    binaryStream.begin(moduleID, MAX_BATCH_SIZE);
+    layoutBundle();
+    startFusion();
   }
 
   // If in configuration mode we setup a webserver for configuring the unit
@@ -197,7 +381,7 @@ void riotCore::begin() {
     WiFi.softAPConfig(accessPointIP, accessPointIP, subnetMask);
     uint64_t chipid = ESP.getEfuseMac(); //The chip ID is essentially its MAC address(length: 6 bytes).
     uint8_t *id = (uint8_t*)&chipid;
-    sprintf(ssidAP, "RIOT-%02x:%02x\0", id[4], id[5]); // Uses the 6 HEX numbers of the MAC address in the AP/SSID name
+    sprintf(ssidAP, "RIOT-%02x:%02x", id[4], id[5]); // Uses the 6 HEX numbers of the MAC address in the AP/SSID name
     Serial.printf("Setting up Access Point named: %s\n", ssidAP);
 
     WiFi.softAP(ssidAP, DEFAULT_AP_PASSWORD, channel, false);  // hidden = false - Beware, password must be 8 char long minimum
@@ -216,13 +400,32 @@ void riotCore::start(void) {
 }
 
 void riotCore::connect(void) {
+  if (!connectTime)
+    connectTime = bootProfile.now();
+  if (!connectStart)
+    connectStart = millis();
+
+  // Directed to the last AP : no scan of all the channels. The cached lease skips DHCP while it's usable
+  fastAttempt = (fastConnect != FAST_CONNECT_OFF) && lastAPValid;
+  bool reuseLease = fastAttempt && useDHCP && (fastConnect == FAST_CONNECT_LEASE) && isLeaseUsable();
 
   if (!useDHCP) // DNS = gateway IP
     WiFi.config(localIP, gatewayIP, gatewayIP, subnetMask);
+  else if (reuseLease)
+    WiFi.config(IPAddress(lastAP.ip), IPAddress(lastAP.gateway), IPAddress(lastAP.mask), IPAddress(lastAP.dns));
+  else if (leaseReused) // back to DHCP
+    WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+  leaseReused = reuseLease;
   // This step shouldn't be needed, a blank password should connect without security
   // To double check with ESP32 APIP
   WiFi.mode(WIFI_STA);
-  WiFi.begin(ssid, password);
+  if (fastAttempt) {
+    Serial.printf("Fast connect to %02X:%02X:%02X:%02X:%02X:%02X channel %u%s\n", lastAP.bssid[0], lastAP.bssid[1],
+      lastAP.bssid[2], lastAP.bssid[3], lastAP.bssid[4], lastAP.bssid[5], lastAP.channel, leaseReused ? " (last lease)" : "");
+    WiFi.begin(ssid, password, lastAP.channel, lastAP.bssid);
+  }
+  else
+    WiFi.begin(ssid, password);
   // Stores the MAC ADDRESS for further use (like AP naming)
   WiFi.macAddress(mac);
   Serial.printf("Retrieved STA MAC %02X:%02X:%02X:%02X:%02X:%02X\n", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
@@ -232,16 +435,33 @@ void riotCore::connect(void) {
 }
 
 
-void riotCore::poll() {
-  // Xtimer task should take care of speed limiter here
-  // but we still prevent a direct call from overriding
-  // polling period
-  if (millis() - pollingTimer < SWITCH_POLLING_PERIOD)
-    return;
+// Switch events (press / release, µs timestamp of the edge) : sent at once in their own OSC message
+// and the on board switch ones handed to calibrate()
+void riotCore::processSwitches() {
+  Switch *switches[] = {&onBoardSwitch, &auxSwitch};
+  SwitchEvent event;
+  uint32_t time;
+
+  for (int i = 0; i < 2; i++) {
+    switches[i]->settle();
+    while ((event = switches[i]->getEvent(&time)) != SwitchNothing) {
+      if (switches[i] == &onBoardSwitch)
+        switchEvents.push(event);
+      sendSwitch(i + 1, event, time);
+    }
+  }
+}
 
-  pollingTimer = millis();
-  onBoardSwitch.poll();
-  auxSwitch.poll();
+void riotCore::sendSwitch(uint8_t index, SwitchEvent event, uint32_t time) {
+  if (!isConnected() || !isStreamed(STREAM_CONTROL))
+    return;
+  switchOSC.rewind();
+  switchOSC.addInt(index);
+  switchOSC.addInt(event == SwitchPressed);
+  switchOSC.addInt(time);
+  switchPacket.beginPacket(destIP, destPort);
+  switchPacket.write(switchOSC.getBuffer(), switchOSC.getSize());
+  switchPacket.endPacket();
 }
 
 // Processes the wifi state machine
@@ -250,11 +470,13 @@ void riotCore::update() {
   static int cnt = 0;
   static bool blinkIt = false;
 
-  // Ressources saver and times info display
-  if (millis() - connectingTimer < CONNECTING_TIMER_UPDATE) {
-    return;
+  // The connection steps are taken as soon as the WiFi events come (they used to wait for the next
+  // 300ms tick each), only the connecting display (dots, LED blink) is paced
+  if (stateMachine == RIOT_CONNECTING) {
+    if (millis() - connectingTimer < CONNECTING_TIMER_UPDATE)
+      return;
+    connectingTimer = millis();
   }
-  connectingTimer = millis();
 
   switch (stateMachine) {
     case RIOT_DISCONNECTED:
@@ -270,6 +492,14 @@ void riotCore::update() {
       break;
 
     case RIOT_CONNECTING:
+      // The last AP didn't answer on its channel : the disconnection event brings us back to a full scan
+      if (fastAttempt && (millis() - connectStart > WIFI_FAST_TIMEOUT)) {
+        Serial.printf("\nLast AP not found\n");
+        lastAPValid = false;
+        fastAttempt = false;
+        WiFi.disconnect();
+        break;
+      }
       Serial.printf(".");
       cnt++;
       if (cnt > CONNECTING_MAX_DOTS) {
@@ -303,6 +533,17 @@ void riotCore::update() {
       break;
 
     case RIOT_GOT_IP:
+      // Reused lease : the gateway must answer on it, else the address may be someone else's by now
+      if (leaseReused && !gatewayCheck) {
+        gatewayCheck = gatewayRequest = millis() | 1;
+        arpGateway(lastAP.gateway, true);
+        stateMachine = RIOT_CHECK_GATEWAY;
+        break;
+      }
+      gatewayCheck = 0;
+      leaseStart = millis();
+      if (!gotIpTime)
+        gotIpTime = bootProfile.add("wifi", connectTime);
       Serial.printf("\nGot IP :-)\n");
       localIP = WiFi.localIP();
       printCurrentNet();
@@ -315,13 +556,55 @@ void riotCore::update() {
       stateMachine = RIOT_CONNECTED;
       //setLedColor(Blue);
       Serial.println("\nConnected to the network");
+
+      // Connection metrics, from the request (boot) or the loss of the previous connection
+      if (connectStart) {
+        connectDuration = millis() - connectStart;
+        connectDurationMax = max(connectDurationMax, connectDuration);
+        connectStart = 0;
+        connections++;
+        if (fastAttempt)
+          fastConnections++;
+        char str[MAX_STRING_LEN];
+        snprintf(str, sizeof(str), "%s %u %u %u %u", TEXT_WIFI_RECONNECT, connections, connectDuration,
+          connectDurationMax, fastConnections);
+        Serial.printf("Connected in %ums (%s)\n", connectDuration, fastAttempt ? "fast" : "scan");
+        printToOSC(str);
+      }
+      saveWifiCache();
+      fastAttempt = false;
+      break;
+
+    case RIOT_CHECK_GATEWAY:
+      if (arpGateway(lastAP.gateway, false)) {
+        stateMachine = RIOT_GOT_IP;
+        break;
+      }
+      if (millis() - gatewayCheck > WIFI_GATEWAY_TIMEOUT) {
+        dropLease("Gateway unreachable on the last lease");
+        break;
+      }
+      if (millis() - gatewayRequest > WIFI_GATEWAY_RETRY) {
+        gatewayRequest = millis();
+        arpGateway(lastAP.gateway, true);
+      }
       break;
 
     case RIOT_CONNECTED:
+      // The server expects a renewal at half the lease : a DHCP exchange refreshes the cache
+      if (leaseReused && (millis() - leaseStart) / 1000 > lastAP.leaseTime / 2)
+        dropLease("Reused lease at half its time");
       break;
 
     case RIOT_LOST_CONNECTION:
       Serial.printf("WIFI lost connnection or unable to connect\n");
+      gatewayCheck = 0;
+      if (!connectStart)
+        connectStart = millis();
+      if (fastAttempt) {   // the last AP is gone (or moved) : full scan
+        lastAPValid = false;
+        fastAttempt = false;
+      }
       start();
       break;
 
@@ -333,8 +616,15 @@ void riotCore::update() {
 
 // Processes the operation state machine (streaming vs. calibration)
 void riotCore::calibrate() {
-  static int winkCounter = 0;
   char str[MAX_STRING_LEN];
+  // Keeps the fusion task off the sensors while calibrating
+  bool locked = isCalibrating();
+  if(locked)
+    lockMotion();
+  // One on board switch event per call (switch task), steps are taken on the press
+  SwitchEvent event = SwitchNothing;
+  switchEvents.pop(event);
+  bool pressed = (event == SwitchPressed);
   
   switch(operationStateMachine) {
     case RIOT_IDLE:
@@ -343,11 +633,8 @@ void riotCore::calibrate() {
     // We autorize changing to calibration only when Streaming (and being connected)
     case RIOT_STREAMING:
       if(calibrationEnabled) {
-        if((millis() - calibrationTimer) < calibrationCountdown) {
-          if(onBoardSwitch.pressed() || motion.isNextStep()) {
-            setLedColor(Red);
-            while(onBoardSwitch.pressed())
-              delay(20);
+        if((millis() - calibrationTimer) < (uint32_t)calibrationCountdown) {
+          if(pressed || motion.isNextStep()) {
             calibrationEnabled = false;
             motion.nextStep(false);
             setLedColor(Yellow);
@@ -371,9 +658,7 @@ void riotCore::calibrate() {
       break;
       
     case RIOT_START_CALIBRATION_ACC_GYR:  
-      if(onBoardSwitch.pressed() || motion.isNextStep()) { 
-        while(onBoardSwitch.pressed())
-          delay(20);
+      if(pressed || motion.isNextStep()) { 
         motion.resetAccOffsetCalibration();
         motion.resetGyroOffsetCalibration();
         motion.nextStep(false);
@@ -382,18 +667,15 @@ void riotCore::calibrate() {
       break;
       
     case RIOT_CALIBRATION_ACC_GYR:
-      if(onBoardSwitch.pressed() || motion.isNextStep()) {
+      if(pressed || motion.isNextStep()) {
         Serial.println("Acc-Gyro Calibration interrupted");
-        while(onBoardSwitch.pressed())
-          delay(20);
         motion.nextStep(false);  
         setOperationState(RIOT_STREAMING);
         break;
       } 
       if(motion.calibrateAccGyro()) { // if acc-gyro ended after found stable
         setOperationState(RIOT_START_CALIBRATION_MAG);
-        winkCounter = 0;
-        setLedColor(White);
+        blinkLed(White, CALIBRATION_WINK_ON, CALIBRATION_WINK_OFF);   // awaiting next calibration step
         motion.nextStep(false);
         sprintf(str, "MAG calibration - Press Switch (or GO) & Max out all axis");
         Serial.printf("%s\n", str);
@@ -402,33 +684,18 @@ void riotCore::calibrate() {
       break;
 
     case RIOT_START_CALIBRATION_MAG: 
-      if(onBoardSwitch.pressed() || motion.isNextStep()) { // Waits for the GP switch to proceed to mag calibration
-        while(onBoardSwitch.pressed())
-          delay(20);
+      if(pressed || motion.isNextStep()) { // Waits for the GP switch to proceed to mag calibration
         motion.resetMagOffsetCalibration();
         motion.nextStep(false);
         setOperationState(RIOT_CALIBRATION_MAG);
         break;
       }
-      else {  // burst winking the led, awaiting next calibration step
-        delay(20);
-        winkCounter++;
-        if(winkCounter > 50) {
-          setLedColor(White);
-          delay(100);
-          setLedColor(Black);
-          winkCounter = 0;
-        }
-      }
       break;
       
     case RIOT_CALIBRATION_MAG:
-      motion.calibrateMag();
-      if(onBoardSwitch.pressed() || motion.isNextStep()) {
+      if(motion.calibrateMag() || pressed || motion.isNextStep()) {   // converged or stopped by hand
         motion.calibrateMag(true);  // stores offsets
         setLedColor(Green);
-        while(onBoardSwitch.pressed())
-          delay(20);
         storeConfig();
         motion.begin();   // Recomputes offsets
         // End of Calibration
@@ -440,6 +707,8 @@ void riotCore::calibrate() {
       setOperationState(RIOT_STREAMING);
       break; 
   }
+  if(locked)
+    unlockMotion();
 }
 
 void riotCore::charge() {
@@ -449,11 +718,14 @@ void riotCore::charge() {
   }
   chargingTimer = millis();
 
+  // The charger detection doesn't block anymore (edge interrupt), it's kept up to date while streaming
+  // for the battery message
+  pollChargerPlugged();
+  chargerStatus = readChargeStatus();
+
   if(isAlwaysStreaming() || isCalibrating())
     return;
 
-  pollChargerPlugged();
-
   if(!isPlugged()) {
     chargingStateMachine = RIOT_CHARGER_UNPLUGGED;
     return;
@@ -467,7 +739,6 @@ void riotCore::charge() {
   }
     
   // Else we process the charging state machine for displaying it on the pixel LED  
-  chargerStatus = readChargeStatus();
   //Serial.printf("Charge State = %d / Charge Status = %d\n", chargingStateMachine, chargerStatus);
   
   switch(chargingStateMachine) {
@@ -559,22 +830,7 @@ void riotCore::charge() {
         break;
       }
       // Led Pulsing during charge
-      if(chargingPulseDir == CHARGER_PULSE_UP) {
-        chargingPulsePWM++;
-        if(chargingPulsePWM > 255) {
-          chargingPulsePWM = 255;
-          chargingPulseDir = CHARGER_PULSE_DOWN;
-        }
-      }
-      else {
-        chargingPulsePWM--;
-        if(chargingPulsePWM < 0) {
-          chargingPulsePWM = 0;
-          chargingPulseDir = CHARGER_PULSE_UP;
-        }
-      }
-      //Serial.printf("pwm=%d\n", chargingPulsePWM);
-      updateStreaming(chargingColor * chargingPulsePWM);
+      updateStreaming(chargingColor, true);
       break;
       
     case RIOT_CHARGING_FINISHED:
@@ -613,7 +869,7 @@ void riotCore::charge() {
 
 
 // Defines streaming mode based on charging mode & options
-void riotCore::updateStreaming(CRGBW8 color) {
+void riotCore::updateStreaming(CRGBW8 color, bool pulse) {
   switch(chargingMode) {
     case CHARGE_ALWAYS_STREAM:
       if(isIdle())
@@ -622,7 +878,10 @@ void riotCore::updateStreaming(CRGBW8 color) {
 
     case CHARGE_NO_STREAM:
     // update led only when not streaming   
-      setLedColor(color);
+      if(pulse)
+        pulseLed(color, CHARGER_PULSE_PERIOD);
+      else
+        setLedColor(color);
       if(isCharging() || isChargingFinished())
         setOperationState(RIOT_IDLE);
       else
@@ -636,7 +895,10 @@ void riotCore::updateStreaming(CRGBW8 color) {
       else {
         setOperationState(RIOT_IDLE);
         //color.print();
-        setLedColor(color);
+        if(pulse)
+          pulseLed(color, CHARGER_PULSE_PERIOD);
+        else
+          setLedColor(color);
       }
       break;
     
@@ -647,6 +909,91 @@ void riotCore::updateStreaming(CRGBW8 color) {
 }
 
 
+// ADC continuous mode : a frame of ADC_CONVERSIONS per pin, averaged by the driver, notifies the ADC task
+static const uint8_t adcPins[] = {PIN_BATT_VOLTAGE, ANALOG_INPUT, ANALOG2_INPUT};
+#define ADC_PINS    (sizeof(adcPins) / sizeof(adcPins[0]))
+static TaskHandle_t adcTaskHandle = NULL;
+
+static void ARDUINO_ISR_ATTR adcFrameDone() {
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(adcTaskHandle, &woken);
+  portYIELD_FROM_ISR(woken);
+}
+
+static void adcTask(void *) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    riot.readAdc();
+  }
+}
+
+void riotCore::startAdc() {
+  if (adcRunning)
+    return;
+  // Values until the first frame
+  batteryRaw = readBatteryRaw();
+  batteryVoltageAverage = batteryVoltageFiltered.init(batteryRaw * BATTERY_VOLTAGE_SCALE);
+  analogInputVoltage[0] = analogRead(ANALOG_INPUT) * ANALOG_INPUT_VOLTAGE_SCALE;
+  analogInputVoltage[1] = analogRead(ANALOG2_INPUT) * ANALOG_INPUT_VOLTAGE_SCALE;
+
+  if (!adcTaskHandle)
+    xTaskCreatePinnedToCore(adcTask, "adc", ADC_TASK_STACK, NULL, ADC_TASK_PRIORITY, &adcTaskHandle, ADC_TASK_CORE);
+  if (!analogContinuous(adcPins, ADC_PINS, ADC_CONVERSIONS, ADC_SAMPLING_FREQ, adcFrameDone) || !analogContinuousStart()) {
+    Serial.printf("%s ADC continuous mode unavailable, using analogRead()\n", TEXT_ERROR_LOG);
+    analogContinuousDeinit();
+    return;
+  }
+  adcRunning = true;
+}
+
+// Gives the pins back to analogRead() / GPIOs (autotest)
+void riotCore::stopAdc() {
+  if (!adcRunning)
+    return;
+  adcRunning = false;
+  analogContinuousStop();
+  analogContinuousDeinit();
+}
+
+// ADC task : latest frame, the battery goes through the moving average
+void riotCore::readAdc() {
+  adc_continuous_data_t *result = NULL;
+  if (!adcRunning || !analogContinuousRead(&result, 0))
+    return;
+  // Results are in the order of adcPins
+  batteryRaw = result[0].avg_read_raw;
+  batteryVoltageAverage = batteryVoltageFiltered.filter(result[0].avg_read_raw * BATTERY_VOLTAGE_SCALE);
+  analogInputVoltage[0] = result[1].avg_read_raw * ANALOG_INPUT_VOLTAGE_SCALE;
+  analogInputVoltage[1] = result[2].avg_read_raw * ANALOG_INPUT_VOLTAGE_SCALE;
+}
+
+float riotCore::getBatteryVoltage() {
+  if (adcRunning)
+    return batteryVoltageAverage;
+  return readBatteryVoltage();
+}
+
+float riotCore::getAnalogInput(uint8_t input) {
+  input = min(input, (uint8_t)1);
+  if (adcRunning)
+    return analogInputVoltage[input];
+  return analogRead(input ? ANALOG2_INPUT : ANALOG_INPUT) * ANALOG_INPUT_VOLTAGE_SCALE;
+}
+
+// From the charger status, whatever the charging mode / led state machine
+uint8_t riotCore::getChargeState() {
+  if(!chargerPlugged)
+    return CHARGE_STATE_UNPLUGGED;
+  switch(chargerStatus) {
+    case CHARGING_IN_PROGRESS:
+      return CHARGE_STATE_CHARGING;
+    case CHARGING_FINISHED:
+      return CHARGE_STATE_FINISHED;
+    default:
+      return CHARGE_STATE_NO_BATTERY;
+  }
+}
+
 bool riotCore::pollChargerPlugged() {
   if((millis() - chargerPollTimer) < POLL_CHARGER_UPDATE) {
     return chargerPlugged;
@@ -659,174 +1006,676 @@ bool riotCore::pollChargerPlugged() {
   return chargerPlugged; 
 }
 
-// This is where we grab motion data and trigger computations, send OSC
+// Network side of the pipeline, runs on its own task on core 0 : pulls the sample records pushed by the
+// sensor task, forges the OSC bundles and sends them. It never touches the motion object so a slow UDP send
+// (480µs) or an incoming OSC message can't delay the next sensor read on core 1
+// With batchsize > 1, the samples are accumulated and sent as one packet when batchsize are pending or when
+// the first one is older than batchlatency : the modem wake-up, ADC reads and UDP send are paid once per
+// packet. The deadline is checked at each output sample, so its resolution is the output period
 void riotCore::process() {  
-  if (!isConnected())
-    return;
+  motionSample sample;
+  uint32_t size = 0;
 
-  if (millis() - samplingCounter < motion.getSampleRate())
+  if (!isConnected() || !isStreaming()) {
+    sampleRing.flush();
+    batchCount = 0;
+    return;
+  }
+  if (sampleRing.isEmpty())
     return;
+  if (streamsChanged)
+    layoutBundle();
 
-  samplingCounter = millis();  
   //digitalWrite(REMOTE_OUTPUT, HIGH);
-  // We speed up the processor during the CPU intensive compute task then sleep the WIFI modem and doze CPU util next time
-  wakeModemSleep();
-  setLedColor(ledColor);    // Turns blue or specified led color in config
-  
   // Debug : use physical output to measure compute / processing duration
   // Durations @240MHz during process() after wake() - Doze off:
   // - digitalWrite :  about 960ns - WakeUpModem() : 120µs - setModemSleep() : 250µs 
   // - update the led color (ws2812 pixel) : takes about 117µs which is huge.
-  // - analogRead() : 112µs - Sensors grab (low level drivers + calculations) : 156µs (including pressure computations)
+  // - analogRead() : 112µs (now sampled by the ADC task) - Sensors grab (low level drivers + calculations) : 156µs (including pressure computations)
   // - SPI sensors acquisition (almost no math) with SPI packed transactions : 78µs
   // - readPressure() is computation intensive due to float math and expf/logf (72µs total)
   // - Madgwick etc : 188µs
-  // - OSC packet forge: 56µs - Wifi UDP packet : 480µs
+  // - OSC packet forge: 56µs (before messages were placed in the bundle, see perf) - Wifi UDP packet : 480µs
   // - Full process (acquisition, math, orientation computation) : 1.76ms
   // Current payload (OSC) is 128 bytes approx. + Eth 14 bytes + IP 20 bytes + UDP 8 Bytes ~ 200 bytes total with OSC address
 
-  // Decide whether you prefer the raw voltage or filtered (moving average)
-  //batteryVoltage = batteryVoltageFiltered.filter(readBatteryVoltage());
-  batteryVoltage = readBatteryVoltage();
-  batterySoC = voltageToSoC(batteryVoltage);
-  batterySoC = constrain(batterySoC, 0.f, 1.f);
-  analogInput1 = (float)analogRead(ANALOG_INPUT) * ANALOG_INPUT_VOLTAGE_SCALE;
-  analogInput2 = (float)analogRead(ANALOG2_INPUT) * ANALOG_INPUT_VOLTAGE_SCALE;
-  now = millis();
-  analogInputsOSC.rewind();
-  analogInputsOSC.addFloat(batteryVoltage);
-  analogInputsOSC.addFloat(analogInput1);
-  analogInputsOSC.addFloat(analogInput2);
-  analogInputsOSC.addInt(now); 
-
-  batteryOSC.rewind();
-  batteryOSC.addFloat(batterySoC);
-  batteryOSC.addInt(isCharging());
-  batteryOSC.addInt(now); 
-
-  controlOSC.rewind();
-  controlOSC.addFloat((float)onBoardSwitch.pressed());
-  controlOSC.addFloat((float)auxSwitch.pressed());
-  controlOSC.addInt(now); 
-
-  motion.grab();
-  motion.compute();
-  now = millis();
+  // Usually one record, more if the network was late (WiFi retries) : they all go out, the ring
+  // drops the newest ones when full
+  while (sampleRing.pop(sample)) {
+    networkMeter.start();
+    if (!batchCount) {
+      batchStart = sample.timestampUs;
+      readInputs();
+      binaryStream.rewind(sample.sequence, streams);
+      batchOSC.rewind();
+      batchOSC.setTimetag(getTimetag(sample.timestampUs));
+    }
+    if (streamFormat == FORMAT_BINARY)
+      forgeFrame(sample, binaryStream.addSample());
+    else {
+      forgeBundle(sample);
+      // Sampling jitter stats only when a new window was latched (about once per second) : the jitter
+      // message is the last one of the bundle, it's otherwise left out of the packet
+      size = bundleStreamSize;
+      if (isStreamed(STREAM_JITTER) && samplingJitter.getWindows() != jitterSent) {
+        jitterSent = samplingJitter.getWindows();
+        jitterOSC.rewind();
+        jitterOSC.addInt(samplingJitter.getMin());
+        jitterOSC.addInt(samplingJitter.getMax());
+        jitterOSC.addInt(samplingJitter.getP99());
+        jitterOSC.addInt(sample.timestamp);
+        size = bundleOSC.getSize();
+      }
+      if (batchLimit > 1)
+        batchOSC.append(bundleOSC, size);
+    }
+    batchCount++;
+    if (batchCount >= batchLimit || (batchLatency && (uint32_t)esp_timer_get_time() - batchStart >= batchLatency * 1000))
+      sendBatch(size);
+    networkMeter.stop();
+  }
 
   // Live debug to Arduino serial plotter - Raw values of the motion sensors, un calibrated
   if((millis() - ODR_logMotion) > (ODR_LOG_MOTION / motion.getSampleRate())) {
     ODR_logMotion = millis();
     if(isLogMotion()) {
-      Serial.printf("%d %d %d ", motion.accX, motion.accY, motion.accZ);
-      Serial.printf("%d %d %d\n", motion.gyrX, motion.gyrX, motion.gyrZ);      
+      Serial.printf("%d %d %d ", sample.raw[0], sample.raw[1], sample.raw[2]);
+      Serial.printf("%d %d %d\n", sample.raw[3], sample.raw[4], sample.raw[5]);      
     }
     else if(isLogMag()) {
-      Serial.printf("%d %d %d\n", motion.magX, motion.magY, motion.magZ);
+      Serial.printf("%d %d %d\n", sample.raw[6], sample.raw[7], sample.raw[8]);
+    }
+  }
+  //digitalWrite(REMOTE_OUTPUT, LOW);
+}
+
+// Battery, analog inputs and switches, once per packet. The voltages are the last ones of the ADC task
+// (no conversion here, they are refreshed every 2.5ms), the battery is filtered (moving average)
+void riotCore::readInputs() {
+  now = millis();
+  if (isStreamed(STREAM_BATTERY | STREAM_ANALOG)) {
+    batteryVoltage = getBatteryVoltage();
+    batterySoC = voltageToSoC(batteryVoltage);
+    batterySoC = constrain(batterySoC, 0.f, 1.f);
+  }
+  if (isStreamed(STREAM_ANALOG)) {
+    analogInput1 = getAnalogInput(0);
+    analogInput2 = getAnalogInput(1);
+    analogInputsOSC.rewind();
+    analogInputsOSC.addFloat(batteryVoltage);
+    analogInputsOSC.addFloat(analogInput1);
+    analogInputsOSC.addFloat(analogInput2);
+    analogInputsOSC.addInt(now); 
+  }
+
+  if (isStreamed(STREAM_BATTERY)) {
+    batteryOSC.rewind();
+    batteryOSC.addFloat(batterySoC);
+    batteryOSC.addInt(getChargeState());
+    batteryOSC.addInt(now); 
+  }
+
+  if (isStreamed(STREAM_CONTROL)) {
+    controlOSC.rewind();
+    controlOSC.addFloat((float)onBoardSwitch.pressed());
+    controlOSC.addFloat((float)auxSwitch.pressed());
+    controlOSC.addInt(now); 
+  }
+}
+
+// Sends the pending batch. size : bytes of bundleOSC to send when not batching (OSC, batchsize=1)
+void riotCore::sendBatch(uint32_t size) {
+  uint8_t *buffer = bundleOSC.getBuffer();
+
+  batchCount = 0;
+  if (streamFormat == FORMAT_BINARY) {
+    buffer = binaryStream.getBuffer();
+    size = binaryStream.getSize();
+  }
+  else {
+    if (batchLimit > 1) {
+      buffer = batchOSC.getBuffer();
+      size = batchOSC.getSize();
     }
+    // Nothing selected (streams=0, or only the jitter between 2 windows) : no empty bundle
+    if (size <= bundleOSC.getHeaderSize())
+      return;
+  }
+
+  // We speed up the processor during the send then sleep the WIFI modem and doze CPU util next time
+  wakeModemSleep();
+  flashLed(ledColor);       // Flashes blue or specified led color in config (led task)
+  streamPacket.beginPacket(destIP, destPort);
+  streamPacket.write(buffer, size);
+  streamPacket.endPacket();
+  setModemSleep();
+  if (!firstPacket) {
+    bootProfile.add("first packet", gotIpTime);
+    firstPacket = true;
   }
+}
+
+// Simplified NTP over OSC (syncport= key) : a numbered request to the sync server on the destination
+// host every SYNC_PERIOD, from the receive port so that the answers (/sync) are parsed along with the
+// remote OSC messages, see receivedOscMessage(). Runs on the loop task
+void riotCore::sync() {
+  uint32_t period;
+
+  if (!syncPort || !isConnected() || !isStreaming())
+    return;
+  period = (clockSync.getExchanges() < CLOCK_SYNC_WINDOW) ? SYNC_PERIOD_FAST : SYNC_PERIOD;
+  if (millis() - syncTimer < period)
+    return;
+  syncTimer = millis();
+  syncOSC.rewind();
+  syncOSC.addInt(clockSync.request(esp_timer_get_time()));
+  configPacket.beginPacket(destIP, syncPort);
+  configPacket.write(syncOSC.getBuffer(), syncOSC.getSize());
+  configPacket.endPacket();
+}
 
+// t2 / t3 : NTP receive & transmit times of the server. Late answers (modem sleep, loop busy) only
+// show up as a longer delay, which the clock filter discards
+void riotCore::syncResponse(uint32_t sequence, uint64_t t2, uint64_t t3) {
+  int64_t t4 = esp_timer_get_time();
+
+  if (clockSync.response(sequence, t2, t3, t4) && isDebug())
+    Serial.printf("[SYNC] offset %lld µs drift %.2f ppm delay %u µs\n", (long long)clockSync.getOffset(), clockSync.getDrift(), clockSync.getDelay());
+}
+
+// OSC time tag of a sample acquisition time (µs timer, 32 bit wrapped), 0 = immediate when not synced
+uint64_t riotCore::getTimetag(uint32_t timestampUs) {
+  int64_t now = esp_timer_get_time();
+  return clockSync.toNtp(now - (uint32_t)((uint32_t)now - timestampUs));
+}
+
+// Places the selected messages in the bundle, forgeBundle() / process() then fill them in place.
+// Called by begin() then by the network task when the streams= / batch / format keys changed, as it owns
+// the bundle. The pending batch is dropped
+void riotCore::layoutBundle() {
+  uint32_t size;
+
+  streamsChanged = false;
+  for (int i = 0; i < BUNDLE_MESSAGES; i++)
+    bundleLayout[i].message->detach();
+  bundleOSC.rewind();
+  bundleStreamSize = bundleOSC.getSize();
+  for (int i = 0; i < BUNDLE_MESSAGES; i++) {
+    if (!isStreamed(bundleLayout[i].stream))
+      continue;
+    if (bundleLayout[i].stream == STREAM_BNO055 && !hasBNO055())
+      continue;
+    size = bundleOSC.place(*bundleLayout[i].message);
+    if (bundleLayout[i].message != &jitterOSC)
+      bundleStreamSize = size;
+  }
+
+  // OSC batches hold as many complete bundles (jitter included) as fit in the payload
+  batchCount = 0;
+  batchLimit = batchSize;
+  if (streamFormat == FORMAT_OSC) {
+    size = bundleOSC.getSize() - bundleOSC.getHeaderSize();
+    if (size)
+      batchLimit = constrain((BATCH_MAX_PAYLOAD - bundleOSC.getHeaderSize()) / size, 1, batchSize);
+  }
+}
+
+// Fills all the motion OSC messages from a sample record. They were placed in the bundle by begin(),
+// along with the analog / battery / control messages filled in process(), so it's ready to send
+void riotCore::forgeBundle(const motionSample &sample) {
   // OSC export - multiple layers and structures in one single OSC Bundle
-  // Add timetags to the OSC bundle when NTP is there
+  // Time tag = acquisition time on the sync server clock once synced, else immediate
+  bundleOSC.setTimetag(getTimetag(sample.timestampUs));
 
   // Sensors data order now complies with the W3C device motion standard (order and units)
   // https://www.w3.org/TR/orientation-event/
   // Magnetometers are exported in µT which are 100 Gauss
-  accelerometerOSC.rewind();
-  accelerometerOSC.addFloat(motion.a_x * G_TO_MS2);  // Range {-8 ; +8} g x 9.81 => m.s-2
-  accelerometerOSC.addFloat(motion.a_y * G_TO_MS2);
-  accelerometerOSC.addFloat(motion.a_z * G_TO_MS2);
-  accelerometerOSC.addInt(now);
+  if(isStreamed(STREAM_ACCELEROMETER)) {
+    accelerometerOSC.rewind();
+    accelerometerOSC.addFloat(sample.acc[0] * G_TO_MS2);  // Range {-8 ; +8} g x 9.81 => m.s-2
+    accelerometerOSC.addFloat(sample.acc[1] * G_TO_MS2);
+    accelerometerOSC.addFloat(sample.acc[2] * G_TO_MS2);
+    accelerometerOSC.addInt(sample.timestamp);
+  }
   
-  gyroscopeOSC.rewind();
-  gyroscopeOSC.addFloat(motion.g_x * DEG_TO_RAD); // rad/s (2000° / PI)/s)
-  gyroscopeOSC.addFloat(motion.g_y * DEG_TO_RAD);
-  gyroscopeOSC.addFloat(motion.g_z * DEG_TO_RAD);
-  gyroscopeOSC.addInt(now);
-
-  magnetometerOSC.rewind();
-  magnetometerOSC.addFloat(motion.m_x * 100.f);  // Range {-4 ; +4} Gauss <=> {-400 ; +400} µTesla
-  magnetometerOSC.addFloat(motion.m_y * 100.f);
-  magnetometerOSC.addFloat(motion.m_z * 100.f);
-  magnetometerOSC.addInt(now);
-
-  barometerOSC.rewind();
-  barometerOSC.addFloat(motion.pressure);
-  barometerOSC.addFloat(motion.altitude);
-  barometerOSC.addInt(now);
+  if(isStreamed(STREAM_GYROSCOPE)) {
+    gyroscopeOSC.rewind();
+    gyroscopeOSC.addFloat(sample.gyro[0] * DEG_TO_RAD); // rad/s (2000° / PI)/s)
+    gyroscopeOSC.addFloat(sample.gyro[1] * DEG_TO_RAD);
+    gyroscopeOSC.addFloat(sample.gyro[2] * DEG_TO_RAD);
+    gyroscopeOSC.addInt(sample.timestamp);
+  }
+
+  if(isStreamed(STREAM_MAGNETOMETER)) {
+    magnetometerOSC.rewind();
+    magnetometerOSC.addFloat(sample.mag[0] * 100.f);  // Range {-4 ; +4} Gauss <=> {-400 ; +400} µTesla
+    magnetometerOSC.addFloat(sample.mag[1] * 100.f);
+    magnetometerOSC.addFloat(sample.mag[2] * 100.f);
+    magnetometerOSC.addInt(sample.timestamp);
+  }
+
+  if(isStreamed(STREAM_BAROMETER)) {
+    barometerOSC.rewind();
+    barometerOSC.addFloat(sample.pressure);
+    barometerOSC.addFloat(sample.altitude);
+    barometerOSC.addInt(sample.timestamp);
+  }
   
-  temperatureOSC.rewind();
-  temperatureOSC.addFloat(motion.boardTemperature); // Acc sensor
-  temperatureOSC.addFloat(motion.temperature);      // Barometer sensor
-  temperatureOSC.addFloat(motion.mcuTemperature);   // ESP32-S3 sensor
-  temperatureOSC.addInt(now);
-
-  quaternionsOSC.rewind();
-  quaternionsOSC.addFloat(motion.q1); // x
-  quaternionsOSC.addFloat(motion.q2); // y
-  quaternionsOSC.addFloat(motion.q3); // z
-  quaternionsOSC.addFloat(motion.q0); // w
-  quaternionsOSC.addInt(now);
-
-  eulerOSC.rewind();
-  eulerOSC.addFloat(motion.yaw);    // in Degree
-  eulerOSC.addFloat(motion.pitch);
-  eulerOSC.addFloat(motion.roll);
-  eulerOSC.addInt(now);
+  if(isStreamed(STREAM_TEMPERATURE)) {
+    temperatureOSC.rewind();
+    temperatureOSC.addFloat(sample.boardTemperature); // Acc sensor
+    temperatureOSC.addFloat(sample.temperature);      // Barometer sensor
+    temperatureOSC.addFloat(sample.mcuTemperature);   // ESP32-S3 sensor
+    temperatureOSC.addInt(sample.timestamp);
+  }
 
-  if(hasBNO055()) {
+  if(isStreamed(STREAM_QUATERNION)) {
+    quaternionsOSC.rewind();
+    quaternionsOSC.addFloat(sample.quat[1]); // x
+    quaternionsOSC.addFloat(sample.quat[2]); // y
+    quaternionsOSC.addFloat(sample.quat[3]); // z
+    quaternionsOSC.addFloat(sample.quat[0]); // w
+    quaternionsOSC.addInt(sample.timestamp);
+  }
+
+  if(isStreamed(STREAM_EULER)) {
+    eulerOSC.rewind();
+    eulerOSC.addFloat(sample.yaw);    // in Degree
+    eulerOSC.addFloat(sample.pitch);
+    eulerOSC.addFloat(sample.roll);
+    eulerOSC.addInt(sample.timestamp);
+  }
+
+  if(hasBNO055() && isStreamed(STREAM_BNO055)) {
     bno055EulerOSC.rewind();
-    bno055EulerOSC.addFloat((float)motion.bno055Data[0]); // Yaw
-    bno055EulerOSC.addFloat((float)motion.bno055Data[2]); // Pitch
-    bno055EulerOSC.addFloat((float)motion.bno055Data[1]); // Roll
-    bno055EulerOSC.addInt(now);
+    bno055EulerOSC.addFloat(sample.bno055Euler[0]); // Yaw
+    bno055EulerOSC.addFloat(sample.bno055Euler[2]); // Pitch
+    bno055EulerOSC.addFloat(sample.bno055Euler[1]); // Roll
+    bno055EulerOSC.addInt(sample.timestamp);
 
     bno055QuatOSC.rewind();
-    bno055QuatOSC.addFloat((float)motion.bno055Quat[1]); // x
-    bno055QuatOSC.addFloat((float)motion.bno055Quat[2]); // y
-    bno055QuatOSC.addFloat((float)motion.bno055Quat[3]); // z
-    bno055QuatOSC.addFloat((float)motion.bno055Quat[0]); // w
-    bno055QuatOSC.addInt(now);
-  }
-
-  gravityOSC.rewind();
-  gravityOSC.addFloat(motion.grav_x * G_TO_MS2);
-  gravityOSC.addFloat(motion.grav_y * G_TO_MS2);
-  gravityOSC.addFloat(motion.grav_z * G_TO_MS2);
-  gravityOSC.addInt(now);
-
-  headingOSC.rewind();
-  headingOSC.addFloat(motion.heading);    // Magnetic heading (acc+mag) = compass heading
-  headingOSC.addFloat(-1.f);              // we don't have geographic heading on RIOT, no GPS avail.
-  headingOSC.addFloat(-1.f);              // Accuracy - in degree of accuracy - When iOS is happy : 15° - bad accuracy is more like 50°. -1 for "unknown"
-  headingOSC.addInt(now);
-
-  // Create bundle out of all individual OSC message. Here you can cherry pick what you send or not,
-  // to save on wifi traffic and/or latency or CPU load
-  bundleOSC.rewind();
-  bundleOSC.addMessage(accelerometerOSC.getBuffer(), accelerometerOSC.getSize());
-  bundleOSC.addMessage(gyroscopeOSC.getBuffer(), gyroscopeOSC.getSize());
-  bundleOSC.addMessage(magnetometerOSC.getBuffer(), magnetometerOSC.getSize());
-  bundleOSC.addMessage(barometerOSC.getBuffer(), barometerOSC.getSize());
-  bundleOSC.addMessage(temperatureOSC.getBuffer(), temperatureOSC.getSize());
-  bundleOSC.addMessage(quaternionsOSC.getBuffer(), quaternionsOSC.getSize());
-  bundleOSC.addMessage(eulerOSC.getBuffer(), eulerOSC.getSize());
-  bundleOSC.addMessage(gravityOSC.getBuffer(), gravityOSC.getSize());
-  bundleOSC.addMessage(headingOSC.getBuffer(), headingOSC.getSize());
+    bno055QuatOSC.addFloat(sample.bno055Quat[1]); // x
+    bno055QuatOSC.addFloat(sample.bno055Quat[2]); // y
+    bno055QuatOSC.addFloat(sample.bno055Quat[3]); // z
+    bno055QuatOSC.addFloat(sample.bno055Quat[0]); // w
+    bno055QuatOSC.addInt(sample.timestamp);
+  }
+
+  if(isStreamed(STREAM_GRAVITY)) {
+    gravityOSC.rewind();
+    gravityOSC.addFloat(sample.grav[0] * G_TO_MS2);
+    gravityOSC.addFloat(sample.grav[1] * G_TO_MS2);
+    gravityOSC.addFloat(sample.grav[2] * G_TO_MS2);
+    gravityOSC.addInt(sample.timestamp);
+  }
+
+  if(isStreamed(STREAM_HEADING)) {
+    headingOSC.rewind();
+    headingOSC.addFloat(sample.heading);    // Magnetic heading (acc+mag) = compass heading
+    headingOSC.addFloat(-1.f);              // we don't have geographic heading on RIOT, no GPS avail.
+    headingOSC.addFloat(-1.f);              // Accuracy - in degree of accuracy - When iOS is happy : 15° - bad accuracy is more like 50°. -1 for "unknown"
+    headingOSC.addInt(sample.timestamp);
+  }
+
+  if(isStreamed(STREAM_SEQUENCE)) {
+    sequenceOSC.rewind();
+    sequenceOSC.addInt(sample.sequence);
+    sequenceOSC.addInt(sample.timestampUs);
+  }
+}
+
+
+// Binary counterpart of forgeBundle() (format=1) : same values, units and streams= selection, quantized to
+// 16 bits (RiotFrame.h). The fields of the streams left out stay 0
+void riotCore::forgeFrame(const motionSample &sample, riotFrameSample *frame) {
+  if(!frame)
+    return;
+  frame->timestamp = sample.timestampUs;
+  for (int i = 0; i < 3; i++) {
+    if(isStreamed(STREAM_ACCELEROMETER))
+      frame->acc[i] = riotQuantize(sample.acc[i] * G_TO_MS2, RIOT_FRAME_ACC_SCALE);
+    if(isStreamed(STREAM_GYROSCOPE))
+      frame->gyro[i] = riotQuantize(sample.gyro[i] * DEG_TO_RAD, RIOT_FRAME_GYRO_SCALE);
+    if(isStreamed(STREAM_MAGNETOMETER))
+      frame->mag[i] = riotQuantize(sample.mag[i] * 100.f, RIOT_FRAME_MAG_SCALE);
+    if(isStreamed(STREAM_GRAVITY))
+      frame->grav[i] = riotQuantize(sample.grav[i] * G_TO_MS2, RIOT_FRAME_ACC_SCALE);
+  }
+  if(isStreamed(STREAM_QUATERNION)) {
+    frame->quat[0] = riotQuantize(sample.quat[1], RIOT_FRAME_QUAT_SCALE);   // x
+    frame->quat[1] = riotQuantize(sample.quat[2], RIOT_FRAME_QUAT_SCALE);   // y
+    frame->quat[2] = riotQuantize(sample.quat[3], RIOT_FRAME_QUAT_SCALE);   // z
+    frame->quat[3] = riotQuantize(sample.quat[0], RIOT_FRAME_QUAT_SCALE);   // w
+  }
+  if(isStreamed(STREAM_EULER)) {
+    frame->euler[0] = riotQuantize(sample.yaw, RIOT_FRAME_ANGLE_SCALE);
+    frame->euler[1] = riotQuantize(sample.pitch, RIOT_FRAME_ANGLE_SCALE);
+    frame->euler[2] = riotQuantize(sample.roll, RIOT_FRAME_ANGLE_SCALE);
+  }
+  if(isStreamed(STREAM_HEADING))
+    frame->heading = riotQuantize(sample.heading, RIOT_FRAME_ANGLE_SCALE);
+  if(isStreamed(STREAM_BAROMETER)) {
+    frame->pressure = riotQuantizeUnsigned(sample.pressure, RIOT_FRAME_PRESSURE_SCALE);
+    frame->altitude = riotQuantize(sample.altitude, RIOT_FRAME_ALTITUDE_SCALE);
+  }
+  if(isStreamed(STREAM_TEMPERATURE)) {
+    frame->temperature[0] = riotQuantize(sample.boardTemperature, RIOT_FRAME_TEMP_SCALE);
+    frame->temperature[1] = riotQuantize(sample.temperature, RIOT_FRAME_TEMP_SCALE);
+    frame->temperature[2] = riotQuantize(sample.mcuTemperature, RIOT_FRAME_TEMP_SCALE);
+  }
+  // Filled by process() at the packet rate
+  if(isStreamed(STREAM_ANALOG)) {
+    frame->analog[0] = riotQuantize(batteryVoltage, RIOT_FRAME_VOLTAGE_SCALE);
+    frame->analog[1] = riotQuantize(analogInput1, RIOT_FRAME_VOLTAGE_SCALE);
+    frame->analog[2] = riotQuantize(analogInput2, RIOT_FRAME_VOLTAGE_SCALE);
+  }
+  if(isStreamed(STREAM_BATTERY)) {
+    frame->battery = riotQuantize(batterySoC, RIOT_FRAME_SOC_SCALE);
+    switch(getChargeState()) {
+      case CHARGE_STATE_CHARGING:
+        frame->flags |= RIOT_FRAME_CHARGING;
+        break;
+      case CHARGE_STATE_FINISHED:
+        frame->flags |= RIOT_FRAME_CHARGED;
+        break;
+      case CHARGE_STATE_NO_BATTERY:
+        frame->flags |= RIOT_FRAME_NO_BATTERY;
+        break;
+    }
+  }
+  if(isStreamed(STREAM_CONTROL)) {
+    if(onBoardSwitch.pressed())
+      frame->flags |= RIOT_FRAME_SWITCH_1;
+    if(auxSwitch.pressed())
+      frame->flags |= RIOT_FRAME_SWITCH_2;
+  }
+}
+
+
+// Dual core pipeline : sensors acquisition and the AHRS run on the fusion task pinned to core 1, woken up
+// by a µs hardware timer at samplerate. Every outputDecimation steps, the averaged sensors + the filter state
+// are pushed as a fixed size record into a lock-free SPSC ring and the network task (core 0, next to the
+// WiFi stack) is notified to forge and send the bundle. More fusion steps than OSC outputs = better
+// convergence & stability while we send less packets (20+ modules per AP).
+// The motion object is shared with calibration and the replay command only, hence the mutex. Replay also
+// forges bundles : it holds the network lock meanwhile, the network task waits (the ring overflows, its
+// records are dropped)
+static void fusionTask(void *) {
+  for(;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    riot.fuse();
+  }
+}
+
+static void networkTask(void *) {
+  for(;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    riot.lockNetwork();
+    riot.process();
+    riot.unlockNetwork();
+  }
+}
+
+// The BNO055 probe alone waits 650ms for the chip to boot : it runs on its own task while setup() goes on
+// (config, WiFi connection). The fusion only reads it once it's found, the orientation from the config
+// is applied then
+static void bno055Task(void *) {
+  uint32_t start = bootProfile.now();
+  if(bno055.begin().TestConnection()) {
+    Serial.println("Found BNO055 sensor\n");
+    bno055.Initialize();
+    riot.lockMotion();
+    bno055.SetPos(riot.getBnoOrientation());
+    bno055.Set_Mode(NDOF);  // 9DoF fusion
+    riot.bno055Found(true);
+    riot.unlockMotion();
+  }
+  bootProfile.add("bno055", start);
+  vTaskDelete(NULL);
+}
+
+void riotCore::startBno055() {
+  if(xTaskCreatePinnedToCore(bno055Task, "bno055", BNO055_TASK_STACK, NULL, BNO055_TASK_PRIORITY, NULL, BNO055_TASK_CORE) != pdPASS)
+    Serial.printf("%s Can't create the BNO055 task\n", TEXT_ERROR_LOG);
+}
+
+void riotCore::setBnoOrientation(uint8_t orient) {
+  lockMotion();
+  bnoOrientation = constrain(orient, 0, 7);
   if(hasBNO055()) {
-    bundleOSC.addMessage(bno055EulerOSC.getBuffer(), bno055EulerOSC.getSize());
-    bundleOSC.addMessage(bno055QuatOSC.getBuffer(), bno055QuatOSC.getSize());
+    bno055.SetPos(bnoOrientation);
+    bno055.Set_Mode(NDOF);  // 9DoF fusion
+  }
+  unlockMotion();
+}
+
+static void fusionTimerCallback(void *param) {
+  xTaskNotifyGive((TaskHandle_t)param);
+}
+
+void riotCore::startFusion() {
+  if(fusionTaskHandle)
+    return;
+  xTaskCreatePinnedToCore(networkTask, "network", NETWORK_TASK_STACK, NULL, NETWORK_TASK_PRIORITY, &networkTaskHandle, NETWORK_TASK_CORE);
+  xTaskCreatePinnedToCore(fusionTask, "fusion", FUSION_TASK_STACK, NULL, FUSION_TASK_PRIORITY, &fusionTaskHandle, FUSION_TASK_CORE);
+  if(!motionMutex || !networkTaskHandle || !fusionTaskHandle) {
+    Serial.printf("%s Can't create the fusion / network tasks\n", TEXT_ERROR_LOG);
+    return;
+  }
+  esp_timer_create_args_t timerArgs = {};
+  timerArgs.callback = fusionTimerCallback;
+  timerArgs.arg = fusionTaskHandle;
+  timerArgs.name = "fusion";
+  esp_timer_create(&timerArgs, &fusionTimer);
+  updateFusion();
+}
+
+// (Re)starts the fusion timer when the sample rate or the output rate change
+void riotCore::updateFusion() {
+  if(!fusionTimer)
+    return;
+  lockMotion();
+  esp_timer_stop(fusionTimer);
+  // Output period rounded to the nearest multiple of the sample period
+  outputDecimation = max((uint32_t)1, (getOutputPeriod() + motion.getSampleRate() / 2) / motion.getSampleRate());
+  decimationCounter = 0;
+  lastSampleTime = 0;
+  samplingJitter.begin(motion.getSampleRate() * 1000, JITTER_BIN_WIDTH, max((uint32_t)1, JITTER_WINDOW / motion.getSampleRate()));
+  esp_timer_start_periodic(fusionTimer, motion.getSampleRate() * 1000);
+  unlockMotion();
+  if(isDebug())
+    Serial.printf("[FUSION] sample period %ums / output every %u samples\n", motion.getSampleRate(), outputDecimation);
+}
+
+// The inter-sample interval is measured with the µs timer at the start of each step : it drives the
+// filter integration step (deltat) instead of the nominal period and feeds the jitter histogram
+void riotCore::fuse() {
+  motionSample sample;
+  bool ready = false;
+  int64_t timestamp = esp_timer_get_time();
+
+  lockMotion();
+  // Calibration uses the sensors on its own
+  if(isStreaming()) {
+    uint32_t nominal = motion.getSampleRate() * 1000;
+    uint32_t interval = (uint32_t)(timestamp - lastSampleTime);
+    // First sample after start / calibration / rate change : nothing to measure yet
+    if(lastSampleTime && interval < nominal * JITTER_MAX_GAP) {
+      samplingJitter.add(interval);
+      motion.setSamplePeriod(interval);
+    }
+    else
+      motion.setSamplePeriod(nominal);
+    lastSampleTime = timestamp;
+    processMeter.start();
+    motion.grab();
+    if(recordBuffer && !recordDone)
+      recordFrame();
+    motion.compute();
+    motion.accumulate();
+    if(++decimationCounter >= outputDecimation) {
+      decimationCounter = 0;
+      motion.decimate();
+      motion.snapshot(sample, (uint32_t)(timestamp / 1000));   // acquisition time
+      sample.timestampUs = (uint32_t)timestamp;
+      sample.sequence = outputSequence++;
+      ready = true;
+    }
+    processMeter.stop();
+  }
+  else
+    lastSampleTime = 0;
+  unlockMotion();
+
+  if(ready && isConnected()) {
+    sampleRing.push(sample);    // full ring = the network is stalled, the record is dropped
+    xTaskNotifyGive(networkTaskHandle);
   }
-  bundleOSC.addMessage(batteryOSC.getBuffer(), batteryOSC.getSize());
-  bundleOSC.addMessage(analogInputsOSC.getBuffer(), analogInputsOSC.getSize());
-  bundleOSC.addMessage(controlOSC.getBuffer(), controlOSC.getSize());
+}
+
+
+// Profiling of the grab->compute->bundle path, live (perf command) or on a recorded trace (replay command)
+// The trace file is a raw dump of int16 frames accX,accY,accZ,gyrX,gyrY,gyrZ,magX,magY,magZ (little endian)
+// as produced by the record command, so that every change in the fusion code can be measured on the
+// very same data. Replay runs at full CPU speed, blocking, and resets the fusion state when done.
+void riotCore::printPerf() {
+  processMeter.report("fusion task grab->compute");
+  networkMeter.report("network task forge->send");
+  samplingJitter.report("sampling interval");
+  Serial.printf("[PERF] Sample ring : %u pending / %u dropped\n", sampleRing.size(), sampleRing.getOverruns());
+  if (clockSync.isSynced())
+    Serial.printf("[SYNC] offset %lld µs drift %.2f ppm delay %u µs (%u exchanges)\n", (long long)clockSync.getOffset(), clockSync.getDrift(), clockSync.getDelay(), clockSync.getExchanges());
+}
+
+bool riotCore::replay(const char *path) {
+  FIL traceFile;
+  UINT read;
+  int16_t frame[RAW_FRAME_SIZE];
+  motionSample sample;
+  uint32_t frames = 0;
+  uint32_t elapsed;
+  uint8_t selectedFusion = motion.getFusion();
+  char label[MAX_STRING_LEN];
+
+  if (f_open(&traceFile, path, FA_OPEN_EXISTING | FA_READ) != FR_OK) {
+    Serial.printf("%s Can't open trace %s\n", TEXT_ERROR_LOG, path);
+    return false;
+  }
+  Serial.printf("[PERF] Replaying %s (%u frames)\n", path, (uint32_t)(f_size(&traceFile) / sizeof(frame)));
   
-  udpPacket.beginPacket(destIP, destPort);
-  udpPacket.write(bundleOSC.getBuffer(), bundleOSC.getSize());
-  udpPacket.endPacket();
-     
-  setLedColor(Black);
+  // The network task stays out of the OSC messages while they're forged here
+  lockNetwork();
+  lockMotion();
+  wakeModemSleep();
+  // The same trace goes through each orientation filter (fusion= key) to compare their cost per update.
+  // The float madgwick runs alongside the other ones to report how far their orientation gets from it
+  for (uint8_t engine = 0; engine < MAX_FUSION_ENGINE; engine++) {
+    motion.setFusion(engine);
+    motion.resetFusion();
+    motion.setReference(engine != FUSION_MADGWICK);
+    f_lseek(&traceFile, 0);
+    replayMeter.reset();
+    frames = 0;
+    elapsed = micros();
+    while (f_read(&traceFile, frame, sizeof(frame), &read) == FR_OK && read == sizeof(frame)) {
+      replayMeter.start();
+      motion.inject(frame);
+      motion.compute();
+      motion.snapshot(sample, millis());
+      forgeBundle(sample);
+      replayMeter.stop();
+      frames++;
+    }
+    elapsed = micros() - elapsed;
+
+    Serial.printf("[PERF] %s : %u frames replayed in %u µs (file reads included)\n", motion.getFusionName(), frames, elapsed);
+    if (frames)
+      Serial.printf("[PERF] %s : final yaw %.1f° pitch %.1f° roll %.1f°\n", motion.getFusionName(), sample.yaw, sample.pitch, sample.roll);
+    if (frames && engine != FUSION_MADGWICK)
+      Serial.printf("[PERF] %s vs madgwick : max %.3f° mean %.3f°\n", motion.getFusionName(), motion.getReferenceMaxError(), motion.getReferenceMeanError());
+    sprintf(label, "replay %s compute->bundle", motion.getFusionName());
+    replayMeter.report(label);
+  }
+  f_close(&traceFile);
+
+  motion.setReference(false);
+  motion.setFusion(selectedFusion);
+  motion.resetFusion();
   setModemSleep();
-  //digitalWrite(REMOTE_OUTPUT, LOW);
+  unlockMotion();
+  unlockNetwork();
+  return (frames > 0);
+}
+
+// Captures the next n raw frames in the fusion task, saveRecord() then dumps them to the flash drive
+// A trace frame is one IMU sample with the sample period as deltat : the FIFO batches (several IMU samples
+// at the sensor ODR per step) can't be replayed as recorded, so there's no recording in FIFO mode
+bool riotCore::record(uint32_t frames) {
+  if (recordBuffer || !frames)
+    return false;
+  if (lsm6d.isFifo()) {
+    Serial.printf("%s No recording with %s=1, the trace couldn't be replayed as recorded\n", TEXT_ERROR_LOG, TEXT_IMU_FIFO);
+    return false;
+  }
+  frames = constrain(frames, 1, MAX_RECORD_FRAMES);
+  int16_t *buffer = (int16_t*)malloc(frames * RAW_FRAME_SIZE * sizeof(int16_t));
+  if (!buffer) {
+    Serial.printf("%s Not enough memory to record %u frames\n", TEXT_ERROR_LOG, frames);
+    return false;
+  }
+  recordLength = frames;
+  recordIndex = 0;
+  recordDone = false;
+  recordBuffer = buffer;  // last, the fusion task may be running
+  Serial.printf("[PERF] Recording %u frames to %s\n", frames, RECORD_FILE);
+  return true;
+}
+
+// Fusion task, motion lock held : only copies the frame, the flash write is left to the loop task.
+// FIFO mode turned on meanwhile : the trace ends there
+void riotCore::recordFrame() {
+  if (lsm6d.isFifo()) {
+    recordLength = recordIndex;
+    recordDone = true;
+    return;
+  }
+  int16_t *frame = &recordBuffer[recordIndex * RAW_FRAME_SIZE];
+  frame[0] = motion.accX;
+  frame[1] = motion.accY;
+  frame[2] = motion.accZ;
+  frame[3] = motion.gyrX;
+  frame[4] = motion.gyrY;
+  frame[5] = motion.gyrZ;
+  frame[6] = motion.magX;
+  frame[7] = motion.magY;
+  frame[8] = motion.magZ;
+  recordIndex++;
+  if (recordIndex >= recordLength)
+    recordDone = true;
+}
+
+// Loop task : writes the trace once complete. The buffer is taken under the lock so that the fusion
+// task can't be copying a frame in it while it's freed
+void riotCore::saveRecord() {
+  if (!recordDone)
+    return;
+  lockMotion();
+  int16_t *buffer = recordBuffer;
+  uint32_t length = recordLength;
+  recordBuffer = NULL;
+  recordDone = false;
+  unlockMotion();
+
+  FIL traceFile;
+  UINT write;
+  if (f_open(&traceFile, RECORD_FILE, FA_CREATE_ALWAYS | FA_WRITE) == FR_OK) {
+    f_write(&traceFile, buffer, length * RAW_FRAME_SIZE * sizeof(int16_t), &write);
+    f_close(&traceFile);
+    Serial.printf("[PERF] %u frames saved in %s\n", length, RECORD_FILE);
+  }
+  else
+    Serial.printf("%s Can't create %s\n", TEXT_ERROR_LOG, RECORD_FILE);
+  free(buffer);
 }
 
 int riotCore::getRSSI() {
@@ -852,29 +1701,46 @@ void riotCore::version(bool logToFile) {
     sprintf(str, "/%s", VERSION_FILE);
     if (f_open(&VersionFile, str, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
       return;
-      
-      if(isDebug())
-        printf("[LOG] Saving %s\n", VERSION_FILE, str);
-
-      sprintf(str, "R-IoT fw version\r\n");
-      strcat(str, versionString);
-      strcat(str, TEXT_FILE_EOL);
-      f_write(&VersionFile, str, strlen(str), &write);
-      sprintf(str, fwString);
-      strcat(str, TEXT_FILE_EOL);
-      strcat(str, dateString);
-      strcat(str, TEXT_FILE_EOL);
-      sprintf(str, "MAC address: %02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
-      strcat(str, TEXT_FILE_EOL);
-      f_write(&VersionFile, str, strlen(str), &write);
+    
+    if(isDebug())
+      printf("[LOG] Saving %s\n", str);
+
+    sprintf(str, "R-IoT fw version\r\n");
+    strcat(str, versionString);
+    strcat(str, TEXT_FILE_EOL);
+    f_write(&VersionFile, str, strlen(str), &write);
+    sprintf(str, fwString);
+    strcat(str, TEXT_FILE_EOL);
+    strcat(str, dateString);
+    strcat(str, TEXT_FILE_EOL);
+    sprintf(str, "MAC address: %02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    strcat(str, TEXT_FILE_EOL);
+    f_write(&VersionFile, str, strlen(str), &write);
+    if(bootProfile.getCount()) {  // last boot phases, see reportBoot()
+      char profile[BOOT_PHASES * 64];
+      int length = bootProfile.format(profile, sizeof(profile), TEXT_FILE_EOL);
+      f_write(&VersionFile, profile, length, &write);
+    }
       f_close(&VersionFile);
   }
 }
 
 
+// Once the first packet is out : boot phases on the serial port. They are only added to version.txt in
+// debug mode, or later by the version command, so that a normal boot doesn't write on the flash
+void riotCore::reportBoot() {
+  if(!firstPacket || bootReported)
+    return;
+  bootReported = true;
+  bootProfile.report();
+  if(isDebug())
+    version(true);
+}
+
+
 void riotCore::printCurrentNet() {
   // print the SSID of the network you're attached to:
-  Serial.printf("SSID: %s\n", WiFi.SSID());
+  Serial.printf("SSID: %s\n", WiFi.SSID().c_str());
 
   // print the received signal strength:
   getRSSI();
@@ -5,6 +5,7 @@
 #include "main.h"
 #include "textfile.h"
 #include "esp_wifi.h"
+#include "esp_timer.h"
 #include "motion.h"
 #include "routines.h"
 #include "osc.h"
@@ -19,8 +20,52 @@ extern IPAddress defaultDestinationIP;
 #define CONNECTING_TIMER_UPDATE   300     // ms
 #define CONNECTING_MAX_DOTS       30
 #define CHARGING_TIMER_UPDATE     15      // ms
+#define CHARGER_PULSE_PERIOD      7680    // ms, led breathing while charging
+#define CALIBRATION_WINK_ON       100     // ms, led wink while waiting for the mag calibration
+#define CALIBRATION_WINK_OFF      1000
 #define POLL_CHARGER_UPDATE       1000    // ms
-#define SWITCH_POLLING_PERIOD     10      // ms
+#define SWITCH_TASK_STACK         3072    // switch events : OSC message + calibration
+#define SWITCH_TASK_PRIORITY      3       // above the network task, sent right away
+#define SWITCH_TASK_CORE          0
+#define SWITCH_EVENTS             8       // on board switch events for calibrate()
+
+// Dual core pipeline : sensors + fusion on core 1, OSC forge + UDP send on core 0 (WiFi stack)
+#define FUSION_TASK_STACK         4096
+#define FUSION_TASK_PRIORITY      3       // above the arduino loop (1)
+#define FUSION_TASK_CORE          1
+#define NETWORK_TASK_STACK        4096
+#define NETWORK_TASK_PRIORITY     2       // below the WiFi & lwIP tasks
+#define NETWORK_TASK_CORE         0
+#define SAMPLE_RING_SIZE          16      // sample records between the 2 tasks (power of 2)
+#define BNO055_TASK_STACK         4096    // BNO055 probe + init during the boot
+#define BNO055_TASK_PRIORITY      1
+#define BNO055_TASK_CORE          0
+
+// Battery + analog inputs sampled in the background by the ADC continuous (DMA) driver. ADC1 pins only,
+// the USB voltage (ADC2) is still read by analogRead(), once per second by pollChargerPlugged()
+#define ADC_CONVERSIONS           4       // per pin and frame, averaged by the driver
+#define ADC_SAMPLING_FREQ         4800    // Hz, all the pins : a frame every 2.5ms
+#define ADC_TASK_STACK            2048
+#define ADC_TASK_PRIORITY         1
+#define ADC_TASK_CORE             0
+
+// Boot profiling : phases of setup() and the tasks until the first packet (bootProfile)
+#define BOOT_PHASES               20
+
+// Fast WiFi (re)connection : AP (BSSID + channel) and DHCP lease of the last connection kept in NVS
+#define WIFI_CACHE_NAMESPACE      "riot"
+#define WIFI_CACHE_KEY            "wifi"
+#define WIFI_CACHE_MAGIC          0x5357  // 'W' 'S'
+#define WIFI_FAST_TIMEOUT         1500    // ms, directed connection attempt before the full scan
+#define WIFI_LEASE_REUSES         8       // connections on the cached lease before a DHCP exchange refreshes it
+#define WIFI_GATEWAY_TIMEOUT      1000    // ms, ARP answer of the gateway on a reused lease, else DHCP
+#define WIFI_GATEWAY_RETRY        200     // ms between ARP requests
+
+// Sampling jitter instrumentation (inter-sample interval of the fusion task)
+#define JITTER_BINS               128
+#define JITTER_BIN_WIDTH          10      // µs - histogram covers the nominal period +/- 640µs
+#define JITTER_WINDOW             1000    // ms of samples between 2 latched min / max / p99
+#define JITTER_MAX_GAP            4       // x sample period - longer = sampling was paused, not jitter
 
 #define DEFAULT_CPU_SPEED         240     // MHz
 #define DEFAULT_CPU_DOZE          80      // MHz
@@ -39,6 +84,11 @@ extern IPAddress defaultDestinationIP;
 #define ODR_LOG_MOTION            50   // ms
 #define ODR_STREAMING_LED         20   // ms
 
+// Profiling & trace recording (perf, record, replay commands)
+#define PERF_METER_SAMPLES        512
+#define MAX_RECORD_FRAMES         8000    // 144 KB of heap - 40s @5ms
+#define RECORD_FILE               "/trace.raw"
+
 #define OSC_DATA_SLOTS            26      // 26 data exported - 9D IMU RAW, 2 switches, pressure, alt, board temp, air temp, Vbatt, Quaternions, Euler+compass
 #define OSC_SLOTS_BNO055          4       // yaw, pitch, roll, timestamp
 
@@ -65,13 +115,55 @@ extern IPAddress defaultDestinationIP;
 #define OSC_STRING_QUATERNION     "quaternion"
 #define OSC_STRING_CONTROL        "control"
 #define OSC_STRING_KEY            "key"
+#define OSC_STRING_SWITCH         "switch"
 #define OSC_STRING_BATTERY        "battery"
 #define OSC_STRING_ANALOG         "analog"
 #define OSC_STRING_BNO055         "bno055"
 #define OSC_STRING_MESSAGE        "message"
+#define OSC_STRING_JITTER         "jitter"
+#define OSC_STRING_SEQUENCE       "sequence"
+#define OSC_STRING_SYNC           "sync"
+#define OSC_STRING_ACK            "ack"
 #define OSC_STRING_API_VERSION    "v3"
 #define OSC_STRING_SOURCE         "riot"
 
+// OSC streams selection (streams= key), one bit per message of the bundle. The sensors reads and
+// computations only feeding a disabled stream are skipped too
+#define STREAM_ACCELEROMETER      (1 << 0)
+#define STREAM_GYROSCOPE          (1 << 1)
+#define STREAM_MAGNETOMETER       (1 << 2)
+#define STREAM_BAROMETER          (1 << 3)
+#define STREAM_TEMPERATURE        (1 << 4)
+#define STREAM_QUATERNION         (1 << 5)
+#define STREAM_EULER              (1 << 6)
+#define STREAM_GRAVITY            (1 << 7)
+#define STREAM_HEADING            (1 << 8)
+#define STREAM_BNO055             (1 << 9)    // euler + quaternion, when the BNO055 is fitted
+#define STREAM_BATTERY            (1 << 10)
+#define STREAM_ANALOG             (1 << 11)
+#define STREAM_CONTROL            (1 << 12)
+#define STREAM_JITTER             (1 << 13)
+#define STREAM_SEQUENCE           (1 << 14)   // sample counter + µs timestamp, for the receivers loss / jitter stats
+#define STREAM_ALL                0x7FFF
+
+// Sample batching (batchsize= / batchlatency= keys) : several output samples per UDP packet, the
+// packet being sent when full or when its first sample gets older than the latency deadline
+#define MAX_BATCH_SIZE            16
+#define DEFAULT_BATCH_LATENCY     20      // ms, 0 = no deadline
+#define MAX_BATCH_LATENCY         1000    // ms
+#define BATCH_MAX_PAYLOAD         1400    // bytes, OSC batches are capped below the MTU (no IP fragments)
+
+// Clock sync with a host server (syncport= key), see ./src/ClockSync.h
+#define SYNC_PERIOD               2000    // ms between requests
+#define SYNC_PERIOD_FAST          250     // ms, until the clock filter window is full
+
+// Streaming format (streamformat= key)
+enum {
+  FORMAT_OSC = 0,           // OSC bundle, one message per stream
+  FORMAT_BINARY,            // compact frame, see ./src/RiotFrame.h
+  MAX_STREAM_FORMAT
+};
+
            
 
 enum s_riotWifiStateMachine {
@@ -80,10 +172,33 @@ enum s_riotWifiStateMachine {
   RIOT_CONNECTING,
   RIOT_WAIT_IP,
   RIOT_GOT_IP,
+  RIOT_CHECK_GATEWAY,       // reused lease : gateway ARP answer before using it
   RIOT_CONNECTED,
   RIOT_LOST_CONNECTION,
 };
 
+enum s_riotFastConnect {
+  FAST_CONNECT_OFF = 0,     // full scan at each connection
+  FAST_CONNECT_AP,          // directed to the last AP (BSSID + channel), full scan if it fails
+  FAST_CONNECT_LEASE,       // same + the last DHCP lease reused as static IP (no DHCP exchange)
+  MAX_FAST_CONNECT
+};
+#define DEFAULT_FAST_CONNECT      FAST_CONNECT_AP
+
+// Last successful connection (NVS)
+struct wifiCache {
+  uint16_t magic;
+  uint8_t bssid[6];
+  uint32_t network;         // CRC of ssid + password
+  uint32_t ip;              // DHCP lease, 0 = static IP config
+  uint32_t gateway;
+  uint32_t mask;
+  uint32_t dns;
+  uint32_t leaseTime;       // s, granted by the DHCP server, 0 = unknown (not reused)
+  uint8_t leaseReuses;      // connections on that lease since the DHCP exchange (no clock across boots)
+  uint8_t channel;
+};
+
 enum s_riotChargeMode {
   CHARGE_ALWAYS_STREAM = 0,
   CHARGE_NO_STREAM,
@@ -104,9 +219,12 @@ enum s_chargerState {
   BATTERY_DISCONNECTED,
 };
 
-enum s_chargerPulse {
-  CHARGER_PULSE_UP = 0,
-  CHARGER_PULSE_DOWN
+// Charge state sent in the battery message (int after the SoC, binary frame flags)
+enum s_chargeState {
+  CHARGE_STATE_UNPLUGGED = 0,
+  CHARGE_STATE_CHARGING,
+  CHARGE_STATE_FINISHED,
+  CHARGE_STATE_NO_BATTERY
 };
 
 enum s_riotOperationStateMachine {
@@ -137,6 +255,28 @@ public:
   void end();
   void connect();
   void process();
+  void forgeBundle(const motionSample &sample);
+  void forgeFrame(const motionSample &sample, riotFrameSample *frame);
+  void layoutBundle();
+  void readInputs();
+  void sync();
+  void syncResponse(uint32_t sequence, uint64_t t2, uint64_t t3);
+  uint64_t getTimetag(uint32_t timestampUs);
+  void sendBatch(uint32_t size);
+  void startFusion();
+  void updateFusion();
+  void fuse();
+  // Recursive : the remote settings are applied under the lock and some call updateFusion()
+  void lockMotion() { if(motionMutex) xSemaphoreTakeRecursive(motionMutex, portMAX_DELAY); }
+  void unlockMotion() { if(motionMutex) xSemaphoreGiveRecursive(motionMutex); }
+  // Held by the network task around process() : the OSC messages and the bundle are its own, replay()
+  // takes it to forge in them. Taken before the motion lock
+  void lockNetwork() { if(networkMutex) xSemaphoreTake(networkMutex, portMAX_DELAY); }
+  void unlockNetwork() { if(networkMutex) xSemaphoreGive(networkMutex); }
+  void printPerf();
+  bool replay(const char *path);
+  bool record(uint32_t frames);
+  void saveRecord();
   void printWifiData();
   int getRSSI();
   void printCurrentNet();
@@ -144,12 +284,20 @@ public:
   void update();
   void calibrate();
   void charge();
-  void poll();
+  void processSwitches();
   void start();
   void version(bool logToFile = false);
+  void reportBoot();
+  void startAdc();
+  void stopAdc();
+  void readAdc();
   char* getVersion() { return versionString; }
   void readSlowBoot();
   void writeSlowBoot();  
+  void loadWifiCache();
+  void saveWifiCache();
+  bool isLeaseUsable();
+  void dropLease(const char *reason);
    
   char* getSSID() { return ssid; }
   char* getPassword() { return password;}
@@ -162,6 +310,8 @@ public:
   
   uint16_t getDestPort() { return destPort; }
   uint16_t getReceivePort() { return receivePort; }
+  uint16_t getSyncPort() { return syncPort; }
+  bool isSyncEnabled() { return syncPort; }
   
   bool getOperatingMode() { return operatingMode; }
   uint8_t getID() { return moduleID; }
@@ -170,15 +320,36 @@ public:
   int getCalibrationTimer() { return calibrationCountdown; }
   uint8_t getChargingMode() { return chargingMode; }
   uint32_t getSlowBoot() { return slowBoot; }
+  uint8_t getFastConnect() { return fastConnect; }
+  uint32_t getConnections() { return connections; }
+  uint32_t getFastConnections() { return fastConnections; }
+  uint32_t getConnectDuration() { return connectDuration; }
+  uint32_t getConnectDurationMax() { return connectDurationMax; }
   uint8_t getChargingState() { return chargingStateMachine; }
+  uint8_t getChargeState();
   uint8_t getOperationState() { return operationStateMachine; }
   CRGBW8& getPixelColor() { return ledColor; }
   int getCpuSpeed() { return cpuSpeed; }
   int getCpuDoze() { return cpuDoze; }
   float getPliLow() { return pliLow; }
   float getPliHigh() { return pliHigh; }
+  uint32_t getOutputRate() { return outputRate; }
+  uint32_t getOutputPeriod() { return max((uint32_t)MIN_OUTPUT_RATE, outputRate ? outputRate : motion.getSampleRate()); }
+  uint32_t getOutputDecimation() { return outputDecimation; }
+  uint32_t getJitterMin() { return samplingJitter.getMin(); }
+  uint32_t getJitterMax() { return samplingJitter.getMax(); }
+  uint32_t getJitterP99() { return samplingJitter.getP99(); }
+  uint32_t getStreams() { return streams; }
+  bool isStreamed(uint32_t mask) { return (streams & mask); }
+  uint8_t getStreamFormat() { return streamFormat; }
+  uint32_t getBatchSize() { return batchSize; }
+  uint32_t getBatchLatency() { return batchLatency; }
+  bool isAdcRunning() { return adcRunning; }
+  int getBatteryRaw() { return batteryRaw; }
+  float getBatteryVoltage();
+  float getAnalogInput(uint8_t input);
   char* getOscAddress() { return oscAddressString; }
-  void updateStreaming(CRGBW8 color);
+  void updateStreaming(CRGBW8 color, bool pulse = false);
   bool pollChargerPlugged();
 
   void setOwnIP(IPAddress ip) {localIP = ip;}
@@ -189,7 +360,8 @@ public:
   void setID(uint8_t id) { moduleID = id; }
   void setDestPort(uint16_t port) { destPort = port; }
   void setReceivePort(uint16_t port) { receivePort = port; }
-  void setSSID(char *newSSID) { memset(ssid, '\0', sizeof(ssid)); strcpy(ssid, newSSID); }
+  void setSyncPort(uint16_t port) { syncPort = port; }
+  void setSSID(const char *newSSID) { memset(ssid, '\0', sizeof(ssid)); strcpy(ssid, newSSID); }
   void setPassword(char *newPass) { memset(password, '\0', sizeof(password)); strcpy(password, newPass); }
   void setUseDHCP(bool dhcp) { useDHCP = dhcp; }
   void setConfigMode(bool enable) { configurationMode = enable; }
@@ -202,6 +374,7 @@ public:
   void setCpuSpeed(int speed) { cpuSpeed = speed; }
   void setCpuDoze(int speed) { cpuDoze = speed; }
   void setSlowBoot(uint32_t del) { slowBoot = del; }
+  void setFastConnect(uint8_t mode) { fastConnect = constrain(mode, FAST_CONNECT_OFF, MAX_FAST_CONNECT - 1); }
   bool isStation() { return operatingMode == STATION_MODE; }
   void setState(uint8_t state) { state = constrain(state, RIOT_DISCONNECTED, RIOT_LOST_CONNECTION); stateMachine = state; }
   void setOperationState(uint8_t state) { state = constrain(state, RIOT_IDLE, RIOT_CALIBRATION_MAG); operationStateMachine = state; }
@@ -213,7 +386,12 @@ public:
   void setBonjour(char *name) { strcpy(mdnsName, name); }
   void setPliLow(float thresh) { pliLow = thresh; }
   void setPliHigh(float thresh) { pliHigh = thresh; }
-  bool isAP() { operatingMode == AP_MODE; }
+  void setOutputRate(uint32_t rate) { outputRate = rate; updateFusion(); }
+  void setStreams(uint32_t mask) { streams = mask & STREAM_ALL; streamsChanged = true; }  // bundle laid out again by process()
+  void setStreamFormat(uint8_t format) { streamFormat = constrain(format, FORMAT_OSC, MAX_STREAM_FORMAT - 1); streamsChanged = true; }
+  void setBatchSize(uint32_t size) { batchSize = constrain(size, 1, MAX_BATCH_SIZE); streamsChanged = true; }
+  void setBatchLatency(uint32_t latency) { batchLatency = min(latency, (uint32_t)MAX_BATCH_LATENCY); }
+  bool isAP() { return operatingMode == AP_MODE; }
   bool isConfig() { return configurationMode; }
   bool isForcedConfig() { return forceConfigMode; }
   bool isDHCP() { return useDHCP; }
@@ -231,7 +409,10 @@ public:
   bool isAlwaysStreaming() { return (chargingMode == CHARGE_ALWAYS_STREAM); }
   bool isLogMotion() { return logMotion;}
   bool isLogMag() { return logMag; }
-  void bno055Found(bool val) { _bno055Flag = val; }
+  void bno055Found(bool val) { _bno055Flag = val; streamsChanged = true; }   // found after the bundle layout
+  void startBno055();
+  void setBnoOrientation(uint8_t orient);
+  uint8_t getBnoOrientation() { return bnoOrientation; }
   void oledFound(bool val) { _oledFlag = val; }
   bool hasBNO055() { return _bno055Flag; }
   bool hasDisplay() { return _oledFlag; }
@@ -259,6 +440,9 @@ private:
   IPAddress destIP;
   uint16_t destPort;
   uint16_t receivePort;
+  uint16_t syncPort = 0;
+  uint32_t syncTimer = 0;
+  ClockSync clockSync;
   uint8_t moduleID;
   int channel;
   bool hidden;
@@ -272,19 +456,30 @@ private:
   int cpuSpeed = DEFAULT_CPU_SPEED;
   int cpuDoze = DEFAULT_CPU_DOZE;
   int connectingTimer = 0;
-  int pollingTimer = 0;
   int chargingTimer = 0;
   int chargerPollTimer = 0;
-  int samplingCounter = 0;
   int ledCounter;
-  bool chargingPulseDir = CHARGER_PULSE_UP;
-  int chargingPulsePWM = 0;
   bool chargerPlugged = false;
   bool ledState;
   CRGBW8 ledColor;
   CRGBW8 chargingColor;
   uint8_t chargingMode = CHARGE_ALWAYS_STREAM;
   uint32_t  slowBoot = 0;
+
+  // Fast (re)connection
+  uint8_t fastConnect = DEFAULT_FAST_CONNECT;
+  wifiCache lastAP;
+  bool lastAPValid = false;
+  bool fastAttempt = false;     // current connection directed to lastAP
+  bool leaseReused = false;     // current IP config is the cached lease
+  uint32_t leaseStart = 0;      // ms, connection on the reused lease
+  uint32_t gatewayCheck = 0;    // ms, start of the gateway check, 0 = none
+  uint32_t gatewayRequest = 0;  // ms, last ARP request
+  uint32_t connectStart = 0;    // ms, connection request or loss, 0 = connected
+  uint32_t connections = 0;     // completed connections (the 1st one at boot included)
+  uint32_t fastConnections = 0; // through the directed connection
+  uint32_t connectDuration = 0; // ms, request / loss to IP, last one
+  uint32_t connectDurationMax = 0;
   bool logMotion = false;
   bool logMag = false;
 
@@ -299,25 +494,76 @@ private:
   short unsigned int RemoteOutputState = LOW;
 
   int batteryVoltageRaw;
-  BoxFilter<float, 10> batteryVoltageFiltered;
+  BoxFilter<float, 10> batteryVoltageFiltered;   // fed by the ADC task
+  bool adcRunning = false;
+  volatile int batteryRaw = 0;                    // last ADC frame
+  volatile float batteryVoltageAverage = 0.f;
+  volatile float analogInputVoltage[2] = {0.f, 0.f};
   float batteryVoltage, batterySoC, analogInput1, analogInput2;
   float pliLow, pliHigh;
 
   uint32_t now;   // time since start to add as timestamp
+
+  // Sensor fusion decoupled from the OSC output
+  uint32_t outputRate = 0;      // ms - 0 = output at each sample (samplerate)
+  uint32_t outputDecimation = 1;  // fusion steps per OSC bundle
+  uint32_t decimationCounter = 0;
+  uint32_t outputSequence = 0;  // output samples since boot, gaps at the receiver = lost (ring or network)
+  esp_timer_handle_t fusionTimer = NULL;
+  TaskHandle_t fusionTaskHandle = NULL;
+  TaskHandle_t networkTaskHandle = NULL;
+  SemaphoreHandle_t motionMutex = NULL;
+  SemaphoreHandle_t networkMutex = NULL;
+  SpscRing<motionSample, SAMPLE_RING_SIZE> sampleRing;
+  int64_t lastSampleTime = 0;   // µs, 0 = no previous sample (start or resume)
+  JitterMeter<JITTER_BINS> samplingJitter;
+  uint32_t jitterSent = 0;      // last window exported over OSC
+  uint32_t bundleStreamSize = 0;  // bytes of the bundle without the trailing jitter message
+  uint32_t streams = STREAM_ALL;
+  volatile bool streamsChanged = false;
+  uint8_t streamFormat = FORMAT_OSC;
+  uint32_t batchSize = 1;       // samples per packet
+  uint32_t batchLatency = DEFAULT_BATCH_LATENCY;
+  uint32_t batchLimit = 1;      // batchSize, capped by the payload size for OSC
+  uint32_t batchCount = 0;      // samples in the pending packet
+  uint32_t batchStart = 0;      // µs, acquisition time of its first sample
+
+  // Switch events from the switch task (interrupt driven)
+  TaskHandle_t switchTaskHandle = NULL;
+  SpscRing<SwitchEvent, SWITCH_EVENTS> switchEvents;   // on board switch -> calibrate()
+  void sendSwitch(uint8_t index, SwitchEvent event, uint32_t time);
+
+  // Profiling
+  void recordFrame();
+  PerfMeter<PERF_METER_SAMPLES> processMeter;
+  PerfMeter<PERF_METER_SAMPLES> networkMeter;
+  PerfMeter<PERF_METER_SAMPLES> replayMeter;
+  int16_t *recordBuffer = NULL;
+  uint32_t recordLength = 0;
+  uint32_t recordIndex = 0;
+  volatile bool recordDone = false;               // buffer full, saved by the loop task (saveRecord())
   
   char versionString[80];
   char fwString[20];
   char dateString[20];
-  char oscAddressString[20];
+  char oscAddressString[32];   // /riot/v3/<id>/message
   bool _bno055Flag = false;
+  uint8_t bnoOrientation = 0;   // bno_orient, applied once the BNO055 is initialized
   bool _oledFlag = false;
 
+  // Boot profiling
+  uint32_t connectTime = 0;     // µs, first WiFi connection request
+  uint32_t gotIpTime = 0;
+  volatile bool firstPacket = false;
+  bool bootReported = false;
+
   bool _initialized = false;
   
 };
 
 
 extern riotCore riot;
+extern BootProfiler<BOOT_PHASES> bootProfile;
 
 
 
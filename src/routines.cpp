@@ -9,24 +9,185 @@ const voltageSOCMap socMap[SOC_NUM_POINTS] = {
     {3.50f, 0.10f}, {3.45f, 0.05f}, {3.4f, 0.02f}, {3.35f, 0.f}
 };
 
+// Status led. Last request, read by the led task
+static struct {
+  uint8_t mode;
+  uint32_t color;           // RGB24
+  uint16_t onTime;
+  uint16_t offTime;
+  uint32_t start;           // ms
+} ledRequest = {LED_STEADY, 0, 0, 0, 0};
+static portMUX_TYPE ledMux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t ledTaskHandle = NULL;
+
+static inline uint32_t rgb24(CRGBW8 color) {
+  return ((uint32_t)color.r << 16) | ((uint32_t)color.g << 8) | color.b;
+}
+
+static void ledTask(void *) {
+  uint32_t shown = 0xFFFFFFFF;   // forces the first write
+  for (;;) {
+    portENTER_CRITICAL(&ledMux);
+    uint8_t mode = ledRequest.mode;
+    uint32_t color = ledRequest.color;
+    uint32_t onTime = ledRequest.onTime;
+    uint32_t offTime = ledRequest.offTime;
+    uint32_t elapsed = millis() - ledRequest.start;
+    portEXIT_CRITICAL(&ledMux);
+
+    uint32_t wait = 0;  // ms until the pattern changes, 0 = next request
+    switch (mode) {
+      case LED_FLASH:
+        if (elapsed < onTime)
+          wait = onTime - elapsed;
+        else
+          color = 0;
+        break;
+
+      case LED_BLINK: {
+        uint32_t phase = elapsed % (onTime + offTime);
+        if (phase < onTime)
+          wait = onTime - phase;
+        else {
+          wait = onTime + offTime - phase;
+          color = 0;
+        }
+        break;
+      }
+
+      case LED_PULSE: {
+        uint32_t phase = elapsed % onTime;
+        int level = (phase * 510) / onTime;   // up then down
+        if (level > 255)
+          level = 510 - level;
+        color = rgb24(CRGBW8(color >> 16, color >> 8, color) * level);
+        wait = LED_PULSE_STEP;
+        break;
+      }
+
+      default:
+        break;
+    }
+
+    if (color != shown) {
+      rgbLedWrite(PIN_NEOPIXEL, color >> 16, color >> 8, color);
+      shown = color;
+    }
+    ulTaskNotifyTake(pdTRUE, wait ? max((TickType_t)1, pdMS_TO_TICKS(wait)) : portMAX_DELAY);
+  }
+}
+
+void startLed() {
+  if (!ledTaskHandle)
+    xTaskCreatePinnedToCore(ledTask, "led", LED_TASK_STACK, NULL, LED_TASK_PRIORITY, &ledTaskHandle, LED_TASK_CORE);
+}
+
+// Same request as the current one = nothing to do, except restarting a flash
+static void postLed(uint8_t mode, CRGBW8 color, uint16_t onTime, uint16_t offTime) {
+  if (!ledTaskHandle) {   // before startLed()
+    rgbLedWrite(PIN_NEOPIXEL, color.r, color.g, color.b);
+    return;
+  }
+  uint32_t now = millis();
+  bool changed;
+  portENTER_CRITICAL(&ledMux);
+  changed = (mode != ledRequest.mode) || (rgb24(color) != ledRequest.color)
+    || (onTime != ledRequest.onTime) || (offTime != ledRequest.offTime);
+  if (mode == LED_FLASH) {
+    changed |= (now - ledRequest.start >= onTime);   // already back to black
+    ledRequest.start = now;
+  }
+  if (changed) {
+    ledRequest.mode = mode;
+    ledRequest.color = rgb24(color);
+    ledRequest.onTime = onTime;
+    ledRequest.offTime = offTime;
+    ledRequest.start = now;
+  }
+  portEXIT_CRITICAL(&ledMux);
+  if (changed)
+    xTaskNotifyGive(ledTaskHandle);
+}
+
 // Use CRGBW class simplified RGB to at least define colors with 8:8:8 RGB24
 // Could be a #define substitute
 void setLedColor(CRGBW8 color) { 
-  rgbLedWrite(PIN_NEOPIXEL, color.r, color.g, color.b);
+  postLed(LED_STEADY, color, 0, 0);
 }
 
-void printToOSC(char *str) {
+void flashLed(CRGBW8 color, uint16_t duration) {
+  postLed(LED_FLASH, color, max(duration, (uint16_t)1), 0);
+}
+
+void blinkLed(CRGBW8 color, uint16_t onTime, uint16_t offTime) {
+  postLed(LED_BLINK, color, onTime, max(offTime, (uint16_t)1));
+}
+
+void pulseLed(CRGBW8 color, uint16_t period) {
+  postLed(LED_PULSE, color, max(period, (uint16_t)2), 0);
+}
+
+static void sendStringToOSC(const char *name, char *str) {
   if(!riot.isConnected())
     return;
   //log_v("%s printToOSC: %s", TEXT_LOG_OSC, str);
   char addr[MAX_STRING_LEN];
-  sprintf(addr, "/%s/%s/%d/%s", OSC_STRING_SOURCE, OSC_STRING_API_VERSION, riot.getID(), OSC_STRING_MESSAGE);
+  sprintf(addr, "/%s/%s/%d/%s", OSC_STRING_SOURCE, OSC_STRING_API_VERSION, riot.getID(), name);
   printOscMessage.createString(addr, str);
   udpPacket.beginPacket(riot.getDestIP(), riot.getDestPort());
   udpPacket.write(printOscMessage.getBuffer(), printOscMessage.getSize());
   udpPacket.endPacket(); 
 }
 
+void printToOSC(char *str) {
+  sendStringToOSC(OSC_STRING_MESSAGE, str);
+}
+
+// Queue of the texts posted by the other tasks, any of them can post
+static struct {
+  char text[OSC_TEXT_QUEUE][MAX_STRING_LEN];
+  uint8_t first;
+  uint8_t count;
+} postedText = {{{0}}, 0, 0};
+static portMUX_TYPE postedTextMux = portMUX_INITIALIZER_UNLOCKED;
+
+void postToOSC(const char *str) {
+  portENTER_CRITICAL(&postedTextMux);
+  if (postedText.count < OSC_TEXT_QUEUE) {
+    uint8_t slot = (postedText.first + postedText.count) % OSC_TEXT_QUEUE;
+    strncpy(postedText.text[slot], str, MAX_STRING_LEN - 1);
+    postedText.text[slot][MAX_STRING_LEN - 1] = '\0';
+    postedText.count++;
+  }
+  portEXIT_CRITICAL(&postedTextMux);
+}
+
+// Loop task
+void sendPostedOSC() {
+  char str[MAX_STRING_LEN];
+
+  for (;;) {
+    portENTER_CRITICAL(&postedTextMux);
+    bool pending = (postedText.count > 0);
+    if (pending) {
+      memcpy(str, postedText.text[postedText.first], MAX_STRING_LEN);
+      postedText.first = (postedText.first + 1) % OSC_TEXT_QUEUE;
+      postedText.count--;
+    }
+    portEXIT_CRITICAL(&postedTextMux);
+    if (!pending)
+      return;
+    printToOSC(str);
+  }
+}
+
+// Answer to a remote setting : "key=value status" on /riot/v3/<id>/ack
+void ackToOSC(char *command, const char *status) {
+  char str[MAX_STRING_LEN + 16];
+  snprintf(str, sizeof(str), "%s %s", command, status);
+  sendStringToOSC(OSC_STRING_ACK, str);
+}
+
 void die() {
   while(1) {
     delay(10);
@@ -35,12 +196,16 @@ void die() {
 }
 
 void reset() {
+  flushConfig();    // a savecfg just before must reach the flash
   ESP.restart();
 }
 
 
 
+// Last frame of the ADC task once started (the pin then belongs to the ADC continuous driver)
 int readBatteryRaw(void) {
+  if(riot.isAdcRunning())
+    return(riot.getBatteryRaw());
   return(analogRead(PIN_BATT_VOLTAGE));
 }
 
@@ -79,25 +244,34 @@ float voltageToSoC(float voltage) {
 }
 
 
+// When disconnected, the charger status flickers @250 Hz : the charger is probing the battery
+// without success and switches between low and hi-z. The edges are timestamped by an interrupt,
+// a few of them within CHARGER_FLICKER_TIME indicate the battery is most likely disconnected
+static volatile uint32_t chargerEdgeTime[CHARGER_FLICKER_EDGES];   // ms, ring of the last edges
+static volatile uint32_t chargerEdges = 0;
+
+static void ARDUINO_ISR_ATTR chargerEdge() {
+  chargerEdgeTime[chargerEdges % CHARGER_FLICKER_EDGES] = millis();
+  chargerEdges++;
+}
+
+void startChargeDetection() {
+  attachInterrupt(PIN_CHARGE_STATUS, chargerEdge, CHANGE);
+}
+
+// Non blocking (used to poll the pin for 5ms)
 uint8_t readChargeStatus(void) {
   uint8_t chargeStatus;
   int pinState;
-  int timeout;
 
   pinState = digitalRead(PIN_CHARGE_STATUS);
   //Serial.printf("charger pin = %d\n", pinState);
-  timeout = millis();
-  // When disconnected, the charger status flickers @250 Hz
-  // Check if change of state, poll with timeout
-  // If a change occurs within 5ms, the charger is probing the battery
-  // without success and switches between low and hi-z indicating the battery
-  // is most likely disconnected
-  while((millis() - timeout) < 5 ) {
-    if(pinState != digitalRead(PIN_CHARGE_STATUS)) {
-      chargeStatus = BATTERY_DISCONNECTED;
-      return chargeStatus;
-      break;
-    }
+  uint32_t edges = chargerEdges;
+  // Oldest of the last CHARGER_FLICKER_EDGES edges
+  if(edges >= CHARGER_FLICKER_EDGES
+     && (millis() - chargerEdgeTime[edges % CHARGER_FLICKER_EDGES]) < CHARGER_FLICKER_TIME) {
+    chargeStatus = BATTERY_DISCONNECTED;
+    return chargeStatus;
   }
   if(pinState == HIGH){
     chargeStatus = CHARGING_FINISHED;
@@ -158,10 +332,8 @@ void format() {
 #define SAMPLE_DELAY          0
 
 bool autoTest() {
-  uint8_t result = 0;
   uint8_t isMovingX, isMovingY, isMovingZ;
-  char str[MAX_STRING_LEN];
-  float testArray[3], testArray_1[3];
+  float testArray[3], testArray_1[3] = {0.f, 0.f, 0.f};
   int maxSamples = u8g2.getWidth();
   bool accOK, gyroOK, magOK, baroOK, analogOK, gpioOK;
   
@@ -356,6 +528,7 @@ bool autoTest() {
   u8g2.setFont(MEDIUM_FONT);
   u8g2.drawStr(0, ACC_TEST_LINE, "Testing I/Os");
   u8g2.drawStr(0, X_SCOPE_LINE, " ");
+  riot.stopAdc();   // A0 & A1 are used as GPIOs
   pinMode(A1, INPUT);
   pinMode(A3, INPUT);
   pinMode(A5, INPUT);
@@ -494,8 +667,8 @@ bool autoTest() {
 }
 
 float clipData(float val, float analogScale, int scopeScale) {
-  val = fmap(val, -1.f * ANALOG_SCALE_ACC, ANALOG_SCALE_ACC, SCOPE_SCALE, -1.f * SCOPE_SCALE);
-  val = constrain(val, -1 * SCOPE_SCALE, SCOPE_SCALE);
+  val = fmap(val, -1.f * analogScale, analogScale, scopeScale, -1.f * scopeScale);
+  val = constrain(val, -1 * scopeScale, scopeScale);
   return(val);  
 }
 
@@ -506,7 +679,7 @@ float clipData(float val, float analogScale, int scopeScale) {
 //////////////////////////////////////////////////////////////////////////////////////////////
 // File & Dir handling + helpers
 
-bool checkFile(char *filename) {
+bool checkFile(const char *filename) {
   FILINFO fno;
   FRESULT fr1 = f_stat(filename, &fno);
   return(fr1 == FR_OK);
@@ -634,9 +807,9 @@ void performUpdate(Stream &updateSource, size_t updateSize) {
     // Get update progress report in % and sweep a rainbow on the onboard pixel
     size_t written = Update.writeStream(updateSource);
     if (written == updateSize) {
-      Serial.printf("Wrote %d bytes\n", written);
+      Serial.printf("Wrote %u bytes\n", (uint32_t)written);
     } else {
-      Serial.printf("Wrote only : %d bytes / %d\n", written, updateSize);
+      Serial.printf("Wrote only : %u bytes / %u\n", (uint32_t)written, (uint32_t)updateSize);
     }
     if (Update.end()) {
       Serial.println("OTA done!");
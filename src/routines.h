@@ -25,13 +25,42 @@
 #define PIN1_SET(_pin)                   GPIO.out1_w1ts.data = (uint32_t)(1<<(_pin-32))
 
 
+// Status led (WS2812) : the RMT writes (~120µs) are done by a low priority task, the callers
+// only post the requested color or pattern. Repeated requests are coalesced
+#define LED_TASK_STACK          2048
+#define LED_TASK_PRIORITY       1       // same as the arduino loop
+#define LED_TASK_CORE           0
+#define LED_FLASH_TIME          2       // ms, activity flash of a sent packet
+#define LED_PULSE_STEP          15      // ms, brightness update of the pulse pattern
+
+// Text messages of the fusion task (autocalibration) : udpPacket and the print message belong to the loop
+// task, the messages are queued and sent by sendPostedOSC(). Dropped when the queue is full
+#define OSC_TEXT_QUEUE          4
+
+enum s_ledMode {
+  LED_STEADY = 0,
+  LED_FLASH,                // color during onTime then black, restarted by each request
+  LED_BLINK,                // color during onTime, black during offTime
+  LED_PULSE                 // triangle brightness ramp over onTime (breathing)
+};
+
+#define CHARGER_FLICKER_EDGES   4       // edges of the charger status pin...
+#define CHARGER_FLICKER_TIME    20      // ms ...within this time = battery disconnected (250 Hz flicker)
+
 typedef struct {
     float voltage;
     float soc; // normalized {0. ; 1.}
 } voltageSOCMap;
 
+void startLed();
 void setLedColor(CRGBW8 color);
+void flashLed(CRGBW8 color, uint16_t duration = LED_FLASH_TIME);
+void blinkLed(CRGBW8 color, uint16_t onTime, uint16_t offTime);
+void pulseLed(CRGBW8 color, uint16_t period);
 void printToOSC(char *StringMessage);
+void postToOSC(const char *StringMessage);
+void sendPostedOSC();
+void ackToOSC(char *command, const char *status);
 void die();
 void restoreDefaults(bool save = false);
 void reset();
@@ -41,6 +70,7 @@ float clipData(float val, float analogScale, int scopeScale);
 int readBatteryRaw(void);
 float readBatteryVoltage(void);
 float readUsbVoltage(void);
+void startChargeDetection();
 uint8_t readChargeStatus(void);
 float voltageToSoC(float voltage);
 
@@ -51,7 +81,7 @@ void disableWiFi();
 void format();
 
 // file & dir helpers
-bool checkFile(char *filename);
+bool checkFile(const char *filename);
 void listDir(fs::FS &fs, const char * dirname, uint8_t levels);
 void deleteFile(fs::FS &fs, const char * path);
 void renameFile(fs::FS &fs, const char * path1, const char * path2);
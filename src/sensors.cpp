@@ -320,6 +320,118 @@ void imu::read() {
   
 }
 
+// FIFO batch mode : the IMU runs at 416 Hz while we sample every few ms, so read() only gets one
+// snapshot and the fusion runs on aliased data. In FIFO mode, all queued gyro/acc samples are
+// retrieved with 2 transactions (status + burst of data) and fed one by one to the filter
+bool imu::setFifo(bool enable) {
+  if(_imuType == IMU_LSM6DSV || _imuType == IMU_UNKNOWN) {
+    // DSV uses a tagged FIFO with another register map - not supported (yet)
+    if(enable)
+      Serial.printf("IMU FIFO mode not supported on this sensor\n");
+    fifoEnabled = false;
+    return false;
+  }
+
+  xgWriteByte(LSM6DS3_ACC_GYRO_FIFO_CTRL5, LSM6D_FIFO_MODE_BYPASS);   // clears the FIFO
+  fifoCount = 0;
+  fifoEnabled = enable;
+  if(!enable)
+    return true;
+
+  xgWriteByte(LSM6DS3_ACC_GYRO_FIFO_CTRL1, 0x00);   // No threshold / watermark, we poll it
+  xgWriteByte(LSM6DS3_ACC_GYRO_FIFO_CTRL2, 0x00);
+  xgWriteByte(LSM6DS3_ACC_GYRO_FIFO_CTRL3, LSM6D_FIFO_NO_DECIMATION);
+  xgWriteByte(LSM6DS3_ACC_GYRO_FIFO_CTRL4, 0x00);
+  xgWriteByte(LSM6DS3_ACC_GYRO_FIFO_CTRL5, LSM6D_FIFO_MODE_CONTINUOUS);
+  return true;
+}
+
+uint8_t imu::readFifo() {
+  uint8_t status[5] = {LSM6DS3_ACC_GYRO_FIFO_STATUS1 | READ_AND_AUTOINCREMENT, 0xFF, 0xFF, 0xFF, 0xFF};
+  uint16_t words, pattern, skip, samples, bytes;
+  uint8_t *p;
+
+  // FIFO_STATUS1..4 : number of unread words + next word position in the Gx..XLz pattern
+  digitalWrite(_pin, LOW);
+  SPI.transfer(status, 5);
+  digitalWrite(_pin, HIGH);
+  words = ((uint16_t)(status[2] & 0x0F) << 8) | status[1];
+  pattern = ((uint16_t)(status[4] & 0x03) << 8) | status[3];
+
+  // Realign on a complete data set if we were left in the middle of one (after an overrun)
+  skip = (LSM6D_FIFO_PATTERN_WORDS - pattern) % LSM6D_FIFO_PATTERN_WORDS;
+  samples = (words > skip) ? (words - skip) / LSM6D_FIFO_PATTERN_WORDS : 0;
+
+  if(samples > IMU_FIFO_MAX_SAMPLES || (status[2] & LSM6D_FIFO_OVERRUN)) {
+    // We are too late (very slow sample rate or a long blocking task), the queue is stale anyway
+    // Flush it and fall back to a single snapshot
+    xgWriteByte(LSM6DS3_ACC_GYRO_FIFO_CTRL5, LSM6D_FIFO_MODE_BYPASS);
+    xgWriteByte(LSM6DS3_ACC_GYRO_FIFO_CTRL5, LSM6D_FIFO_MODE_CONTINUOUS);
+    read();
+    fifoData[0][0] = accX.Value;
+    fifoData[0][1] = accY.Value;
+    fifoData[0][2] = accZ.Value;
+    fifoData[0][3] = gyrX.Value;
+    fifoData[0][4] = gyrY.Value;
+    fifoData[0][5] = gyrZ.Value;
+    fifoCount = 1;
+    return fifoCount;
+  }
+
+  fifoCount = samples;
+  if(!samples)
+    return 0;
+
+  bytes = 2 * (skip + samples * LSM6D_FIFO_PATTERN_WORDS);
+  fifoBuffer[0] = LSM6DS3_ACC_GYRO_FIFO_DATA_OUT_L | READ_AND_AUTOINCREMENT;
+  memset(&fifoBuffer[1], 0xFF, bytes);
+  digitalWrite(_pin, LOW);
+  SPI.transfer(fifoBuffer, bytes + 1);
+  digitalWrite(_pin, HIGH);
+
+  p = &fifoBuffer[1 + 2 * skip];
+  for(int i = 0 ; i < samples ; i++) {
+    // FIFO order is gyro then acc, stored as acc then gyro like the raw frames
+    fifoData[i][3] = (int16_t)(p[0] | (p[1] << 8));
+    fifoData[i][4] = (int16_t)(p[2] | (p[3] << 8));
+    fifoData[i][5] = (int16_t)(p[4] | (p[5] << 8));
+    fifoData[i][0] = (int16_t)(p[6] | (p[7] << 8));
+    fifoData[i][1] = (int16_t)(p[8] | (p[9] << 8));
+    fifoData[i][2] = (int16_t)(p[10] | (p[11] << 8));
+    p += 2 * LSM6D_FIFO_PATTERN_WORDS;
+  }
+
+  // Latest sample is also the current value returned by the getters
+  accX.Value = fifoData[samples - 1][0];
+  accY.Value = fifoData[samples - 1][1];
+  accZ.Value = fifoData[samples - 1][2];
+  gyrX.Value = fifoData[samples - 1][3];
+  gyrY.Value = fifoData[samples - 1][4];
+  gyrZ.Value = fifoData[samples - 1][5];
+
+  if(++fifoReads >= IMU_TEMP_DECIMATION) {
+    fifoReads = 0;
+    readTemp();
+  }
+  return fifoCount;
+}
+
+// Batch of count samples (accX..gyrZ, oldest first) in place of the SPI burst, as readFifo() leaves it
+void imu::loadFifo(const int16_t (*samples)[6], uint8_t count) {
+  if(count > IMU_FIFO_MAX_SAMPLES)
+    count = IMU_FIFO_MAX_SAMPLES;
+  memcpy(fifoData, samples, count * sizeof(fifoData[0]));
+  fifoCount = count;
+  if(!count)
+    return;
+  accX.Value = fifoData[count - 1][0];
+  accY.Value = fifoData[count - 1][1];
+  accZ.Value = fifoData[count - 1][2];
+  gyrX.Value = fifoData[count - 1][3];
+  gyrY.Value = fifoData[count - 1][4];
+  gyrZ.Value = fifoData[count - 1][5];
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////
 // Mag Sensor
 bool mag::begin(uint8_t pin) {
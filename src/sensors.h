@@ -201,6 +201,22 @@ enum s_GyroRangeDsv {
 #define WHO_AM_I_LSM6D_RSP3    0x6B   // LSM6DSR
 #define WHO_AM_I_LSM6D_RSP4    0x70   // LSM6DSV(16X)
 
+////////////////////////////////
+// LSM6D FIFO (DS3 / DSL)     //
+////////////////////////////////
+// Gyro + Acc data sets stored at the sensor ODR in continuous mode. Each sample is a 6 words pattern
+// Gx Gy Gz XLx XLy XLz. FIFO_DATA_OUT_L/H rolls back on itself with auto-increment so the whole
+// queue is drained in a single burst transaction
+#define LSM6D_FIFO_NO_DECIMATION      0b00001001    // FIFO_CTRL3 : gyro & acc data sets, no decimation
+#define LSM6D_FIFO_MODE_BYPASS        0b00000000    // FIFO_CTRL5 : FIFO off / cleared
+#define LSM6D_FIFO_MODE_CONTINUOUS    0b00110110    // FIFO_CTRL5 : ODR 416 Hz / continuous (oldest overwritten)
+#define LSM6D_FIFO_OVERRUN            0b01000000    // FIFO_STATUS2
+#define LSM6D_FIFO_PATTERN_WORDS      6
+#define LSM6D_FIFO_ODR                416.0f        // Hz, same as CTRL1_XL / CTRL2_G
+#define IMU_FIFO_MAX_SAMPLES          48            // ~115ms @416Hz, beyond that the FIFO is flushed
+#define IMU_FIFO_BUFFER_SIZE          (1 + 2 * LSM6D_FIFO_PATTERN_WORDS * (IMU_FIFO_MAX_SAMPLES + 1))
+#define IMU_TEMP_DECIMATION           16            // board temperature isn't in the FIFO, read it once in a while
+
 
 ///////////////////////////////////////////////////////////////////////////////////////
 // LIS3MDL 3 axis Mag sensor 
@@ -332,11 +348,14 @@ public:
     void readAcc();
     void readGyro();
     void readTemp();
+    uint8_t readFifo();   // Drains the FIFO, returns the number of samples
+    void loadFifo(const int16_t (*samples)[6], uint8_t count);   // Same result from given samples (host tests)
 
     // TODO
     void setAccRange(int range);
     void setGyroRange(int range);
     void setGyroHpf(bool hpf);
+    bool setFifo(bool enable);
     //void setAccODR();
     //void setGyrODR();
 
@@ -350,6 +369,10 @@ public:
     int16_t getGyrY() { return gyrY.Value; }
     int16_t getGyrZ() { return gyrZ.Value; }
     int16_t getTemp() { return temperature.Value; }
+    bool isFifo() { return fifoEnabled; }
+    uint8_t getFifoCount() { return fifoCount; }
+    float getFifoPeriod() { return 1.0f / LSM6D_FIFO_ODR; }
+    const int16_t *getFifoSample(uint8_t index) { return fifoData[index]; }   // accX..gyrZ (6 values)
      
 private:
   void xgWriteByte(uint8_t subAddress, uint8_t data);  
@@ -363,6 +386,13 @@ private:
   Word temperature;
   int accRange, gyroRange;
   bool gyroHpf = false;
+
+  // FIFO
+  bool fifoEnabled = false;
+  uint8_t fifoCount = 0;
+  uint8_t fifoReads = 0;
+  uint8_t fifoBuffer[IMU_FIFO_BUFFER_SIZE];
+  int16_t fifoData[IMU_FIFO_MAX_SAMPLES][6];
   
   bool _initialized = false;
   uint8_t _imuType = IMU_UNKNOWN;
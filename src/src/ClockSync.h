@@ -0,0 +1,174 @@
+//////////////////////////////////////////////////////////////////////////////////////
+// Simplified NTP over OSC : estimates the offset and drift of the local µs clock (esp_timer)
+// against a host server, to stamp the OSC bundles with real NTP time tags.
+// Plain C++11, no Arduino / FreeRTOS dependency so it also compiles on a host
+//
+// Exchange : the module sends a request numbered n at local time t1, the server answers with its
+// receive (t2) and transmit (t3) NTP times, received at local time t4.
+//   offset = ((t2 - t1) + (t3 - t4)) / 2      delay = (t4 - t1) - (t3 - t2)
+// Like the NTP clock filter, the exchange with the lowest delay among the last CLOCK_SYNC_WINDOW
+// ones is kept (the least queued by WiFi retries / power save). The offset and drift are then a
+// least squares line through the last CLOCK_SYNC_HISTORY kept exchanges, so that the time tags
+// neither step nor wander between exchanges
+//
+// - request() / response() on one task, toNtp() may be called from an other one : the clock model
+//   is double buffered and published atomically (exchanges are seconds apart)
+
+#ifndef _CLOCK_SYNC_H
+#define _CLOCK_SYNC_H
+
+#include <atomic>
+#include <stdint.h>
+
+#define CLOCK_SYNC_WINDOW         8         // exchanges (power of 2)
+#define CLOCK_SYNC_HISTORY        32        // filtered exchanges in the fit (power of 2)
+#define CLOCK_SYNC_MAX_DRIFT      500e-6f   // crystal tolerance, larger = bad estimate
+#define CLOCK_SYNC_MAX_DELAY      100000    // µs round trip, longer exchanges are ignored
+
+class ClockSync {
+  static_assert(CLOCK_SYNC_WINDOW && ((CLOCK_SYNC_WINDOW & (CLOCK_SYNC_WINDOW - 1)) == 0), "CLOCK_SYNC_WINDOW must be a power of 2");
+
+  struct pending {
+    uint32_t sequence;
+    int64_t t1;
+  };
+  struct exchange {
+    int64_t offset;   // server - local, µs
+    int64_t delay;    // µs, -1 = empty slot
+    int64_t local;    // local time of the exchange
+  };
+  struct point {
+    int64_t local;
+    int64_t offset;
+  };
+  struct model {
+    int64_t offset;
+    int64_t local;
+    float drift;
+  };
+
+public:
+  ClockSync() { reset(); }
+
+  void reset() {
+    _synced.store(false, std::memory_order_relaxed);
+    _exchanges = 0;
+    _points = 0;
+    _drift = 0.f;
+    for (int i = 0; i < CLOCK_SYNC_WINDOW; i++)
+      _window[i].delay = -1;
+  }
+
+  // Returns the sequence number to send in the request, t1 = local µs time of sending
+  uint32_t request(int64_t t1) {
+    uint32_t sequence = _sequence++;
+    _sent[sequence & (CLOCK_SYNC_WINDOW - 1)] = {sequence, t1};
+    return sequence;
+  }
+
+  // t2 / t3 : server NTP times, t4 : local µs time of reception. False = stale or unknown request
+  bool response(uint32_t sequence, uint64_t t2, uint64_t t3, int64_t t4) {
+    const pending &p = _sent[sequence & (CLOCK_SYNC_WINDOW - 1)];
+    if (p.sequence != sequence || !p.t1)
+      return false;
+    int64_t t1 = p.t1;
+    _sent[sequence & (CLOCK_SYNC_WINDOW - 1)].t1 = 0;   // answered
+
+    int64_t server2 = ntpToMicros(t2);
+    int64_t server3 = ntpToMicros(t3);
+    int64_t delay = (t4 - t1) - (server3 - server2);
+    if (delay < 0 || delay > CLOCK_SYNC_MAX_DELAY)
+      return false;
+    exchange &e = _window[_exchanges++ & (CLOCK_SYNC_WINDOW - 1)];
+    e.offset = ((server2 - t1) + (server3 - t4)) / 2;
+    e.delay = delay;
+    e.local = t4;
+
+    // Clock filter : best exchange of the window
+    const exchange *best = &e;
+    for (int i = 0; i < CLOCK_SYNC_WINDOW; i++) {
+      if (_window[i].delay >= 0 && _window[i].delay < best->delay)
+        best = &_window[i];
+    }
+    _delay = (uint32_t)best->delay;
+
+    if (!_points || _history[(_points - 1) & (CLOCK_SYNC_HISTORY - 1)].local != best->local)
+      _history[_points++ & (CLOCK_SYNC_HISTORY - 1)] = {best->local, best->offset};
+    fit();
+
+    uint32_t next = _current.load(std::memory_order_relaxed) ^ 1;
+    _model[next] = _fit;
+    _current.store(next, std::memory_order_release);
+    _synced.store(true, std::memory_order_release);
+    return true;
+  }
+
+  bool isSynced() { return _synced.load(std::memory_order_acquire); }
+
+  // Server time of a local µs time, as an NTP / OSC time tag (0 = not synced yet)
+  uint64_t toNtp(int64_t local) {
+    if (!isSynced())
+      return 0;
+    const model &m = _model[_current.load(std::memory_order_acquire)];
+    int64_t elapsed = local - m.local;
+    return microsToNtp(local + m.offset + (int64_t)(m.drift * (float)elapsed));
+  }
+
+  int64_t getOffset() { return _model[_current.load(std::memory_order_acquire)].offset; }
+  float getDrift() { return _drift * 1e6f; }   // ppm
+  uint32_t getDelay() { return _delay; }       // µs, round trip of the exchange in use
+  uint32_t getExchanges() { return _exchanges; }
+
+  // 32.32 fixed point seconds since 1900 <-> µs
+  static int64_t ntpToMicros(uint64_t ntp) {
+    return (int64_t)(ntp >> 32) * 1000000 + (int64_t)(((ntp & 0xFFFFFFFFull) * 1000000) >> 32);
+  }
+  static uint64_t microsToNtp(int64_t us) {
+    uint64_t seconds = (uint64_t)(us / 1000000);
+    uint64_t fraction = ((uint64_t)(us % 1000000) << 32) / 1000000;
+    return (seconds << 32) | fraction;
+  }
+
+private:
+  // Least squares offset = a + drift x (local - mean local). Doubles : no FPU for them on the
+  // ESP32 but it's a few µs every few seconds
+  void fit() {
+    uint32_t n = _points < CLOCK_SYNC_HISTORY ? _points : CLOCK_SYNC_HISTORY;
+    const point &origin = _history[(_points - 1) & (CLOCK_SYNC_HISTORY - 1)];
+    double meanX = 0, meanY = 0, sxx = 0, sxy = 0;
+
+    for (uint32_t i = 0; i < n; i++) {
+      meanX += (double)(_history[i].local - origin.local);
+      meanY += (double)(_history[i].offset - origin.offset);
+    }
+    meanX /= n;
+    meanY /= n;
+    for (uint32_t i = 0; i < n; i++) {
+      double dx = (double)(_history[i].local - origin.local) - meanX;
+      double dy = (double)(_history[i].offset - origin.offset) - meanY;
+      sxx += dx * dx;
+      sxy += dx * dy;
+    }
+    _drift = (sxx > 0) ? (float)(sxy / sxx) : 0.f;
+    if (_drift > CLOCK_SYNC_MAX_DRIFT || _drift < -CLOCK_SYNC_MAX_DRIFT)
+      _drift = 0.f;   // not enough span yet or outliers : offset only
+    _fit.local = origin.local + (int64_t)meanX;
+    _fit.offset = origin.offset + (int64_t)meanY;
+    _fit.drift = _drift;
+  }
+
+  pending _sent[CLOCK_SYNC_WINDOW] = {};
+  exchange _window[CLOCK_SYNC_WINDOW];
+  point _history[CLOCK_SYNC_HISTORY];
+  model _model[2] = {};
+  model _fit = {};
+  std::atomic<uint32_t> _current{0};
+  std::atomic<bool> _synced{false};
+  uint32_t _sequence = 0;
+  uint32_t _exchanges = 0;
+  uint32_t _delay = 0;
+  float _drift = 0.f;
+  uint32_t _points = 0;
+};
+
+#endif
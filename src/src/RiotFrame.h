@@ -0,0 +1,139 @@
+//////////////////////////////////////////////////////////////////////////////////////
+// Compact binary streaming format (format=1 key), an alternative to the OSC bundle.
+// One UDP datagram = a header followed by count samples of fixed size. Everything is little
+// endian (native on the ESP32 as well as on x86 / ARM hosts) and quantized to 16 bits with
+// the scales below, which are chosen to cover the largest sensor ranges.
+// Plain C++, no Arduino dependency : receivers include this file to check and decode the
+// frames, riotFrameDecode() giving back the units and order of the OSC messages.
+//
+// Sizes : header 12 bytes + 64 bytes per sample, vs. ~600 bytes for the full OSC bundle
+
+#ifndef _RIOT_FRAME_H
+#define _RIOT_FRAME_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define RIOT_FRAME_VERSION        1
+#define RIOT_FRAME_MAGIC_0        'R'
+#define RIOT_FRAME_MAGIC_1        'F'
+
+// Quantization : int16 value = physical value x scale
+#define RIOT_FRAME_ACC_SCALE      200.0f      // m.s-2 : ±163 m.s-2 (±16g), 0.005 m.s-2
+#define RIOT_FRAME_GYRO_SCALE     900.0f      // rad/s : ±36.4 rad/s (±2086°/s), 0.064°/s
+#define RIOT_FRAME_MAG_SCALE      20.0f       // µT : ±1638 µT (±16 gauss), 0.05 µT
+#define RIOT_FRAME_QUAT_SCALE     32767.0f    // Q15
+#define RIOT_FRAME_ANGLE_SCALE    50.0f       // degree : ±655°, 0.02°
+#define RIOT_FRAME_PRESSURE_SCALE 50.0f       // hPa, unsigned : 0 - 1310 hPa, 0.02 hPa
+#define RIOT_FRAME_ALTITUDE_SCALE 5.0f        // m : ±6553 m, 0.2 m
+#define RIOT_FRAME_TEMP_SCALE     100.0f      // °C : 0.01°C
+#define RIOT_FRAME_VOLTAGE_SCALE  1000.0f     // V : mV
+#define RIOT_FRAME_SOC_SCALE      10000.0f    // {0;1}
+
+// flags
+#define RIOT_FRAME_SWITCH_1       (1 << 0)
+#define RIOT_FRAME_SWITCH_2       (1 << 1)
+#define RIOT_FRAME_CHARGING       (1 << 2)
+#define RIOT_FRAME_CHARGED        (1 << 3)
+#define RIOT_FRAME_NO_BATTERY     (1 << 4)
+
+#pragma pack(push, 1)
+struct riotFrameHeader {
+  uint8_t magic[2];           // 'R' 'F'
+  uint8_t version;            // RIOT_FRAME_VERSION
+  uint8_t moduleId;
+  uint16_t streams;           // streams= mask when sent, fields of the disabled streams are 0
+  uint16_t count;             // samples following the header
+  uint32_t sequence;          // counter of the first sample, next frame = sequence + count (else samples were lost)
+};
+
+struct riotFrameSample {
+  uint32_t timestamp;         // µs, acquisition time (wraps every ~71 minutes)
+  int16_t acc[3];             // x, y, z (W3C order like the OSC messages)
+  int16_t gyro[3];
+  int16_t mag[3];
+  int16_t quat[4];            // x, y, z, w
+  int16_t euler[3];           // yaw, pitch, roll
+  int16_t grav[3];
+  int16_t heading;
+  uint16_t pressure;
+  int16_t altitude;
+  int16_t temperature[3];     // board (acc sensor), barometer, MCU
+  int16_t analog[3];          // battery voltage, analog input 1 & 2
+  int16_t battery;            // state of charge
+  uint8_t flags;              // RIOT_FRAME_xxx
+  uint8_t reserved;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(riotFrameHeader) == 12, "riotFrameHeader must stay 12 bytes");
+static_assert(sizeof(riotFrameSample) == 64, "riotFrameSample must stay 64 bytes");
+
+// Decoded sample, same units as the OSC messages
+struct riotFrameValues {
+  uint32_t timestamp;
+  float acc[3], gyro[3], mag[3];
+  float quat[4];
+  float euler[3], grav[3], heading;
+  float pressure, altitude;
+  float temperature[3];
+  float analog[3];
+  float battery;
+  bool switch1, switch2, charging;
+  uint8_t chargeState;        // 0 = unplugged, 1 = charging, 2 = finished, 3 = no battery (OSC battery message)
+};
+
+static inline int16_t riotQuantize(float value, float scale) {
+  float v = value * scale;
+  if (v >= 32767.0f) return 32767;
+  if (v <= -32768.0f) return -32768;
+  return (int16_t)(v + (v < 0.0f ? -0.5f : 0.5f));
+}
+
+static inline uint16_t riotQuantizeUnsigned(float value, float scale) {
+  float v = value * scale;
+  if (v >= 65535.0f) return 65535;
+  if (v <= 0.0f) return 0;
+  return (uint16_t)(v + 0.5f);
+}
+
+// Checks a received datagram. Returns the number of samples it holds (0 = not a valid frame)
+static inline uint16_t riotFrameCheck(const uint8_t *data, uint32_t len, riotFrameHeader &header) {
+  if (len < sizeof(riotFrameHeader))
+    return 0;
+  memcpy(&header, data, sizeof(header));
+  if (header.magic[0] != RIOT_FRAME_MAGIC_0 || header.magic[1] != RIOT_FRAME_MAGIC_1 || header.version != RIOT_FRAME_VERSION)
+    return 0;
+  if (len < sizeof(riotFrameHeader) + (uint32_t)header.count * sizeof(riotFrameSample))
+    return 0;
+  return header.count;
+}
+
+// index : 0 to count - 1
+static inline void riotFrameDecode(const uint8_t *data, uint16_t index, riotFrameValues &out) {
+  riotFrameSample s;
+  memcpy(&s, data + sizeof(riotFrameHeader) + index * sizeof(riotFrameSample), sizeof(s));
+
+  out.timestamp = s.timestamp;
+  for (int i = 0; i < 3; i++) {
+    out.acc[i] = s.acc[i] / RIOT_FRAME_ACC_SCALE;
+    out.gyro[i] = s.gyro[i] / RIOT_FRAME_GYRO_SCALE;
+    out.mag[i] = s.mag[i] / RIOT_FRAME_MAG_SCALE;
+    out.euler[i] = s.euler[i] / RIOT_FRAME_ANGLE_SCALE;
+    out.grav[i] = s.grav[i] / RIOT_FRAME_ACC_SCALE;
+    out.temperature[i] = s.temperature[i] / RIOT_FRAME_TEMP_SCALE;
+    out.analog[i] = s.analog[i] / RIOT_FRAME_VOLTAGE_SCALE;
+  }
+  for (int i = 0; i < 4; i++)
+    out.quat[i] = s.quat[i] / RIOT_FRAME_QUAT_SCALE;
+  out.heading = s.heading / RIOT_FRAME_ANGLE_SCALE;
+  out.pressure = s.pressure / RIOT_FRAME_PRESSURE_SCALE;
+  out.altitude = s.altitude / RIOT_FRAME_ALTITUDE_SCALE;
+  out.battery = s.battery / RIOT_FRAME_SOC_SCALE;
+  out.switch1 = s.flags & RIOT_FRAME_SWITCH_1;
+  out.switch2 = s.flags & RIOT_FRAME_SWITCH_2;
+  out.charging = s.flags & RIOT_FRAME_CHARGING;
+  out.chargeState = (s.flags & RIOT_FRAME_CHARGING) ? 1 : (s.flags & RIOT_FRAME_CHARGED) ? 2 : (s.flags & RIOT_FRAME_NO_BATTERY) ? 3 : 0;
+}
+
+#endif
@@ -131,7 +131,7 @@ Simple_Wire & Simple_Wire::ReadBytes(uint8_t AltAddress,uint8_t regAddr, uint8_t
             Data[I2CReadCount] = Wire.read();
         }
     }
-    Val = (int32_t) Data[0];
+    Val = I2CReadCount ? (int32_t) Data[0] : 0;
    	return *this;
 }
 
@@ -0,0 +1,65 @@
+//////////////////////////////////////////////////////////////////////////////////////
+// Lock-free Single Producer / Single Consumer ring buffer
+// Used to hand over fixed size sample records from the sensor task (core 1) to the
+// network task (core 0) without mutex or critical section.
+// Plain C++11 (std::atomic), no Arduino / FreeRTOS dependency so it also compiles on a host
+//
+// - only ONE task calls push() and only ONE task calls pop()
+// - N must be a power of 2, indexes are free running and masked
+// - when full, push() fails and the record is dropped (counted in overruns) : we prefer
+//   losing a sample than blocking the fusion
+
+#ifndef _SPSC_RING_H
+#define _SPSC_RING_H
+
+#include <atomic>
+#include <stdint.h>
+
+template<class T, uint32_t N>
+class SpscRing {
+  static_assert(N && ((N & (N - 1)) == 0), "SpscRing size must be a power of 2");
+
+public:
+  // Producer side
+  bool push(const T& item) {
+    uint32_t head = _head.load(std::memory_order_relaxed);
+    if ((head - _tail.load(std::memory_order_acquire)) >= N) {
+      _overruns++;
+      return false;
+    }
+    data[head & (N - 1)] = item;
+    _head.store(head + 1, std::memory_order_release);   // publishes the record
+    return true;
+  }
+
+  // Consumer side
+  bool pop(T& item) {
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail == _head.load(std::memory_order_acquire))
+      return false;
+    item = data[tail & (N - 1)];
+    _tail.store(tail + 1, std::memory_order_release);   // frees the slot
+    return true;
+  }
+
+  // Consumer side : drops everything pending
+  void flush(void) {
+    _tail.store(_head.load(std::memory_order_acquire), std::memory_order_release);
+  }
+
+  uint32_t size(void) {
+    return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+  }
+
+  bool isEmpty(void) { return size() == 0; }
+  uint32_t capacity(void) { return N; }
+  uint32_t getOverruns(void) { return _overruns; }
+
+private:
+  T data[N];
+  std::atomic<uint32_t> _head{0};
+  std::atomic<uint32_t> _tail{0};
+  uint32_t _overruns = 0;   // written by the producer only
+};
+
+#endif
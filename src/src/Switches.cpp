@@ -5,6 +5,7 @@
 
 #include "Switches.h"
 #include "Arduino.h"
+#include "driver/gpio.h"
 //#include "wiring_digital.h"
 
 Switch::Switch()
@@ -39,17 +40,107 @@ void Switch::setPin(uint32_t pin) {
 
 void Switch::end() {
 	enabled = false;
+	if (interrupt_mode)
+		detachInterrupt(button_pin);
+	interrupt_mode = false;
 	pinMode(button_pin, INPUT);
 }
 
-SwitchEvent Switch::getEvent() {
+// Interrupt mode, instead of poll() : edges are timestamped (µs) by the GPIO interrupt. The first
+// edge of a change is taken at once (no wait for the contact to be stable), the next ones within
+// the debounce time are bounces and the level is read again once it's over (settle()). The notified
+// task reads the events and calls settle() at getSettleDeadline() while isBouncing()
+void Switch::enableInterrupt(TaskHandle_t notifyTask) {
+	notify = notifyTask;
+	stable_state = raw_state = last_read = readStatus();
+	settle_deadline = esp_timer_get_time() + debounce * 1000;
+	interrupt_mode = true;
+	attachInterruptArg(button_pin, isr, this, CHANGE);
+}
+
+void ARDUINO_ISR_ATTR Switch::isr(void *arg) {
+	Switch *sw = (Switch*)arg;
+	BaseType_t woken = pdFALSE;
+
+	portENTER_CRITICAL_ISR(&sw->mux);
+	sw->edge(esp_timer_get_time());
+	portEXIT_CRITICAL_ISR(&sw->mux);
+	if (sw->notify) {
+		vTaskNotifyGiveFromISR(sw->notify, &woken);
+		portYIELD_FROM_ISR(woken);
+	}
+}
+
+void ARDUINO_ISR_ATTR Switch::edge(int64_t now) {
+	raw_state = readStatus();
+	if (now < settle_deadline) {
+		bouncing = true;
+		return;
+	}
+	change(raw_state, now);
+}
+
+bool ARDUINO_ISR_ATTR Switch::change(uint8_t status, int64_t now) {
+	if (status == stable_state)
+		return false;
+	stable_state = status;
+	settle_deadline = now + debounce * 1000;
+	if (status) {
+		pressed_time = (uint32_t)(now / 1000);
+		addEvent(SwitchPressed, (uint32_t)now);
+	}
+	else {
+		released_time = (uint32_t)(now / 1000);
+		total_pressed_time = released_time - pressed_time;
+		addEvent(SwitchReleased, (uint32_t)now);
+	}
+	return true;
+}
+
+// Level at the end of the debounce time, when edges were ignored. True if it was a change
+bool Switch::settle() {
+	bool changed = false;
+	int64_t now = esp_timer_get_time();
+
+	portENTER_CRITICAL(&mux);
+	if (bouncing && now >= settle_deadline) {
+		bouncing = false;
+		raw_state = readStatus();
+		changed = change(raw_state, now);
+	}
+	portEXIT_CRITICAL(&mux);
+	return changed;
+}
+
+// µs, when settle() reads the level again after ignored edges
+int64_t Switch::getSettleDeadline() {
+	int64_t deadline;
+
+	portENTER_CRITICAL(&mux);
+	deadline = settle_deadline;
+	portEXIT_CRITICAL(&mux);
+	return deadline;
+}
+
+// gpio_get_level() : plain register read in the ISR, no Arduino pin manager lookup
+uint8_t ARDUINO_ISR_ATTR Switch::readStatus() {
+	uint8_t status = gpio_get_level((gpio_num_t)button_pin);
+	if ((button_type == LatchingSwitchNO) || (button_type == MomentarySwitch) || (button_type == MomentarySwitchSolo))
+		status = !status;
+	return status;
+}
+
+SwitchEvent Switch::getEvent(uint32_t *time) {
 	SwitchEvent event;
 
 	if (!event_count)
 		return SwitchNothing;
 
 	read_enabled = 0;
+	portENTER_CRITICAL(&mux);
 
+	if (time)
+		*time = event_time[event_rd];
 	event = events[event_rd++];
 
 	if (event_rd == SWITCH_MAX_EVENTS)
@@ -57,15 +148,17 @@ SwitchEvent Switch::getEvent() {
 
 	event_count--;
 
+	portEXIT_CRITICAL(&mux);
 	read_enabled = 1;
 
 	return event;
 }
 
-void Switch::addEvent(SwitchEvent event) {
+void ARDUINO_ISR_ATTR Switch::addEvent(SwitchEvent event, uint32_t time) {
 	if (event_count == SWITCH_MAX_EVENTS)
 		return;
 
+	event_time[event_wr] = time ? time : (uint32_t)esp_timer_get_time();
 	events[event_wr++] = event;
 	if (event_wr == SWITCH_MAX_EVENTS)
 		event_wr = 0;
@@ -104,7 +197,7 @@ void Switch::resetDouble() {
 void Switch::poll() {
 	uint32_t elapsed = 0;
 
-	if (!enabled)
+	if (!enabled || interrupt_mode)
 		return;
 
 	if (read_enabled) {
@@ -6,7 +6,7 @@
 #define __SWITCHES_H__
 
 
-#define SWITCH_MAX_EVENTS	5
+#define SWITCH_MAX_EVENTS	8
 
 #include "Arduino.h"
 
@@ -44,6 +44,10 @@ public:
 	~Switch();
 
 	void begin(uint32_t pin, SwitchType type = MomentarySwitch, uint32_t debounce_time = 25, uint16_t timeOutDouble = 0);
+	void enableInterrupt(TaskHandle_t notifyTask = NULL);
+	bool settle();
+	inline bool isBouncing() { return bouncing; }
+	int64_t getSettleDeadline();
 	void setPin(uint32_t pin);
 	uint32_t getPin() { return button_pin; }
 	void end();
@@ -65,15 +69,21 @@ public:
 	inline bool isMomentary() {return (button_type == MomentarySwitch) || (button_type == MomentarySwitchSolo); }
 	inline bool isLatching() {return (button_type != MomentarySwitch) && (button_type != MomentarySwitchSolo); }
 	inline bool isSolo() {return (button_type == MomentarySwitchSolo); }
-	SwitchEvent getEvent();
+	SwitchEvent getEvent(uint32_t *time = NULL);
 	void resetEvents();
 	void poll();
 
 protected:
-	void addEvent(SwitchEvent event);
+	void addEvent(SwitchEvent event, uint32_t time = 0);
 
 private:
+	static void isr(void *arg);
+	void edge(int64_t now);
+	bool change(uint8_t status, int64_t now);
+	uint8_t readStatus();
+
 	volatile SwitchEvent events[SWITCH_MAX_EVENTS];
+	volatile uint32_t event_time[SWITCH_MAX_EVENTS];	// µs (esp_timer_get_time())
 	uint8_t event_count;
 	uint8_t event_rd;
 	uint8_t event_wr;
@@ -104,6 +114,13 @@ private:
 	volatile uint32_t timeDoublePress;
 	uint16_t timeOutDP;
 	volatile uint8_t event_dp;
+
+	// Interrupt mode
+	bool interrupt_mode = false;
+	TaskHandle_t notify = NULL;		// notified at each edge
+	portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+	volatile int64_t settle_deadline = 0;	// µs, end of the debounce time of the last change
+	volatile bool bouncing = false;
 };
 
 #endif // __SWITCHES_H__
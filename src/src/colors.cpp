@@ -57,7 +57,6 @@ CRGBW8 randomColor(bool normalize) {
 	}
 	
 	if(normalize) {
-		int mult = 255 * peak;
 		for(int i = 0 ; i < 3 ; i++) { // RGB only not using the white channel in normalization
 			array[i] = (array[i] * 255) / peak;
 			array[i] = constrain(array[i], 0, 255);
@@ -79,10 +78,10 @@ CRGBW8::~CRGBW8() {
 }
 
 CRGBW8::CRGBW8(uint32_t color) :
-	w(color & 0xFF),
-	b((color >> 8) & 0xFF),
+	r((color >> 24) & 0xFF),
 	g((color >> 16) & 0xFF),
-	r((color >> 24) & 0xFF)
+	b((color >> 8) & 0xFF),
+	w(color & 0xFF)
 {
 }
 
@@ -357,7 +356,6 @@ void CRGBW8::randomColor(bool normalize) {
 	}
 	
 	if(normalize) {
-		int mult = 255 * peak;
 		for(int i = 0 ; i < 3 ; i++) { // RGB only not using the white channel in normalization
 			array[i] = (array[i] * 255) / peak;
 			array[i] = constrain(array[i], 0, 255);
@@ -410,7 +408,7 @@ CRGBW8 wheelHue(int hue, int sat, int brightness) {
 	brightness = cie_lut[brightness];
 	sat = 255-cie_lut[255-sat];
 	
-	int r, g, b, base;
+	int r = 0, g = 0, b = 0, base;
 	
 	if (sat == 0) { // Acromatic color (gray). Hue doesn't mind.
 		return CRGBW8(brightness, brightness, brightness, 0);  
@@ -476,21 +474,7 @@ uint8_t beforeOrAfter(char *compareStr, char *refStr) {
 	if(!strcmp(compareStr, refStr))
 		return STRING_EQUAL;
 	
-	char str1[30], str2[30];
-	int refSize = strlen(refStr);
-	int compareSize = strlen(compareStr);
-	int useSize = (refSize >= compareSize) ? refSize : compareSize;
-	
-	strncpy(str1, compareStr, useSize);
-	strncpy(str2, refStr, useSize);
-	//strlwr(str1);
-	//strlwr(str2);
-	int i;
-	for(i = 0 ; i < useSize ; i++) {
-		if(str1[i] != str2[i])
-			break;
-	}
-	if(str1[i] < str2[i])
+	if(strcmp(compareStr, refStr) < 0)
 		return STRING_BEFORE;
 	else
 		return STRING_AFTER;
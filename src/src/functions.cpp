@@ -1,4 +1,5 @@
 #include <Arduino.h>
+#include <string.h>
 
 #include "functions.h"
 
@@ -134,41 +135,6 @@ double diffNormVector(const double *a, const double *b, int len) {
     return sqrt(sum);
 }
 
-void matVecMul10x10(const double A[10][10], const double v[10], double result[10]) {
-    for (int i = 0; i < 10; ++i) {
-        result[i] = 0.0;
-        for (int j = 0; j < 10; ++j)
-            result[i] += A[i][j] * v[j];
-    }
-}
-
-bool powerIteration10x10(const double A[10][10], double eigenvec[10], int numIter, double tol) {
-    double b[10] = {0.0};  // Initial guess
-	b[0] = 1.0;
-    double b_next[10];
-	bool success = false;
-	
-    for (int k = 0; k < numIter; ++k) {
-        matVecMul10x10(A, b, b_next);
-        normalizeVector(b_next,10);
-        
-        if (diffNormVector(b, b_next, 10) < tol) {
-			if(k < numIter) {	// most likely
-				success = true;
-			}
-            break;
-		}
-
-        for (int i = 0; i < 10; ++i)
-            b[i] = b_next[i];
-    }
-
-    // Copy result
-    for (int i = 0; i < 10; ++i)
-        eigenvec[i] = b[i];
-	return success;
-}
-
 // Compute 3x3 inverse (basic method)
 bool inverse3x3(const double M[3][3], double inv[3][3]) {
     double det =
@@ -196,8 +162,264 @@ bool inverse3x3(const double M[3][3], double inv[3][3]) {
     return true;
 }
 
+// Eigen decomposition of a symmetric 3x3 matrix (cyclic Jacobi). Eigen vectors are the columns of vectors
+bool eigenSymmetric3x3(const double A[3][3], double values[3], double vectors[3][3]) {
+  double a[3][3];
+  bool converged = false;
+
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      a[i][j] = A[i][j];
+      vectors[i][j] = (i == j) ? 1.0 : 0.0;
+    }
+  }
+  for (int sweep = 0; sweep < 50 && !converged; sweep++) {
+    double off = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+    double diag = a[0][0] * a[0][0] + a[1][1] * a[1][1] + a[2][2] * a[2][2];
+    if (off <= 1e-24 * diag) {
+      converged = true;
+      break;
+    }
+    for (int p = 0; p < 2; p++) {
+      for (int q = p + 1; q < 3; q++) {
+        if (a[p][q] == 0.0)
+          continue;
+        // Rotation zeroing a[p][q] : a = J^T a J
+        double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+        double t = ((theta >= 0.0) ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+        double c = 1.0 / sqrt(t * t + 1.0);
+        double s = t * c;
+        for (int k = 0; k < 3; k++) {
+          double akp = a[k][p], akq = a[k][q];
+          a[k][p] = c * akp - s * akq;
+          a[k][q] = s * akp + c * akq;
+        }
+        for (int k = 0; k < 3; k++) {
+          double apk = a[p][k], aqk = a[q][k];
+          a[p][k] = c * apk - s * aqk;
+          a[q][k] = s * apk + c * aqk;
+        }
+        for (int k = 0; k < 3; k++) {
+          double vkp = vectors[k][p], vkq = vectors[k][q];
+          vectors[k][p] = c * vkp - s * vkq;
+          vectors[k][q] = s * vkp + c * vkq;
+        }
+      }
+    }
+  }
+  for (int i = 0; i < 3; i++)
+    values[i] = a[i][i];
+  return converged;
+}
+
 
+/////////////////////////////////////////////////////
+// Incremental ellipsoid fit
+void EllipsoidFit::begin(const float o[3], float radius) {
+  for (int i = 0; i < 3; i++) {
+    origin[i] = o[i];
+    center[i] = 0.0;
+    for (int j = 0; j < 3; j++)
+      matrix[i][j] = (i == j) ? 1.0 : 0.0;
+  }
+  scale = (radius > 0.0f) ? 1.0f / radius : 1.0f;
+  for (int i = 0; i < ELLIPSOID_PACKED; i++)
+    scatter[i] = 0.0;
+  // Starts from the unit sphere x² + y² + z² - 1 = 0
+  for (int i = 0; i < ELLIPSOID_PARAMS; i++)
+    coeffs[i] = 0.0;
+  coeffs[0] = coeffs[1] = coeffs[2] = 1.0;
+  coeffs[9] = -1.0;
+  normalizeVector(coeffs, ELLIPSOID_PARAMS);
+  for (int i = 0; i < ELLIPSOID_PARAMS; i++)
+    second[i] = 1.0;
+  count = 0;
+  coverage = 0.0f;
+  valid = false;
+  residual = 1.0f;
+  change = 1.0f;
+}
 
+void EllipsoidFit::add(const float sample[3]) {
+  double x = (sample[0] - origin[0]) * scale;
+  double y = (sample[1] - origin[1]) * scale;
+  double z = (sample[2] - origin[2]) * scale;
+  double v[ELLIPSOID_PARAMS] = {x * x, y * y, z * z, x * y, x * z, y * z, x, y, z, 1.0};
+  int k = 0;
+
+  // Upper triangle, row by row
+  for (int i = 0; i < ELLIPSOID_PARAMS; i++) {
+    for (int j = i; j < ELLIPSOID_PARAMS; j++)
+      scatter[k++] += v[i] * v[j];
+  }
+  count++;
+}
+
+bool EllipsoidFit::fit(int iterations) {
+  double S[ELLIPSOID_PARAMS][ELLIPSOID_PARAMS];
+  double L[ELLIPSOID_PARAMS][ELLIPSOID_PARAMS];
+  double x[ELLIPSOID_PARAMS], y[ELLIPSOID_PARAMS];
+  double trace = 0.0;
+  int k = 0;
+
+  if (count < ELLIPSOID_PARAMS)
+    return false;
+
+  // Unpacks the mean scatter matrix
+  for (int i = 0; i < ELLIPSOID_PARAMS; i++) {
+    for (int j = i; j < ELLIPSOID_PARAMS; j++)
+      S[i][j] = S[j][i] = scatter[k++] / (double)count;
+    trace += S[i][i];
+  }
+
+  // Cholesky factor of the (slightly shifted) matrix : S + shift.I = L.Lt
+  double shift = ELLIPSOID_RIDGE * trace;
+  for (int i = 0; i < ELLIPSOID_PARAMS; i++) {
+    for (int j = 0; j <= i; j++) {
+      double sum = S[i][j] + ((i == j) ? shift : 0.0);
+      for (int m = 0; m < j; m++)
+        sum -= L[i][m] * L[j][m];
+      if (i == j) {
+        if (sum <= 0.0)
+          return false;
+        L[i][i] = sqrt(sum);
+      }
+      else
+        L[i][j] = sum / L[j][j];
+    }
+  }
+
+  // Inverse iteration : x <- (L.Lt)^-1 x converges to the smallest eigenvector
+  for (int i = 0; i < ELLIPSOID_PARAMS; i++)
+    x[i] = coeffs[i];
+  for (int it = 0; it < iterations; it++) {
+    for (int i = 0; i < ELLIPSOID_PARAMS; i++) {
+      double sum = x[i];
+      for (int m = 0; m < i; m++)
+        sum -= L[i][m] * y[m];
+      y[i] = sum / L[i][i];
+    }
+    for (int i = ELLIPSOID_PARAMS - 1; i >= 0; i--) {
+      double sum = y[i];
+      for (int m = i + 1; m < ELLIPSOID_PARAMS; m++)
+        sum -= L[m][i] * x[m];
+      x[i] = sum / L[i][i];
+    }
+    normalizeVector(x, ELLIPSOID_PARAMS);
+  }
+  // Same on the orthogonal of x : second smallest eigenvalue. Close to 0 when the samples don't
+  // cover enough orientations to constrain the ellipsoid (ie all of them in a plane)
+  double w[ELLIPSOID_PARAMS];
+  for (int i = 0; i < ELLIPSOID_PARAMS; i++)
+    w[i] = second[i];
+  for (int it = 0; it < iterations; it++) {
+    double d = dot(w, x, ELLIPSOID_PARAMS);
+    for (int i = 0; i < ELLIPSOID_PARAMS; i++)
+      w[i] -= d * x[i];
+    normalizeVector(w, ELLIPSOID_PARAMS);
+    for (int i = 0; i < ELLIPSOID_PARAMS; i++) {
+      double sum = w[i];
+      for (int m = 0; m < i; m++)
+        sum -= L[i][m] * y[m];
+      y[i] = sum / L[i][i];
+    }
+    for (int i = ELLIPSOID_PARAMS - 1; i >= 0; i--) {
+      double sum = y[i];
+      for (int m = i + 1; m < ELLIPSOID_PARAMS; m++)
+        sum -= L[m][i] * w[m];
+      w[i] = sum / L[i][i];
+    }
+  }
+  double d = dot(w, x, ELLIPSOID_PARAMS);
+  for (int i = 0; i < ELLIPSOID_PARAMS; i++)
+    w[i] -= d * x[i];
+  normalizeVector(w, ELLIPSOID_PARAMS);
+  double lambda2 = 0.0;
+  for (int i = 0; i < ELLIPSOID_PARAMS; i++) {
+    lambda2 += w[i] * dot(S[i], w, ELLIPSOID_PARAMS);
+    second[i] = w[i];
+  }
+  coverage = (float)(lambda2 / trace);
+
+  if (x[0] + x[1] + x[2] < 0.0) {
+    for (int i = 0; i < ELLIPSOID_PARAMS; i++)
+      x[i] = -x[i];
+  }
+  // Mean squared algebraic distance (Rayleigh quotient)
+  double lambda = 0.0;
+  for (int i = 0; i < ELLIPSOID_PARAMS; i++)
+    lambda += x[i] * dot(S[i], x, ELLIPSOID_PARAMS);
+  for (int i = 0; i < ELLIPSOID_PARAMS; i++)
+    coeffs[i] = x[i];
+
+  // Quadric (p - c)t.Q.(p - c) = k, with Q from [A B C D E F], v = [G H I] / 2
+  double Q[3][3] = {
+    { x[0], x[3] / 2.0, x[4] / 2.0 },
+    { x[3] / 2.0, x[1], x[5] / 2.0 },
+    { x[4] / 2.0, x[5] / 2.0, x[2] }
+  };
+  double v[3] = { x[6] / 2.0, x[7] / 2.0, x[8] / 2.0 };
+  double Qinv[3][3];
+  if (!inverse3x3(Q, Qinv)) {
+    valid = false;
+    return false;
+  }
+  double c[3];
+  double kq = -x[9];
+  for (int i = 0; i < 3; i++) {
+    c[i] = -dot(Qinv[i], v, 3);
+    kq -= v[i] * c[i];    // vt.Qinv.v - J
+  }
+  if (kq == 0.0) {
+    valid = false;
+    return false;
+  }
+
+  // Correction = square root of Q / k (maps the ellipsoid on a sphere), scaled to a unit determinant
+  double values[3], vectors[3][3];
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 3; j++)
+      Q[i][j] /= kq;
+  eigenSymmetric3x3(Q, values, vectors);
+  if (values[0] <= 0.0 || values[1] <= 0.0 || values[2] <= 0.0) {
+    valid = false;      // not an ellipsoid (yet) : not enough orientations covered
+    return false;
+  }
+  double root[3], det = 1.0;
+  for (int i = 0; i < 3; i++) {
+    root[i] = sqrt(values[i]);
+    det *= root[i];
+  }
+  double norm = 1.0 / cbrt(det);
+  float delta = 0.0f;
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      double m = 0.0;
+      for (int e = 0; e < 3; e++)
+        m += vectors[i][e] * root[e] * vectors[j][e];
+      m *= norm;
+      delta = max(delta, (float)fabs(m - matrix[i][j]));
+      matrix[i][j] = m;
+    }
+    center[i] = c[i];
+  }
+  // f / k = r² - 1 for a sample of corrected radius r, i.e. about 2 (r - 1)
+  residual = (float)(0.5 * sqrt(max(lambda, 0.0)) / fabs(kq));
+  change = valid ? delta : 1.0f;
+  valid = true;
+  return true;
+}
+
+void EllipsoidFit::getCenter(float c[3]) {
+  for (int i = 0; i < 3; i++)
+    c[i] = origin[i] + (float)center[i] / scale;
+}
+
+void EllipsoidFit::getMatrix(float m[3][3]) {
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 3; j++)
+      m[i][j] = (float)matrix[i][j];
+}
 
 
 //---------------------------------------------------------------------------------------------------
@@ -207,9 +429,10 @@ bool inverse3x3(const double M[3][3], double inv[3][3]) {
 float invSqrt(float x) {
   float halfx = 0.5f * x;
   float y = x;
-  uint32_t i = *(uint32_t*)&y;
+  uint32_t i;
+  memcpy(&i, &y, sizeof(i));    // no type punning through pointers (strict aliasing)
   i = 0x5f3759df - (i>>1);
-  y = *(float*)&i;
+  memcpy(&y, &i, sizeof(y));
   y = y * (1.5f - (halfx * y * y)); // First iteration
   y = y * (1.5f - (halfx * y * y)); // optional second iteration
   return y;
@@ -220,7 +443,37 @@ float invSqrt(float x) {
 // Variant with 1/3 of the error of the code above
 // https://pizer.wordpress.com/2008/10/12/fast-inverse-square-root/
 float accurateinvSqrt(float x){
-  uint32_t i = 0x5F1F1412 - (*(uint32_t*)&x >> 1);
-  float tmp = *(float*)&i;
+  uint32_t i;
+  float tmp;
+  memcpy(&i, &x, sizeof(i));
+  i = 0x5F1F1412 - (i >> 1);
+  memcpy(&tmp, &i, sizeof(tmp));
   return tmp * (1.69000231f - 0.714158168f * x * tmp * tmp);
-}
\ No newline at end of file
+}
+
+//---------------------------------------------------------------------------------------------------
+// Polynomial atan2 : minimax fit of atan() on [0;1] (odd, 11th order), the other octants are
+// obtained by symmetry. Max. error ~2e-6 rad (0.0001°), well below the sensors noise, for a
+// fraction of the cost of the newlib atan2f(). atan2(0, 0) returns 0 like libm. The error bounds
+// against libm are asserted on the host by host/test_fasttrig.cpp
+float fastAtan2f(float y, float x) {
+  float ax = fabsf(x);
+  float ay = fabsf(y);
+  float mx = max(ax, ay);
+  if (mx == 0.0f)
+    return 0.0f;
+  float a = min(ax, ay) / mx;
+  float s = a * a;
+  float r = (((((-0.01172120f * s + 0.05265332f) * s - 0.11643287f) * s + 0.19354346f) * s - 0.33262347f) * s + 0.99997726f) * a;
+  if (ay > ax) r = HALF_PI - r;
+  if (x < 0.0f) r = PI - r;
+  if (y < 0.0f) r = -r;
+  return r;
+}
+
+// asin(x) = atan2(x, sqrt(1 - x²)), input clamped to [-1;1] so that a quaternion slightly
+// off the unit sphere doesn't produce a NaN (asinf() would)
+float fastAsinf(float x) {
+  x = clamp(x, -1.0f, 1.0f);
+  return fastAtan2f(x, sqrtf(1.0f - x * x));
+}
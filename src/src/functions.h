@@ -7,6 +7,7 @@
 #define _FUNCTIONS_H
 
 #include <Arduino.h>
+#include "esp_timer.h"
 
 
 // {0;360°} range to {-180;+180°}
@@ -26,6 +27,8 @@ int16_t clamptoi16(int32_t x);
 float fmap(float x, float in_min, float in_max, float out_min, float out_max);
 float accurateinvSqrt(float x);
 float invSqrt(float x);
+float fastAtan2f(float y, float x);
+float fastAsinf(float x);
 void symmetrize10x10(double M[10][10]);
 void printMatrix3x3(const double A[3][3]);
 void printMatrix3x3(const float A[3][3]);
@@ -34,10 +37,9 @@ bool inverse3x3(const double M[3][3], double inv[3][3]);
 bool normalize3x3(double A[3][3]);
 double norm(const double *v, int len);
 double dot(const double *a, const double *b, int len);
-void matVecMul10x10(const double A[10][10], const double v[10], double result[10]);
 void normalizeVector(double *v, int len);
 double diffNormVector(const double *a, const double *b, int len);
-bool powerIteration10x10(const double A[10][10], double eigenvec[10], int numIter = 100, double tol = 1e-6f);
+bool eigenSymmetric3x3(const double A[3][3], double values[3], double vectors[3][3]);
 
 
 // Circular buffer of N elements of class T. 
@@ -65,6 +67,7 @@ public:
     for (int i = 0; i < N; i++) {
       data[i] = v;
     }
+    average = v;
 	return(v);
   }
 
@@ -144,6 +147,245 @@ public:
 
 
 
+/////////////////////////////////////////////////////
+// Execution time profiler. Keeps the last N durations measured in CPU cycles
+// between start() and stop(), which gives a ns resolution @240MHz (micros() is too coarse for
+// the ~200µs fusion step). Percentiles are only computed when report() is called, by sorting
+// a copy, so the cost during the measured loop is 2 cycle counter reads.
+template<int N>
+class PerfMeter {
+public:
+  void reset(void) {
+    memset(data, 0, sizeof(data));
+    pos = 0;
+    count = 0;
+    sum = 0;
+  }
+
+  void start(void) {
+    startCycles = ESP.getCycleCount();
+  }
+
+  uint32_t stop(void) {
+    uint32_t elapsed = ESP.getCycleCount() - startCycles;
+    sum -= data[pos];   // sliding sum: remove the sample being overwritten
+    data[pos] = elapsed;
+    sum += elapsed;
+    pos++;
+    if (pos == N) pos = 0;
+    if (count < N) count++;
+    return elapsed;
+  }
+
+  int getCount(void) { return count; }
+
+  // Prints ns/sample (mean), p50, p99, worst case and the equivalent max. throughput
+  void report(const char *label) {
+    if (!count) {
+      Serial.printf("[PERF] %s : no samples\n", label);
+      return;
+    }
+    uint32_t mhz = getCpuFrequencyMhz();
+    for (int i = 0; i < count; i++)
+      sorted[i] = data[i];
+    qsort(sorted, count, sizeof(uint32_t), compare);
+    float mean = (float)sum / (float)count * 1000.f / (float)mhz;
+    float p50 = (float)sorted[(count - 1) / 2] * 1000.f / (float)mhz;
+    float p99 = (float)sorted[((count - 1) * 99) / 100] * 1000.f / (float)mhz;
+    float worst = (float)sorted[count - 1] * 1000.f / (float)mhz;
+    Serial.printf("[PERF] %s : %d samples @%uMHz\n", label, count, mhz);
+    Serial.printf("[PERF] mean %.0f ns/sample - p50 %.0f ns - p99 %.0f ns - max %.0f ns - %.0f samples/s\n", mean, p50, p99, worst, 1e9f / mean);
+  }
+
+private:
+  static int compare(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+  }
+
+  uint32_t data[N] = {0};
+  uint32_t sorted[N];
+  uint32_t startCycles = 0;
+  uint64_t sum = 0;
+  int pos = 0;
+  int count = 0;
+};
+
+
+/////////////////////////////////////////////////////
+// Sampling jitter histogram. Inter-sample intervals (µs) are counted in N bins of binWidth µs
+// centered on the nominal period, the first and last bins collecting everything beyond.
+// Every window samples, min / max / p99 of the interval are latched and the histogram cleared
+// so that the exported values always describe the last window (about 1s), not the whole uptime.
+template<int N>
+class JitterMeter {
+public:
+  void begin(uint32_t nominalPeriod, uint32_t binWidth, uint32_t windowSize) {
+    nominal = nominalPeriod;
+    width = binWidth ? binWidth : 1;
+    window = windowSize ? windowSize : 1;
+    latchedMin = latchedMax = latchedP99 = 0;
+    windows = 0;
+    clear();
+  }
+
+  void add(uint32_t interval) {
+    int32_t bin = ((int32_t)interval - (int32_t)nominal + (N / 2) * (int32_t)width) / (int32_t)width;
+    bins[constrain(bin, 0, N - 1)]++;
+    if (interval < minInterval) minInterval = interval;
+    if (interval > maxInterval) maxInterval = interval;
+    if (++count < window)
+      return;
+    // Upper edge of the bin reaching 99% of the window, can't be worse than the max. itself
+    uint32_t target = (count * 99 + 99) / 100;
+    uint32_t cumulated = 0;
+    int i;
+    for (i = 0; i < N - 1; i++) {
+      cumulated += bins[i];
+      if (cumulated >= target)
+        break;
+    }
+    int32_t p99 = (int32_t)nominal + (i + 1 - N / 2) * (int32_t)width;
+    latchedP99 = (i == N - 1) ? maxInterval : min((uint32_t)max(p99, (int32_t)0), maxInterval);
+    latchedMin = minInterval;
+    latchedMax = maxInterval;
+    windows++;
+    clear();
+  }
+
+  uint32_t getMin(void) { return latchedMin; }
+  uint32_t getMax(void) { return latchedMax; }
+  uint32_t getP99(void) { return latchedP99; }
+  uint32_t getNominal(void) { return nominal; }
+  uint32_t getWindows(void) { return windows; }   // increments each time new values are latched
+
+  void report(const char *label) {
+    if (!windows) {
+      Serial.printf("[PERF] %s : no complete window yet\n", label);
+      return;
+    }
+    Serial.printf("[PERF] %s : nominal %u µs - min %u µs - max %u µs - p99 %u µs (last %u samples)\n", label, nominal, latchedMin, latchedMax, latchedP99, window);
+  }
+
+private:
+  void clear(void) {
+    memset(bins, 0, sizeof(bins));
+    count = 0;
+    minInterval = UINT32_MAX;
+    maxInterval = 0;
+  }
+
+  uint32_t bins[N] = {0};
+  uint32_t nominal = 0;
+  uint32_t width = 1;
+  uint32_t window = 1;
+  uint32_t count = 0;
+  uint32_t minInterval = UINT32_MAX;
+  uint32_t maxInterval = 0;
+  uint32_t latchedMin = 0, latchedMax = 0, latchedP99 = 0;
+  uint32_t windows = 0;
+};
+
+
+/////////////////////////////////////////////////////
+// Boot critical path profiler. Each phase is kept with its start and end in µs of esp_timer (started
+// early in the app startup, after the bootloader), which shows the overlap of the phases running on
+// their own task with setup(). add() can be called from any task
+template<int N>
+class BootProfiler {
+public:
+  static uint32_t now(void) { return (uint32_t)esp_timer_get_time(); }
+
+  // Stores the phase [start ; now] and returns now, i.e. the start of the next phase
+  uint32_t add(const char *phase, uint32_t start) {
+    uint32_t end = now();
+    portENTER_CRITICAL(&lock);
+    if (count < N) {
+      phases[count].name = phase;
+      phases[count].start = start;
+      phases[count].end = end;
+      count++;
+    }
+    portEXIT_CRITICAL(&lock);
+    return end;
+  }
+
+  int getCount(void) { return count; }
+
+  // One line per phase : name, start -> end and duration in ms
+  int format(char *buffer, int size, const char *eol = "\n") {
+    int length = 0;
+    buffer[0] = '\0';
+    for (int i = 0; i < count && length < size; i++) {
+      int n = snprintf(buffer + length, size - length, "[BOOT] %-12s %8.1f -> %8.1f ms (%7.1f ms)%s", phases[i].name,
+                       phases[i].start / 1000.f, phases[i].end / 1000.f, (phases[i].end - phases[i].start) / 1000.f, eol);
+      if (n < 0)
+        break;
+      length += n;
+    }
+    return min(length, size - 1);
+  }
+
+  void report(void) {
+    char buffer[N * 64];
+    format(buffer, sizeof(buffer));
+    Serial.print(buffer);
+  }
+
+private:
+  struct {
+    const char *name;
+    uint32_t start;
+    uint32_t end;
+  } phases[N];
+  int count = 0;
+  portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+};
+
+
+/////////////////////////////////////////////////////
+// Incremental ellipsoid fit (magnetometer soft iron). Each sample adds its monomials
+// [x² y² z² xy xz yz x y z 1] to the scatter matrix, kept as its upper triangle (55 MACs instead
+// of 100). fit() finds the quadric minimizing the algebraic distance, i.e. the eigenvector of the
+// smallest eigenvalue, by inverse iteration on the Cholesky factor warm started from the previous
+// fit : a few iterations, cheap enough to run every few samples while rotating the module.
+// Samples are centered on origin and scaled by 1/radius so that all the terms are ~1
+#define ELLIPSOID_PARAMS      10
+#define ELLIPSOID_PACKED      55    // ELLIPSOID_PARAMS * (ELLIPSOID_PARAMS + 1) / 2
+#define ELLIPSOID_ITERATIONS  4     // inverse iterations per fit (warm started)
+#define ELLIPSOID_RIDGE       1e-9  // relative shift of the diagonal, keeps the factorization defined on exact data
+
+class EllipsoidFit {
+public:
+  void begin(const float origin[3], float radius);
+  void add(const float sample[3]);
+  bool fit(int iterations = ELLIPSOID_ITERATIONS);
+
+  uint32_t getCount(void) { return count; }
+  bool isValid(void) { return valid; }        // last fit is an ellipsoid (not an hyperboloid / degenerate)
+  float getResidual(void) { return residual; } // RMS relative error of the corrected radius, last fit
+  float getChange(void) { return change; }     // max. change of the correction matrix since the previous fit
+  float getCoverage(void) { return coverage; } // second smallest eigenvalue / trace, ~0 = orientations missing
+  void getCenter(float c[3]);                  // hard iron, in sample units
+  void getMatrix(float m[3][3]);               // soft iron correction, unit determinant
+
+private:
+  double scatter[ELLIPSOID_PACKED];
+  double coeffs[ELLIPSOID_PARAMS];   // [A B C D E F G H I J] of the last fit
+  double second[ELLIPSOID_PARAMS];   // next eigenvector (coverage check)
+  double center[3];
+  double matrix[3][3];
+  float origin[3] = {0.0f, 0.0f, 0.0f};
+  float scale = 1.0f;
+  uint32_t count = 0;
+  bool valid = false;
+  float residual = 1.0f;
+  float change = 1.0f;
+  float coverage = 0.0f;
+};
+
+
 class linearInterpolator {
 private:
     float startValue, endValue, interpolatedValue;
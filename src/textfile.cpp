@@ -1,5 +1,7 @@
 
 #include "textfile.h"
+#include "esp_rom_crc.h"
+#include <Preferences.h>
 
 configurationFile::configurationFile() {
   _writable = false;
@@ -99,10 +101,29 @@ void configurationFile::setCallback(parsingCallback *cb) {
   parseSyntax = cb;
 }
 
+static bool loadSnapshot(const FILINFO &info);
+static void startSnapshot();
+static void saveSnapshot(const FILINFO &info);
+static void removeSnapshot();
+
+// Parses CONFIG_FILE, or applies the binary snapshot of its last parsing when it didn't change since
 bool configurationFile::parseConfigFile(bool debug) {
+  FILINFO info;
+
+  recoverConfig();
+  if (f_stat(CONFIG_FILE, &info) != FR_OK)
+    return (false);
+  uint32_t loadTime = micros();
+  if (loadSnapshot(info)) {
+    if(debug)
+      Serial.printf("%s Config loaded from the snapshot in %uus\n", TEXT_FILE_LOG, micros() - loadTime);
+    configLoaded();
+    return (true);
+  }
   if (!begin(CONFIG_FILE, false))
     return (false);
   setCallback(parseConfigCallback);
+  startSnapshot();
   while (readLine(stringBuffer)) {
     removeWhiteSpace(stringBuffer);
     if (!parseSyntax(stringBuffer)) {
@@ -111,6 +132,8 @@ bool configurationFile::parseConfigFile(bool debug) {
     }
   } // EOF
   end();
+  saveSnapshot(info);
+  configLoaded();
   return (true);
 }
 
@@ -128,7 +151,7 @@ void clearString(char* str, int size) {
 /////////////////////////////////////////////////////
 // Look for the '=' sign then tries to find a value
 int skipToValue(char *line, char separator, bool strip) {
-  unsigned char i = 0;
+  int i = 0;
   while (line[i] != separator) {
     if (i >= CONFIG_MAX_LINE_LEN) {
       Serial.printf("Syntax error - '%c' sign is missing\n", separator);
@@ -262,802 +285,1125 @@ bool processSerial(char *str) {
 
 
   
-bool parseConfigCallback(char *line) {
-  int i, j, index, val;
-  byte temp_ip[IPV4_SIZE];
-  IPAddress tempIP;
+/////////////////////////////////////////////////////////////////////////////////
+// Command dispatch : one entry per TEXT_xxx key / command, shared by the config file, the serial
+// port, the OSC remote commands and the HTTP config page. The table is sorted by key (checked at
+// compile time) and searched by dichotomy on the token before the '=' : ~7 compares instead of the
+// former chain of up to 90 strncmp(). The value is parsed according to the entry type before the
+// handler is called.
+
+// Replies over OSC for the remote commands, the serial / file ones only log on Serial
+static void reply(commandArgs &arg, const char *text) {
+  if(arg.source == SOURCE_OSC)
+    printToOSC((char*)text);
+}
 
-  if(skipLine(line))
-    return (true);
+static void printConfig(commandArgs &) {
+  IPAddress tempIP;
 
-  // Debug
-  //Serial.printf("Cmd: %s - OK\n", line);
-
-  // Send current config to the configuration app
-  if(!strncmp(TEXT_GET_CONFIG, line, strlen(TEXT_GET_CONFIG))) {
-    // Outputs all the configuration  
-    Serial.printf("%s %d\n", TEXT_DHCP, riot.isDHCP());
-    Serial.printf("%s %s\n", TEXT_SSID, riot.getSSID());
-    Serial.printf("%s %d\n", TEXT_WIFI_MODE, riot.getOperatingMode());
-    Serial.printf("%s %s\n", TEXT_PASSWORD, riot.getPassword());
-    Serial.printf("%s %s\n", TEXT_MDNS, riot.getBonjour());
-    
-    tempIP = riot.getOwnIP(); 
-    Serial.printf("%s %u.%u.%u.%u\n", TEXT_OWNIP, tempIP[0], tempIP[1], tempIP[2], tempIP[3] );
-    tempIP = riot.getDestIP(); 
-    Serial.printf("%s %u.%u.%u.%u\n", TEXT_DESTIP, tempIP[0], tempIP[1], tempIP[2], tempIP[3]);
-    tempIP = riot.getGatewayIP(); 
-    Serial.printf("%s %u.%u.%u.%u\n", TEXT_GATEWAY, tempIP[0], tempIP[1],tempIP[2],tempIP[3]);
-    tempIP = riot.getSubnetMask();
-    Serial.printf("%s %u.%u.%u.%u\n", TEXT_MASK, tempIP[0], tempIP[1], tempIP[2], tempIP[3] );
-    Serial.printf("%s %u\n", TEXT_PORT, riot.getDestPort());
-    Serial.printf("%s %u\n", TEXT_RECEIVE_PORT, riot.getReceivePort());
-
-    Serial.printf("%s %u\n", TEXT_MASTER_ID, riot.getID());
-    Serial.printf("%s %u\n", TEXT_SAMPLE_RATE, motion.getSampleRate());
-    Serial.printf("%s %d\n", TEXT_WIFI_POWER, riot.getWifiPower());
-    Serial.printf("%s %u\n", TEXT_REMOTE, riot.isOSCinput());
-    Serial.printf("%s %u\n", TEXT_FORCE_CONFIG, riot.isForcedConfig());
-    Serial.printf("%s %u\n", TEXT_CALIBRATION, riot.getCalibrationTimer());
-    Serial.printf("%s %u\n", TEXT_CHARGE_MODE, riot.getChargingMode());
-
-    Serial.printf("%s %u\n", TEXT_CPU_SPEED, riot.getCpuSpeed());
-    Serial.printf("%s %u\n", TEXT_CPU_DOZE, riot.getCpuDoze());
-
-    Serial.printf("%s %f\n", TEXT_DECLINATION, motion.getDeclination());
-    Serial.printf("%s %u\n", TEXT_ORIENTATION, motion.getOrientation());
-    Serial.printf("%s %u\n", TEXT_BNO_ORIENT, bno055.orientation);
-
-    Serial.printf("%s %u\n", TEXT_ACC_RANGE, lsm6d.getAccRange());
-    Serial.printf("%s %u\n", TEXT_GYRO_RANGE, lsm6d.getGyroRange());
-    Serial.printf("%s %u\n", TEXT_MAG_RANGE, lis3mdl.getRange());
-    Serial.printf("%s %f\n" ,TEXT_GYRO_GATE, motion.getGyroGate());
-    Serial.printf("%s %u\n", TEXT_GYRO_HPF, lsm6d.getGyroHpf());
+  // Outputs all the configuration  
+  Serial.printf("%s %d\n", TEXT_DHCP, riot.isDHCP());
+  Serial.printf("%s %s\n", TEXT_SSID, riot.getSSID());
+  Serial.printf("%s %d\n", TEXT_WIFI_MODE, riot.getOperatingMode());
+  Serial.printf("%s %s\n", TEXT_PASSWORD, riot.getPassword());
+  Serial.printf("%s %s\n", TEXT_MDNS, riot.getBonjour());
   
-    Serial.printf("%s %u\n", TEXT_BARO_MODE, bmp390.getSamplingMode());
-    Serial.printf("%s %f\n", TEXT_BARO_REF, bmp390.getRefAltitude());    
-    Serial.printf("%s %u\n", TEXT_SLOW_BOOT, riot.getSlowBoot());
-    Serial.printf("%s ", TEXT_LED_COLOR); riot.getPixelColor().print();
-          
-    // All offsets as lists + rotation matrix
-    Serial.printf("%s %d\n", TEXT_ACC_OFFSETX, motion.getAccelBiasRaw(X_AXIS));
-    Serial.printf("%s %d\n", TEXT_ACC_OFFSETY, motion.getAccelBiasRaw(Y_AXIS));
-    Serial.printf("%s %d\n", TEXT_ACC_OFFSETZ, motion.getAccelBiasRaw(Z_AXIS));
-   
-    Serial.printf("%s %d\n", TEXT_GYRO_OFFSETX, motion.getGyroBiasRaw(X_AXIS));
-    Serial.printf("%s %d\n", TEXT_GYRO_OFFSETY, motion.getGyroBiasRaw(Y_AXIS));
-    Serial.printf("%s %d\n", TEXT_GYRO_OFFSETZ, motion.getGyroBiasRaw(Z_AXIS));
-    
-    Serial.printf("%s %d\n", TEXT_MAG_OFFSETX, motion.getMagBiasRaw(X_AXIS));
-    Serial.printf("%s %d\n", TEXT_MAG_OFFSETY, motion.getMagBiasRaw(Y_AXIS));
-    Serial.printf("%s %d\n", TEXT_MAG_OFFSETZ, motion.getMagBiasRaw(Z_AXIS));
-
-    // Soft Iron Matrix
-    float *pVect;
-    pVect = motion.getSoftIronMatrixRow(X_AXIS);
-    Serial.printf("%s [ %f %f %f ]\n", TEXT_SOFT_IRON_MATRIX1, pVect[0], pVect[1], pVect[2]);
-    pVect = motion.getSoftIronMatrixRow(Y_AXIS);
-    Serial.printf("%s [ %f %f %f ]\n", TEXT_SOFT_IRON_MATRIX2, pVect[0], pVect[1], pVect[2]);
-    pVect = motion.getSoftIronMatrixRow(Z_AXIS);
-    Serial.printf("%s [ %f %f %f ]\n", TEXT_SOFT_IRON_MATRIX1, pVect[0], pVect[1], pVect[2]);
-   
-    Serial.printf("%s %f\n", TEXT_BETA, motion.getBeta()); 
-      
-    Serial.printf("refresh\n");
-    return(true);
-  }
+  tempIP = riot.getOwnIP(); 
+  Serial.printf("%s %u.%u.%u.%u\n", TEXT_OWNIP, tempIP[0], tempIP[1], tempIP[2], tempIP[3] );
+  tempIP = riot.getDestIP(); 
+  Serial.printf("%s %u.%u.%u.%u\n", TEXT_DESTIP, tempIP[0], tempIP[1], tempIP[2], tempIP[3]);
+  tempIP = riot.getGatewayIP(); 
+  Serial.printf("%s %u.%u.%u.%u\n", TEXT_GATEWAY, tempIP[0], tempIP[1],tempIP[2],tempIP[3]);
+  tempIP = riot.getSubnetMask();
+  Serial.printf("%s %u.%u.%u.%u\n", TEXT_MASK, tempIP[0], tempIP[1], tempIP[2], tempIP[3] );
+  Serial.printf("%s %u\n", TEXT_PORT, riot.getDestPort());
+  Serial.printf("%s %u\n", TEXT_RECEIVE_PORT, riot.getReceivePort());
+  Serial.printf("%s %u\n", TEXT_SYNC_PORT, riot.getSyncPort());
+
+  Serial.printf("%s %u\n", TEXT_MASTER_ID, riot.getID());
+  Serial.printf("%s %u\n", TEXT_SAMPLE_RATE, motion.getSampleRate());
+  Serial.printf("%s %u\n", TEXT_OUTPUT_RATE, riot.getOutputRate());
+  Serial.printf("%s %u %u %u\n", TEXT_JITTER, riot.getJitterMin(), riot.getJitterMax(), riot.getJitterP99());
+  Serial.printf("%s %d\n", TEXT_WIFI_POWER, riot.getWifiPower());
+  Serial.printf("%s %u\n", TEXT_FAST_CONNECT, riot.getFastConnect());
+  Serial.printf("%s %u %u %u %u\n", TEXT_WIFI_RECONNECT, riot.getConnections(), riot.getConnectDuration(),
+    riot.getConnectDurationMax(), riot.getFastConnections());
+  Serial.printf("%s %u\n", TEXT_REMOTE, riot.isOSCinput());
+  Serial.printf("%s %u\n", TEXT_FORCE_CONFIG, riot.isForcedConfig());
+  Serial.printf("%s %u\n", TEXT_CALIBRATION, riot.getCalibrationTimer());
+  Serial.printf("%s %u\n", TEXT_CHARGE_MODE, riot.getChargingMode());
+
+  Serial.printf("%s %u\n", TEXT_CPU_SPEED, riot.getCpuSpeed());
+  Serial.printf("%s %u\n", TEXT_CPU_DOZE, riot.getCpuDoze());
+
+  Serial.printf("%s %f\n", TEXT_DECLINATION, motion.getDeclination());
+  Serial.printf("%s %u\n", TEXT_ORIENTATION, motion.getOrientation());
+  Serial.printf("%s %u\n", TEXT_BNO_ORIENT, riot.getBnoOrientation());
+
+  Serial.printf("%s %u\n", TEXT_ACC_RANGE, lsm6d.getAccRange());
+  Serial.printf("%s %u\n", TEXT_GYRO_RANGE, lsm6d.getGyroRange());
+  Serial.printf("%s %u\n", TEXT_MAG_RANGE, lis3mdl.getRange());
+  Serial.printf("%s %f\n" ,TEXT_GYRO_GATE, motion.getGyroGate());
+  Serial.printf("%s %u\n", TEXT_GYRO_HPF, lsm6d.getGyroHpf());
+  Serial.printf("%s %u\n", TEXT_IMU_FIFO, lsm6d.isFifo());
+  Serial.printf("%s 0x%04X\n", TEXT_STREAMS, riot.getStreams());
+  Serial.printf("%s %u\n", TEXT_STREAM_FORMAT, riot.getStreamFormat());
+  Serial.printf("%s %u\n", TEXT_BATCH_SIZE, riot.getBatchSize());
+  Serial.printf("%s %u\n", TEXT_BATCH_LATENCY, riot.getBatchLatency());
+
+  Serial.printf("%s %u\n", TEXT_BARO_MODE, bmp390.getSamplingMode());
+  Serial.printf("%s %f\n", TEXT_BARO_REF, bmp390.getRefAltitude());    
+  Serial.printf("%s %u\n", TEXT_SLOW_BOOT, riot.getSlowBoot());
+  Serial.printf("%s ", TEXT_LED_COLOR); riot.getPixelColor().print();
+        
+  // All offsets as lists + rotation matrix
+  Serial.printf("%s %d\n", TEXT_ACC_OFFSETX, motion.getAccelBiasRaw(X_AXIS));
+  Serial.printf("%s %d\n", TEXT_ACC_OFFSETY, motion.getAccelBiasRaw(Y_AXIS));
+  Serial.printf("%s %d\n", TEXT_ACC_OFFSETZ, motion.getAccelBiasRaw(Z_AXIS));
+ 
+  Serial.printf("%s %d\n", TEXT_GYRO_OFFSETX, motion.getGyroBiasRaw(X_AXIS));
+  Serial.printf("%s %d\n", TEXT_GYRO_OFFSETY, motion.getGyroBiasRaw(Y_AXIS));
+  Serial.printf("%s %d\n", TEXT_GYRO_OFFSETZ, motion.getGyroBiasRaw(Z_AXIS));
   
-  // Ping / Echo question/answer from the GUI
-  else if(!strncmp(TEXT_DEBUG, line, strlen(TEXT_DEBUG))) {
-    index = skipToValue(line);
-    val = atoi(&line[index]);
-    riot.setDebugMode(val);
-    if(riot.isDebug())
-      Serial.printf("%s %d\n", TEXT_DEBUG, riot.isDebug());
-    return true;
-  }
+  Serial.printf("%s %d\n", TEXT_MAG_OFFSETX, motion.getMagBiasRaw(X_AXIS));
+  Serial.printf("%s %d\n", TEXT_MAG_OFFSETY, motion.getMagBiasRaw(Y_AXIS));
+  Serial.printf("%s %d\n", TEXT_MAG_OFFSETZ, motion.getMagBiasRaw(Z_AXIS));
+
+  // Soft Iron Matrix
+  float *pVect;
+  pVect = motion.getSoftIronMatrixRow(X_AXIS);
+  Serial.printf("%s [ %f %f %f ]\n", TEXT_SOFT_IRON_MATRIX1, pVect[0], pVect[1], pVect[2]);
+  pVect = motion.getSoftIronMatrixRow(Y_AXIS);
+  Serial.printf("%s [ %f %f %f ]\n", TEXT_SOFT_IRON_MATRIX2, pVect[0], pVect[1], pVect[2]);
+  pVect = motion.getSoftIronMatrixRow(Z_AXIS);
+  Serial.printf("%s [ %f %f %f ]\n", TEXT_SOFT_IRON_MATRIX1, pVect[0], pVect[1], pVect[2]);
+ 
+  Serial.printf("%s %f\n", TEXT_BETA, motion.getBeta()); 
+  Serial.printf("%s %u\n", TEXT_FUSION, motion.getFusion());
+    
+  Serial.printf("refresh\n");
+}
 
-  // Ping / Echo question/answer from the GUI
-  else if(!strncmp(TEXT_PING, line, strlen(TEXT_PING))) {
-    Serial.printf("%s\n", TEXT_ECHO);  // a simple ASCII echo answer to let the GUI know the COM port is the right one
-    return true;
-  }
+static void setLedColor(commandArgs &arg) {
+  int index = arg.index;
+  int tempVal;
+  int colorArray[3];
+  CRGBW8 color;
 
-  else if(!strncmp(TEXT_SAVE_CONFIG, line,strlen(TEXT_SAVE_CONFIG))) { // Saves config to FLASH
-    storeConfig();
-    return(true);
+  if (!index)
+    return;
+  if (isDigit(arg.line[index])) { // Normal color definition
+    for (int i = 0 ; i < 3 ; i++) {
+      if (index) {
+        tempVal = atoi(&arg.line[index]);
+        colorArray[i] = constrain(tempVal, 0, 255);
+        index = skipToNextValue(arg.line, index);
+      }
+    }
+    color = CRGBW8(colorArray[0], colorArray[1], colorArray[2]);
+    riot.setPixelColor(color);
+  } // End of Classic Color Definition
+  else { // using a color name from the dictionnary
+    // Nothing to check, if we don't find the color, we get black
+    color = getColorFromDictionary(arg.value);
+    riot.setPixelColor(color);
+  }
+  if(riot.isDebug()) {
+    Serial.printf("%s \n", TEXT_LED_COLOR);
+    (riot.getPixelColor()).print();
   }
-  else if(!strncmp(TEXT_REBOOT, line,strlen(TEXT_REBOOT))) { // Saves config to FLASH
-    // Reboot is needed to use new settings - force reboot with the watchdog or another technique or wait for the reset command
-    reset();
-    return(true);
+}
+
+// PLI high & low thresholds (list)
+static void setPli(commandArgs &arg) {
+  int index = arg.index;
+  float val;
+
+  if (!index)
+    return;
+  val = atof(&arg.line[index]);
+  val = constrain(val, 0.f, MAX_PLI_RANGE);
+  riot.setPliLow(val);
+  index = skipToNextValue(arg.line, index);
+  val = atof(&arg.line[index]);
+  val = constrain(val, 0.f, MAX_PLI_RANGE);
+  riot.setPliHigh(val);
+  if (riot.getPliLow() >= riot.getPliHigh()) {
+    Serial.printf("%s PLI Low end must be < PLI High end\n", TEXT_ERROR_LOG);
   }
+  if (riot.isDebug())
+    Serial.printf("PLI range (V)={%f;%f}\n", riot.getPliLow(), riot.getPliHigh());
+}
 
-  else if(!strncmp(TEXT_WIFI_RSSI, line,strlen(TEXT_WIFI_RSSI))) { // Saves config to FLASH
-    // Reboot is needed to use new settings - force reboot with the watchdog or another technique or wait for the reset command
-    riot.getRSSI();
-    return(true);
+static void setSoftIronRow(commandArgs &arg, int axis, const char *key) {
+  float vect[3] = {0.f, 0.f, 0.f};
+  int index = arg.index;
+
+  if(index) {
+    for(int i = 0; i < 3; i++) {
+      vect[i] = atof(&arg.line[index]);
+      index = skipToNextValue(arg.line, index);
+    }
   }
-  
-  else if(!strncmp(TEXT_WIFI_MODE, line,strlen(TEXT_WIFI_MODE))) {
-    index = skipToValue(line);
-    val = atoi(&line[index]);
-    riot.setOperatingMode(val);
+  motion.setSoftIronMatrix(vect, axis);
+  if(riot.isDebug())
+    Serial.printf("%s [ %f %f %f ]\n", key, vect[0], vect[1], vect[2]);
+}
+
+// Sorted by key in strcmp() order : upper case < '_' < lower case. Looked up by binary search (findCommand(),
+// 7 compares for the 78 keys) : a perfect hash would be O(1) but needs a generator to stay in sync
+static constexpr commandEntry commandTable[] = {
+  {TEXT_CANCEL_COMMAND, CMD_NONE, CMD_REMOTE, [](commandArgs &arg) {
+    reply(arg, "Cancelling operation");
+    motion.cancel(true);  // Cancel calibration - emulates the switch press
+  }},
+  {TEXT_GO_COMMAND, CMD_NONE, CMD_REMOTE, [](commandArgs &arg) {
+    reply(arg, "Next Step");
+    motion.nextStep(true);  // Proceed with calibration - emulates the switch press
+  }},
+  {TEXT_ACC_OFFSETX, CMD_INT, 0, [](commandArgs &arg) {
+    motion.setAccelBias(arg.i, X_AXIS);
     if(riot.isDebug())
-      Serial.printf("%s %d\n", TEXT_WIFI_MODE, riot.getOperatingMode());
-    return(true);
-  }
-  
-  else if(!strncmp(TEXT_DHCP, line,strlen(TEXT_DHCP))) {
-    index = skipToValue(line);
-    val = atoi(&line[index]);
-    riot.setUseDHCP(val);
+      Serial.printf("%s %d\n", TEXT_ACC_OFFSETX, motion.getAccelBiasRaw(X_AXIS));
+  }},
+  {TEXT_ACC_OFFSETY, CMD_INT, 0, [](commandArgs &arg) {
+    motion.setAccelBias(arg.i, Y_AXIS);
     if(riot.isDebug())
-      Serial.printf("%s %d\n", TEXT_DHCP, riot.isDHCP());
-    return(true);
-  }
-  else if(!strncmp(TEXT_SSID, line,strlen(TEXT_SSID))) {
-    index = skipToValue(line);
-    riot.setSSID(&line[index]);
+      Serial.printf("%s %d\n", TEXT_ACC_OFFSETY, motion.getAccelBiasRaw(Y_AXIS));
+  }},
+  {TEXT_ACC_OFFSETZ, CMD_INT, 0, [](commandArgs &arg) {
+    motion.setAccelBias(arg.i, Z_AXIS);
     if(riot.isDebug())
-      Serial.printf("%s %s\n", TEXT_SSID, riot.getSSID());
-    return(true);
-  }
-  else if(!strncmp(TEXT_PASSWORD, line,strlen(TEXT_PASSWORD))) {
-    index = skipToValue(line);
-    riot.setPassword(&line[index]);
+      Serial.printf("%s %d\n", TEXT_ACC_OFFSETZ, motion.getAccelBiasRaw(Z_AXIS));
+  }},
+  {TEXT_ACC_RANGE, CMD_INT, 0, [](commandArgs &arg) {
+    lsm6d.setAccRange(constrain(arg.i, ACC_2G, ACC_16G));
+    motion.begin();
     if(riot.isDebug())
-      Serial.printf("%s %s\n", TEXT_PASSWORD, riot.getPassword());
-    return(true);
-  }
-  else if(!strncmp(TEXT_OWNIP, line,strlen(TEXT_OWNIP))) {
-    index = skipToValue(line);
-    tempIP.fromString(&line[index]);
-    riot.setOwnIP(tempIP);
+      Serial.printf("%s %d\n", TEXT_ACC_RANGE, lsm6d.getAccRange());
+  }},
+  {TEXT_AUTOCAL_MAG, CMD_NONE, CMD_REMOTE, [](commandArgs &arg) {
+    reply(arg, "Starting Mag Calibration");
+    motion.runAutoCalMag();
+  }},
+  {TEXT_AUTOCAL_MOTION, CMD_NONE, CMD_REMOTE, [](commandArgs &arg) {
+    reply(arg, "Starting Acc-Gyro Calibration");
+    motion.runAutoCalMotion();
+  }},
+  {TEXT_AUTO_TEST, CMD_NONE, 0, [](commandArgs &) {
+    autoTest();
+  }},
+  {TEXT_BARO_MODE, CMD_INT, 0, [](commandArgs &arg) {
+    bmp390.setSamplingMode(constrain(arg.i, 0, BARO_MAX_SAMPLING_MODE));
     if(riot.isDebug())
-      Serial.printf("%s %u.%u.%u.%u\n",TEXT_OWNIP, tempIP[0], tempIP[1], tempIP[2], tempIP[3]);
-    return(true);
-  } 
-  else if(!strncmp(TEXT_DESTIP, line, strlen(TEXT_DESTIP))) {
-    index = skipToValue(line);
-    tempIP.fromString(&line[index]);
-    riot.setDestIP(tempIP);
+      Serial.printf("%s %d\n", TEXT_BARO_MODE, bmp390.getSamplingMode());
+  }},
+  {TEXT_BARO_REF, CMD_FLOAT, 0, [](commandArgs &arg) {
+    bmp390.setRefAltitude(arg.f);
     if(riot.isDebug())
-      Serial.printf("%s %u.%u.%u.%u\n",TEXT_DESTIP, tempIP[0], tempIP[1], tempIP[2], tempIP[3]);
-    
-    return(true);
-  } 
-  else if(!strncmp(TEXT_GATEWAY, line, strlen(TEXT_GATEWAY))) {
-    index = skipToValue(line);
-    tempIP.fromString(&line[index]);
-    riot.setGatewayIP(tempIP);
+      Serial.printf("%s %f\n", TEXT_BARO_REF, bmp390.getRefAltitude());
+  }},
+  {TEXT_BATCH_LATENCY, CMD_INT, 0, [](commandArgs &arg) {
+    riot.setBatchLatency(arg.i);
     if(riot.isDebug())
-      Serial.printf("%s %u.%u.%u.%u\n",TEXT_GATEWAY, tempIP[0], tempIP[1], tempIP[2], tempIP[3]);
-    return(true);
-  } 
-  else if(!strncmp(TEXT_MASK, line, strlen(TEXT_MASK))) {
-    index = skipToValue(line);
-    tempIP.fromString(&line[index]);
-    riot.setSubnetMask(tempIP);
+      Serial.printf("%s %u\n", TEXT_BATCH_LATENCY, riot.getBatchLatency());
+  }},
+  {TEXT_BATCH_SIZE, CMD_INT, 0, [](commandArgs &arg) {
+    riot.setBatchSize(arg.i);
     if(riot.isDebug())
-      Serial.printf("%s %u.%u.%u.%u\n",TEXT_MASK, tempIP[0], tempIP[1], tempIP[2], tempIP[3]);
-    return(true);
-  } 
-  // mDNS name
-  else if(!strncmp(TEXT_MDNS, line, strlen(TEXT_MDNS))) {
-    index = skipToValue(line);
-    riot.setBonjour(&line[index]);
+      Serial.printf("%s %u\n", TEXT_BATCH_SIZE, riot.getBatchSize());
+  }},
+  {TEXT_VBATT, CMD_NONE, 0, [](commandArgs &) {
+    Serial.printf("%s %f volts\n", TEXT_VBATT, readBatteryVoltage());
+  }},
+  {TEXT_BETA, CMD_FLOAT, 0, [](commandArgs &arg) {
+    motion.setBeta(arg.f);
     if(riot.isDebug())
-      Serial.printf("%s %s.local\n", TEXT_MDNS, riot.getBonjour());
-    
-    return(true);
-  } 
-  
-  else if(!strncmp(TEXT_PORT, line, strlen(TEXT_PORT))) {
-    index = skipToValue(line);
-    val = atoi(&line[index]);
-    riot.setDestPort(val);
+      Serial.printf("%s %f\n", TEXT_BETA, motion.getBeta());
+  }},
+  {TEXT_BNO_ORIENT, CMD_INT, 0, [](commandArgs &arg) {
+    riot.setBnoOrientation(arg.i);    // applied when the BNO055 is ready
     if(riot.isDebug())
-      Serial.printf("%s %d\n", TEXT_PORT, riot.getDestPort());
-    
-    return(true);
-  } 
-  else if(!strncmp(TEXT_RECEIVE_PORT, line, strlen(TEXT_RECEIVE_PORT))) {
-    index = skipToValue(line);
-    val = atoi(&line[index]);
-    riot.setReceivePort(val);
+      Serial.printf("%s %d\n", TEXT_BNO_ORIENT, riot.getBnoOrientation());
+  }},
+  {TEXT_CALIBRATE, CMD_NONE, 0, [](commandArgs &) {
+    // re enable calibration timer
+    riot.setCalibrationTimer(riot.getCalibrationTimer());
+    motion.nextStep(true);  // overrides switch action
+  }},
+  {TEXT_CALIBRATION, CMD_INT, 0, [](commandArgs &arg) {
+    riot.setCalibrationTimer(constrain(arg.i, 0, 20000));
     if(riot.isDebug())
-      Serial.printf("%s %d\n", TEXT_RECEIVE_PORT, riot.getReceivePort());
-    
-    return(true);
-  } 
-  else if(!strncmp(TEXT_MASTER_ID, line, strlen(TEXT_MASTER_ID))) {
-    index = skipToValue(line);
-    val = atoi(&line[index]);
-    riot.setID(val);
+      Serial.printf("%s %d\n", TEXT_CALIBRATION, riot.getCalibrationTimer());
+  }},
+  {TEXT_GET_CONFIG, CMD_NONE, 0, printConfig},  // Send current config to the configuration app
+  {TEXT_CHARGE_MODE, CMD_INT, 0, [](commandArgs &arg) {
+    riot.setChargingMode(constrain(arg.i, 0, MAX_CHARGE_MODE));
     if(riot.isDebug())
-      Serial.printf("%s %d\n", TEXT_MASTER_ID, riot.getID());
-    return(true);
-  }
-  else if(!strncmp(TEXT_SAMPLE_RATE, line, strlen(TEXT_SAMPLE_RATE))) {
-    index = skipToValue(line);
-    val = atoi(&line[index]);
-    val = constrain(val, MIN_SAMPLERATE, MAX_SAMPLERATE);
-    motion.setSampleRate(val);
+      Serial.printf("%s %d\n", TEXT_CHARGE_MODE, riot.getChargingMode());
+  }},
+  {TEXT_CPU_SPEED, CMD_INT, CMD_REBOOT, [](commandArgs &arg) {
+    riot.setCpuSpeed(constrain(arg.i, 40, 240));
     if(riot.isDebug())
-      Serial.printf("%s %d\n", TEXT_SAMPLE_RATE, motion.getSampleRate());
-    return(true);
-  } 
-  else if(!strncmp(TEXT_REMOTE, line, strlen(TEXT_REMOTE))) {
-    index = skipToValue(line);
-    val = atoi(&line[index]);
-    val = constrain(val, false, true);
-    riot.setOscInput(val);
+      Serial.printf("%s %d\n", TEXT_CPU_SPEED, riot.getCpuSpeed());
+  }},
+  {TEXT_DEBUG, CMD_INT, 0, [](commandArgs &arg) {
+    riot.setDebugMode(arg.i);
     if(riot.isDebug())
-      Serial.printf("%s %d\n", TEXT_REMOTE, riot.isOSCinput());
-    return(true);
-  } 
-  else if(!strncmp(TEXT_FORCE_CONFIG, line, strlen(TEXT_FORCE_CONFIG))) {
-    index = skipToValue(line);
-    val = atoi(&line[index]);
-    val = constrain(val, false, true);
-    riot.setForcedConfigMode(val);
+      Serial.printf("%s %d\n", TEXT_DEBUG, riot.isDebug());
+  }},
+  {TEXT_DECLINATION, CMD_FLOAT, 0, [](commandArgs &arg) {
+    motion.setDeclination(constrain(arg.f, 0, 90.f));  // Max observed declination is 26-30° max
+    if(riot.isDebug())
+      Serial.printf("%s %f\n", TEXT_DECLINATION, motion.getDeclination());
+  }},
+  {TEXT_DEFAULTS, CMD_NONE, 0, [](commandArgs &) {
+    // Re open in write mode
+    restoreDefaults(false);
+  }},
+  {TEXT_DESTIP, CMD_IP, 0, [](commandArgs &arg) {
+    riot.setDestIP(arg.ip);
+    if(riot.isDebug())
+      Serial.printf("%s %u.%u.%u.%u\n",TEXT_DESTIP, arg.ip[0], arg.ip[1], arg.ip[2], arg.ip[3]);
+  }},
+  {TEXT_DHCP, CMD_INT, CMD_REBOOT, [](commandArgs &arg) {
+    riot.setUseDHCP(arg.i);
+    if(riot.isDebug())
+      Serial.printf("%s %d\n", TEXT_DHCP, riot.isDHCP());
+  }},
+  {TEXT_CPU_DOZE, CMD_INT, CMD_REBOOT, [](commandArgs &arg) {
+    riot.setCpuDoze(constrain(arg.i, 40, 240));
+    if(riot.isDebug())
+      Serial.printf("%s %d\n", TEXT_CPU_DOZE, riot.getCpuDoze());
+  }},
+  {TEXT_FAST_CONNECT, CMD_INT, 0, [](commandArgs &arg) {
+    riot.setFastConnect(arg.i);
+    if(riot.isDebug())
+      Serial.printf("%s %d\n", TEXT_FAST_CONNECT, riot.getFastConnect());
+  }},
+  {TEXT_FORCE_CONFIG, CMD_INT, CMD_REBOOT, [](commandArgs &arg) {
+    riot.setForcedConfigMode(constrain(arg.i, false, true));
     if(riot.isDebug())
       Serial.printf("%s %d\n", TEXT_FORCE_CONFIG, riot.isForcedConfig());
-    return(true);
-  } 
-  else if(!strncmp(TEXT_WIFI_POWER, line, strlen(TEXT_WIFI_POWER))) {
-    index = skipToValue(line);
-    val = atoi(&line[index]);
-    val = constrain(val,WIFI_POWER_MINUS_1dBm , WIFI_POWER_19_5dBm);
-    riot.setWifiPower((wifi_power_t)val);
+  }},
+  {TEXT_FORMAT, CMD_NONE, 0, [](commandArgs &) {
+    format();
+  }},
+  {TEXT_FUSION, CMD_INT, 0, [](commandArgs &arg) {
+    motion.setFusion(arg.i);
     if(riot.isDebug())
-      Serial.printf("%s %d\n", TEXT_WIFI_POWER, riot.getWifiPower());
-    return(true);
-  } 
-  else if(!strncmp(TEXT_CALIBRATION, line, strlen(TEXT_CALIBRATION))) {
-    index = skipToValue(line);
-    val = atoi(&line[index]);
-    val = constrain(val,0 , 20000);
-    riot.setCalibrationTimer(val);
+      Serial.printf("%s %d (%s)\n", TEXT_FUSION, motion.getFusion(), motion.getFusionName());
+  }},
+  {TEXT_GATEWAY, CMD_IP, CMD_REBOOT, [](commandArgs &arg) {
+    riot.setGatewayIP(arg.ip);
     if(riot.isDebug())
-      Serial.printf("%s %d\n", TEXT_CALIBRATION, riot.getCalibrationTimer());
-    return(true);
-  }
-  else if(!strncmp(TEXT_DECLINATION, line, strlen(TEXT_DECLINATION))) {
-    index = skipToValue(line);
-    float angle = atof(&line[index]);
-    angle = constrain(angle,0 , 90.f);  // Max observed declination is 26-30° max
-    motion.setDeclination(angle);
+      Serial.printf("%s %u.%u.%u.%u\n",TEXT_GATEWAY, arg.ip[0], arg.ip[1], arg.ip[2], arg.ip[3]);
+  }},
+  {TEXT_GYRO_OFFSETX, CMD_INT, 0, [](commandArgs &arg) {
+    motion.setGyroBias(arg.i, X_AXIS);
     if(riot.isDebug())
-      Serial.printf("%s %f\n", TEXT_DECLINATION, motion.getDeclination());
-    return(true);
-  }
-
-  else if(!strncmp(TEXT_ORIENTATION, line, strlen(TEXT_ORIENTATION))) {
-    index = skipToValue(line);
-    val = atoi(&line[index]);
-    val = constrain(val,0 , MAX_BOARD_ORIENTATION);
-    motion.setOrientation(val);
+      Serial.printf("%s %d\n", TEXT_GYRO_OFFSETX, motion.getGyroBiasRaw(X_AXIS));
+  }},
+  {TEXT_GYRO_OFFSETY, CMD_INT, 0, [](commandArgs &arg) {
+    motion.setGyroBias(arg.i, Y_AXIS);
     if(riot.isDebug())
-      Serial.printf("%s %d\n", TEXT_ORIENTATION, motion.getOrientation());
-    return(true);
-  }
-
-  else if(!strncmp(TEXT_BNO_ORIENT, line, strlen(TEXT_BNO_ORIENT))) {
-    index = skipToValue(line);
-    val = atoi(&line[index]);
-    val = constrain(val,0 , 7);
-    bno055.SetPos(val);
-    bno055.Set_Mode(NDOF);  // 9DoF fusion
+      Serial.printf("%s %d\n", TEXT_GYRO_OFFSETY, motion.getGyroBiasRaw(Y_AXIS));
+  }},
+  {TEXT_GYRO_OFFSETZ, CMD_INT, 0, [](commandArgs &arg) {
+    motion.setGyroBias(arg.i, Z_AXIS);
     if(riot.isDebug())
-      Serial.printf("%s %d\n", TEXT_BNO_ORIENT, bno055.orientation);
-    return(true);
-  }
-
-  else if(!strncmp(TEXT_ACC_RANGE, line, strlen(TEXT_ACC_RANGE))) {
-    index = skipToValue(line);
-    val = atoi(&line[index]);
-    val = constrain(val, ACC_2G, ACC_16G);
-    lsm6d.setAccRange(val);
-    motion.begin();
+      Serial.printf("%s %d\n", TEXT_GYRO_OFFSETZ, motion.getGyroBiasRaw(Z_AXIS));
+  }},
+  {TEXT_GYRO_GATE, CMD_FLOAT, 0, [](commandArgs &arg) {
+    motion.setGyroGate(arg.f);
     if(riot.isDebug())
-      Serial.printf("%s %d\n", TEXT_ACC_RANGE, lsm6d.getAccRange());
-    return(true);
-  }
-  else if(!strncmp(TEXT_GYRO_RANGE, line, strlen(TEXT_GYRO_RANGE))) {
-    index = skipToValue(line);
-    val = atoi(&line[index]);
-    val = constrain(val, GYRO_250DPS, GYRO_2000DPS);
-    lsm6d.setGyroRange(val);
+      Serial.printf("%s %f\n", TEXT_GYRO_GATE, motion.getGyroGate());
+  }},
+  {TEXT_GYRO_HPF, CMD_INT, 0, [](commandArgs &arg) {
+    lsm6d.setGyroHpf(arg.i);
+    if(riot.isDebug())
+      Serial.printf("%s %d\n", TEXT_GYRO_HPF, lsm6d.getGyroHpf());
+  }},
+  {TEXT_GYRO_RANGE, CMD_INT, 0, [](commandArgs &arg) {
+    lsm6d.setGyroRange(constrain(arg.i, GYRO_250DPS, GYRO_2000DPS));
     motion.begin();
     if(riot.isDebug())
       Serial.printf("%s %d\n", TEXT_GYRO_RANGE, lsm6d.getGyroRange());
-    return(true);
-  }
-  else if(!strncmp(TEXT_MAG_RANGE, line, strlen(TEXT_MAG_RANGE))) {
-    index = skipToValue(line);
-    val = atoi(&line[index]);
-    val = constrain(val, MAG_4GAUSS, MAG_16GAUSS);
-    lis3mdl.setRange(val);
+  }},
+  {TEXT_IMU_FIFO, CMD_INT, 0, [](commandArgs &arg) {
+    lsm6d.setFifo(arg.i);
+    if(riot.isDebug())
+      Serial.printf("%s %d\n", TEXT_IMU_FIFO, lsm6d.isFifo());
+  }},
+  {TEXT_LED_COLOR, CMD_LIST, 0, setLedColor},
+  {TEXT_LOG_MAG, CMD_FLOAT, CMD_DEBUG, [](commandArgs &arg) {
+    riot.setLogMag(arg.f);
+  }},
+  {TEXT_LOG_MOTION, CMD_FLOAT, CMD_DEBUG, [](commandArgs &arg) {
+    riot.setLogMotion(arg.f);
+  }},
+  {TEXT_MAG_OFFSETX, CMD_INT, 0, [](commandArgs &arg) {
+    motion.setMagBias(arg.i, X_AXIS);
+    if(riot.isDebug())
+      Serial.printf("%s %d\n", TEXT_MAG_OFFSETX, motion.getMagBiasRaw(X_AXIS));
+  }},
+  {TEXT_MAG_OFFSETY, CMD_INT, 0, [](commandArgs &arg) {
+    motion.setMagBias(arg.i, Y_AXIS);
+    if(riot.isDebug())
+      Serial.printf("%s %d\n", TEXT_MAG_OFFSETY, motion.getMagBiasRaw(Y_AXIS));
+  }},
+  {TEXT_MAG_OFFSETZ, CMD_INT, 0, [](commandArgs &arg) {
+    motion.setMagBias(arg.i, Z_AXIS);
+    if(riot.isDebug())
+      Serial.printf("%s %d\n", TEXT_MAG_OFFSETZ, motion.getMagBiasRaw(Z_AXIS));
+  }},
+  {TEXT_MAG_RANGE, CMD_INT, 0, [](commandArgs &arg) {
+    lis3mdl.setRange(constrain(arg.i, MAG_4GAUSS, MAG_16GAUSS));
     motion.begin();
     if(riot.isDebug())
       Serial.printf("%s %d\n", TEXT_MAG_RANGE, lis3mdl.getRange());
-    return(true);
-  }  
-  else if(!strncmp(TEXT_GYRO_GATE, line, strlen(TEXT_GYRO_GATE))) {
-    index = skipToValue(line);
-    float gate = atof(&line[index]);
-    motion.setGyroGate(gate);
+  }},
+  {TEXT_MASK, CMD_IP, CMD_REBOOT, [](commandArgs &arg) {
+    riot.setSubnetMask(arg.ip);
     if(riot.isDebug())
-      Serial.printf("%s %f\n", TEXT_GYRO_GATE, motion.getGyroGate());
-    return(true);
-  }  
-  else if(!strncmp(TEXT_GYRO_HPF, line, strlen(TEXT_GYRO_HPF))) {
-    index = skipToValue(line);
-    val = atoi(&line[index]);
-    lsm6d.setGyroHpf(val);
+      Serial.printf("%s %u.%u.%u.%u\n",TEXT_MASK, arg.ip[0], arg.ip[1], arg.ip[2], arg.ip[3]);
+  }},
+  {TEXT_MASTER_ID, CMD_INT, CMD_REBOOT, [](commandArgs &arg) {
+    riot.setID(arg.i);
     if(riot.isDebug())
-      Serial.printf("%s %d\n", TEXT_GYRO_HPF, lsm6d.getGyroHpf());
-    return(true);
-  }  
-  else if(!strncmp(TEXT_BARO_MODE, line, strlen(TEXT_BARO_MODE))) {
-    index = skipToValue(line);
-    val = atoi(&line[index]);
-    val = constrain(val,0 , BARO_MAX_SAMPLING_MODE);
-    bmp390.setSamplingMode(val);
+      Serial.printf("%s %d\n", TEXT_MASTER_ID, riot.getID());
+  }},
+  {TEXT_MDNS, CMD_TEXT, CMD_REBOOT, [](commandArgs &arg) {  // mDNS name
+    riot.setBonjour(arg.value);
     if(riot.isDebug())
-      Serial.printf("%s %d\n", TEXT_BARO_MODE, bmp390.getSamplingMode());
-    return(true);
-  }
-  else if(!strncmp(TEXT_BARO_REF, line, strlen(TEXT_BARO_REF))) {
-    index = skipToValue(line);
-    float alt = atof(&line[index]);
-    bmp390.setRefAltitude(alt);
+      Serial.printf("%s %s.local\n", TEXT_MDNS, riot.getBonjour());
+  }},
+  {TEXT_WIFI_MODE, CMD_INT, CMD_REBOOT, [](commandArgs &arg) {
+    riot.setOperatingMode(arg.i);
     if(riot.isDebug())
-      Serial.printf("%s %f\n", TEXT_BARO_REF, bmp390.getRefAltitude());
-    return(true);
-  }
-  else if(!strncmp(TEXT_CHARGE_MODE, line, strlen(TEXT_CHARGE_MODE))) {
-    index = skipToValue(line);
-    val = atoi(&line[index]);
-    val = constrain(val,0 , MAX_CHARGE_MODE);
-    riot.setChargingMode(val);
+      Serial.printf("%s %d\n", TEXT_WIFI_MODE, riot.getOperatingMode());
+  }},
+  {TEXT_OUTPUT_RATE, CMD_INT, 0, [](commandArgs &arg) {
+    int val = arg.i;
+    if(val)   // 0 = same as samplerate
+      val = constrain(val, MIN_OUTPUT_RATE, MAX_SAMPLERATE);
+    riot.setOutputRate(val);
     if(riot.isDebug())
-      Serial.printf("%s %d\n", TEXT_CHARGE_MODE, riot.getChargingMode());
-    return(true);
-  }
-  else if(!strncmp(TEXT_CPU_SPEED, line, strlen(TEXT_CPU_SPEED))) {
-    index = skipToValue(line);
-    val = atoi(&line[index]);
-    val = constrain(val,40 , 240);
-    riot.setCpuSpeed(val);
+      Serial.printf("%s %d\n", TEXT_OUTPUT_RATE, riot.getOutputRate());
+  }},
+  {TEXT_ORIENTATION, CMD_INT, 0, [](commandArgs &arg) {
+    motion.setOrientation(constrain(arg.i, 0, MAX_BOARD_ORIENTATION));
     if(riot.isDebug())
-      Serial.printf("%s %d\n", TEXT_CPU_SPEED, riot.getCpuSpeed());
-    return(true);
-  }
-  else if(!strncmp(TEXT_CPU_DOZE, line, strlen(TEXT_CPU_DOZE))) {
-    index = skipToValue(line);
-    val = atoi(&line[index]);
-    val = constrain(val,40 , 240);
-    riot.setCpuDoze(val);
+      Serial.printf("%s %d\n", TEXT_ORIENTATION, motion.getOrientation());
+  }},
+  {TEXT_OWNIP, CMD_IP, CMD_REBOOT, [](commandArgs &arg) {
+    riot.setOwnIP(arg.ip);
     if(riot.isDebug())
-      Serial.printf("%s %d\n", TEXT_CPU_DOZE, riot.getCpuDoze());
-    return(true);
-  }
-  // PLI high & low thresholds (list)
-  else if (!strncmp(TEXT_PLI_LOW_HIGH, line, strlen(TEXT_PLI_LOW_HIGH))) {
-    float val;
-    index = skipToValue(line);
-    if (index) {
-      val = atof(&line[index]);
-      val = constrain(val, 0.f, MAX_PLI_RANGE);
-      riot.setPliLow(val);
-      index = skipToNextValue(line, index);
-      val = atof(&line[index]);
-      val = constrain(val, 0.f, MAX_PLI_RANGE);
-      riot.setPliHigh(val);
-      if (riot.getPliLow() >= riot.getPliHigh()) {
-        Serial.printf("%s PLI Low end must be < PLI High end\n", TEXT_ERROR_LOG);
-      }
-
-      if (riot.isDebug())
-        Serial.printf("PLI range (V)={%f;%f}\n", riot.getPliLow(), riot.getPliHigh());
-    }
-    return (true);
-  }
-  
-  else if(!strncmp(TEXT_LED_COLOR, line, strlen(TEXT_LED_COLOR))) {
-    index = skipToValue(line);
-    if (index) {
-      int tempVal;
-      int colorArray[3];
-      CRGBW8 color;
-      char c = line[index];
-      if (isDigit(c)) { // Normal color definition
-        for (i = 0 ; i < 3 ; i++) {
-          if (index) {
-            tempVal = atoi(&line[index]);
-            //Serial.printf("Index=%d\n",index);
-            //Serial.printf("index = %d - color[%d]=%d\n",index, i, tempVal);
-            colorArray[i] = constrain(tempVal, 0, 255);
-            index = skipToNextValue(line, index);
-          }
-        }
-        color = CRGBW8(colorArray[0], colorArray[1], colorArray[2]);
-        riot.setPixelColor(color);
-      } // End of Classic Color Definition
-      else { // using a color name from the dictionnary
-        // Nothing to check, if we don't find the color, we get black
-        color = getColorFromDictionary(&line[index]);
-        riot.setPixelColor(color);
-      }
-      if(riot.isDebug()) {
-        Serial.printf("%s \n", TEXT_LED_COLOR);
-        (riot.getPixelColor()).print();
-      }
-    }
-    return (true);
-  }
-  
-  else if(!strncmp(TEXT_SLOW_BOOT, line, strlen(TEXT_SLOW_BOOT))) {
-    index = skipToValue(line);
-    val = atoi(&line[index]);
-    val = constrain(val,0 , MAX_SLOW_BOOT);
+      Serial.printf("%s %u.%u.%u.%u\n",TEXT_OWNIP, arg.ip[0], arg.ip[1], arg.ip[2], arg.ip[3]);
+  }},
+  {TEXT_PASSWORD, CMD_TEXT, CMD_REBOOT, [](commandArgs &arg) {
+    riot.setPassword(arg.value);
+    if(riot.isDebug())
+      Serial.printf("%s %s\n", TEXT_PASSWORD, riot.getPassword());
+  }},
+  {TEXT_PERF, CMD_NONE, 0, [](commandArgs &) {
+    riot.printPerf();
+  }},
+  {TEXT_PING, CMD_NONE, CMD_REMOTE, [](commandArgs &arg) {
+    // Ping / Echo question/answer from the GUI
+    Serial.printf("%s\n", TEXT_ECHO);  // a simple ASCII echo answer to let the GUI know the COM port is the right one
+    reply(arg, TEXT_ECHO);
+  }},
+  {TEXT_PLI_LOW_HIGH, CMD_LIST, 0, setPli},
+  {TEXT_PORT, CMD_INT, 0, [](commandArgs &arg) {
+    riot.setDestPort(arg.i);
+    if(riot.isDebug())
+      Serial.printf("%s %d\n", TEXT_PORT, riot.getDestPort());
+  }},
+  {TEXT_WIFI_POWER, CMD_INT, CMD_REBOOT, [](commandArgs &arg) {
+    riot.setWifiPower((wifi_power_t)constrain(arg.i, WIFI_POWER_MINUS_1dBm, WIFI_POWER_19_5dBm));
+    if(riot.isDebug())
+      Serial.printf("%s %d\n", TEXT_WIFI_POWER, riot.getWifiPower());
+  }},
+  {TEXT_RECORD, CMD_INT, CMD_SERIAL, [](commandArgs &arg) {
+    riot.record(arg.i);
+  }},
+  {TEXT_REMOTE, CMD_INT, 0, [](commandArgs &arg) {
+    riot.setOscInput(constrain(arg.i, false, true));
+    if(riot.isDebug())
+      Serial.printf("%s %d\n", TEXT_REMOTE, riot.isOSCinput());
+  }},
+  {TEXT_REPLAY, CMD_TEXT, CMD_SERIAL, [](commandArgs &arg) {
+    riot.replay(arg.index ? arg.value : RECORD_FILE);
+  }},
+  {TEXT_REBOOT, CMD_NONE, CMD_REMOTE, [](commandArgs &arg) {
+    // Reboot is needed to use new settings - force reboot with the watchdog or another technique or wait for the reset command
+    reply(arg, "Reboot module");
+    reset();
+  }},
+  {TEXT_WIFI_RSSI, CMD_NONE, 0, [](commandArgs &) {
+    riot.getRSSI();
+  }},
+  {TEXT_RECEIVE_PORT, CMD_INT, CMD_REBOOT, [](commandArgs &arg) {
+    riot.setReceivePort(arg.i);
+    if(riot.isDebug())
+      Serial.printf("%s %d\n", TEXT_RECEIVE_PORT, riot.getReceivePort());
+  }},
+  {TEXT_SAMPLE_RATE, CMD_INT, 0, [](commandArgs &arg) {
+    motion.setSampleRate(constrain(arg.i, MIN_SAMPLERATE, MAX_SAMPLERATE));
+    riot.updateFusion();
+    if(riot.isDebug())
+      Serial.printf("%s %d\n", TEXT_SAMPLE_RATE, motion.getSampleRate());
+  }},
+  {TEXT_SAVE_CONFIG, CMD_NONE, CMD_REMOTE, [](commandArgs &arg) { // Saves config to FLASH
+    storeConfig();
+    reply(arg, "Config saved");
+  }},
+  {TEXT_SLOW_BOOT, CMD_INT, CMD_REBOOT, [](commandArgs &arg) {
+    uint32_t val = constrain(arg.i, 0, MAX_SLOW_BOOT);
     if( val != riot.getSlowBoot()) { // avoids flash wear
       riot.setSlowBoot(val);
       riot.writeSlowBoot();
     }
     if(riot.isDebug())
       Serial.printf("%s %d\n", TEXT_SLOW_BOOT, riot.getSlowBoot());
-    return(true);
-  }
-
-  else if(!strncmp(TEXT_ACC_OFFSETX, line, strlen(TEXT_ACC_OFFSETX))) {
-    index = skipToValue(line);
-    motion.setAccelBias(atoi(&line[index]), X_AXIS);
-    if(riot.isDebug())
-      Serial.printf("%s %d\n", TEXT_ACC_OFFSETX, motion.getAccelBiasRaw(X_AXIS));
-    return(true);
-  }
-  else if(!strncmp(TEXT_ACC_OFFSETY, line, strlen(TEXT_ACC_OFFSETY))) {
-    index = skipToValue(line);
-    motion.setAccelBias(atoi(&line[index]), Y_AXIS);
-    if(riot.isDebug())
-      Serial.printf("%s %d\n", TEXT_ACC_OFFSETY, motion.getAccelBiasRaw(Y_AXIS));
-    return(true);
-  }
-  else if(!strncmp(TEXT_ACC_OFFSETZ, line, strlen(TEXT_ACC_OFFSETZ))) {
-    index = skipToValue(line);
-    motion.setAccelBias(atoi(&line[index]), Z_AXIS);
-    if(riot.isDebug())
-      Serial.printf("%s %d\n", TEXT_ACC_OFFSETZ, motion.getAccelBiasRaw(Z_AXIS));
-    return(true);
-  }  
-  else if(!strncmp(TEXT_GYRO_OFFSETX, line, strlen(TEXT_GYRO_OFFSETX))) {
-    index = skipToValue(line);
-    motion.setGyroBias(atoi(&line[index]), X_AXIS);
+  }},
+  {TEXT_SOFT_IRON_MATRIX1, CMD_LIST, 0, [](commandArgs &arg) {
+    setSoftIronRow(arg, X_AXIS, TEXT_SOFT_IRON_MATRIX1);
+  }},
+  {TEXT_SOFT_IRON_MATRIX2, CMD_LIST, 0, [](commandArgs &arg) {
+    setSoftIronRow(arg, Y_AXIS, TEXT_SOFT_IRON_MATRIX2);
+  }},
+  {TEXT_SOFT_IRON_MATRIX3, CMD_LIST, 0, [](commandArgs &arg) {
+    setSoftIronRow(arg, Z_AXIS, TEXT_SOFT_IRON_MATRIX3);
+  }},
+  {TEXT_SSID, CMD_TEXT, CMD_REBOOT, [](commandArgs &arg) {
+    riot.setSSID(arg.value);
     if(riot.isDebug())
-      Serial.printf("%s %d\n", TEXT_GYRO_OFFSETX, motion.getGyroBiasRaw(X_AXIS));
-    return(true);
-  }
-  else if(!strncmp(TEXT_GYRO_OFFSETY, line, strlen(TEXT_GYRO_OFFSETY))) {
-    index = skipToValue(line);
-    motion.setGyroBias(atoi(&line[index]), Y_AXIS);
+      Serial.printf("%s %s\n", TEXT_SSID, riot.getSSID());
+  }},
+  {TEXT_STREAM_FORMAT, CMD_INT, 0, [](commandArgs &arg) {
+    riot.setStreamFormat(arg.i);
     if(riot.isDebug())
-      Serial.printf("%s %d\n", TEXT_GYRO_OFFSETY, motion.getGyroBiasRaw(Y_AXIS));
-    return(true);
-  }
-  else if(!strncmp(TEXT_GYRO_OFFSETZ, line, strlen(TEXT_GYRO_OFFSETZ))) {
-    index = skipToValue(line);
-    motion.setGyroBias(atoi(&line[index]), Z_AXIS);
+      Serial.printf("%s %u\n", TEXT_STREAM_FORMAT, riot.getStreamFormat());
+  }},
+  {TEXT_STREAMS, CMD_TEXT, CMD_REMOTE, [](commandArgs &arg) {  // OSC streams selection, applied at the next packet
+    char line[MAX_STRING_LEN];
+    if(arg.index)   // no value would otherwise mute everything
+      riot.setStreams(strtoul(arg.value, NULL, 0));   // decimal or 0x hexadecimal
     if(riot.isDebug())
-      Serial.printf("%s %d\n", TEXT_GYRO_OFFSETZ, motion.getGyroBiasRaw(Z_AXIS));
-    return(true);
-  }
-  else if(!strncmp(TEXT_MAG_OFFSETX, line, strlen(TEXT_MAG_OFFSETX))) {
-    index = skipToValue(line);
-    motion.setMagBias(atoi(&line[index]), X_AXIS);
+      Serial.printf("%s 0x%04X\n", TEXT_STREAMS, riot.getStreams());
+    sprintf(line, "%s 0x%04X", TEXT_STREAMS, riot.getStreams());
+    reply(arg, line);
+  }},
+  {TEXT_SYNC_PORT, CMD_INT, 0, [](commandArgs &arg) {
+    riot.setSyncPort(arg.i);
     if(riot.isDebug())
-      Serial.printf("%s %d\n", TEXT_MAG_OFFSETX, motion.getMagBiasRaw(X_AXIS));
-    return(true);
+      Serial.printf("%s %d\n", TEXT_SYNC_PORT, riot.getSyncPort());
+  }},
+  {TEXT_VUSB, CMD_NONE, 0, [](commandArgs &) {
+    Serial.printf("%s %f volts\n", TEXT_VUSB, readUsbVoltage());
+  }},
+  {TEXT_VERSION, CMD_NONE, 0, [](commandArgs &) {
+    riot.version(true);   // + version.txt with the last boot phases
+  }},
+  {TEXT_WIFI, CMD_NONE, 0, [](commandArgs &) {
+    riot.printCurrentNet();
+    riot.printWifiData();
+  }},
+};
+#define COMMANDS   (int)(sizeof(commandTable) / sizeof(commandTable[0]))
+
+static constexpr int compareKeys(const char *a, const char *b) {
+  return (*a != *b || !*a) ? (int)(unsigned char)*a - (int)(unsigned char)*b : compareKeys(a + 1, b + 1);
+}
+
+static constexpr bool isTableSorted(int i = 1) {
+  return (i >= COMMANDS) || (compareKeys(commandTable[i - 1].key, commandTable[i].key) < 0 && isTableSorted(i + 1));
+}
+static_assert(isTableSorted(), "commandTable must be sorted by key (strcmp order) without duplicates");
+
+// Length of the command token : up to the '=' or a blank
+static int tokenLength(const char *line) {
+  int i = 0;
+  while (line[i] && line[i] != '=' && line[i] != ' ' && line[i] != '\t' && line[i] != '\r' && line[i] != '\n')
+    i++;
+  return i;
+}
+
+int getCommandCount() {
+  return COMMANDS;
+}
+
+const commandEntry* getCommand(int index) {
+  return (index >= 0 && index < COMMANDS) ? &commandTable[index] : NULL;
+}
+
+const commandEntry* findCommand(const char *line) {
+  int length = tokenLength(line);
+  int low = 0, high = COMMANDS - 1;
+
+  while (low <= high) {
+    int middle = (low + high) / 2;
+    const char *key = commandTable[middle].key;
+    int compare = strncmp(line, key, length);
+    if (!compare && key[length])
+      compare = -1;   // the token is a prefix of the key
+    if (!compare)
+      return &commandTable[middle];
+    if (compare < 0)
+      high = middle - 1;
+    else
+      low = middle + 1;
+  }
+  return NULL;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+// Config snapshot : while CONFIG_FILE is parsed, the parsed values are also recorded as binary records
+// {table index, value} and stored in NVS with the size and date of the file. At the next boot, if the file
+// wasn't changed (edited over USB MSC, saved by storeConfig()), the handlers are called straight from the
+// records : no file reading nor parsing. Checked with a CRC and a hash of the command table, so a firmware
+// update with other keys falls back to the text file. Only the settings are recorded : not the commands, the
+// trace record / replay (CMD_SERIAL) nor the debug switches (CMD_DEBUG). A key without value is a record
+// without value, replayed as such (the handlers keep their current value).
+// The size / date check only catches the edits over USB MSC : FatFs has no RTC here, the firmware's own
+// writes can keep the same size and timestamp. writeConfig() removes the snapshot before replacing the file
+
+struct snapshotHeader {
+  uint16_t magic;
+  uint8_t version;
+  uint8_t count;        // records
+  uint32_t table;       // hash of the command table keys and types
+  uint32_t fileSize;    // of CONFIG_FILE when it was parsed
+  uint16_t fileDate;
+  uint16_t fileTime;
+  uint32_t size;        // of the records
+  uint32_t crc;         // of the records
+};
+
+// Followed by length bytes : int32 / float / IPv4 or the value string with its terminator (text, lists).
+// 0 = key without value (arg.index = 0)
+struct snapshotRecord {
+  uint8_t command;      // commandTable index
+  uint8_t length;
+};
+
+static uint8_t *snapshotRecording = NULL;   // records buffer while the config file is parsed
+static uint32_t snapshotSize = 0;
+static uint8_t snapshotCount = 0;
+static bool snapshotOverflow = false;
+
+static uint32_t commandTableHash() {
+  uint32_t crc = 0;
+  for (int i = 0; i < COMMANDS; i++) {
+    crc = esp_rom_crc32_le(crc, (const uint8_t*)commandTable[i].key, strlen(commandTable[i].key) + 1);
+    crc = esp_rom_crc32_le(crc, &commandTable[i].type, 1);
+  }
+  return crc;
+}
+
+static void recordSnapshot(const commandEntry *command, commandArgs &arg) {
+  uint8_t value[CONFIG_SNAPSHOT_VALUE];
+  uint32_t length;
+
+  if (command->type == CMD_NONE || (command->flags & (CMD_SERIAL | CMD_DEBUG)))
+    return;
+  switch (arg.index ? command->type : (uint8_t)CMD_NONE) {
+    case CMD_NONE:
+      length = 0;
+      break;
+    case CMD_INT:
+      memcpy(value, &arg.i, sizeof(int32_t));
+      length = sizeof(int32_t);
+      break;
+    case CMD_FLOAT:
+      memcpy(value, &arg.f, sizeof(float));
+      length = sizeof(float);
+      break;
+    case CMD_IP: {
+      uint32_t ip = (uint32_t)arg.ip;
+      memcpy(value, &ip, sizeof(ip));
+      length = sizeof(ip);
+      break;
+    }
+    default:
+      length = strlen(arg.value) + 1;
+      if (length > CONFIG_SNAPSHOT_VALUE) {
+        snapshotOverflow = true;
+        return;
+      }
+      memcpy(value, arg.value, length);
+      break;
   }
-  else if(!strncmp(TEXT_MAG_OFFSETY, line, strlen(TEXT_MAG_OFFSETY))) {
-    index = skipToValue(line);
-    motion.setMagBias(atoi(&line[index]), Y_AXIS);
-    if(riot.isDebug())
-      Serial.printf("%s %d\n", TEXT_MAG_OFFSETY, motion.getMagBiasRaw(Y_AXIS));
-    return(true);
+  if (snapshotSize + sizeof(snapshotRecord) + length > CONFIG_SNAPSHOT_SIZE || snapshotCount == 255) {
+    snapshotOverflow = true;
+    return;
   }
-  else if(!strncmp(TEXT_MAG_OFFSETZ, line, strlen(TEXT_MAG_OFFSETZ))) {
-    index = skipToValue(line);
-    motion.setMagBias(atoi(&line[index]), Z_AXIS);
-    if(riot.isDebug())
-      Serial.printf("%s %d\n", TEXT_MAG_OFFSETZ, motion.getMagBiasRaw(Z_AXIS));
-    return(true);
+  snapshotRecord record = {(uint8_t)(command - commandTable), (uint8_t)length};
+  memcpy(snapshotRecording + snapshotSize, &record, sizeof(record));
+  memcpy(snapshotRecording + snapshotSize + sizeof(record), value, length);
+  snapshotSize += sizeof(record) + length;
+  snapshotCount++;
+}
+
+// Checks every record before applying any
+static bool checkSnapshot(const uint8_t *records, uint32_t size, uint8_t count) {
+  uint32_t offset = 0;
+  for (int i = 0; i < count; i++) {
+    snapshotRecord record;
+    if (offset + sizeof(record) > size)
+      return false;
+    memcpy(&record, records + offset, sizeof(record));
+    offset += sizeof(record);
+    if (record.command >= COMMANDS || offset + record.length > size)
+      return false;
+    uint8_t type = commandTable[record.command].type;
+    if ((type == CMD_INT || type == CMD_FLOAT || type == CMD_IP) && record.length && record.length != 4)
+      return false;
+    if ((type == CMD_TEXT || type == CMD_LIST) && record.length && records[offset + record.length - 1])
+      return false;
+    if (type == CMD_NONE || (commandTable[record.command].flags & (CMD_SERIAL | CMD_DEBUG)))
+      return false;
+    offset += record.length;
   }
-  else if(!strncmp(TEXT_SOFT_IRON_MATRIX1, line, strlen(TEXT_SOFT_IRON_MATRIX1))) {
-    float vect[3];
-    index = skipToValue(line);
-    if(index) {
-      for(int i = 0; i < 3; i++) {
-        vect[i] = atof(&line[index]);
-        index = skipToNextValue(line, index);
-      }
+  return (offset == size);
+}
+
+static void applySnapshot(const uint8_t *records, uint8_t count) {
+  char line[CONFIG_SNAPSHOT_VALUE + MAX_STRING_LEN];
+  uint32_t offset = 0;
+
+  for (int i = 0; i < count; i++) {
+    snapshotRecord record;
+    memcpy(&record, records + offset, sizeof(record));
+    offset += sizeof(record);
+    const commandEntry *command = &commandTable[record.command];
+    const uint8_t *value = records + offset;
+    offset += record.length;
+
+    // The handlers may use the line as if it was read from the file : key=value, or key alone
+    commandArgs arg;
+    int keyLength = strlen(command->key);
+    memcpy(line, command->key, keyLength);
+    line[keyLength] = '\0';
+    arg.line = line;
+    arg.source = SOURCE_SERIAL;
+    arg.index = 0;
+    arg.value = &line[keyLength];
+    arg.i = 0;
+    arg.f = 0.0f;
+    if (record.length) {
+      line[keyLength] = '=';
+      line[keyLength + 1] = '\0';
+      arg.index = keyLength + 1;
+      arg.value = &line[arg.index];
     }
-    motion.setSoftIronMatrix(vect, X_AXIS);
-    if(riot.isDebug())
-      Serial.printf("%s [ %f %f %f ]\n", TEXT_SOFT_IRON_MATRIX1, vect[0], vect[1], vect[2]);
-    return(true);
-  }
-  else if(!strncmp(TEXT_SOFT_IRON_MATRIX2, line, strlen(TEXT_SOFT_IRON_MATRIX2))) {
-    float vect[3];
-    index = skipToValue(line);
-    if(index) {
-      for(int i = 0; i < 3; i++) {
-        vect[i] = atof(&line[index]);
-        index = skipToNextValue(line, index);
+    switch (record.length ? command->type : (uint8_t)CMD_NONE) {
+      case CMD_INT:
+        memcpy(&arg.i, value, sizeof(int32_t));
+        break;
+      case CMD_FLOAT:
+        memcpy(&arg.f, value, sizeof(float));
+        break;
+      case CMD_IP: {
+        uint32_t ip;
+        memcpy(&ip, value, sizeof(ip));
+        arg.ip = IPAddress(ip);
+        break;
       }
+      default:
+        memcpy(arg.value, value, record.length);
+        break;
     }
-    motion.setSoftIronMatrix(vect, Y_AXIS);
-    if(riot.isDebug())
-      Serial.printf("%s [ %f %f %f ]\n", TEXT_SOFT_IRON_MATRIX2, vect[0], vect[1], vect[2]);
-    return(true);
+    command->handler(arg);
   }
-  else if(!strncmp(TEXT_SOFT_IRON_MATRIX3, line, strlen(TEXT_SOFT_IRON_MATRIX3))) {
-    float vect[3];
-    index = skipToValue(line);
-    if(index) {
-      for(int i = 0; i < 3; i++) {
-        vect[i] = atof(&line[index]);
-        index = skipToNextValue(line, index);
-      }
+}
+
+// Applies the snapshot if it matches the config file
+static bool loadSnapshot(const FILINFO &info) {
+  Preferences prefs;
+  snapshotHeader header;
+  bool loaded = false;
+
+  if (!prefs.begin(CONFIG_SNAPSHOT_NAMESPACE, true))
+    return false;
+  size_t size = prefs.getBytesLength(CONFIG_SNAPSHOT_KEY);
+  if (size >= sizeof(header) && size <= sizeof(header) + CONFIG_SNAPSHOT_SIZE) {
+    uint8_t *buffer = new uint8_t[size];
+    prefs.getBytes(CONFIG_SNAPSHOT_KEY, buffer, size);
+    memcpy(&header, buffer, sizeof(header));
+    const uint8_t *records = buffer + sizeof(header);
+    if (header.magic == CONFIG_SNAPSHOT_MAGIC && header.version == CONFIG_SNAPSHOT_VERSION
+        && header.fileSize == (uint32_t)info.fsize && header.fileDate == info.fdate && header.fileTime == info.ftime
+        && header.size == size - sizeof(header) && header.table == commandTableHash()
+        && header.crc == esp_rom_crc32_le(0, records, header.size)
+        && checkSnapshot(records, header.size, header.count)) {
+      applySnapshot(records, header.count);
+      loaded = true;
     }
-    motion.setSoftIronMatrix(vect, Z_AXIS);
-    if(riot.isDebug())
-      Serial.printf("%s [ %f %f %f ]\n", TEXT_SOFT_IRON_MATRIX3, vect[0], vect[1], vect[2]);
-    return(true);
-  }
-  
-  else if(!strncmp(TEXT_BETA, line, strlen(TEXT_BETA))) {
-    index = skipToValue(line);
-    motion.setBeta(atof(&line[index]));
-    if(riot.isDebug())
-      Serial.printf("%s %f\n", TEXT_BETA, motion.getBeta());
-    return(true);
-  }
-  else if(!strncmp(TEXT_DEFAULTS, line, strlen(TEXT_DEFAULTS))) {
-    // Re open in write mode
-    restoreDefaults(false);
-    return(true);
+    delete[] buffer;
   }
+  prefs.end();
+  return loaded;
+}
 
-  else if(!strncmp(TEXT_FORMAT, line, strlen(TEXT_FORMAT))) {
-    format();
-    return(true);
-  }
-  else if(!strncmp(TEXT_AUTO_TEST, line, strlen(TEXT_AUTO_TEST))) {
-    autoTest();
-    return(true);
-  }
-  else if(!strncmp(TEXT_CALIBRATE, line, strlen(TEXT_CALIBRATE))) {
-    // re enable calibration timer
-    riot.setCalibrationTimer(riot.getCalibrationTimer());
-    motion.nextStep(true);  // overrides switch action
-    return(true);
-  }
-  else if(!strncmp(TEXT_AUTOCAL_MAG, line, strlen(TEXT_AUTOCAL_MAG))) {    
-    motion.runAutoCalMag();
-    return(true);
-  }
-  else if(!strncmp(TEXT_AUTOCAL_MOTION, line, strlen(TEXT_AUTOCAL_MOTION))) {    
-    motion.runAutoCalMotion();
-    return(true);
-  }
- 
-  else if(!strncmp(TEXT_VERSION, line, strlen(TEXT_VERSION))) {
-    Serial.printf("%s\n", riot.getVersion());
-    return(true);
-  }
-  else if(!strncmp(TEXT_WIFI, line, strlen(TEXT_WIFI))) {
-    riot.printCurrentNet();
-    riot.printWifiData();
-    return(true);
-  }
-  else if(!strncmp(TEXT_GO_COMMAND, line, strlen(TEXT_GO_COMMAND))) {
-    motion.nextStep(true);  // Proceed with calibration - emulates the switch press
-    return(true);
-  }
-  else if(!strncmp(TEXT_CANCEL_COMMAND, line, strlen(TEXT_CANCEL_COMMAND))) {
-    motion.cancel(true);  // Cancel calibration - emulates the switch press
-    return(true);
-  }
-  else if(!strncmp(TEXT_LOG_MOTION, line, strlen(TEXT_LOG_MOTION))) {
-    index = skipToValue(line);
-    riot.setLogMotion(atof(&line[index]));
-    return(true);
-  }
-  else if(!strncmp(TEXT_LOG_MAG, line, strlen(TEXT_LOG_MAG))) {
-    index = skipToValue(line);
-    riot.setLogMag(atof(&line[index]));
-    return(true);
+// The config file is about to change : parsed again at the next boot, which records a new snapshot
+static void removeSnapshot() {
+  Preferences prefs;
+
+  if (!prefs.begin(CONFIG_SNAPSHOT_NAMESPACE, false))
+    return;
+  if (prefs.isKey(CONFIG_SNAPSHOT_KEY))
+    prefs.remove(CONFIG_SNAPSHOT_KEY);
+  prefs.end();
+}
+
+// Records the values parsed until saveSnapshot()
+static void startSnapshot() {
+  snapshotRecording = new uint8_t[sizeof(snapshotHeader) + CONFIG_SNAPSHOT_SIZE];
+  snapshotSize = 0;
+  snapshotCount = 0;
+  snapshotOverflow = false;
+}
+
+static void saveSnapshot(const FILINFO &info) {
+  Preferences prefs;
+  snapshotHeader header;
+
+  if (snapshotOverflow || !prefs.begin(CONFIG_SNAPSHOT_NAMESPACE, false)) {
+    Serial.printf("%s Config snapshot not saved\n", TEXT_ERROR_LOG);
+    delete[] snapshotRecording;
+    snapshotRecording = NULL;
+    return;
   }
-  else if(!strncmp(TEXT_VBATT, line, strlen(TEXT_VBATT))) {
-    index = skipToValue(line);
-    Serial.printf("%s %f volts\n", TEXT_VBATT, readBatteryVoltage());
-    return(true);
+  header.magic = CONFIG_SNAPSHOT_MAGIC;
+  header.version = CONFIG_SNAPSHOT_VERSION;
+  header.count = snapshotCount;
+  header.table = commandTableHash();
+  header.fileSize = (uint32_t)info.fsize;
+  header.fileDate = info.fdate;
+  header.fileTime = info.ftime;
+  header.size = snapshotSize;
+  header.crc = esp_rom_crc32_le(0, snapshotRecording, snapshotSize);
+  // Header in front of the records : one NVS blob
+  memmove(snapshotRecording + sizeof(header), snapshotRecording, snapshotSize);
+  memcpy(snapshotRecording, &header, sizeof(header));
+  prefs.putBytes(CONFIG_SNAPSHOT_KEY, snapshotRecording, sizeof(header) + snapshotSize);
+  prefs.end();
+  delete[] snapshotRecording;
+  snapshotRecording = NULL;
+}
+
+bool dispatchCommand(char *line, uint8_t source) {
+  const commandEntry *command = findCommand(line);
+  commandArgs arg;
+
+  if (!command)
+    return false;
+  if (source != SOURCE_SERIAL && (command->flags & CMD_SERIAL))
+    return false;   // blocking / debug commands with a value (record, replay)
+  if (source == SOURCE_OSC && command->type == CMD_NONE && !(command->flags & CMD_REMOTE))
+    return false;   // serial only commands (format, defaults, perf...)
+  arg.line = line;
+  arg.source = source;
+  arg.index = skipToValue(line);
+  arg.value = &line[arg.index];
+  if (!arg.index)
+    arg.value = &line[strlen(line)];    // no value : empty string
+  switch (command->type) {
+    case CMD_INT:
+      arg.i = atoi(arg.value);
+      break;
+    case CMD_FLOAT:
+      arg.f = atof(arg.value);
+      break;
+    case CMD_IP:
+      arg.ip.fromString(arg.value);
+      break;
+    default:
+      break;
   }
-  else if(!strncmp(TEXT_VUSB, line, strlen(TEXT_VUSB))) {
-    index = skipToValue(line);
-    Serial.printf("%s %f volts\n", TEXT_VUSB, readUsbVoltage());
-    return(true);
+  if (snapshotRecording && source == SOURCE_SERIAL)
+    recordSnapshot(command, arg);
+  if (source == SOURCE_OSC && command->type != CMD_NONE) {
+    // Remote setting : fuse() holds the motion lock for a whole sample step, so the change lands between
+    // two samples. The network side settings (streams, batching...) are picked up at the next packet
+    riot.lockMotion();
+    command->handler(arg);
+    riot.unlockMotion();
+    ackToOSC(line, (command->flags & CMD_REBOOT) ? "reboot" : "ok");
   }
-  return(false);
+  else
+    command->handler(arg);
+  return true;
 }
 
+bool parseConfigCallback(char *line) {
+  if(skipLine(line))
+    return (true);
+  return dispatchCommand(line, SOURCE_SERIAL);
+}
 
 
-bool storeConfig(void) {
-  FIL file;
-  UINT write;
-  int totalWrite = 0;
-  char stringBuffer[MAX_PATH_LEN];
-  char *fileBuffer;
-  IPAddress tempIP;
 
-  int writeTime = millis();
-  
-  // Open file
-  sprintf(stringBuffer, "%s", CONFIG_FILE);
-  if (f_open(&file, stringBuffer, FA_OPEN_ALWAYS | FA_READ | FA_WRITE) != FR_OK)
-    return false;
+/////////////////////////////////////////////////////////////////////////////////
+// Config persistence : storeConfig() formats the config text in the caller (no file access) and hands it
+// to a low priority task that writes it to CONFIG_TEMP_FILE then renames it over CONFIG_FILE, so the
+// streaming / calibration state machines never wait for the flash and a power cut during the write can't
+// leave a truncated config. The text is compared (CRC) with the last one saved or parsed at boot : when
+// no value changed, nothing is written and the FAT sectors aren't erased again
+
+static char pendingConfig[CONFIG_TEXT_SIZE];    // formatted by storeConfig()
+static char writtenConfig[CONFIG_TEXT_SIZE];    // being written by the config task
+static int pendingSize = 0;
+static bool configWriting = false;
+static uint32_t configCrc = 0;                  // of the last text saved / queued, 0 = unknown
+static SemaphoreHandle_t configMutex = NULL;    // guards the 3 above and pendingConfig
+static TaskHandle_t configTaskHandle = NULL;
+
+// Bounded text buffer for the config formatting
+struct configText {
+  char *buffer;
+  int size;
+  int length;
+
+  void printf(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(buffer + length, size - length, format, args);
+    va_end(args);
+    if (n < 0 || length + n >= size)
+      length = size - 1;    // truncated
+    else
+      length += n;
+  }
+};
+
+// Config text of the current settings (also what cfgrequest would print), 0 if it doesn't fit
+int formatConfig(char *buffer, int size) {
+  configText out = {buffer, size, 0};
+  IPAddress tempIP;
 
-  if (riot.isDebug())
-    Serial.printf("%s Saving %s\n", TEXT_FILE_LOG, stringBuffer);
+  out.printf("//R-IoT Configuration - fw: %s%s", riot.getVersion(), TEXT_FILE_EOL);
+  // all general config params
+  out.printf(TEXT_FILE_SINGLE_PARAM, TEXT_DEBUG, riot.isDebug());
+  out.printf(TEXT_FILE_SINGLE_PARAM, TEXT_WIFI_MODE, riot.getOperatingMode());
+  out.printf(TEXT_FILE_SINGLE_PARAM_STRING, TEXT_SSID, riot.getSSID());
+  out.printf(TEXT_FILE_SINGLE_PARAM_STRING, TEXT_PASSWORD, riot.getPassword());
+  out.printf(TEXT_FILE_SINGLE_PARAM_STRING, TEXT_MDNS, riot.getBonjour());
 
-  fileBuffer = new char[CONFIG_MAX_LINE_LEN];
+  out.printf(TEXT_FILE_SINGLE_PARAM, TEXT_DHCP, riot.isDHCP());
 
-  f_lseek(&file, 0); // rewinds
-  f_truncate(&file);
-  
-  //////////////////////////////////////////////////////////////////////:
-  // all general config params
-  memset(fileBuffer, '\0', CONFIG_MAX_LINE_LEN);
-  sprintf(fileBuffer, "//R-IoT Configuration - fw: %s%s", riot.getVersion(), TEXT_FILE_EOL);
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM, TEXT_DEBUG, riot.isDebug());
-  strcat(fileBuffer, stringBuffer);
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM, TEXT_WIFI_MODE, riot.getOperatingMode());
-  strcat(fileBuffer, stringBuffer);
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM_STRING, TEXT_SSID, riot.getSSID());
-  strcat(fileBuffer, stringBuffer);
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM_STRING, TEXT_PASSWORD, riot.getPassword());
-  strcat(fileBuffer, stringBuffer);
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM_STRING, TEXT_MDNS, riot.getBonjour());
-  strcat(fileBuffer, stringBuffer);
-  
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM, TEXT_DHCP, riot.isDHCP());
-  strcat(fileBuffer, stringBuffer);  
-  
   tempIP = riot.getOwnIP();
-  sprintf(stringBuffer, "%s=%u.%u.%u.%u\r\n", TEXT_OWNIP, tempIP[0], tempIP[1], tempIP[2], tempIP[3]);
-  strcat(fileBuffer, stringBuffer);
+  out.printf("%s=%u.%u.%u.%u\r\n", TEXT_OWNIP, tempIP[0], tempIP[1], tempIP[2], tempIP[3]);
   tempIP = riot.getDestIP();
-  sprintf(stringBuffer, "%s=%u.%u.%u.%u\r\n", TEXT_DESTIP, tempIP[0], tempIP[1], tempIP[2], tempIP[3]);
-  strcat(fileBuffer, stringBuffer);
+  out.printf("%s=%u.%u.%u.%u\r\n", TEXT_DESTIP, tempIP[0], tempIP[1], tempIP[2], tempIP[3]);
   tempIP = riot.getGatewayIP();
-  sprintf(stringBuffer, "%s=%u.%u.%u.%u\r\n", TEXT_GATEWAY, tempIP[0], tempIP[1], tempIP[2], tempIP[3]);
-  strcat(fileBuffer, stringBuffer);
+  out.printf("%s=%u.%u.%u.%u\r\n", TEXT_GATEWAY, tempIP[0], tempIP[1], tempIP[2], tempIP[3]);
   tempIP = riot.getSubnetMask();
-  sprintf(stringBuffer, "%s=%u.%u.%u.%u\r\n", TEXT_MASK, tempIP[0], tempIP[1], tempIP[2], tempIP[3]);
-  strcat(fileBuffer, stringBuffer);
-
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM, TEXT_PORT, riot.getDestPort());
-  strcat(fileBuffer, stringBuffer);
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM, TEXT_RECEIVE_PORT, riot.getReceivePort());
-  strcat(fileBuffer, stringBuffer);
-
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM, TEXT_MASTER_ID, riot.getID());
-  strcat(fileBuffer, stringBuffer);
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM_SIGNED, TEXT_WIFI_POWER, riot.getWifiPower());
-  strcat(fileBuffer, stringBuffer); 
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM, TEXT_SAMPLE_RATE, motion.getSampleRate());
-  strcat(fileBuffer, stringBuffer);
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM, TEXT_REMOTE, riot.isOSCinput());
-  strcat(fileBuffer, stringBuffer);
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM, TEXT_FORCE_CONFIG, riot.isForcedConfig());
-  strcat(fileBuffer, stringBuffer);
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM, TEXT_CALIBRATION, riot.getCalibrationTimer());
-  strcat(fileBuffer, stringBuffer);
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM, TEXT_CHARGE_MODE, riot.getChargingMode());
-  strcat(fileBuffer, stringBuffer);
-  sprintf(stringBuffer, "%s=%u,%u,%u\r\n", TEXT_LED_COLOR, riot.getPixelColor()[RED], riot.getPixelColor()[GREEN], riot.getPixelColor()[BLUE]);
-  strcat(fileBuffer, stringBuffer);
-
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM, TEXT_CPU_SPEED, riot.getCpuSpeed());
-  strcat(fileBuffer, stringBuffer);
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM, TEXT_CPU_DOZE, riot.getCpuDoze());
-  strcat(fileBuffer, stringBuffer);
-  
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM_FLOAT, TEXT_DECLINATION, motion.getDeclination());
-  strcat(fileBuffer, stringBuffer);
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM, TEXT_ORIENTATION, motion.getOrientation());
-  strcat(fileBuffer, stringBuffer);
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM, TEXT_BNO_ORIENT, bno055.orientation);
-  strcat(fileBuffer, stringBuffer);
-
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM, TEXT_ACC_RANGE, lsm6d.getAccRange());
-  strcat(fileBuffer, stringBuffer);
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM, TEXT_GYRO_RANGE, lsm6d.getGyroRange());
-  strcat(fileBuffer, stringBuffer);
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM, TEXT_MAG_RANGE, lis3mdl.getRange());
-  strcat(fileBuffer, stringBuffer);
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM_FLOAT, TEXT_GYRO_GATE, motion.getGyroGate());
-  strcat(fileBuffer, stringBuffer);
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM, TEXT_GYRO_HPF, lsm6d.getGyroHpf());
-  strcat(fileBuffer, stringBuffer);
-    
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM, TEXT_BARO_MODE, bmp390.getSamplingMode());
-  strcat(fileBuffer, stringBuffer);
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM_FLOAT, TEXT_BARO_REF, bmp390.getRefAltitude());
-  strcat(fileBuffer, stringBuffer);
-   
-  f_write(&file, fileBuffer, strlen(fileBuffer), &write);
-  totalWrite += write;
-  f_sync(&file);
-  memset(fileBuffer, '\0', CONFIG_MAX_LINE_LEN);
-
-   // Calibration data
-  sprintf(fileBuffer, TEXT_FILE_SINGLE_PARAM_SIGNED, TEXT_ACC_OFFSETX, motion.getAccelBiasRaw(X_AXIS));
-  //strcat(fileBuffer, stringBuffer);
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM_SIGNED, TEXT_ACC_OFFSETY, motion.getAccelBiasRaw(Y_AXIS));
-  strcat(fileBuffer, stringBuffer);
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM_SIGNED, TEXT_ACC_OFFSETZ, motion.getAccelBiasRaw(Z_AXIS));
-  strcat(fileBuffer, stringBuffer);
-
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM_SIGNED, TEXT_GYRO_OFFSETX, motion.getGyroBiasRaw(X_AXIS));
-  strcat(fileBuffer, stringBuffer);
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM_SIGNED, TEXT_GYRO_OFFSETY, motion.getGyroBiasRaw(Y_AXIS));
-  strcat(fileBuffer, stringBuffer);
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM_SIGNED, TEXT_GYRO_OFFSETZ, motion.getGyroBiasRaw(Z_AXIS));
-  strcat(fileBuffer, stringBuffer);
-
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM_SIGNED, TEXT_MAG_OFFSETX, motion.getMagBiasRaw(X_AXIS));
-  strcat(fileBuffer, stringBuffer);
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM_SIGNED, TEXT_MAG_OFFSETY, motion.getMagBiasRaw(Y_AXIS));
-  strcat(fileBuffer, stringBuffer);
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM_SIGNED, TEXT_MAG_OFFSETZ, motion.getMagBiasRaw(Z_AXIS));
-  strcat(fileBuffer, stringBuffer);
-
-  f_write(&file, fileBuffer, strlen(fileBuffer), &write);
-  totalWrite += write;
-  f_sync(&file);
-  memset(fileBuffer, '\0', CONFIG_MAX_LINE_LEN);
+  out.printf("%s=%u.%u.%u.%u\r\n", TEXT_MASK, tempIP[0], tempIP[1], tempIP[2], tempIP[3]);
+
+  out.printf(TEXT_FILE_SINGLE_PARAM, TEXT_PORT, riot.getDestPort());
+  out.printf(TEXT_FILE_SINGLE_PARAM, TEXT_RECEIVE_PORT, riot.getReceivePort());
+  out.printf(TEXT_FILE_SINGLE_PARAM, TEXT_SYNC_PORT, riot.getSyncPort());
+
+  out.printf(TEXT_FILE_SINGLE_PARAM, TEXT_MASTER_ID, riot.getID());
+  out.printf(TEXT_FILE_SINGLE_PARAM_SIGNED, TEXT_WIFI_POWER, riot.getWifiPower());
+  out.printf(TEXT_FILE_SINGLE_PARAM, TEXT_FAST_CONNECT, riot.getFastConnect());
+  out.printf(TEXT_FILE_SINGLE_PARAM, TEXT_SAMPLE_RATE, motion.getSampleRate());
+  out.printf(TEXT_FILE_SINGLE_PARAM, TEXT_OUTPUT_RATE, riot.getOutputRate());
+  out.printf(TEXT_FILE_SINGLE_PARAM, TEXT_REMOTE, riot.isOSCinput());
+  out.printf(TEXT_FILE_SINGLE_PARAM, TEXT_FORCE_CONFIG, riot.isForcedConfig());
+  out.printf(TEXT_FILE_SINGLE_PARAM, TEXT_CALIBRATION, riot.getCalibrationTimer());
+  out.printf(TEXT_FILE_SINGLE_PARAM, TEXT_CHARGE_MODE, riot.getChargingMode());
+  out.printf("%s=%u,%u,%u\r\n", TEXT_LED_COLOR, riot.getPixelColor()[RED], riot.getPixelColor()[GREEN], riot.getPixelColor()[BLUE]);
+
+  out.printf(TEXT_FILE_SINGLE_PARAM, TEXT_CPU_SPEED, riot.getCpuSpeed());
+  out.printf(TEXT_FILE_SINGLE_PARAM, TEXT_CPU_DOZE, riot.getCpuDoze());
+
+  out.printf(TEXT_FILE_SINGLE_PARAM_FLOAT, TEXT_DECLINATION, motion.getDeclination());
+  out.printf(TEXT_FILE_SINGLE_PARAM, TEXT_ORIENTATION, motion.getOrientation());
+  out.printf(TEXT_FILE_SINGLE_PARAM, TEXT_BNO_ORIENT, riot.getBnoOrientation());
+
+  out.printf(TEXT_FILE_SINGLE_PARAM, TEXT_ACC_RANGE, lsm6d.getAccRange());
+  out.printf(TEXT_FILE_SINGLE_PARAM, TEXT_GYRO_RANGE, lsm6d.getGyroRange());
+  out.printf(TEXT_FILE_SINGLE_PARAM, TEXT_MAG_RANGE, lis3mdl.getRange());
+  out.printf(TEXT_FILE_SINGLE_PARAM_FLOAT, TEXT_GYRO_GATE, motion.getGyroGate());
+  out.printf(TEXT_FILE_SINGLE_PARAM, TEXT_GYRO_HPF, lsm6d.getGyroHpf());
+  out.printf(TEXT_FILE_SINGLE_PARAM, TEXT_IMU_FIFO, lsm6d.isFifo());
+  out.printf(TEXT_FILE_SINGLE_PARAM, TEXT_STREAMS, riot.getStreams());
+  out.printf(TEXT_FILE_SINGLE_PARAM, TEXT_STREAM_FORMAT, riot.getStreamFormat());
+  out.printf(TEXT_FILE_SINGLE_PARAM, TEXT_BATCH_SIZE, riot.getBatchSize());
+  out.printf(TEXT_FILE_SINGLE_PARAM, TEXT_BATCH_LATENCY, riot.getBatchLatency());
+
+  out.printf(TEXT_FILE_SINGLE_PARAM, TEXT_BARO_MODE, bmp390.getSamplingMode());
+  out.printf(TEXT_FILE_SINGLE_PARAM_FLOAT, TEXT_BARO_REF, bmp390.getRefAltitude());
+
+  // Calibration data
+  out.printf(TEXT_FILE_SINGLE_PARAM_SIGNED, TEXT_ACC_OFFSETX, motion.getAccelBiasRaw(X_AXIS));
+  out.printf(TEXT_FILE_SINGLE_PARAM_SIGNED, TEXT_ACC_OFFSETY, motion.getAccelBiasRaw(Y_AXIS));
+  out.printf(TEXT_FILE_SINGLE_PARAM_SIGNED, TEXT_ACC_OFFSETZ, motion.getAccelBiasRaw(Z_AXIS));
+
+  out.printf(TEXT_FILE_SINGLE_PARAM_SIGNED, TEXT_GYRO_OFFSETX, motion.getGyroBiasRaw(X_AXIS));
+  out.printf(TEXT_FILE_SINGLE_PARAM_SIGNED, TEXT_GYRO_OFFSETY, motion.getGyroBiasRaw(Y_AXIS));
+  out.printf(TEXT_FILE_SINGLE_PARAM_SIGNED, TEXT_GYRO_OFFSETZ, motion.getGyroBiasRaw(Z_AXIS));
+
+  out.printf(TEXT_FILE_SINGLE_PARAM_SIGNED, TEXT_MAG_OFFSETX, motion.getMagBiasRaw(X_AXIS));
+  out.printf(TEXT_FILE_SINGLE_PARAM_SIGNED, TEXT_MAG_OFFSETY, motion.getMagBiasRaw(Y_AXIS));
+  out.printf(TEXT_FILE_SINGLE_PARAM_SIGNED, TEXT_MAG_OFFSETZ, motion.getMagBiasRaw(Z_AXIS));
 
   // Soft Iron Matrix storage
   float *pf;
   pf = motion.getSoftIronMatrixRow(X_AXIS);
-  sprintf(stringBuffer, "%s=%f,%f,%f%s", TEXT_SOFT_IRON_MATRIX1, pf[0],pf[1],pf[2], TEXT_FILE_EOL);
-  strcat(fileBuffer, stringBuffer);
+  out.printf("%s=%f,%f,%f%s", TEXT_SOFT_IRON_MATRIX1, pf[0],pf[1],pf[2], TEXT_FILE_EOL);
   pf = motion.getSoftIronMatrixRow(Y_AXIS);
-  sprintf(stringBuffer, "%s=%f,%f,%f%s", TEXT_SOFT_IRON_MATRIX2, pf[0],pf[1],pf[2], TEXT_FILE_EOL);
-  strcat(fileBuffer, stringBuffer);
+  out.printf("%s=%f,%f,%f%s", TEXT_SOFT_IRON_MATRIX2, pf[0],pf[1],pf[2], TEXT_FILE_EOL);
   pf = motion.getSoftIronMatrixRow(Z_AXIS);
-  sprintf(stringBuffer, "%s=%f,%f,%f%s", TEXT_SOFT_IRON_MATRIX3, pf[0],pf[1],pf[2], TEXT_FILE_EOL);
-  strcat(fileBuffer, stringBuffer);
-  
-  sprintf(stringBuffer, TEXT_FILE_SINGLE_PARAM_FLOAT, TEXT_BETA, motion.getBeta());
-  strcat(fileBuffer, stringBuffer);
+  out.printf("%s=%f,%f,%f%s", TEXT_SOFT_IRON_MATRIX3, pf[0],pf[1],pf[2], TEXT_FILE_EOL);
 
-  eol(fileBuffer, 4);
-  
-  f_write(&file, fileBuffer, strlen(fileBuffer), &write);
-  totalWrite += write;
+  out.printf(TEXT_FILE_SINGLE_PARAM_FLOAT, TEXT_BETA, motion.getBeta());
+  out.printf(TEXT_FILE_SINGLE_PARAM, TEXT_FUSION, motion.getFusion());
+
+  for (int i = 0; i < 4; i++)
+    out.printf(TEXT_FILE_EOL);
+  if (out.length >= size - 1) {
+    Serial.printf("%s Config text larger than CONFIG_TEXT_SIZE, not saved\n", TEXT_ERROR_LOG);
+    return 0;
+  }
+  return out.length;
+}
+
+// The first line holds the fw version, not a setting (and unknown while parsing the config at boot)
+static uint32_t configTextCrc(const char *text, int size) {
+  const char *settings = (const char*)memchr(text, '\n', size);
+  if (!settings)
+    return 0;
+  settings++;
+  return esp_rom_crc32_le(0, (const uint8_t*)settings, size - (settings - text));
+}
+
+static bool writeConfig(const char *text, int size) {
+  FIL file;
+  UINT write = 0;
+  FRESULT result;
+  int writeTime = millis();
+
+  if (riot.isDebug())
+    Serial.printf("%s Saving %s\n", TEXT_FILE_LOG, CONFIG_FILE);
+  if (f_open(&file, CONFIG_TEMP_FILE, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK) {
+    Serial.printf("%s Can't create %s\n", TEXT_ERROR_LOG, CONFIG_TEMP_FILE);
+    return false;
+  }
+  result = f_write(&file, text, size, &write);
+  if (f_close(&file) != FR_OK || result != FR_OK || (int)write != size) {
+    Serial.printf("%s Writing %s failed, config not saved\n", TEXT_ERROR_LOG, CONFIG_TEMP_FILE);
+    f_unlink(CONFIG_TEMP_FILE);
+    return false;
+  }
+  // The snapshot goes first : a reset from here boots on the text file (new or recovered)
+  removeSnapshot();
+  // FatFs doesn't rename over an existing file. A reset in between is caught by recoverConfig()
+  f_unlink(CONFIG_FILE);
+  if (f_rename(CONFIG_TEMP_FILE, CONFIG_FILE) != FR_OK) {
+    Serial.printf("%s Can't rename %s\n", TEXT_ERROR_LOG, CONFIG_TEMP_FILE);
+    return false;
+  }
   writeTime = millis() - writeTime;
-  Serial.printf("%s R-IoT Config saved in %dms - Wrote %d bytes\n", TEXT_FILE_LOG, writeTime, totalWrite);
-  f_close(&file);
-  delete[] fileBuffer;
- 
-  return(true);
+  Serial.printf("%s R-IoT Config saved in %dms - Wrote %d bytes\n", TEXT_FILE_LOG, writeTime, write);
+  return true;
+}
+
+static void configTask(void *) {
+  for(;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    xSemaphoreTake(configMutex, portMAX_DELAY);
+    int size = pendingSize;
+    memcpy(writtenConfig, pendingConfig, size);
+    pendingSize = 0;
+    configWriting = (size > 0);
+    xSemaphoreGive(configMutex);
+    if (!size)
+      continue;
+    bool written = writeConfig(writtenConfig, size);
+    uint32_t crc = written ? 0 : configTextCrc(writtenConfig, size);
+    xSemaphoreTake(configMutex, portMAX_DELAY);
+    // Retried at the next save, unless other values were queued meanwhile (their CRC is the reference)
+    if (!written && configCrc == crc)
+      configCrc = 0;
+    configWriting = false;
+    xSemaphoreGive(configMutex);
+  }
+}
+
+static bool startConfigTask() {
+  if (!configMutex)
+    configMutex = xSemaphoreCreateMutex();
+  if (configMutex && !configTaskHandle)
+    xTaskCreatePinnedToCore(configTask, "config", CONFIG_TASK_STACK, NULL, CONFIG_TASK_PRIORITY, &configTaskHandle, CONFIG_TASK_CORE);
+  return (configMutex && configTaskHandle);
+}
+
+// A reset between the unlink and the rename of writeConfig() leaves only the temp file
+void recoverConfig() {
+  FILINFO info;
+  if (f_stat(CONFIG_FILE, &info) != FR_OK && f_stat(CONFIG_TEMP_FILE, &info) == FR_OK) {
+    Serial.printf("%s Recovering %s from %s\n", TEXT_FILE_LOG, CONFIG_FILE, CONFIG_TEMP_FILE);
+    f_rename(CONFIG_TEMP_FILE, CONFIG_FILE);
+  }
+}
+
+// Called once the config file is parsed : the settings on flash are the current ones
+void configLoaded() {
+  if (!startConfigTask())
+    return;
+  xSemaphoreTake(configMutex, portMAX_DELAY);
+  configCrc = configTextCrc(pendingConfig, formatConfig(pendingConfig, CONFIG_TEXT_SIZE));
+  xSemaphoreGive(configMutex);
+}
+
+// Queues the current settings to be written by the config task, skipped if nothing changed (unless forced).
+// Returns false only if the config couldn't be queued nor written
+bool storeConfig(bool force) {
+  if (!startConfigTask()) {
+    // No task : synchronous write
+    int size = formatConfig(writtenConfig, CONFIG_TEXT_SIZE);
+    return size && writeConfig(writtenConfig, size);
+  }
+  xSemaphoreTake(configMutex, portMAX_DELAY);
+  int size = formatConfig(pendingConfig, CONFIG_TEXT_SIZE);
+  if (!size) {
+    xSemaphoreGive(configMutex);
+    return false;
+  }
+  uint32_t crc = configTextCrc(pendingConfig, size);
+  if (!force && crc && crc == configCrc) {
+    pendingSize = 0;    // a write still queued with other values is cancelled too
+    xSemaphoreGive(configMutex);
+    if (riot.isDebug())
+      Serial.printf("%s Config unchanged, not saved\n", TEXT_FILE_LOG);
+    return true;
+  }
+  pendingSize = size;
+  configCrc = crc;
+  xSemaphoreGive(configMutex);
+  xTaskNotifyGive(configTaskHandle);
+  return true;
+}
+
+// Waits for a queued config write to be on flash (before a reset)
+void flushConfig(uint32_t timeout) {
+  uint32_t start = millis();
+  if (!configMutex)
+    return;
+  for (;;) {
+    xSemaphoreTake(configMutex, portMAX_DELAY);
+    bool busy = pendingSize || configWriting;
+    xSemaphoreGive(configMutex);
+    if (!busy || millis() - start >= timeout)
+      return;
+    delay(5);
+  }
 }
 
 
@@ -1068,8 +1414,9 @@ void restoreDefaults(bool save) {
   motion.init();
   lsm6d.setAccRange(ACC_8G);
   lsm6d.setGyroRange(GYRO_2000DPS);
+  lsm6d.setFifo(false);
   lis3mdl.setRange(MAG_4GAUSS);  
   riot.init();
   if(save)
-    storeConfig();
+    storeConfig(true);
 }
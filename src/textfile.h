@@ -31,9 +31,11 @@
 #define TEXT_MASK                 "mask"
 #define TEXT_PORT                 "port"
 #define TEXT_RECEIVE_PORT         "rxport"
+#define TEXT_SYNC_PORT            "syncport"  // clock sync server port on the destination host, 0 = off
 #define TEXT_MDNS                 "mdns"
 #define TEXT_MASTER_ID            "masterid"
 #define TEXT_SAMPLE_RATE          "samplerate"
+#define TEXT_OUTPUT_RATE          "odr"       // OSC output period, can be > samplerate (fusion period)
 #define TEXT_PASSWORD             "pass"
 #define TEXT_DHCP                 "dhcp"
 #define TEXT_STANDALONE           "standalone"
@@ -68,6 +70,8 @@
 #define TEXT_MAG_RANGE            "magrange"
 #define TEXT_GYRO_GATE            "gyrogate"
 #define TEXT_GYRO_HPF             "gyrohpf"
+#define TEXT_IMU_FIFO             "imufifo"   // IMU FIFO batch acquisition
+#define TEXT_FUSION               "fusion"    // orientation filter : 0 = madgwick, 1 = mahony, 2 = complementary
 #define TEXT_BARO_MODE            "baromode"
 #define TEXT_BARO_REF             "baroref"
 #define TEXT_PLI_LOW_HIGH         "plilh"
@@ -78,6 +82,16 @@
 #define TEXT_LED_COLOR            "ledcolor"
 #define TEXT_VBATT                "battery"
 #define TEXT_VUSB                 "usb"
+#define TEXT_PERF                 "perf"      // process() timing report
+#define TEXT_RECORD               "record"    // records n raw sensor frames to the flash drive
+#define TEXT_REPLAY               "replay"    // benchmarks the fusion + OSC forge on a recorded trace
+#define TEXT_JITTER               "jitter"    // sampling interval min / max / p99 in µs (cfgrequest dump only)
+#define TEXT_STREAMS              "streams"   // bitmask of the OSC messages sent (STREAM_xxx in riot.h)
+#define TEXT_STREAM_FORMAT        "streamformat"  // 0 = OSC bundle, 1 = binary frames (RiotFrame.h)
+#define TEXT_BATCH_SIZE           "batchsize"     // output samples per UDP packet
+#define TEXT_BATCH_LATENCY        "batchlatency"  // ms, max age of a batched sample before the packet is sent
+#define TEXT_FAST_CONNECT         "fastconnect"   // 0 = full scan, 1 = last AP first, 2 = + last DHCP lease
+#define TEXT_WIFI_RECONNECT       "reconnect"     // connections, last / max duration in ms, fast ones (cfgrequest + OSC)
 
 // Offsets & calibration matrix
 #define TEXT_ACC_OFFSETX    "acc_offsetx"
@@ -111,9 +125,67 @@
 
 #define CONFIG_MAX_LINE_LEN    2048
 #define CONFIG_PRELOAD_SIZE    1024     // Reads 2 sector in a row (for SD), helps with access time. Increase to 
+#define CONFIG_TEXT_SIZE       4096     // formatted config, ~1.6KB for now
+
+#define CONFIG_SNAPSHOT_SIZE      1536     // binary records of the parsed config (NVS blob)
+#define CONFIG_SNAPSHOT_VALUE     128      // longest text value recorded
+#define CONFIG_SNAPSHOT_NAMESPACE "riot"
+#define CONFIG_SNAPSHOT_KEY       "config"
+#define CONFIG_SNAPSHOT_MAGIC     0x5352   // 'R' 'S'
+#define CONFIG_SNAPSHOT_VERSION   2
+
+#define CONFIG_TASK_STACK      4096
+#define CONFIG_TASK_PRIORITY   1        // below the network task, same as the arduino loop
+#define CONFIG_TASK_CORE       0
+#define CONFIG_FLUSH_TIMEOUT   3000     // ms
 
 typedef bool (parsingCallback)(char* line);
 
+// Command dispatch table (textfile.cpp)
+enum commandSource {
+  SOURCE_SERIAL = 0,    // serial port and config file
+  SOURCE_OSC,           // string command received on the OSC input (remote=1)
+  SOURCE_HTTP           // config web page
+};
+
+enum commandType {
+  CMD_NONE = 0,         // command without value
+  CMD_INT,
+  CMD_FLOAT,
+  CMD_TEXT,             // value is a string
+  CMD_IP,
+  CMD_LIST              // comma separated values, parsed by the handler
+};
+
+#define CMD_REMOTE      0x01    // command accepted from the OSC input (all the settings are)
+#define CMD_REBOOT      0x02    // setting only used at boot (network, IDs) : needs savecfg + reset
+#define CMD_SERIAL      0x04    // serial port / config file only, whatever the type (refused from OSC & HTTP)
+#define CMD_DEBUG       0x08    // debug switch, not a setting : left out of the config snapshot
+
+struct commandArgs {
+  char *line;           // full line : key=value
+  char *value;          // value string, empty if none
+  int index;            // index of the value in line, 0 if none
+  int i;
+  float f;
+  IPAddress ip;
+  uint8_t source;
+};
+
+typedef void (commandHandler)(commandArgs &arg);
+
+struct commandEntry {
+  const char *key;
+  uint8_t type;
+  uint8_t flags;
+  commandHandler *handler;
+};
+
+const commandEntry* findCommand(const char *line);
+int getCommandCount();
+const commandEntry* getCommand(int index);
+bool dispatchCommand(char *line, uint8_t source);
+
 // List of all C parsing callbacks
 bool parseConfigCallback(char *line);
 
@@ -128,7 +200,11 @@ void purgeCRLF(char *str, int size);
 void padString(char *str, char c, int padSize);
 bool skipLine(char *line);
 void eol(char* str, uint8_t howmany = 1);
-bool storeConfig();
+int formatConfig(char *buffer, int size);
+bool storeConfig(bool force = false);
+void flushConfig(uint32_t timeout = CONFIG_FLUSH_TIMEOUT);
+void recoverConfig();
+void configLoaded();
 void configRequest();
 void restoreDefaults(bool save);
 bool processSerial(char *str) ;
@@ -14,7 +14,7 @@ void onOTAProgress(size_t current, size_t final) {
   // Log every 1 second
   if (millis() - ota_progress_millis > 1000) {
     ota_progress_millis = millis();
-    Serial.printf("OTA Progress Current: %u bytes, Final: %u bytes\n", current, final);
+    Serial.printf("OTA Progress Current: %u bytes, Final: %u bytes\n", (uint32_t)current, (uint32_t)final);
   }
 }
 
@@ -113,7 +113,6 @@ void handleNotFound(void) {
 void handleFillForm(void) {
   IPAddress tempIP;
   String json = "{";
-  int i;
 
   //Serial.printf("getparams web request\n");
   //Serial.println(String(WiFi.softAPmacAddress()));
@@ -256,6 +255,14 @@ void handleParams(void) {
         riot.setWifiPower(power);
         Serial.printf("Updated Wifi Power to %ddBm\n", power);
       }
+      else {  // Any other config key, through the dispatch table (settings only, no commands)
+        String command = ArgName + "=" + ArgValue;
+        char line[command.length() + 1];
+        command.toCharArray(line, sizeof(line));
+        const commandEntry *entry = findCommand(line);
+        if (entry && entry->type != CMD_NONE)
+          dispatchCommand(line, SOURCE_HTTP);
+      }
     } // End of Browsing Args
   }
   Answer = "Received " + String(HttpArgs) + " args\n";